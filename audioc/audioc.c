@@ -16,44 +16,76 @@
 #include <sys/time.h>
 #include <sys/soundcard.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include "common.h"
 #include "audiocArgs.h"
 #include "audioc_rtp.h"
-#include "../lib/circularBuffer.h"
+#include "audioc_bench.h"
+#include "audioc_session.h"
+#include "audioc_playout.h"
+#include "audioc_capture.h"
+#include "audioc_arena.h"
+#include "audioc_realtime.h"
+#include "audioc_profile.h"
+#include "audioc_calibrate.h"
+#include "audioc_server.h"
+#include "audioc_reflector.h"
+#include "audioc_gateway.h"
+#include "audioc_filter.h"
+#include "audioc_xdp.h"
+#include "audioc_arrival.h"
+#include "audioc_rtpdump.h"
+#include "audioc_report.h"
+#include "audioc_socket.h"
+#include "audioc_record.h"
+#include "audioc_nack.h"
+#include "audioc_fec.h"
+#include "audioc_red.h"
+#include "audioc_uring.h"
 #include "../lib/configureSndcard.h"
 //#include "../lib/rtp.h"
 
 #include <stdlib.h>
 
 typedef enum payload payload_t;
-typedef struct {
-    u32 ssrc;
-    u8 pt;
-    u32 fragmentBytes;
-    u32 bytesPerSample;
-    i32 sampleRate;
-} session_params_t;
-
 
+//Where the packets of the session go
 typedef struct {
-    i32 packetsPlayed;
-    i32 silencesPlayed;
-    i32 timeouts; //Technically count as silences
-    i32 lostPackets;
-    i32 packetsRecorded;
-    struct timeval playbackStart;
-} statistics_t;
-
-static session_params_t sessionParams = {};
-static statistics_t stats = {};
-static rtp_packet_t* packet;
-static void* circularBuffer;
+    int sockId;
+    struct sockaddr_in sendAddr;
+    uring_t* ring;          //--io=uring: sends are queued to it
+} session_socket_t;
+
+//Only what the signal handler needs is kept here, the session keeps the rest
+static audioc_session_t* session;
+static u32 bytesPerSecond;
+static u32 fragmentBytes;
+static struct timeval playbackStart;
+static capture_t capture;
+static realtime_counters_t playoutCounters; //At the start of playout
+static playout_scheduler_t playout;
+static arrival_stats_t arrival = { .rate = 8000 };
+static rtpdump_t rtpdump;
+static bool recording;
+static record_writer_t recordWriter;
+static recorder_t recorders[2]; //Audio played, datagrams received
+static uring_t ring;
+static bool ringUsed;
+
+//SIGINT only asks the loops to stop: shutting the recording down takes locks and joins
+//its writer thread, which cannot be done from the handler
+static volatile sig_atomic_t stopRequested = 0;
 
 static void signalHandler(int sigNum)
 {
-	(void) sigNum;
+    (void) sigNum;
+    stopRequested = 1;
+}
 
+//Figures of the session, once the loops stopped
+static void printSummary(void)
+{
     struct timeval stopTime;
     if(gettimeofday(&stopTime, NULL) != 0) {
         panic("Could not get current time from gettimeofday()!");
@@ -61,20 +93,51 @@ static void signalHandler(int sigNum)
 
     printf("Interrupted audioc\n");
 
+    audioc_stats_t stats = {};
+    if (session) {
+        audiocSessionStats(session, &stats);
+    }
     printf("Played packets: %d\n", stats.packetsPlayed);
     printf("Silent packets: %d\n", stats.lostPackets + stats.silencesPlayed + stats.timeouts);
     printf("\tDue to detected silence (~): %d\n", stats.silencesPlayed);
     printf("\tDue to packet loss (x): %d\n", stats.lostPackets);
+    printf("\t\tIn the network: %d, dropped by our socket: %d (of %d datagrams it dropped)\n",
+        stats.lostPackets - stats.localLost, stats.localLost, stats.socketDrops);
     printf("\tDue to timeouts (t): %d\n", stats.timeouts);
+    printf("Lost packets recovered by FEC (f): %d\n", stats.fecRecovered);
+    printf("Lost packets recovered from redundancy (r): %d\n", stats.redRecovered);
+    printf("Lost packets recovered from late copies (n): %d\n", stats.lateRecovered);
+    printf("NACKs sent: %d, packets retransmitted: %d\n", stats.nacksSent, stats.retransmissions);
+    printf("Payload changes by the peer: %d, by --adapt: %d\n", stats.payloadChanges, stats.sendPayloadChanges);
+    printf("Receiver reports sent: %d, received: %d\n", stats.reportsSent, stats.peerReports);
+    printf("Dropped: %d malformed datagrams, %d packets that cannot be played, %d blocks (jitter buffer full)\n",
+        stats.malformed, stats.unplayable, stats.bufferDrops);
+    if (stats.peerReports > 0) {
+        printf("\tThe peer lost %d of our packets in the network, %d in its socket\n",
+            stats.peerNetworkLost, stats.peerLocalLost);
+    }
+    arrivalPrint(&arrival);
+    if (ringUsed) {
+        uringPrint(&ring);
+    }
+    if (rtpdump.file) {
+        printf("Packets recorded to the rtpdump file: %lu\n", rtpdump.packets);
+        rtpdumpClose(&rtpdump);
+    }
+    if (recording) {
+        recorderClose(&recorders[0]);
+        recorderClose(&recorders[1]);
+        recordWriterStop(&recordWriter);
+        recordPrint(&recordWriter, recorders, ARRAY_COUNT(recorders));
+    }
 
     if (stats.packetsPlayed > 0) {
         //in us
-        i64 start = stats.playbackStart.tv_usec + stats.playbackStart.tv_sec * 1000000;
+        i64 start = playbackStart.tv_usec + playbackStart.tv_sec * 1000000;
         i64 end = stopTime.tv_usec + stopTime.tv_sec * 1000000;
 
         i64 diff = end - start;
-        double theoreticalPlayback = stats.packetsPlayed * sessionParams.fragmentBytes / 
-            (double)(sessionParams.bytesPerSample * sessionParams.sampleRate);
+        double theoreticalPlayback = stats.packetsPlayed * (double)fragmentBytes / bytesPerSecond;
         
         printf("Total playback time (theoretical): %f seconds.\n", theoreticalPlayback);
         printf("Total playback time (wall clock): %f seconds.\n", (double)diff / 1e6);
@@ -82,92 +145,311 @@ static void signalHandler(int sigNum)
         printf("No audio was played.\n");
     }
     
-    printf("Recorded (and sent) packets: %d\n", stats.packetsRecorded);
+    printf("Sent packets: %d\n", stats.packetsRecorded);
+    realtimePrintCounters(&playoutCounters);
+    if (arenaOverflows() > 0) {
+        printf("WARNING: %lu allocations did not fit in the preallocated memory.\n", arenaOverflows());
+    }
+    printf("Partial sound card reads: %lu, captured bytes dropped by the card: %lu\n", capture.partialReads, capture.droppedBytes);
+    printf("Sound card queried %lu times in %lu wakeups, %lu writes, playout margin %ld us\n", playout.queries,
+        playout.wakeups, playout.writes, playout.marginUs);
+}
 
-    //Free buffers
-    free(packet);
-    cbuf_destroy_buffer(circularBuffer);
+//Send callback of the session
+static bool sendToGroup(void* context, const void* packet, usize size)
+{
+    session_socket_t* socket = context;
+    if (socket->ring) {
+        return uringSend(socket->ring, packet, size, &socket->sendAddr);
+    }
+    return sendto(socket->sockId, packet, size, 0, (struct sockaddr *)&socket->sendAddr, sizeof(struct sockaddr_in)) >= 0;
+}
 
-    exit(0);
+//Event callback of the session: what -v prints
+static void sessionEvent(void* context, audioc_event_t event, u32 value)
+{
+    (void) context;
+    if (event == AUDIOC_EVENT_PEER_PAYLOAD) {
+        trace("The peer switched to %s", payloadToStr(value));
+    } else if (event == AUDIOC_EVENT_SEND_PAYLOAD) {
+        trace("The packets NACKed by the peer changed, sending %s", payloadToStr(value));
+    } else {
+        verboseInfo("%c", event);
+    }
 }
 
-static void readAudioFragment(int sndCardFD, rtp_packet_t* packet, session_params_t sessionParams)
+static void checkStatus(audioc_status_t status)
 {
-    u8* fragmentBuffer = (u8*)packet->payload;
-    usize fragmentSize = sessionParams.fragmentBytes;
+    if (status == AUDIOC_SEND_FAILED) {
+        panic("sendto error");
+    }
+    //AUDIOC_DROPPED, AUDIOC_WRONG_PAYLOAD: counted by the session, which goes on with the next packet
+}
 
-    isize readBytes;
-    usize packetSize = sessionParams.fragmentBytes + sizeof(rtp_hdr_t);
-    if ((readBytes = read(sndCardFD, fragmentBuffer, fragmentSize)) < 0)
-    {
-        panic("Error reading %lu bytes (%lu samples) from sound card file", fragmentSize, packetSize);
-    } else if ((usize)readBytes != fragmentSize)
-    {
-        panic("Incomplete read of %lu bytes (actually read %lu bytes) from sound card file", fragmentSize, readBytes);
+//Reads what the sound card has and, once a whole fragment is captured, hands it to the session
+static void captureAudio(void)
+{
+    if (captureRead(&capture)) {
+        checkStatus(audiocSessionCapture(session, capture.block, capture.position));
     }
 }
 
-static void sendAudioPacket(rtp_packet_t* packet, int sockId, struct sockaddr_in* sendAddr, session_params_t sessionParams, u16 seq, u32 ts)
+//A datagram received, with select() or the ring
+static void handleDatagram(rtp_packet_t* packet, isize result, const struct sockaddr_in* remoteSAddr,
+    const arrival_t* stamp)
 {
-    packet->header = (rtp_hdr_t) {
-        .version = RTP_VERSION,
-        .pt = sessionParams.pt,
-        .ssrc = sessionParams.ssrc,
-        .seq = seq, 
-        .ts = ts, 
-    };
+    //Before the session turns the header to host order
+    bool rtcp = isRtcpPacket(packet, result);
+    rtpdumpWrite(&rtpdump, packet, result, rtcp, stamp->ns);
+    recorderPacket(&recorders[1], packet, result, stamp->ns);
+    if (!rtcp && result >= (isize)sizeof(rtp_hdr_t)) {
+        rtp_hdr_t header = packet->header;
+        ntohRTP(&header);
+        if (header.version == RTP_VERSION && (header.pt == PCMU || header.pt == L16_1 || header.pt == RED_PAYLOAD_TYPE)) {
+            arrivalUpdate(&arrival, &header, stamp);
+        }
+    }
 
-    htonRTP(&packet->header);
+    audiocSessionSocketDrops(session, stamp->queueDrops);
+    bool wasEmpty = audiocSessionBuffering(session) && audiocSessionBufferedBlocks(session) == 0;
+    audioc_status_t status = audiocSessionReceive(session, packet, result);
+    checkStatus(status);
+    if (wasEmpty && status == AUDIOC_OK && audiocSessionBufferedBlocks(session) > 0) {
+        char ipBuf[64];
+        const char* ip = inet_ntop(AF_INET, &remoteSAddr->sin_addr, ipBuf, sizeof(ipBuf));
+        trace("Started receiving from %s.\n", ip);
+    }
+}
 
-    isize result;
-    usize packetSize = sessionParams.fragmentBytes + sizeof(rtp_hdr_t);
-    /* Using sendto to send information. Since I've bind the socket, the local (source) port of the packet is fixed. In the rem structure I set the remote (destination) address and port */ 
-    if ( (result = sendto(sockId, packet, packetSize, /* flags */ 0, (struct sockaddr *)sendAddr, sizeof(struct sockaddr_in)) )<0) {
-        panic("sendto error");
-    } else {
-        verboseInfo(".");
+static void receivePacket(int sockId, rtp_packet_t* packet)
+{
+    struct sockaddr_in remoteSAddr = {0}; 
+    
+    arrival_t stamp;
+    isize result = arrivalReceive(sockId, packet, MAX_DATAGRAM_SIZE, &remoteSAddr, &stamp);
+    if (result < 0) {
+        panic("recvfrom error");
     }
+    handleDatagram(packet, result, &remoteSAddr, &stamp);
 }
 
-static bool validateRTPHeader(rtp_hdr_t* header, session_params_t sessionParams)
+//uring_handler_t: the datagram stays in the ring's buffer, the session copies its payload
+static void receiveDatagram(void* context, void* datagram, usize size, const struct sockaddr_in* from,
+    const arrival_t* arrival)
 {
-    if (header->version != RTP_VERSION) {
-        return false;
+    (void) context;
+    handleDatagram(datagram, size, from, arrival);
+}
+
+//Waits for the sound card (to be written only if wantCardWrite), the socket or timeoutUs
+//(-1: none), with the ring when there is one, else with select(). Returns false if
+//interrupted
+static bool waitForEvents(int sndCardFD, int sockId, bool wantCardWrite, i64 timeoutUs, uring_events_t* events)
+{
+    if (ringUsed) {
+        if (!uringWait(&ring, wantCardWrite, timeoutUs, events)) {
+            fprintf(stderr, "io_uring_enter has been interrupted.\n");
+            return false;
+        }
+        return true;
+    }
+
+    fd_set readSet, writeSet;
+    FD_ZERO(&readSet);
+    FD_SET(sndCardFD, &readSet); //Microphone read
+    FD_SET(sockId, &readSet); //Network read
+
+    // Network writes don't block for a long time
+    FD_ZERO(&writeSet);
+    if (wantCardWrite) {
+        FD_SET(sndCardFD, &writeSet); //Microphone write
     }
 
-    if (header->pt != sessionParams.pt) {
-        fprintf(stderr, "Payload type mismatch between nodes (%s, expected %s). Closing. \n", payloadToStr(header->pt), payloadToStr(sessionParams.pt));
-        return false;
+    struct timeval timeout = {
+        .tv_sec = timeoutUs / 1000000,
+        .tv_usec = timeoutUs % 1000000,
+    };
+    *events = (uring_events_t) {};
+    int res = select(FD_SETSIZE, &readSet, &writeSet, NULL, timeoutUs >= 0 ? &timeout : NULL);
+    if (res < 0) {
+        int error = errno;
+        switch (error)
+        {
+        case EINTR:
+            fprintf(stderr, "select has been interrupted.\n");
+            return false;
+        default:
+            panic("select() error!");
+            break;
+        }
     }
+    events->cardReadable = FD_ISSET(sndCardFD, &readSet);
+    events->cardWritable = FD_ISSET(sndCardFD, &writeSet);
+    events->socketReadable = FD_ISSET(sockId, &readSet);
+    events->timedOut = res == 0;
     return true;
 }
 
-static bool pushSilence(void* cbuf, usize fragmentSize, isize *outCbufCount, payload_t payload)
+//Writes to the sound card, with a single writev(), as many buffered blocks as fit: no more
+//than the room SNDCTL_DSP_GETOSPACE reports nor than what keeps the card at most
+//cardTargetBytes ahead
+static void playBufferedBlocks(int sndCardFD, usize cardTargetBytes)
+{
+    u64 cardDelay = playoutCardDelay(&playout, playoutNowUs());
+    usize roomBytes = cardTargetBytes > cardDelay ? cardTargetBytes - cardDelay : 0;
+
+    audio_buf_info space;
+    playout.queries++;
+    if (ioctl(sndCardFD, SNDCTL_DSP_GETOSPACE, &space) == 0) {
+        roomBytes = MIN(roomBytes, (usize)MAX(space.bytes, 0));
+    }
+    //The wait said there is room for at least one fragment
+    usize maxBlocks = MAX(1, roomBytes / fragmentBytes);
+
+    //The blocks may wrap around the end of the circular buffer
+    struct iovec iov[2];
+    int iovCount = audiocSessionPlayout(session, maxBlocks, iov);
+    if (iovCount == 0) {
+        trace("Circular buffer is overrun!");
+        return;
+    }
+
+    isize n = writev(sndCardFD, iov, iovCount);
+    if (n < 0) {
+        if (errno != EAGAIN) {
+            printError("Error playing %lu bytes at sound card.", iov[0].iov_len + (iovCount > 1 ? iov[1].iov_len : 0));
+        }
+        return;
+    }
+    playoutWritten(&playout, n);
+    usize recorded = 0;
+    for (int i = 0; i < iovCount && recorded < (usize)n; i++) {
+        usize played = MIN((usize)n - recorded, iov[i].iov_len);
+        recorderAudio(&recorders[0], iov[i].iov_base, played);
+        recorded += played;
+    }
+
+    audioc_stats_t stats;
+    audiocSessionStats(session, &stats);
+    if (audiocSessionPlayed(session, n) > 0 && stats.packetsPlayed == 0) {
+        if(gettimeofday(&playbackStart, NULL) != 0) {
+            panic("Could not get current time from gettimeofday()!");
+        }
+    }
+}
+
+static int openSessionSocket(struct in_addr multicastIp, u16 port, struct sockaddr_in* outSendAddr)
+{
+    struct sockaddr_in sendAddr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr = multicastIp,
+    };
+
+    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockId < 0) {
+        panic("socket error");
+    }
+
+    int enable = 1;
+    if (setsockopt(sockId, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
+        panic("setsockopt(SO_REUSEADDR) failed!\n");
+    }
+
+    if (bind(sockId, (struct sockaddr *)&sendAddr, sizeof(struct sockaddr_in)) < 0) {
+        panic("Socket bind error!\n");
+    }
+
+    //Join multicast group
+    struct ip_mreq mcRequest = {0}; 
+    mcRequest.imr_multiaddr = multicastIp;
+    mcRequest.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(sockId, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mcRequest, sizeof(struct ip_mreq)) < 0) {
+        panic("Failed to join multicast group, setsockopt error");
+    }
+
+    //Disable loopback
+    u8 loopback = 0;
+    if (setsockopt(sockId, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(u8)) < 0) {
+        panic("Failed to disable MC loopback, setsockopt error");
+    }
+
+    *outSendAddr = sendAddr;
+    return sockId;
+}
+
+//--filter: what a session may receive. It follows a change of payload, so both are played
+static bool sessionFilter(const audioc_ext_args_t* ext, filter_params_t* params)
+{
+    *params = (filter_params_t) {
+        .pts = { PCMU, L16_1, RED_PAYLOAD_TYPE, FEC_PAYLOAD_TYPE },
+        .ptCount = 4,
+        .ssrcCount = ext->filterSsrcCount,
+        .rtcp = true,
+    };
+    memcpy(params->ssrcs, ext->filterSsrcs, ext->filterSsrcCount * sizeof(u32));
+    return ext->filter;
+}
+
+//--record, --record-rtp
+static bool sessionRecording(const audioc_ext_args_t* ext, record_params_t* params)
+{
+    *params = (record_params_t) {
+        .audioDirectory = ext->recordDirectory[0] != '\0' ? ext->recordDirectory : NULL,
+        .audioSeconds = ext->recordSeconds,
+        .rtpDirectory = ext->recordRtpDirectory[0] != '\0' ? ext->recordRtpDirectory : NULL,
+        .rtpSeconds = ext->recordRtpSeconds,
+    };
+    return params->audioDirectory || params->rtpDirectory;
+}
+
+//Not fatal: without it the same datagrams are dropped, in user space
+static void attachFilter(int sockId, const filter_params_t* params)
+{
+    usize instructions = filterAttach(sockId, params);
+    if (instructions == 0) {
+        printError("Could not attach the packet filter, receiving every datagram");
+        return;
+    }
+    trace("Packet filter attached: %zu instructions, %u payload types, %u SSRCs", instructions, params->ptCount,
+        params->ssrcCount);
+}
+
+//Self-check: every step reports whether it worked, a failure is not fatal
+static void setupRealtime(const audioc_ext_args_t* ext)
 {
-    u8* bufferBlock = (u8*)cbuf_pointer_to_write(cbuf);
-    if (bufferBlock) {
-        usize blockSize;
-        u8* silenceArray;
-        if (payload == PCMU) {
-            blockSize = ARRAY_COUNT(silenceMU8);
-            silenceArray = silenceMU8;
+    if (arenaInit(ARENA_DEFAULT_BYTES)) {
+        printf("Realtime: %d KiB of session memory preallocated.\n", ARENA_DEFAULT_BYTES / 1024);
+    } else {
+        fprintf(stderr, "WARNING: could not preallocate session memory, using malloc().\n");
+    }
+
+    if (realtimeLockMemory()) {
+        printf("Realtime: memory locked.\n");
+    } else {
+        fprintf(stderr, "WARNING: mlockall() failed (%s), memory may be paged out.\n", strerror(errno));
+    }
+
+    if (ext->realtimePriority > 0) {
+        if (realtimeSetPriority(ext->realtimePriority)) {
+            printf("Realtime: SCHED_FIFO priority %u.\n", ext->realtimePriority);
         } else {
-            blockSize = ARRAY_COUNT(silenceL16BE);
-            silenceArray = silenceL16BE;
+            fprintf(stderr, "WARNING: could not set SCHED_FIFO priority %u (%s).\n", ext->realtimePriority, strerror(errno));
         }
-        usize fullCopies = fragmentSize / blockSize;
-        usize partialCopy = fragmentSize % blockSize;
-        for (usize i = 0; i < fullCopies; i++)
-        {
-            memcpy(bufferBlock, silenceArray, blockSize);
-            bufferBlock += blockSize;
+    }
+
+    if (ext->realtimeCpu >= 0) {
+        if (realtimePinCpu(ext->realtimeCpu)) {
+            printf("Realtime: running on CPU %d.\n", ext->realtimeCpu);
+        } else {
+            fprintf(stderr, "WARNING: could not pin to CPU %d (%s).\n", ext->realtimeCpu, strerror(errno));
         }
-        memcpy(bufferBlock, silenceArray, partialCopy);
-        //memset(bufferBlock, 0, fragmentSize);
-        *outCbufCount = (*outCbufCount) + 1;
-        return true;
     }
-    return false;
+
+    realtime_counters_t counters;
+    realtimeCounters(&counters);
+    printf("Realtime: %ld page faults and %ld context switches so far.\n", counters.minorFaults + counters.majorFaults,
+        counters.voluntarySwitches + counters.involuntarySwitches);
 }
 
 int main(int argc, char** argv)
@@ -183,9 +465,10 @@ int main(int argc, char** argv)
     u32 bufferingTime; //in ms
     bool verbose;
     u8 payload;
+    audioc_ext_args_t ext;
     
     if (args_capture_audioc(argc, argv, &multicastIp, &ssrc,
-            &port, &vol, &packetDuration, &verbose, &payload, &bufferingTime) == EXIT_FAILURE)
+            &port, &vol, &packetDuration, &verbose, &payload, &bufferingTime, &ext) == EXIT_FAILURE)
     { 
         exit(1);  /* there was an error parsing the arguments, error info
                    is printed by the args_capture function */
@@ -197,6 +480,75 @@ int main(int argc, char** argv)
 
     if (verbose) {
         args_print_audioc(multicastIp, ssrc, port, packetDuration, payload, bufferingTime, vol, verbose);
+        args_print_audioc_ext(&ext);
+    }
+
+    filter_params_t filter;
+    bool filtered = sessionFilter(&ext, &filter);
+    record_params_t record;
+    recording = sessionRecording(&ext, &record);
+
+    if (ext.bench) {
+        //Receive path only: no sound card, no packets sent
+        struct sockaddr_in sendAddr;
+        int sockId = openSessionSocket(multicastIp, port, &sendAddr);
+        if (filtered) {
+            attachFilter(sockId, &filter);
+        }
+        arrivalEnable(sockId);
+        //The socket stays: it is the fallback, and it gets what is not for the XDP queue
+        xdp_socket_t xdp;
+        bool xdpReady = ext.xdpInterface[0] != '\0' && xdpOpen(&xdp, ext.xdpInterface, ext.xdpQueue, port);
+        if (ext.xdpInterface[0] != '\0' && !xdpReady) {
+            fprintf(stderr, "WARNING: AF_XDP not available, receiving with the socket only.\n");
+        }
+        int result = runReceiveBenchmark(sockId, xdpReady ? &xdp : NULL, ext.ioUring, 1000);
+        if (xdpReady) {
+            xdpClose(&xdp);
+        }
+        return result;
+    }
+
+    if (ext.reflectPort > 0) {
+        //Receives the group once, as a session would, and sends nothing to it
+        struct sockaddr_in sendAddr;
+        int sockId = openSessionSocket(multicastIp, port, &sendAddr);
+        return runReflector(sockId, ext.reflectPort);
+    }
+
+    if (ext.gatewayIp.s_addr != 0) {
+        //Side 0 is our group with -y, side 1 the other one with the other payload
+        u8 otherPayload = payload == L16_1 ? PCMU : L16_1;
+        gateway_side_t sides[2] = {
+            { .pt = payload, .rate = payload == L16_1 ? ext.gatewayRate : 8000 },
+            { .pt = otherPayload, .rate = otherPayload == L16_1 ? ext.gatewayRate : 8000 },
+        };
+        sides[0].sockId = openSessionSocket(multicastIp, port, &sides[0].sendAddr);
+        sides[1].sockId = openSessionSocket(ext.gatewayIp, ext.gatewayPort > 0 ? ext.gatewayPort : port, &sides[1].sendAddr);
+        if (filtered) {
+            //Only what is translated: RTCP is not
+            filter.ptCount = 1;
+            filter.rtcp = false;
+            for (u32 side = 0; side < 2; side++) {
+                filter.pts[0] = sides[side].pt;
+                attachFilter(sides[side].sockId, &filter);
+            }
+        }
+        return runGateway(sides[0], sides[1]);
+    }
+
+    if (ext.calibrate) {
+        return runCalibration(payload, ext.profilePath);
+    }
+
+    if (ext.realtime) {
+        //Before the session allocates anything
+        setupRealtime(&ext);
+    }
+
+    if (ext.serverSessions > 0) {
+        return runServer(multicastIp, port, ssrc, payload, packetDuration, bufferingTime, ext.serverSessions,
+            ext.serverThreads, filtered ? &filter : NULL, recording ? &record : NULL);
     }
 
     /*
@@ -241,7 +593,9 @@ int main(int argc, char** argv)
 
     trace("BPSample: %d bytes, rate=%d Hz", bytesPerSample, rate);
     // In bytes
-    int requestedFragmentSize = packetDuration * rate * channelNumber * bytesPerSample / 1000;
+    //Without --fragment, packets last as long as the fragment the card gives us for -l
+    u32 fragmentDuration = ext.fragmentDuration > 0 ? ext.fragmentDuration : packetDuration;
+    int requestedFragmentSize = fragmentDuration * rate * channelNumber * bytesPerSample / 1000;
     
     trace("Requested fragment size: %d bytes.", requestedFragmentSize);
     
@@ -250,429 +604,213 @@ int main(int argc, char** argv)
     configSndcard(&sndCardFD, &sndCardFmt, &channelNumber, &rate, &requestedFragmentSize, true);
     vol = configVol(channelNumber, sndCardFD, vol);
 
-    float fragmentDuration = requestedFragmentSize * 1000 / (rate * channelNumber * bytesPerSample); //in ms
-    trace("Obtained fragment size: %d. Obtained sound fragment duration: %.3f.", requestedFragmentSize, fragmentDuration);
+    //A missing profile is not an error, fixed values are used instead
+    sndcard_profile_t profile;
+    profileLoad(ext.profilePath, &profile);
+    const sndcard_calibration_t* calibration = profileFind(&profile, sndCardFmt, requestedFragmentSize);
+    if (calibration) {
+        trace("Using calibration from %s: output latency %u us, wakeup jitter %u us", ext.profilePath,
+            calibration->outputLatencyUs, calibration->wakeupJitterUs);
+    }
 
-    sessionParams = (session_params_t) {
-        .ssrc = ssrc,
-        .pt = payload,
-        .fragmentBytes = requestedFragmentSize, 
-        .bytesPerSample = bytesPerSample,
-        .sampleRate = rate,
-    };    
+    float obtainedFragmentDuration = requestedFragmentSize * 1000 / (rate * channelNumber * bytesPerSample); //in ms
+    trace("Obtained fragment size: %d. Obtained sound fragment duration: %.3f.", requestedFragmentSize, obtainedFragmentDuration);
+
+    u32 packetBytes = requestedFragmentSize;
+    if (ext.fragmentDuration > 0) {
+        packetBytes = packetDuration * rate * channelNumber * bytesPerSample / 1000;
+        trace("Packet size: %u bytes (%u ms).", packetBytes, packetDuration);
+    }
+    if (packetBytes == 0) {
+        panic("Packet duration too short");
+    }
 
     /*
     *   Circular buffer
     */
 
-    int bufferingBytes = bufferingTime * rate * channelNumber * bytesPerSample / 1000;
+    bytesPerSecond = rate * channelNumber * bytesPerSample;
+    fragmentBytes = requestedFragmentSize;
+    int bufferingBytes = bufferingTime * bytesPerSecond / 1000;
     //The behavior of audiocTest is to round down the buffering blocks count, so we do it here too
     int bufferingBlocks = (int)floor((float)bufferingBytes / (float)requestedFragmentSize);
     
     trace("Bytes for buffering: %d", bufferingBytes);
 
-    // +200ms for safety
-    int bufferByteCapacity = bufferingBytes + (200 * rate * channelNumber * bytesPerSample / 1000);
+    //Room for what the card may take late, measured by --calibrate, or 200ms for safety
+    u32 safetyMs = calibration ? profileCapacityMs(calibration, bytesPerSecond) : PROFILE_DEFAULT_CAPACITY_MS;
+    int bufferByteCapacity = bufferingBytes + (safetyMs * bytesPerSecond / 1000);
     int bufferBlockCapacity = bufferByteCapacity / requestedFragmentSize;
 
     trace("Num. blocks in cbuf: %d, buffer block threshold: %d\n", bufferBlockCapacity, bufferingBlocks);
-    
-    circularBuffer = cbuf_create_buffer(bufferBlockCapacity, requestedFragmentSize);
 
     /*
     *   Multicast socket configuration
     */
-    struct sockaddr_in sendAddr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(port),
-        .sin_addr = multicastIp,
-    };
-
-    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockId < 0) {
-        panic("socket error");
+    session_socket_t sessionSocket = {0};
+    int sockId = openSessionSocket(multicastIp, port, &sessionSocket.sendAddr);
+    sessionSocket.sockId = sockId;
+    if (filtered) {
+        attachFilter(sockId, &filter);
     }
-
-    int enable = 1;
-    if (setsockopt(sockId, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
-        panic("setsockopt(SO_REUSEADDR) failed!\n");
+    socketSizeBuffers(sockId, bufferingTime, packetDuration, packetBytes * (1 + ext.redDepth) + sizeof(rtp_hdr_t));
+    arrival_source_t arrivalSource = arrivalEnable(sockId);
+    trace("Arrival times from %s", arrivalSource == ARRIVAL_HARDWARE ? "the NIC (if enabled) or the kernel"
+        : arrivalSource == ARRIVAL_SOFTWARE ? "the kernel" : "recvmsg()");
+    if (ext.rtpdumpPath) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (!rtpdumpOpen(&rtpdump, ext.rtpdumpPath, multicastIp, port, (i64)now.tv_sec * 1000000000 + now.tv_nsec)) {
+            panic("Could not create the rtpdump file %s", ext.rtpdumpPath);
+        }
     }
-
-    if (bind(sockId, (struct sockaddr *)&sendAddr, sizeof(struct sockaddr_in)) < 0) {
-        panic("Socket bind error!\n");
+    if (recording && (!recordWriterStart(&recordWriter, ARRAY_COUNT(recorders))
+        || !recordOpenSession(&record, &recordWriter, port, payload == L16_1 ? RECORD_L16 : RECORD_ULAW,
+            &recorders[0], &recorders[1]))) {
+        panic("Could not set up the recording");
     }
 
-    //Join multicast group
-    struct ip_mreq mcRequest = {0}; 
-    mcRequest.imr_multiaddr = multicastIp;
-    mcRequest.imr_interface.s_addr = htonl(INADDR_ANY);
-    if (setsockopt(sockId, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mcRequest, sizeof(struct ip_mreq)) < 0) {
-        panic("Failed to join multicast group, setsockopt error");
+    trace("Samples per packet: %d, per playout block: %d\n", packetBytes / bytesPerSample, requestedFragmentSize / bytesPerSample);
+    if (ext.nack && bufferingTime < 3 * packetDuration) {
+        fprintf(stderr, "WARNING: with -k%u retransmissions will rarely arrive before their playout time.\n", bufferingTime);
     }
 
-    //Disable loopback
-    u8 loopback = 0;
-    if (setsockopt(sockId, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(u8)) < 0) {
-        panic("Failed to disable MC loopback, setsockopt error");
+    audioc_session_config_t sessionConfig = {
+        .ssrc = ssrc,
+        .pt = payload,
+        .fragmentBytes = requestedFragmentSize,
+        .packetBytes = packetBytes,
+        .bytesPerSample = bytesPerSample,
+        .bufferingBlocks = bufferingBlocks,
+        .capacityBlocks = MAX(bufferBlockCapacity, MAX(bufferingBlocks, 1)),
+        .fecGroup = ext.fecGroup,
+        .redDepth = ext.redDepth,
+        .redPcmu = ext.redPcmu,
+        .nack = ext.nack,
+        .adaptPayload = ext.adapt,
+        .firstSeq = 0, //TODO: make it random
+        .fecFirstSeq = (u16)rand(),
+        .firstTs = 0, //TODO: make it random
+        .send = sendToGroup,
+        .sendContext = &sessionSocket,
+        .event = sessionEvent,
+        .allocator = &arenaAllocator,
+    };
+    session = audiocSessionCreate(&sessionConfig);
+    //Received packets may be of any size, not just the one we send
+    rtp_packet_t* packet = (rtp_packet_t*) arenaAlloc(MAX_DATAGRAM_SIZE);
+    if (!session || !packet) {
+        panic("Could not set up the session for %u byte packets", packetBytes);
+    }
+    //From here on the sound card is non-blocking, for reads and writes
+    if (!captureInit(&capture, sndCardFD, requestedFragmentSize)) {
+        panic("Could not set up sound card capture");
     }
 
-    usize expectedPacketSize = sessionParams.fragmentBytes + sizeof(rtp_hdr_t);
-    const usize samplesPerPacket = sessionParams.fragmentBytes / sessionParams.bytesPerSample;
-    trace("Samples per packet: %d\n", samplesPerPacket);
-    packet = (rtp_packet_t*) malloc(expectedPacketSize);
-    struct timeval timeout;
-    fd_set readSet, writeSet;
-
-    //RTP State variables
-    bool startedReceiving = false;
-    u16 inputSequenceNum = 0;
-    u32 inputTimeStamp = 0;
+    if (ext.ioUring) {
+        //One receive buffer per block of the jitter buffer. The peer may send L16 where we
+        //send PCMU, with redundancy (FEC adds less): larger datagrams are dropped, and counted
+        u32 datagramBytes = sizeof(rtp_hdr_t) + RED_MAX_PAYLOAD(2 * packetBytes);
+        ringUsed = uringOpen(&ring, sockId, sndCardFD, datagramBytes, sessionConfig.capacityBlocks, receiveDatagram,
+            NULL);
+        if (!ringUsed) {
+            fprintf(stderr, "WARNING: io_uring not available, using select().\n");
+        }
+        sessionSocket.ring = ringUsed ? &ring : NULL;
+    }
 
-    u16 outputSequenceNum = 0; //TODO: make it random
-    u32 outputTimeStamp = 0; //TODO: make it random
+    uring_events_t events;
 
     //1st phase
 
     //TODO: Measure time
-    isize cbufAccumulated = 0; //in blocks
-    while (cbufAccumulated < bufferingBlocks)
+    while (audiocSessionBuffering(session) && !stopRequested)
     {
-        memset(packet, 0, expectedPacketSize);
-
-        timeout.tv_sec = 10;
-        timeout.tv_usec = 0;
-
-        FD_ZERO(&readSet);
-        FD_SET(sndCardFD, &readSet); //Microphone read
-        FD_SET(sockId, &readSet); //Network read
-        
-        // Network writes don't block for a long time
-        FD_ZERO(&writeSet);
-        
         //No timeout in 1st phase
-        int res = 0;
-        if ((res = select(FD_SETSIZE, &readSet, &writeSet, NULL, NULL)) <0) 
-        {
-            int error = errno;
-            switch (error)
-            {
-            case EINTR:
-                fprintf(stderr, "select has been interrupted.\n");
-                break;
-            default:
-                panic("select() error!");
-                break;
-            }
-        } else if (res > 0) {
-            //Reads
-            if (FD_ISSET(sndCardFD, &readSet)) 
-            {
-                //We can read from the sound card
-                
-                readAudioFragment(sndCardFD, packet, sessionParams);
-                sendAudioPacket(packet, sockId, &sendAddr, sessionParams, outputSequenceNum, outputTimeStamp);               
-
-                //Once we send it, seq and ts is incremented for the next packet
-                outputSequenceNum += 1;
-                outputTimeStamp += samplesPerPacket;
-
-                stats.packetsRecorded++;
-            }
-            if (FD_ISSET(sockId, &readSet)) {
-                isize result;
-                struct sockaddr_in remoteSAddr = {0}; 
-                socklen_t sockAddrInLength = sizeof (struct sockaddr_in); /* remember always to set the size of the rem variable in from_len */	
-                
-                if ((result = recvfrom(sockId, packet, expectedPacketSize, 0, (struct sockaddr *) &remoteSAddr, &sockAddrInLength)) < 0) {
-                    panic("recvfrom error");
-                } else if ((usize)result != expectedPacketSize) {
-                    //TODO: Fix if this happens
-                    panic("Expected to receive full sized packet!");
-                }
-
-                ASSERT(result == (isize)expectedPacketSize);
-                rtp_hdr_t* header = &packet->header;
-                ntohRTP(header);
-
-                if (!validateRTPHeader(&packet->header, sessionParams)) {
-                    fprintf(stderr, "Invalid received RTP packet. Exiting.");
-                    exit(1);
-                }
-
-                if (!startedReceiving) { 
-                    startedReceiving = true;
-                    inputSequenceNum = header->seq;
-                    inputTimeStamp = header->ts;
-
-                    char ipBuf[64];
-                    const char* ip = inet_ntop(AF_INET, &remoteSAddr.sin_addr, ipBuf, sizeof(ipBuf));
-                    trace("Started receiving from %s.\n", ip, result);
-                } else {
-                    i32 seqDifference = seqNumDifference(inputSequenceNum, header->seq);
-                    i64 tsDifference = timestampDifference(inputTimeStamp, header->ts);
-
-                    if (tsDifference % samplesPerPacket != 0) {
-                        fprintf(stderr, "Mismatched packet sizes, exiting program.");
-                        exit(1);
-                    }
-
-                    if (seqDifference == 1) {
-                        //Packet received as expected
-                        if(tsDifference > (i64)samplesPerPacket) {
-                            trace("Silence in buffering phase!");
-                        }
-                    } else {
-                        trace("Warning: Unexpected sequence number received in buffering phase!");
-                    }
-                }
-
-                void* bufferBlock = cbuf_pointer_to_write(circularBuffer);
-                if (bufferBlock) {
-                    memcpy(bufferBlock, packet->payload, sessionParams.fragmentBytes);
-                    cbufAccumulated++;
-                } else {
-                    fprintf(stderr, "Circular buffer is full, dropping packet.\n");
-                }
-                
-
-                verboseInfo("+");
-
-                inputSequenceNum = header->seq;
-                inputTimeStamp = header->ts;
-            }
-
-        } else {
-            printf("Warning: Timeout has expired in buffering phase.\n");
+        if (!waitForEvents(sndCardFD, sockId, false, -1, &events)) {
+            continue;
+        }
+        //Reads
+        if (events.cardReadable) {
+            //We can read from the sound card
+            captureAudio();
+        }
+        if (events.socketReadable) {
+            receivePacket(sockId, packet);
         }
     }
     
     //trace("Finished buffering phase.");
 
     // 2nd loop
-    while (1) {
-        memset(packet, 0, expectedPacketSize);
-
-        i32 bytesInCard = 0;
-        if (ioctl(sndCardFD, SNDCTL_DSP_GETODELAY, &bytesInCard) < 0)
-        {
-            panic("Error calling ioctl SNDCTL_DSP_GETODELAY");
+    realtimeCounters(&playoutCounters);
+    //Blocks are moved to the card in batches, but the card never holds more than the
+    //buffering target: the rest stays in the circular buffer, where it can still be repaired
+    usize cardTargetBytes = MAX(bufferingBlocks, 2) * fragmentBytes;
+    playoutInit(&playout, sndCardFD, bytesPerSecond,
+        calibration ? profileMarginUs(calibration, bytesPerSecond) : PLAYOUT_INITIAL_MARGIN_US);
+    i64 nextReportUs = playoutNowUs() + REPORT_INTERVAL_US;
+    while (!stopRequested) {
+        usize bufferedBlocks = audiocSessionBufferedBlocks(session);
+
+        //Time until sound card depletion minus a safety margin, from the scheduler model
+        //  T = remaining in sound card + remaining in buffer - margin
+        i64 now = playoutNowUs();
+        i64 remUSecs = playoutTimeout(&playout, now, bufferedBlocks * fragmentBytes); //us
+
+        bool wantCardWrite = false;
+        bool waitingForRoom = false;
+        if (bufferedBlocks > 0) {
+            //Only wait for the sound card to be writable if the buffer is not empty and
+            //another block keeps the card within the target delay
+            i64 untilRoom = playoutUntilDelay(&playout, now, cardTargetBytes - fragmentBytes);
+            if (untilRoom == 0) {
+                wantCardWrite = true;
+            } else if (untilRoom < remUSecs) {
+                remUSecs = untilRoom;
+                waitingForRoom = true;
+            }
         }
 
-        //Estimate time until sound card depletion - 10ms (for safety)
-        //  T = remaining in sound card (ms) + remaining in buffer (ms) - 10 ms
-        float timeInBuffer = cbufAccumulated * samplesPerPacket * 1000.f / (float)rate; //ms
-        float timeInCard = (bytesInCard / bytesPerSample) * 1000.f / (float)rate; //ms
-        float remainingTime = MAX(timeInBuffer + timeInCard - 10.f, 0.0f); //ms
-        i64 remUSecs = (i64) (remainingTime * 1000.f); //us
-
-        timeout.tv_sec = 0;
-        timeout.tv_usec = remUSecs;
-
-        FD_ZERO(&readSet);
-        FD_SET(sndCardFD, &readSet); //Microphone read
-        FD_SET(sockId, &readSet); //Network read
-        
-        FD_ZERO(&writeSet);
-        if (cbufAccumulated > 0) {
-            //Only add the sound card to the writing set if the buffer is not empty
-            FD_SET(sndCardFD, &writeSet); //Microphone write
-        }
-        
-        //printf("Timer(%ld us = %f buffer ms + %f card ms), Acc. Buffer: %ld blocks.\n", remUSecs, timeInBuffer, timeInCard, cbufAccumulated);
+        //printf("Timer(%ld us), Acc. Buffer: %ld blocks.\n", remUSecs, bufferedBlocks);
         
-        int res = 0;
-        if ((res = select(FD_SETSIZE, &readSet, &writeSet, NULL, &timeout)) <0) 
-        {
-            int error = errno;
-            switch (error)
-            {
-            case EINTR:
-                fprintf(stderr, "select has been interrupted.\n");
-                break;
-            default:
-                panic("select() error!");
-                break;
-            }
-        } else if (res > 0) {
+        bool woken = waitForEvents(sndCardFD, sockId, wantCardWrite, remUSecs, &events);
+        playoutWakeup(&playout, playoutNowUs(), woken && events.timedOut && !waitingForRoom);
+        if (woken && !events.timedOut) {
 
             //Write operations
-            if (FD_ISSET(sndCardFD, &writeSet)) {
-
-                if (cbuf_has_block(circularBuffer)) {
-                    //We can play audio
-                    void* block = cbuf_pointer_to_read(circularBuffer);
-                    ASSERT(block);
-                    isize n = write(sndCardFD, block, sessionParams.fragmentBytes);
-
-                    if (n < 0) {
-                        printError("Error playing %d byte block at sound card.", sessionParams.fragmentBytes);
-                    } else if (n != sessionParams.fragmentBytes) {
-                        printError("Played a different number of bytes than expected (played %d bytes, expected %d)", 
-                            n, sessionParams.fragmentBytes);
-                    }
-
-                    if (stats.packetsPlayed == 0) {
-                        if(gettimeofday(&stats.playbackStart, NULL) != 0) {
-                            panic("Could not get current time from gettimeofday()!");
-                        }
-                    }
-
-                    stats.packetsPlayed++;
-                    verboseInfo("-");
-                    cbufAccumulated--;
-                } else {
-                    //Empty buffer
-                    trace("Circular buffer is overrun!");
-                }
+            if (events.cardWritable) {
+                playBufferedBlocks(sndCardFD, cardTargetBytes);
             }
 
-            //trace("Buffer blocks: %d", cbufAccumulated);
             //Read operations
-            if (FD_ISSET(sndCardFD, &readSet)) {
+            if (events.cardReadable) {
                 //We can read from the sound card
-                
-                readAudioFragment(sndCardFD, packet, sessionParams);
-                //Simulate packet loss       
-                sendAudioPacket(packet, sockId, &sendAddr, sessionParams, outputSequenceNum, outputTimeStamp);  
-
-                //Once we send it, seq and ts is incremented for the next packet
-                outputSequenceNum += 1;
-                outputTimeStamp += samplesPerPacket;
-
-                stats.packetsRecorded++;
-            }
-            if (FD_ISSET(sockId, &readSet)) {
-                
-                isize result;
-                struct sockaddr_in remoteSAddr = {0}; 
-                socklen_t sockAddrInLength = sizeof (struct sockaddr_in); /* remember always to set the size of the rem variable in from_len */	
-                
-                if ((result = recvfrom(sockId, packet, expectedPacketSize, 0, (struct sockaddr *) &remoteSAddr, &sockAddrInLength)) < 0) {
-                    panic("recvfrom error");
-                } else if ((usize)result != expectedPacketSize) {
-                    panic("Expected to receive full sized packet!");
-                }
-
-                rtp_hdr_t* header = &packet->header;
-                ntohRTP(header);
-
-                if (!validateRTPHeader(&packet->header, sessionParams)) {
-                    fprintf(stderr, "Invalid received RTP packet. Exiting.");
-                    exit(1);
-                }
-                   
-                i32 seqDifference = seqNumDifference(inputSequenceNum, header->seq);
-                i64 tsDifference = timestampDifference(inputTimeStamp, header->ts);
-
-                if (tsDifference % samplesPerPacket != 0) {
-                    fprintf(stderr, "Mismatched packet sizes, exiting program.");
-                    exit(1);
-                }
-
-                bool discard = false;
-
-                if(seqDifference < 1 || tsDifference < (i64)samplesPerPacket) {
-                    //Received previous samples, ignore
-                    //Either last packet was smaller than samplesPerPacket or
-                    //this is a retransmission? ignore
-                    //trace("Re-TX: current(seq=%d, ts=%d), recv(seq=%d, ts=%d)\n", 
-                    //    inputSequenceNum, inputTimeStamp, header->seq, header->ts);
-                    discard = true;
-                }else if (seqDifference == 1) {
-                    //Packet received as expected
-                    if (tsDifference == (i64)samplesPerPacket) {
-                        //Packet received as expected
-                    } else if(tsDifference > (i64)samplesPerPacket) {
-                        //Samples have been skipped (not sent, no loss occured), we need to introduce a silence
-                        i64 numBlocks = tsDifference / samplesPerPacket;
-                        ASSERT(numBlocks > 1);
-                        i64 freeBlocks = bufferBlockCapacity - cbufAccumulated;
-                        i64 numSilenceBlocks = MIN(numBlocks - 1, freeBlocks);
-                        //printf("(Silence packet) Pushing %ld silences.\n", numSilenceBlocks);
-                        for (i64 i = 0; i < numSilenceBlocks; i++)
-                        {
-                            if (!pushSilence(circularBuffer, sessionParams.fragmentBytes, &cbufAccumulated, sessionParams.pt)) {
-                                trace("Circular buffer is full, dropping silences.\n");
-                            } 
-                            stats.silencesPlayed++;
-                            verboseInfo("~");
-                        }
-                    }                    
-                } else if(seqDifference > 1) {
-                    //1 or more packets have been lost (K-1)
-                    i64 lostPackets = seqDifference - 1;
-                    
-                    // tsDiff = (K+J)*F
-                    //Either lost or silence blocks + the received one (K+J)
-                    i64 pendingBlocks = tsDifference / samplesPerPacket;
-                    ASSERT(pendingBlocks > lostPackets);
-                    //leave one for the data buffer 
-                    i64 freeBlocks = bufferBlockCapacity - 1 - cbufAccumulated;
-                    i64 silenceBlocks = MAX(0, MIN(pendingBlocks - 1, freeBlocks));
-                    ASSERT((pendingBlocks - 1 >= lostPackets) && "Wrong pendingBlocks");
-                    
-                    //Silence blocks implied in this packet (J)
-                    //i64 actualSilenceBlocks = silenceBlocks - lostPackets;
-                    //printf("(Lost packet) Seq. dif =%d, lost %ld packets. Pushing %ld silences in total.\n", seqDifference, lostPackets, silenceBlocks);
-
-                    for (i64 i = 0; i < silenceBlocks; i++)
-                    {                        
-                        //We assume the lost blocks come first
-                        if (i < lostPackets) {
-                            verboseInfo("x");
-                            stats.lostPackets++;
-                        } else {
-                            verboseInfo("~");
-                            stats.silencesPlayed++;
-                        }
-
-                        if (!pushSilence(circularBuffer, sessionParams.fragmentBytes, &cbufAccumulated, sessionParams.pt)) {
-                            fprintf(stderr, "Circular buffer is full, dropping silence.\n");
-                        }
-                    }
-
-                } else if(seqDifference <= 0) {
-                    //Retransmission, ignore
-                    //trace("Warning: Retransmission packet received!");
-                    discard = true;
-                }
-
-                if (!discard) {
-                    //Add the samples we just received
-                    void* bufferBlock = cbuf_pointer_to_write(circularBuffer);
-                    if (bufferBlock) {
-                        //TODO: it may be possible to eliminate this copy
-                        //by peeking the header and then doing recvfrom() directly on the buffer
-                        memcpy(bufferBlock, packet->payload, sessionParams.fragmentBytes);
-                        cbufAccumulated++;
-                    } else {
-                        fprintf(stderr, "Circular buffer is full, dropping packet.\n");
-                    }
-
-                    verboseInfo("+");
-                
-                    inputSequenceNum = header->seq;
-                    inputTimeStamp = header->ts;
-                }
+                captureAudio();
             }
-        } else {
-            bool success = pushSilence(circularBuffer, sessionParams.fragmentBytes, &cbufAccumulated, sessionParams.pt);
-            //If the buffer is somehow full something has gone wrong
-            if (!success){
-                fprintf(stderr, "Circular buffer is full, dropping silence.\n");
+            if (events.socketReadable) {
+                receivePacket(sockId, packet);
             }
-            //Increment input counters as if it arrived correctly 
-            stats.timeouts++;
-            //silences do not increment the sequence number
-            inputTimeStamp += samplesPerPacket;
-            verboseInfo("t");
+        } else if (woken && !waitingForRoom) {
+            //Nothing arrived in time: conceal it
+            audiocSessionTick(session);
+        }
+
+        if (playoutNowUs() >= nextReportUs) {
+            checkStatus(audiocSessionReport(session, arrivalJitterTs(&arrival)));
+            nextReportUs += REPORT_INTERVAL_US;
         }
     }
 
     /*
     *   Cleanup
     */
-    free(packet);
-    cbuf_destroy_buffer(circularBuffer);
+    printSummary();
+    arenaFree(packet);
+    if (ringUsed) {
+        uringClose(&ring);
+    }
+    captureDestroy(&capture);
+    audiocSessionDestroy(session);
     return 0;
 }
@@ -27,11 +27,75 @@ void args_print_audioc (struct in_addr multicastIp, uint32_t ssrc, uint16_t port
         printf ("Verbose OFF\n");}
 };
 
+/*=====================================================================*/
+void args_print_audioc_ext (const audioc_ext_args_t *ext)
+{
+    printf ("Benchmark mode %s\n", ext->bench ? "ON" : "OFF");
+    if (ext->fecGroup > 0) {
+        printf ("FEC: 1 parity packet every %"PRIu32" packets\n", ext->fecGroup); }
+    else {
+        printf ("FEC OFF\n"); }
+    if (ext->redDepth > 0) {
+        printf ("Redundancy: %"PRIu32" previous fragments per packet%s\n", ext->redDepth, ext->redPcmu ? " (PCMU)" : ""); }
+    else {
+        printf ("Redundancy OFF\n"); }
+    printf ("NACK retransmission requests %s\n", ext->nack ? "ON" : "OFF");
+    printf ("Payload adaptation %s\n", ext->adapt ? "ON" : "OFF");
+    if (ext->fragmentDuration > 0) {
+        printf ("Sound card fragment %"PRIu32" ms\n", ext->fragmentDuration); }
+    else {
+        printf ("Sound card fragment as long as packets\n"); }
+    printf ("Calibration mode %s\n", ext->calibrate ? "ON" : "OFF");
+    printf ("Sound card profile %s\n", ext->profilePath);
+    if (ext->realtime) {
+        printf ("Realtime mode ON, SCHED_FIFO priority %"PRIu32" (0 is OFF), CPU %"PRId32" (-1 is any)\n",
+            ext->realtimePriority, ext->realtimeCpu); }
+    else {
+        printf ("Realtime mode OFF\n"); }
+    if (ext->serverSessions > 0) {
+        printf ("Server mode: %"PRIu32" sessions, %"PRIu32" threads (0 is one per CPU)\n",
+            ext->serverSessions, ext->serverThreads); }
+    else {
+        printf ("Server mode OFF\n"); }
+    if (ext->reflectPort > 0) {
+        printf ("Reflector mode, control port %"PRIu32"\n", ext->reflectPort); }
+    else {
+        printf ("Reflector mode OFF\n"); }
+    if (ext->gatewayIp.s_addr != 0) {
+        char gatewayIpStr[16];
+        inet_ntop(AF_INET, &ext->gatewayIp, gatewayIpStr, sizeof(gatewayIpStr));
+        printf ("Gateway to group %s, port %"PRIu32" (0 is -p), L16 at %"PRIu32" Hz\n", gatewayIpStr,
+            ext->gatewayPort, ext->gatewayRate); }
+    else {
+        printf ("Gateway mode OFF\n"); }
+    if (ext->filter) {
+        printf ("Kernel packet filter ON, %"PRIu32" SSRCs allowed (0 is any)\n", ext->filterSsrcCount); }
+    else {
+        printf ("Kernel packet filter OFF\n"); }
+    if (ext->xdpInterface[0] != '\0') {
+        printf ("AF_XDP receive on %s queue %"PRIu32"\n", ext->xdpInterface, ext->xdpQueue); }
+    else {
+        printf ("AF_XDP receive OFF\n"); }
+    if (ext->rtpdumpPath != NULL) {
+        printf ("Recording to rtpdump file %s\n", ext->rtpdumpPath); }
+    else {
+        printf ("rtpdump recording OFF\n"); }
+    if (ext->recordDirectory[0] != '\0') {
+        printf ("Recording audio to %s, segments of %"PRIu32" s\n", ext->recordDirectory, ext->recordSeconds); }
+    else {
+        printf ("Audio recording OFF\n"); }
+    if (ext->recordRtpDirectory[0] != '\0') {
+        printf ("Recording RTP to %s, segments of %"PRIu32" s\n", ext->recordRtpDirectory, ext->recordRtpSeconds); }
+    else {
+        printf ("RTP recording OFF\n"); }
+    printf ("I/O with %s\n", ext->ioUring ? "io_uring" : "select()");
+};
+
 /*=====================================================================*/
 static void _printHelp (void)
 {
     printf ("\naudioc v2.0");
-    printf ("\naudioc  MULTICAST_ADDR  LOCAL_SSRC  [-pLOCAL_RTP_PORT] [-lPACKET_DURATION] [-yPAYLOAD] [-kACCUMULATED_TIME] [-vVOL] [-c]\n\n");
+    printf ("\naudioc  MULTICAST_ADDR  LOCAL_SSRC  [-pLOCAL_RTP_PORT] [-lPACKET_DURATION] [-yPAYLOAD] [-kACCUMULATED_TIME] [-vVOL] [-c] [--bench] [--fec=K] [--red=N[,pcmu]] [--nack] [--adapt] [--fragment=MS] [--calibrate] [--profile=FILE] [--realtime[=PRIO[,CPU]]] [--server=N[,THREADS]] [--reflect=PORT] [--gateway=ADDR[:PORT][,RATE]] [--filter[=SSRC[,SSRC...]]] [--xdp=IFACE[,QUEUE]] [--rtpdump=FILE] [--record=DIR[,SECONDS]] [--record-rtp=DIR[,SECONDS]] [--io=select|uring]\n\n");
 }
 
 
@@ -48,10 +112,228 @@ static void _defaultValues (uint16_t *port, uint8_t *vol, uint32_t *packetDurati
 };
 
 
+/*=====================================================================*/
+static void _defaultExtValues (audioc_ext_args_t *ext)
+{
+    memset(ext, 0, sizeof(*ext));
+    ext->profilePath = "audioc.profile";
+    ext->realtimeCpu = -1;
+    ext->gatewayRate = 8000;
+    ext->recordSeconds = 60;
+    ext->recordRtpSeconds = 60;
+};
+
+
+/*=====================================================================*/
+/* Returns true if 'option' (without the leading "--") is 'name', alone or followed
+ * by '='. In the latter case, '*value' points to the text after '=' */
+static bool _matchLongOption (const char *option, const char *name, const char **value)
+{
+    size_t len = strlen(name);
+    if (strncmp(option, name, len) != 0) {
+        return false;
+    }
+    if (option[len] == '\0') {
+        *value = NULL;
+        return true;
+    }
+    if (option[len] == '=') {
+        *value = option + len + 1;
+        return true;
+    }
+    return false;
+}
+
+
+/*=====================================================================*/
+/* DIR[,SECONDS] of --record and --record-rtp */
+static int _parseRecordOption (const char *name, const char *value, char *directory, uint32_t *seconds)
+{
+    char rest[2];
+    /* 199: ARGS_MAX_RECORD_PATH - 1 */
+    int fields = value == NULL ? 0 : sscanf(value, "%199[^,],%" SCNu32 "%1s", directory, seconds, rest);
+    if (fields < 1 || fields > 2 || (fields == 1 && strchr(value, ',') != NULL)
+        || *seconds < 1 || *seconds > 600)
+    {
+        printf ("\n--%s must be followed by '=' and a directory, optionally followed by ',' and a segment duration in seconds in the range [1..600]\n", name);
+        return(EXIT_FAILURE);
+    }
+    return(EXIT_SUCCESS);
+}
+
+
+/*=====================================================================*/
+static int _parseLongOption (const char *option, audioc_ext_args_t *ext)
+{
+    const char *value;
+
+    if (_matchLongOption(option, "adapt", &value)) {
+        ext->adapt = true;
+    }
+    else if (_matchLongOption(option, "bench", &value)) {
+        ext->bench = true;
+    }
+    else if (_matchLongOption(option, "calibrate", &value)) {
+        ext->calibrate = true;
+    }
+    else if (_matchLongOption(option, "fec", &value)) {
+        /* the short mask of RFC 5109 protects up to 16 packets */
+        if (value == NULL || sscanf(value, "%" SCNu32, &ext->fecGroup) != 1
+            || ext->fecGroup < 2 || ext->fecGroup > 16)
+        {
+            printf ("\n--fec must be followed by '=' and a number in the range [2..16]\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else if (_matchLongOption(option, "filter", &value)) {
+        ext->filter = true;
+        while (value != NULL) {
+            int used = 0;
+            if (ext->filterSsrcCount == ARGS_MAX_FILTER_SSRCS
+                || sscanf(value, "%" SCNu32 "%n", &ext->filterSsrcs[ext->filterSsrcCount], &used) < 1
+                || (value[used] != '\0' && value[used] != ','))
+            {
+                printf ("\n--filter may be followed by '=' and up to %d SSRCs separated by ','\n", ARGS_MAX_FILTER_SSRCS);
+                return(EXIT_FAILURE);
+            }
+            ext->filterSsrcCount++;
+            value = value[used] == ',' ? value + used + 1 : NULL;
+        }
+    }
+    else if (_matchLongOption(option, "fragment", &value)) {
+        if (value == NULL || sscanf(value, "%" SCNu32, &ext->fragmentDuration) != 1
+            || ext->fragmentDuration == 0)
+        {
+            printf ("\n--fragment must be followed by '=' and a number of ms greater than 0\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else if (_matchLongOption(option, "gateway", &value)) {
+        char address[16] = "";
+        char rest[32] = "";
+        int fields = value == NULL ? 0 : sscanf(value, "%15[0-9.]%31s", address, rest);
+        if (fields >= 1 && inet_pton(AF_INET, address, &ext->gatewayIp) == 1
+            && IN_CLASSD(ntohl(ext->gatewayIp.s_addr)))
+        {
+            const char *next = rest;
+            int used = 0;
+            if (*next == ':') {
+                if (sscanf(next, ":%" SCNu32 "%n", &ext->gatewayPort, &used) < 1 || ext->gatewayPort < 1 || ext->gatewayPort > 65535) {
+                    next = NULL; }
+                else {
+                    next += used; }
+            }
+            if (next != NULL && *next == ',') {
+                if (sscanf(next, ",%" SCNu32 "%n", &ext->gatewayRate, &used) < 1 || (ext->gatewayRate != 8000 && ext->gatewayRate != 16000)) {
+                    next = NULL; }
+                else {
+                    next += used; }
+            }
+            if (next != NULL && *next == '\0') {
+                return(EXIT_SUCCESS);
+            }
+        }
+        printf ("\n--gateway must be followed by '=' and a multicast address, optionally followed by ':' and a port, and by ',' and a rate of 8000 or 16000\n");
+        return(EXIT_FAILURE);
+    }
+    else if (_matchLongOption(option, "io", &value)) {
+        if (value != NULL && strcmp(value, "uring") == 0) {
+            ext->ioUring = true; }
+        else if (value != NULL && strcmp(value, "select") == 0) {
+            ext->ioUring = false; }
+        else {
+            printf ("\n--io must be followed by '=' and select or uring\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else if (_matchLongOption(option, "nack", &value)) {
+        ext->nack = true;
+    }
+    else if (_matchLongOption(option, "profile", &value)) {
+        if (value == NULL || value[0] == '\0')
+        {
+            printf ("\n--profile must be followed by '=' and a file name\n");
+            return(EXIT_FAILURE);
+        }
+        ext->profilePath = value;
+    }
+    else if (_matchLongOption(option, "realtime", &value)) {
+        ext->realtime = true;
+        if (value != NULL)
+        {
+            int fields = sscanf(value, "%" SCNu32 ",%" SCNd32, &ext->realtimePriority, &ext->realtimeCpu);
+            if (fields < 1 || ext->realtimePriority < 1 || ext->realtimePriority > 99
+                || (fields == 2 && ext->realtimeCpu < 0))
+            {
+                printf ("\n--realtime may be followed by '=' and a priority in the range [1..99], optionally followed by ',' and a CPU number\n");
+                return(EXIT_FAILURE);
+            }
+        }
+    }
+    else if (_matchLongOption(option, "record", &value)) {
+        return _parseRecordOption("record", value, ext->recordDirectory, &ext->recordSeconds);
+    }
+    else if (_matchLongOption(option, "record-rtp", &value)) {
+        return _parseRecordOption("record-rtp", value, ext->recordRtpDirectory, &ext->recordRtpSeconds);
+    }
+    else if (_matchLongOption(option, "reflect", &value)) {
+        if (value == NULL || sscanf(value, "%" SCNu32, &ext->reflectPort) != 1
+            || ext->reflectPort < 1 || ext->reflectPort > 65535)
+        {
+            printf ("\n--reflect must be followed by '=' and a control port in the range [1..65535]\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else if (_matchLongOption(option, "red", &value)) {
+        char codec[8] = "";
+        int fields = value == NULL ? 0 : sscanf(value, "%" SCNu32 ",%7s", &ext->redDepth, codec);
+        if (fields < 1 || ext->redDepth < 1 || ext->redDepth > 2
+            || (fields == 2 && strcmp(codec, "pcmu") != 0))
+        {
+            printf ("\n--red must be followed by '=' and a number in the range [1..2], optionally followed by ',pcmu'\n");
+            return(EXIT_FAILURE);
+        }
+        ext->redPcmu = (fields == 2);
+    }
+    else if (_matchLongOption(option, "rtpdump", &value)) {
+        if (value == NULL || value[0] == '\0')
+        {
+            printf ("\n--rtpdump must be followed by '=' and a file name\n");
+            return(EXIT_FAILURE);
+        }
+        ext->rtpdumpPath = value;
+    }
+    else if (_matchLongOption(option, "server", &value)) {
+        int fields = value == NULL ? 0 : sscanf(value, "%" SCNu32 ",%" SCNu32, &ext->serverSessions, &ext->serverThreads);
+        if (fields < 1 || ext->serverSessions < 1 || ext->serverSessions > 65535
+            || (fields == 2 && (ext->serverThreads < 1 || ext->serverThreads > 1024)))
+        {
+            printf ("\n--server must be followed by '=' and a number of sessions in the range [1..65535], optionally followed by ',' and a number of threads in the range [1..1024]\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else if (_matchLongOption(option, "xdp", &value)) {
+        char rest[2];
+        int fields = value == NULL ? 0 : sscanf(value, "%15[^,],%" SCNu32 "%1s", ext->xdpInterface, &ext->xdpQueue, rest);
+        if (fields < 1 || fields > 2 || (fields == 1 && strchr(value, ',') != NULL))
+        {
+            printf ("\n--xdp must be followed by '=' and an interface name, optionally followed by ',' and a queue number\n");
+            return(EXIT_FAILURE);
+        }
+    }
+    else {
+        printf ("\nI do not understand --%s\n", option);
+        _printHelp ();
+        return(EXIT_FAILURE);
+    }
+    return(EXIT_SUCCESS);
+}
+
+
 /*=====================================================================*/
 int args_capture_audioc(int argc, char * argv[], struct in_addr *multicastIp, 
 uint32_t *ssrc, uint16_t *port, uint8_t *vol, uint32_t *packetDuration, 
-bool *verbose, uint8_t *payload, uint32_t *bufferingTime)
+bool *verbose, uint8_t *payload, uint32_t *bufferingTime, audioc_ext_args_t *ext)
 {
     int index;
     char car;
@@ -59,6 +341,7 @@ bool *verbose, uint8_t *payload, uint32_t *bufferingTime)
 
     /*set default values */
     _defaultValues (port, vol, packetDuration, verbose, payload, bufferingTime);
+    _defaultExtValues (ext);
 
     if (argc < 3 )
     { 
@@ -135,6 +418,13 @@ bool *verbose, uint8_t *payload, uint32_t *bufferingTime)
                     }
                     break;
 
+                case '-': /* Extended (long) option */
+                    if (_parseLongOption (++argv[index], ext) != EXIT_SUCCESS)
+                    {
+                        return(EXIT_FAILURE);
+                    }
+                    break;
+
                 default:
                     printf ("\nI do not understand -%c\n", car);
                     _printHelp ();
@@ -184,6 +474,33 @@ bool *verbose, uint8_t *payload, uint32_t *bufferingTime)
         _printHelp();
         return(EXIT_FAILURE);
     }
+    if (ext->fecGroup > 0 && ext->redDepth > 0)
+    {
+        printf("\n--fec and --red cannot be used at the same time.\n");
+        return(EXIT_FAILURE);
+    }
+    if (ext->xdpInterface[0] != '\0' && !ext->bench)
+    {
+        printf("\n--xdp can only be used with --bench.\n");
+        return(EXIT_FAILURE);
+    }
+    if (ext->ioUring && (ext->xdpInterface[0] != '\0' || ext->serverSessions > 0 || ext->reflectPort > 0
+        || ext->gatewayIp.s_addr != 0 || ext->calibrate))
+    {
+        printf("\n--io=uring cannot be used with --xdp, --server, --reflect, --gateway nor --calibrate.\n");
+        return(EXIT_FAILURE);
+    }
+    if ((ext->recordDirectory[0] != '\0' || ext->recordRtpDirectory[0] != '\0')
+        && (ext->bench || ext->reflectPort > 0 || ext->gatewayIp.s_addr != 0 || ext->calibrate))
+    {
+        printf("\n--record and --record-rtp cannot be used with --bench, --reflect, --gateway nor --calibrate.\n");
+        return(EXIT_FAILURE);
+    }
+    if (ext->adapt && (*payload != L16_1 || ext->redDepth > 0))
+    {
+        printf("\n--adapt needs -y%d and cannot be used with --red.\n", L16_1);
+        return(EXIT_FAILURE);
+    }
     return(EXIT_SUCCESS);
 };
 
@@ -197,9 +514,11 @@ int main(int argc, char *argv[])
     struct in_addr  multicastIp;
     unsigned int ssrc;
     int port, vol, packetDuration, verbose, payload, bufferingTime;
+    audioc_ext_args_t ext;
 
-    if (EXIT_SUCCESS == args_capture_audioc (argc, argv, &multicastIp, &ssrc, &port, &vol, &packetDuration,  &verbose,  &payload, &bufferingTime )) {
+    if (EXIT_SUCCESS == args_capture_audioc (argc, argv, &multicastIp, &ssrc, &port, &vol, &packetDuration,  &verbose,  &payload, &bufferingTime, &ext )) {
         args_print_audioc(multicastIp, ssrc, port, packetDuration, payload, bufferingTime, vol, verbose);
+        args_print_audioc_ext(&ext);
     }
     
     return (EXIT_SUCCESS);
@@ -13,6 +13,110 @@
 /* payload options, to be included in RTP packets */
 enum payload {PCMU=0,  L16_1=101};
 
+#define ARGS_MAX_FILTER_SSRCS 16
+#define ARGS_MAX_RECORD_PATH 200
+
+/* Extended options. They are given as long options (--name or --name=value) and
+ * are not part of the original audioc interface: leaving them out keeps the
+ * original behaviour. */
+typedef struct {
+	bool bench;             /* --bench: receive-only benchmark mode. The sound card is not
+						opened and nothing is sent; every RTP stream received in the group
+						is validated and enqueued as in a normal session, and packets/s,
+						CPU time per stream and drops are reported every second. */
+	uint32_t fecGroup;      /* --fec=K: after every K sent packets, send an XOR parity packet 
+						(RFC 5109) that allows the receivers to rebuild one lost packet of the 
+						group. K in [2..16]. 0 (default) sends no FEC. Received FEC packets are
+						always used. */
+	uint32_t redDepth;      /* --red=N[,pcmu]: every sent packet also carries the previous N
+						fragments (RFC 2198 redundant audio), so a receiver can fill a loss
+						with the copy in the next packet. N in [1..2]. With ',pcmu' and
+						payload L16 the copies are sent as PCMU, halving their size.
+						0 (default) sends no redundancy. Cannot be used with --fec. */
+	bool redPcmu;
+	bool nack;              /* --nack: ask the sender to retransmit lost packets with RTCP
+						generic NACKs (RFC 4585), sent to the group on the RTP port. Only
+						useful if -k leaves time for a round trip. Received NACKs are
+						always answered, within a rate limit. */
+	bool adapt;             /* --adapt: with -y101, send PCMU instead of L16 (half the bandwidth)
+						while more than 5% of the packets sent are NACKed by the receivers,
+						and L16 again when it is below 1%. Decided every 250 packets; the
+						receivers must use --nack. Cannot be used with --red. Receivers
+						always follow a change of payload or packet duration. */
+	uint32_t fragmentDuration; /* --fragment=MS: duration of the sound card fragment, the block
+						audio is captured and played in, chosen independently of the packet
+						duration. The card may round it up (to a power of 2 bytes). Packets
+						are then exactly -l ms long. 0 (default) uses for both the fragment
+						obtained for -l, so packets may be longer than requested. */
+	bool calibrate;         /* --calibrate: measure the sound card (output latency, GETODELAY
+						granularity and wakeup jitter) for every fragment size usable with
+						the payload given by -y, store the results in the profile and exit.
+						No packets are sent or received. */
+	const char *profilePath; /* --profile=FILE: sound card profile written by --calibrate and
+						used to size the jitter buffer and the playout margin. Default
+						'audioc.profile' in the current directory; if it does not exist or
+						has no entry for the card configuration, fixed values are used. */
+	bool realtime;          /* --realtime[=PRIO[,CPU]]: take all session memory from one
+						preallocated, pre-faulted arena and lock it in RAM (mlockall). With
+						PRIO in [1..99], also run with SCHED_FIFO at that priority, and with
+						CPU, only on that CPU. Page faults and context switches are reported
+						on exit in any mode. */
+	uint32_t realtimePriority; /* 0: keep the normal scheduler */
+	int32_t realtimeCpu;    /* -1: any CPU */
+	uint32_t serverSessions; /* --server=N[,THREADS]: receive N sessions in one process, with no
+						sound card: session i uses port -p plus i and SSRC LOCAL_SSRC plus i,
+						and its audio is played out against the clock and discarded. The
+						sessions are spread over THREADS event loops (default, one per
+						online CPU). Packets, wakeups and memory per session are reported
+						on exit. 0 (default) runs a normal session. */
+	uint32_t serverThreads; /* 0: one per online CPU */
+	uint32_t reflectPort;   /* --reflect=PORT: multicast to unicast reflector. The sound card is
+						not opened; every datagram received from the group is sent to each
+						subscriber by unicast. Subscribers are managed with UDP commands to
+						127.0.0.1:PORT: 'add IP:PORT', 'del IP:PORT' and 'list'. 0 (default)
+						runs a normal session. */
+	struct in_addr gatewayIp; /* --gateway=ADDR[:PORT][,RATE]: transcoding gateway between the
+						group of MULTICAST_ADDR, which uses payload -y, and the group ADDR
+						on PORT (default -p), which uses the other payload (PCMU or L16).
+						RATE is the sample rate of the L16 side, 8000 (default) or 16000.
+						Every stream gets its own SSRC, sequence numbers and timestamps on
+						the other side. The sound card is not opened. */
+	uint32_t gatewayPort;   /* 0: the port given by -p */
+	uint32_t gatewayRate;
+	bool filter;            /* --filter[=SSRC[,SSRC...]]: attach a BPF program to the session
+						sockets so the kernel drops, before they are queued or wake us up,
+						datagrams that are not RTP version 2 with one of the payloads we
+						play (PCMU, L16, RED, FEC) nor RTCP. With SSRCs (decimal, as
+						LOCAL_SSRC, up to 16), RTP from any other source is dropped too.
+						Useful on busy groups or ports; OFF by default. */
+	uint32_t filterSsrcs[ARGS_MAX_FILTER_SSRCS];
+	uint32_t filterSsrcCount; /* 0: any SSRC */
+	char xdpInterface[16];  /* --xdp=IFACE[,QUEUE]: with --bench, receive through an AF_XDP socket
+						on receive queue QUEUE (default 0) of interface IFACE: RTP to port
+						-p of any multicast group is parsed in place in the frames, with no
+						system call per packet. Needs root; if it cannot be set up, the
+						normal socket is used. Empty (default): normal socket only. */
+	uint32_t xdpQueue;
+	const char *rtpdumpPath; /* --rtpdump=FILE: record every datagram received by the session, with
+						its arrival time as stamped by the kernel, in rtpdump format
+						(rtptools). NULL (default): no recording. */
+	char recordDirectory[ARGS_MAX_RECORD_PATH]; /* --record=DIR[,SECONDS]: record the audio played
+						(in --server mode, of every session) into the directory DIR, in
+						segment files of SECONDS (default 60, up to 600) compressed without
+						loss, each with a seek index. Files are written by a separate thread
+						and never delay the playout. Empty (default): no recording. */
+	uint32_t recordSeconds;
+	char recordRtpDirectory[ARGS_MAX_RECORD_PATH]; /* --record-rtp=DIR[,SECONDS]: the same for the
+						datagrams received, as they are, indexed by arrival time */
+	uint32_t recordRtpSeconds;
+	bool ioUring;           /* --io=select|uring: how the session (and --bench) waits for the
+						socket, the sound card and the playout deadlines. select (default):
+						select() and one recvmsg() per datagram. uring: an io_uring that
+						receives datagrams into buffers the kernel picks from a ring, with
+						no system call per datagram, and sends what is captured in linked
+						batches; falls back to select when the kernel lacks it. */
+} audioc_ext_args_t;
+
 /* Parses arguments from command line 
  * Returns  EXIT_FAILURE if it finds an error when parsing the args. In this
  * case, the returned values are meaningless. It prints a message indicating
@@ -47,13 +151,18 @@ int  args_capture_audioc ( int argc, char *argv[],
 	uint8_t *payload,       /* Does not use the initial value of the variable.
 						Returns the requested payload for the communication. 
                         This is the payload to include in RTP packets (see 'enum payload'). */
-	uint32_t *bufferingTime  /* Does not use the initial value of the variable.
+	uint32_t *bufferingTime, /* Does not use the initial value of the variable.
 						Returns the buffering time requested before starting playout.
                         Time measured in ms. */
+	audioc_ext_args_t *ext   /* Does not use the initial value of the variable.
+						Returns the extended options (default values if not present) */
 	);
 
 /* prints current values, can be used for debugging */
 void  args_print_audioc (struct in_addr multicastIpStr, uint32_t ssrc, uint16_t port, uint32_t packetDuration, uint8_t payload, uint32_t bufferingTime, uint8_t vol, bool verbose);
 
+/* prints the extended options, can be used for debugging */
+void  args_print_audioc_ext (const audioc_ext_args_t *ext);
+
 
 
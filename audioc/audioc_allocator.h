@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+
+//Where the session library takes its memory from. The caller provides one in the session
+//configuration (audioc uses the arena, see audioc_arena.h); NULL means malloc() and free().
+//Every module keeps the allocator it was initialized with to release its memory.
+
+typedef struct {
+    void* (*alloc)(void* context, usize bytes);
+    void (*free)(void* context, void* memory);
+    void* context;
+} allocator_t;
+
+static inline void* allocatorAlloc(const allocator_t* allocator, usize bytes)
+{
+    return allocator ? allocator->alloc(allocator->context, bytes) : malloc(bytes);
+}
+
+static inline void* allocatorCalloc(const allocator_t* allocator, usize count, usize bytes)
+{
+    if (!allocator) {
+        return calloc(count, bytes);
+    }
+    void* memory = allocator->alloc(allocator->context, count * bytes);
+    if (memory) {
+        memset(memory, 0, count * bytes);
+    }
+    return memory;
+}
+
+static inline void allocatorFree(const allocator_t* allocator, void* memory)
+{
+    if (allocator) {
+        allocator->free(allocator->context, memory);
+    } else {
+        free(memory);
+    }
+}
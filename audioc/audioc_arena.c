@@ -0,0 +1,104 @@
+#include "audioc_arena.h"
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGNMENT 64 //Cache line
+
+static u8* arenaBase;
+static usize arenaCapacity;
+static usize arenaOffset;
+static u64 arenaMisses;
+
+bool arenaInit(usize bytes)
+{
+    ASSERT(!arenaBase);
+    //MAP_POPULATE already faults the pages in, writing them makes sure they are private copies
+    void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    usize pageSize = sysconf(_SC_PAGESIZE);
+    for (usize offset = 0; offset < bytes; offset += pageSize) {
+        ((volatile u8*)memory)[offset] = 0;
+    }
+
+    arenaBase = memory;
+    arenaCapacity = bytes;
+    arenaOffset = 0;
+    return true;
+}
+
+void* arenaAlloc(usize bytes)
+{
+    if (!arenaBase) {
+        return malloc(bytes);
+    }
+
+    usize size = (bytes + ARENA_ALIGNMENT - 1) & ~(usize)(ARENA_ALIGNMENT - 1);
+    //Sessions may be set up from several threads. The offset only moves if the block fits,
+    //so one large request that does not leaves the room for the smaller ones after it
+    usize offset = __atomic_load_n(&arenaOffset, __ATOMIC_RELAXED);
+    do {
+        if (size > arenaCapacity - offset) {
+            __atomic_fetch_add(&arenaMisses, 1, __ATOMIC_RELAXED);
+            return malloc(bytes);
+        }
+    } while (!__atomic_compare_exchange_n(&arenaOffset, &offset, offset + size, true, __ATOMIC_RELAXED,
+        __ATOMIC_RELAXED));
+    return arenaBase + offset;
+}
+
+void* arenaCalloc(usize count, usize bytes)
+{
+    if (!arenaBase) {
+        return calloc(count, bytes);
+    }
+
+    void* memory = arenaAlloc(count * bytes);
+    if (memory) {
+        //Needed if the arena was full and it came from malloc()
+        memset(memory, 0, count * bytes);
+    }
+    return memory;
+}
+
+bool arenaOwns(const void* ptr)
+{
+    return arenaBase && (const u8*)ptr >= arenaBase && (const u8*)ptr < arenaBase + arenaCapacity;
+}
+
+void arenaFree(void* ptr)
+{
+    if (!arenaOwns(ptr)) {
+        free(ptr);
+    }
+}
+
+usize arenaUsed(void)
+{
+    return __atomic_load_n(&arenaOffset, __ATOMIC_RELAXED);
+}
+
+u64 arenaOverflows(void)
+{
+    return arenaMisses;
+}
+
+static void* allocatorArenaAlloc(void* context, usize bytes)
+{
+    (void)context;
+    return arenaAlloc(bytes);
+}
+
+static void allocatorArenaFree(void* context, void* memory)
+{
+    (void)context;
+    arenaFree(memory);
+}
+
+const allocator_t arenaAllocator = {
+    .alloc = allocatorArenaAlloc,
+    .free = allocatorArenaFree,
+};
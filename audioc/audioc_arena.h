@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_allocator.h"
+
+//Session memory. Every buffer audioc needs for a session is taken from here instead of
+//straight from malloc(). Normally that is all it does, but with --realtime arenaInit()
+//first maps one block of memory, touches every page of it (so it is never faulted in
+//during playout) and from then on allocations are carved out of it. Arena memory is never
+//returned: arenaFree() ignores it and it goes away with the process.
+
+//Enough for the largest session: two 64 KiB datagram buffers, the retransmission
+//history, the FEC store and a few seconds of jitter buffer
+#define ARENA_DEFAULT_BYTES (8 * 1024 * 1024)
+
+//Returns false if the memory cannot be mapped. Call it once, before any allocation
+bool arenaInit(usize bytes);
+
+void* arenaAlloc(usize bytes);
+void* arenaCalloc(usize count, usize bytes);
+void arenaFree(void* ptr);
+
+//True if ptr was allocated from the arena
+bool arenaOwns(const void* ptr);
+
+//Bytes taken from the arena, and allocations that did not fit in it (served by malloc())
+usize arenaUsed(void);
+u64 arenaOverflows(void);
+
+//arenaAlloc() and arenaFree(), for the session configuration
+extern const allocator_t arenaAllocator;
@@ -0,0 +1,163 @@
+#include "audioc_arrival.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+arrival_source_t arrivalEnable(int sockId)
+{
+    int enable = 1;
+    if (setsockopt(sockId, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(int)) < 0) {
+        printError("setsockopt(SO_RXQ_OVFL) failed, datagrams dropped by the socket will count as network loss");
+    }
+    //Software stamps always; hardware ones on top, when the NIC has them turned on
+    if (setsockopt(sockId, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(int)) < 0) {
+        printError("setsockopt(SO_TIMESTAMPNS) failed, arrival times will include our wakeup latency");
+        return ARRIVAL_USER;
+    }
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (setsockopt(sockId, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(int)) < 0) {
+        return ARRIVAL_SOFTWARE;
+    }
+    return ARRIVAL_HARDWARE;
+}
+
+static i64 timespecToNs(struct timespec t)
+{
+    return (i64)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static i64 realtimeNowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return timespecToNs(now);
+}
+
+isize arrivalReceive(int sockId, void* buffer, usize size, struct sockaddr_in* from, arrival_t* arrival)
+{
+    struct iovec iov = { .iov_base = buffer, .iov_len = size };
+    //Room for all four control messages
+    union {
+        char buffer[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct scm_timestamping))
+            + CMSG_SPACE(sizeof(u32)) + CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message = {
+        .msg_name = from,
+        .msg_namelen = from ? sizeof(struct sockaddr_in) : 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    isize result = recvmsg(sockId, &message, 0);
+    if (result >= 0) {
+        arrivalParse(&message, arrival);
+    }
+    return result;
+}
+
+void arrivalParse(struct msghdr* message, arrival_t* arrival)
+{
+    *arrival = (arrival_t) { .source = ARRIVAL_USER };
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(message); cmsg; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segmentBytes;
+            memcpy(&segmentBytes, CMSG_DATA(cmsg), sizeof(int));
+            arrival->segmentBytes = MAX(segmentBytes, 0);
+        }
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS && arrival->source < ARRIVAL_SOFTWARE) {
+            struct timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            arrival->ns = timespecToNs(stamp);
+            arrival->source = ARRIVAL_SOFTWARE;
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            //ts[2]: raw hardware, zero unless the NIC stamped this one
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            if (stamps.ts[2].tv_sec != 0 || stamps.ts[2].tv_nsec != 0) {
+                arrival->ns = timespecToNs(stamps.ts[2]);
+                arrival->source = ARRIVAL_HARDWARE;
+            }
+        } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&arrival->queueDrops, CMSG_DATA(cmsg), sizeof(u32));
+        }
+    }
+    if (arrival->source == ARRIVAL_USER) {
+        arrival->ns = realtimeNowNs();
+    }
+}
+
+static void count(u64* histogram, i64 valueUs, i64 bucketUs)
+{
+    histogram[MIN(MAX(valueUs, 0) / bucketUs, ARRIVAL_BUCKETS - 1)]++;
+}
+
+void arrivalUpdate(arrival_stats_t* stats, const rtp_hdr_t* header, const arrival_t* arrival)
+{
+    if (!stats->started || header->ssrc != stats->ssrc || arrival->source != stats->source) {
+        *stats = (arrival_stats_t) {
+            .rate = stats->rate,
+            .started = true,
+            .ssrc = header->ssrc,
+            .source = arrival->source,
+            .lastTs = header->ts,
+            .firstArrivalNs = arrival->ns,
+        };
+    }
+    stats->mediaTs += timestampDifference(stats->lastTs, header->ts);
+    stats->lastTs = header->ts;
+
+    //Transit time up to an unknown constant (the clocks of both ends are not related)
+    i64 transitNs = (arrival->ns - stats->firstArrivalNs) - stats->mediaTs * 1000000000 / stats->rate;
+    if (stats->packets == 0) {
+        stats->lastTransitNs = stats->minTransitNs = transitNs;
+    }
+    double d = fabs((double)(transitNs - stats->lastTransitNs));
+    stats->jitterNs += (d - stats->jitterNs) / 16;
+    stats->lastTransitNs = transitNs;
+    stats->minTransitNs = MIN(stats->minTransitNs, transitNs);
+
+    stats->packets++;
+    count(stats->delay, (transitNs - stats->minTransitNs) / 1000, ARRIVAL_DELAY_BUCKET_US);
+    if (arrival->source == ARRIVAL_SOFTWARE) {
+        count(stats->latency, (realtimeNowNs() - arrival->ns) / 1000, ARRIVAL_LATENCY_BUCKET_US);
+    }
+}
+
+u32 arrivalJitterTs(const arrival_stats_t* stats)
+{
+    return (u32)(stats->jitterNs * stats->rate / 1e9);
+}
+
+static void printHistogram(const char* title, const u64* histogram, i64 bucketUs)
+{
+    printf("%s:", title);
+    for (u32 i = 0; i < ARRIVAL_BUCKETS; i++) {
+        if (histogram[i] > 0) {
+            printf(" %s%ld:%lu", i == ARRIVAL_BUCKETS - 1 ? ">=" : "", i * bucketUs, histogram[i]);
+        }
+    }
+    printf("\n");
+}
+
+void arrivalPrint(const arrival_stats_t* stats)
+{
+    static const char* sourceNames[ARRIVAL_SOURCES] = { "recvmsg() time", "kernel", "NIC" };
+    if (stats->packets == 0) {
+        printf("No audio packets received: no arrival figures.\n");
+        return;
+    }
+    printf("Arrival of SSRC %X, stamped by the %s: %lu packets, jitter %.0f us (%u timestamp units)\n",
+        stats->ssrc, sourceNames[stats->source], stats->packets, stats->jitterNs / 1000, arrivalJitterTs(stats));
+    printHistogram("\tNetwork delay over the fastest packet (us: packets)", stats->delay, ARRIVAL_DELAY_BUCKET_US);
+    if (stats->source == ARRIVAL_SOFTWARE) {
+        printHistogram("\tFrom the kernel to us (us: packets)", stats->latency, ARRIVAL_LATENCY_BUCKET_US);
+    }
+}
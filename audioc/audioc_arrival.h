@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+//Arrival times of received packets as the kernel saw them (SO_TIMESTAMPNS, and the NIC
+//with SO_TIMESTAMPING when it is set up to stamp received packets, e.g. with hwstamp_ctl),
+//not when select() let us read them, so jitter figures are the network's and not our
+//wakeup latency. Without timestamps from the kernel the time of recvmsg() is used.
+
+typedef enum {
+    ARRIVAL_USER = 0,       //clock_gettime() after recvmsg()
+    ARRIVAL_SOFTWARE,       //Kernel, CLOCK_REALTIME
+    ARRIVAL_HARDWARE,       //NIC clock: only differences between packets mean anything
+    ARRIVAL_SOURCES,
+} arrival_source_t;
+
+typedef struct {
+    i64 ns;
+    arrival_source_t source;
+    u32 queueDrops;         //Datagrams the socket dropped so far, its receive buffer was full
+    u32 segmentBytes;       //UDP GRO (audioc_socket.h) coalesced datagrams of this size, 0: one
+} arrival_t;
+
+//Asks for timestamps, and the count of dropped datagrams (SO_RXQ_OVFL), on every datagram
+//received on sockId. Returns the best timestamp source the kernel accepted
+arrival_source_t arrivalEnable(int sockId);
+
+//recvfrom() returning the arrival time too
+isize arrivalReceive(int sockId, void* buffer, usize size, struct sockaddr_in* from, arrival_t* arrival);
+
+//The arrival time of a datagram from the control messages of its recvmsg(), wherever it
+//was received (audioc_uring.h)
+void arrivalParse(struct msghdr* message, arrival_t* arrival);
+
+//Network delay histogram: transit time over the fastest packet seen so far, in 1 ms
+//buckets. Receive latency: from the kernel stamp to arrivalUpdate(), in 50 us buckets.
+//The last bucket of each holds everything longer
+#define ARRIVAL_DELAY_BUCKET_US 1000
+#define ARRIVAL_LATENCY_BUCKET_US 50
+#define ARRIVAL_BUCKETS 64
+
+//Figures of the RTP stream received (the last SSRC seen: they restart when it changes, or
+//when the timestamps start coming from another source)
+typedef struct {
+    u32 rate;               //Of the RTP timestamps, set by the caller
+    bool started;
+    u32 ssrc;
+    arrival_source_t source;
+    u32 lastTs;
+    i64 mediaTs;            //Timestamp units since the first packet, unwrapped
+    i64 firstArrivalNs;
+    i64 lastTransitNs;
+    i64 minTransitNs;
+    double jitterNs;        //RFC 3550 interarrival jitter, in ns instead of timestamp units
+
+    u64 packets;
+    u64 delay[ARRIVAL_BUCKETS];
+    u64 latency[ARRIVAL_BUCKETS];
+} arrival_stats_t;
+
+//An audio packet (header in host order) stamped with arrival. RTCP and FEC are not
+//audio: their timestamps do not follow the media clock
+void arrivalUpdate(arrival_stats_t* stats, const rtp_hdr_t* header, const arrival_t* arrival);
+
+//RFC 3550 jitter in timestamp units, as sent in receiver reports
+u32 arrivalJitterTs(const arrival_stats_t* stats);
+
+void arrivalPrint(const arrival_stats_t* stats);
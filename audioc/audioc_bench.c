@@ -0,0 +1,397 @@
+#include "audioc_bench.h"
+#include "audioc_rtp.h"
+#include "audioc_arrival.h"
+#include "audioc_uring.h"
+#include "audioc_socket.h"
+#include "../lib/circularBuffer.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+
+//Blocks kept in each per-stream jitter buffer before we start "playing" them
+#define BENCH_PLAYOUT_BLOCKS 5
+#define BENCH_BUFFER_BLOCKS 16
+//Wakeup latency, from the kernel stamp to the packet being handled: 10 us buckets, the
+//last one holds everything longer
+#define BENCH_LATENCY_BUCKET_US 10
+#define BENCH_LATENCY_BUCKETS 1000
+//io_uring receive buffers, as the frames of AF_XDP
+#define BENCH_URING_DATAGRAM_BYTES 2048
+#define BENCH_URING_BUFFERS 4096
+
+typedef struct {
+    bool used;
+    u32 ssrc;
+    u8 pt;
+    u16 lastSeq;
+    u64 packets;
+    u64 lost;      //sequence gaps
+    u64 late;      //duplicated, reordered or retransmitted packets
+    u64 packetsAtLastReport;
+    void* cbuf;
+    isize cbufAccumulated;
+    usize blockBytes;
+} bench_stream_t;
+
+typedef struct {
+    u64 packets;
+    u64 bytes;
+    u64 lost;
+    u64 late;
+    u64 invalid;
+    u64 syscalls;           //Of the receive path: select() and recvmsg(), or io_uring_enter()
+    u64 coalesced;          //Datagrams received by UDP GRO with others, in one recvmsg()
+    u64 latency[BENCH_LATENCY_BUCKETS];
+} bench_counters_t;
+
+static volatile sig_atomic_t benchStopRequested = 0;
+
+static void benchSignalHandler(int sigNum)
+{
+    (void) sigNum;
+    benchStopRequested = 1;
+}
+
+static i64 timevalToUs(struct timeval t)
+{
+    return (i64)t.tv_sec * 1000000 + t.tv_usec;
+}
+
+static i64 cpuTimeUs(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        panic("getrusage error");
+    }
+    return timevalToUs(usage.ru_utime) + timevalToUs(usage.ru_stime);
+}
+
+static i64 wallTimeUs(void)
+{
+    struct timeval now;
+    if (gettimeofday(&now, NULL) != 0) {
+        panic("Could not get current time from gettimeofday()!");
+    }
+    return timevalToUs(now);
+}
+
+//Open addressing, linear probing. Returns NULL when the table is full
+static bench_stream_t* findStream(bench_stream_t* streams, u32 ssrc, u32* activeStreams)
+{
+    u32 mask = BENCH_MAX_STREAMS - 1;
+    u32 slot = (ssrc * 2654435761u) & mask;
+    for (u32 probe = 0; probe < BENCH_MAX_STREAMS; probe++) {
+        bench_stream_t* stream = &streams[(slot + probe) & mask];
+        if (!stream->used) {
+            stream->used = true;
+            stream->ssrc = ssrc;
+            (*activeStreams)++;
+            return stream;
+        }
+        if (stream->ssrc == ssrc) {
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static void enqueuePayload(bench_stream_t* stream, const u8* payload, usize payloadBytes)
+{
+    if (!stream->cbuf) {
+        //Streams may use any packet duration; size the buffer from the first packet
+        stream->blockBytes = payloadBytes;
+        stream->cbuf = cbuf_create_buffer(BENCH_BUFFER_BLOCKS, payloadBytes);
+        if (!stream->cbuf) {
+            panic("Could not allocate jitter buffer for SSRC %X", stream->ssrc);
+        }
+    }
+
+    void* bufferBlock = cbuf_pointer_to_write(stream->cbuf);
+    if (bufferBlock) {
+        memcpy(bufferBlock, payload, MIN(payloadBytes, stream->blockBytes));
+        stream->cbufAccumulated++;
+    }
+
+    //Stand-in for the playout side: keep the buffer at its target occupancy
+    while (stream->cbufAccumulated > BENCH_PLAYOUT_BLOCKS) {
+        void* block = cbuf_pointer_to_read(stream->cbuf);
+        ASSERT(block);
+        (void) block;
+        stream->cbufAccumulated--;
+    }
+}
+
+static void processPacket(bench_stream_t* streams, u32* activeStreams, bench_counters_t* counters,
+    rtp_packet_t* packet, isize size)
+{
+    if (size < (isize)sizeof(rtp_hdr_t)) {
+        counters->invalid++;
+        return;
+    }
+
+    rtp_hdr_t* header = &packet->header;
+    ntohRTP(header);
+    const u8* payload;
+    usize payloadBytes;
+    if (header->version != RTP_VERSION || !rtpPayload(packet, size, &payload, &payloadBytes) || payloadBytes == 0) {
+        counters->invalid++;
+        return;
+    }
+
+    bench_stream_t* stream = findStream(streams, header->ssrc, activeStreams);
+    if (!stream) {
+        counters->invalid++;
+        return;
+    }
+
+    if (stream->packets == 0) {
+        stream->pt = header->pt;
+    } else {
+        i32 seqDifference = seqNumDifference(stream->lastSeq, header->seq);
+        if (seqDifference <= 0) {
+            stream->late++;
+            counters->late++;
+            return;
+        }
+        stream->lost += seqDifference - 1;
+        counters->lost += seqDifference - 1;
+    }
+
+    stream->lastSeq = header->seq;
+    stream->packets++;
+    counters->packets++;
+    counters->bytes += size;
+
+    enqueuePayload(stream, payload, payloadBytes);
+}
+
+//A buffer UDP GRO may have coalesced: datagrams of segmentBytes (0: a single one), the
+//last one shorter. Those not aligned for their header are copied to scratch
+static void processSegments(bench_stream_t* streams, u32* activeStreams, bench_counters_t* counters, u8* buffer,
+    usize size, u32 segmentBytes, rtp_packet_t* scratch)
+{
+    if (segmentBytes == 0 || segmentBytes >= size) {
+        processPacket(streams, activeStreams, counters, (rtp_packet_t*)buffer, size);
+        return;
+    }
+    for (usize offset = 0; offset < size; offset += segmentBytes) {
+        usize bytes = MIN(segmentBytes, size - offset);
+        rtp_packet_t* packet = (rtp_packet_t*)(buffer + offset);
+        if ((uintptr_t)packet % _Alignof(rtp_packet_t) != 0) {
+            memcpy(scratch, packet, bytes);
+            packet = scratch;
+        }
+        counters->coalesced++;
+        processPacket(streams, activeStreams, counters, packet, bytes);
+    }
+}
+
+typedef struct {
+    bench_stream_t* streams;
+    u32* activeStreams;
+    bench_counters_t* counters;
+} bench_receiver_t;
+
+//Only kernel stamps are of our clock
+static void countLatency(bench_counters_t* counters, const arrival_t* arrival)
+{
+    if (arrival->source == ARRIVAL_SOFTWARE) {
+        i64 latencyUs = wallTimeUs() - arrival->ns / 1000;
+        counters->latency[MIN(MAX(latencyUs, 0) / BENCH_LATENCY_BUCKET_US, BENCH_LATENCY_BUCKETS - 1)]++;
+    }
+}
+
+//uring_handler_t: the datagram is in a buffer of the ring, only its payload is copied
+static void processUringDatagram(void* context, void* datagram, usize size, const struct sockaddr_in* from,
+    const arrival_t* arrival)
+{
+    (void) from;
+    bench_receiver_t* receiver = context;
+    countLatency(receiver->counters, arrival);
+    processPacket(receiver->streams, receiver->activeStreams, receiver->counters, datagram, size);
+}
+
+//xdp_handler_t: the packet is in the UMEM frame, only its payload is copied (to the jitter buffer)
+static void processXdpPacket(void* context, rtp_packet_t* packet, usize size)
+{
+    bench_receiver_t* receiver = context;
+    processPacket(receiver->streams, receiver->activeStreams, receiver->counters, packet, size);
+}
+
+//Upper bound of the bucket holding the 99th percentile, 0 without samples
+static i64 latencyP99Us(const bench_counters_t* counters)
+{
+    u64 samples = 0;
+    for (u32 i = 0; i < BENCH_LATENCY_BUCKETS; i++) {
+        samples += counters->latency[i];
+    }
+    u64 below = 0;
+    for (u32 i = 0; i < BENCH_LATENCY_BUCKETS && samples > 0; i++) {
+        below += counters->latency[i];
+        if (below * 100 >= samples * 99) {
+            return (i64)(i + 1) * BENCH_LATENCY_BUCKET_US;
+        }
+    }
+    return 0;
+}
+
+static void addCounters(bench_counters_t* total, const bench_counters_t* delta)
+{
+    total->packets += delta->packets;
+    total->bytes += delta->bytes;
+    total->lost += delta->lost;
+    total->late += delta->late;
+    total->invalid += delta->invalid;
+    total->syscalls += delta->syscalls;
+    total->coalesced += delta->coalesced;
+    for (u32 i = 0; i < BENCH_LATENCY_BUCKETS; i++) {
+        total->latency[i] += delta->latency[i];
+    }
+}
+
+static void printReport(double seconds, bench_counters_t* delta, u32 activeStreams, i64 cpuUs)
+{
+    double cpuShare = cpuUs / (seconds * 1e6);
+    double cpuPerStream = activeStreams > 0 ? cpuUs / (seconds * activeStreams) : 0;
+    printf("streams=%u pkt/s=%.0f Mbit/s=%.2f cpu=%.1f%% cpu/stream=%.1fus/s lost=%lu late=%lu invalid=%lu"
+        " syscalls/pkt=%.2f wakeup-p99=%ldus\n",
+        activeStreams, delta->packets / seconds, delta->bytes * 8 / (seconds * 1e6), cpuShare * 100.0,
+        cpuPerStream, delta->lost, delta->late, delta->invalid,
+        delta->packets > 0 ? (double)delta->syscalls / delta->packets : 0.0, latencyP99Us(delta));
+    fflush(stdout);
+}
+
+int runReceiveBenchmark(int sockId, xdp_socket_t* xdp, bool uring, u32 reportIntervalMs)
+{
+    struct sigaction sigInfo = {
+        .sa_handler = benchSignalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if ((sigaction(SIGINT, &sigInfo, NULL)) < 0) {
+        panic("Error installing signal.");
+    }
+
+    bench_stream_t* streams = calloc(BENCH_MAX_STREAMS, sizeof(bench_stream_t));
+    rtp_packet_t* packet = malloc(MAX_DATAGRAM_SIZE);
+    //Without the ring recvmsg() takes up to SOCKET_MAX_SEGMENTS datagrams at once
+    bool gro = !uring && socketEnableGro(sockId);
+    usize receiveBytes = gro ? SOCKET_GRO_BUFFER_BYTES : MAX_DATAGRAM_SIZE;
+    u8* receiveBuffer = malloc(receiveBytes);
+    if (!streams || !packet || !receiveBuffer) {
+        panic("Could not allocate benchmark state");
+    }
+
+    u32 activeStreams = 0;
+    bench_counters_t total = {}, interval = {};
+    i64 startWall = wallTimeUs(), startCpu = cpuTimeUs();
+    i64 lastWall = startWall, lastCpu = startCpu;
+    i64 reportUs = (i64)reportIntervalMs * 1000;
+
+    bench_receiver_t receiver = { .streams = streams, .activeStreams = &activeStreams, .counters = &interval };
+    int maxSockId = xdp ? MAX(sockId, xdp->sockId) : sockId;
+    uring_t ring;
+    if (uring && !uringOpen(&ring, sockId, -1, BENCH_URING_DATAGRAM_BYTES, BENCH_URING_BUFFERS, processUringDatagram,
+        &receiver))
+    {
+        fprintf(stderr, "WARNING: io_uring not available, receiving with select().\n");
+        uring = false;
+    }
+
+    printf("Receive benchmark started%s, Ctrl+C to stop.\n", xdp ? " (AF_XDP)" : uring ? " (io_uring)" : "");
+
+    while (!benchStopRequested) {
+        i64 now = wallTimeUs();
+        i64 untilReport = MAX(lastWall + reportUs - now, 0);
+        if (uring) {
+            //The datagrams are handled inside the wait, one system call for all of them
+            uring_events_t events;
+            u64 enters = ring.enters;
+            uringWait(&ring, false, untilReport, &events);
+            interval.syscalls += ring.enters - enters;
+        } else {
+            struct timeval timeout = {
+                .tv_sec = untilReport / 1000000,
+                .tv_usec = untilReport % 1000000,
+            };
+
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            FD_SET(sockId, &readSet);
+            if (xdp) {
+                FD_SET(xdp->sockId, &readSet);
+            }
+
+            int res = select(maxSockId + 1, &readSet, NULL, NULL, &timeout);
+            if (res < 0) {
+                if (errno == EINTR) continue;
+                panic("select() error!");
+            }
+            interval.syscalls++;
+
+            if (res > 0 && FD_ISSET(sockId, &readSet)) {
+                arrival_t arrival;
+                isize result = arrivalReceive(sockId, receiveBuffer, receiveBytes, NULL, &arrival);
+                if (result < 0) {
+                    panic("recvfrom error");
+                }
+                interval.syscalls++;
+                countLatency(&interval, &arrival);
+                processSegments(streams, &activeStreams, &interval, receiveBuffer, result, arrival.segmentBytes,
+                    packet);
+            }
+            //Whole batches while there are frames: no system call for them
+            if (res > 0 && xdp && FD_ISSET(xdp->sockId, &readSet)) {
+                while (xdpReceive(xdp, processXdpPacket, &receiver) == XDP_BATCH && !benchStopRequested);
+            }
+        }
+
+        now = wallTimeUs();
+        if (now - lastWall >= reportUs) {
+            i64 cpu = cpuTimeUs();
+            printReport((now - lastWall) / 1e6, &interval, activeStreams, cpu - lastCpu);
+
+            addCounters(&total, &interval);
+            interval = (bench_counters_t) {};
+            lastWall = now;
+            lastCpu = cpu;
+        }
+    }
+
+    addCounters(&total, &interval);
+
+    double seconds = (wallTimeUs() - startWall) / 1e6;
+    printf("\nInterrupted audioc benchmark\n");
+    printf("Total: ");
+    printReport(seconds, &total, activeStreams, cpuTimeUs() - startCpu);
+    if (xdp) {
+        printf("AF_XDP frames: %lu, not for us: %lu, dropped by the kernel: %lu\n", xdp->frames, xdp->foreign,
+            xdpDropped(xdp));
+    }
+    if (gro) {
+        printf("UDP GRO: %lu datagrams came coalesced with others\n", total.coalesced);
+    }
+    if (uring) {
+        uringPrint(&ring);
+        uringClose(&ring);
+    }
+
+    for (u32 i = 0; i < BENCH_MAX_STREAMS; i++) {
+        bench_stream_t* stream = &streams[i];
+        if (!stream->used) continue;
+        trace("SSRC %X (%s): %lu packets, %lu lost, %lu late, %lu bytes/packet", stream->ssrc,
+            payloadToStr(stream->pt), stream->packets, stream->lost, stream->late, stream->blockBytes);
+        if (stream->cbuf) {
+            cbuf_destroy_buffer(stream->cbuf);
+        }
+    }
+
+    free(packet);
+    free(receiveBuffer);
+    free(streams);
+    return 0;
+}
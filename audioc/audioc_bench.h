@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_xdp.h"
+
+//Maximum number of concurrent SSRCs tracked by the receive benchmark
+#define BENCH_MAX_STREAMS 16384
+
+//Receive-only benchmark (--bench). Every RTP packet arriving at sockId goes through
+//the same path a normal session uses (select, recvmsg, ntohRTP, header validation,
+//sequence analysis and jitter buffer enqueue/dequeue), but with one jitter buffer per
+//SSRC and no sound card. Prints packets/s, CPU time per stream, drops, system calls per
+//packet and the 99th percentile of the wakeup latency (kernel stamp to handling, sockId
+//needs arrivalEnable()) every reportIntervalMs, and a summary on SIGINT. With xdp, the
+//packets it receives (parsed in place in its frames) go through the same path as those
+//of sockId, which still gets the rest. With uring, an io_uring (audioc_uring.h) takes the
+//place of select and recvmsg; without it sockId gets UDP GRO (audioc_socket.h) and each
+//recvmsg may bring many datagrams. Returns the process exit code.
+int runReceiveBenchmark(int sockId, xdp_socket_t* xdp, bool uring, u32 reportIntervalMs);
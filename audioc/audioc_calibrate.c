@@ -0,0 +1,168 @@
+#include "audioc_calibrate.h"
+#include "audioc_profile.h"
+#include "audioc_playout.h"
+#include "audioc_rtp.h"
+#include "../lib/configureSndcard.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/soundcard.h>
+
+#define CALIBRATION_RATE 8000
+#define CALIBRATION_MIN_FRAGMENT 64
+#define CALIBRATION_MAX_FRAGMENT 1024
+#define CALIBRATION_WAKEUPS 100  //select() wakeups measured for each fragment size
+#define CALIBRATION_POLL_US 200
+
+static int queryDelay(int sndCardFD)
+{
+    int bytesInCard;
+    if (ioctl(sndCardFD, SNDCTL_DSP_GETODELAY, &bytesInCard) < 0) {
+        panic("Error calling ioctl SNDCTL_DSP_GETODELAY");
+    }
+    return bytesInCard;
+}
+
+static void writeFragment(int sndCardFD, const u8* fragment, usize bytes)
+{
+    isize written = write(sndCardFD, fragment, bytes);
+    if (written != (isize)bytes) {
+        panic("Error writing %lu bytes to the sound card", bytes);
+    }
+}
+
+static int compareI64(const void* a, const void* b)
+{
+    i64 x = *(const i64*)a, y = *(const i64*)b;
+    return (x > y) - (x < y);
+}
+
+static i64 percentile99(i64* values, usize count)
+{
+    qsort(values, count, sizeof(i64), compareI64);
+    return values[(count * 99) / 100];
+}
+
+//Writes a fragment to the idle card and polls GETODELAY until it is played. Returns how
+//long it took and the smallest change seen in the reported delay
+static i64 measureDrain(int sndCardFD, const u8* fragment, usize bytes, u32* outStepBytes)
+{
+    i64 start = playoutNowUs();
+    writeFragment(sndCardFD, fragment, bytes);
+
+    int lastDelay = queryDelay(sndCardFD);
+    u32 step = 0;
+    i64 now = start;
+    //Give up after a second, GETODELAY may not work at all
+    while (lastDelay > 0 && now - start < 1000000) {
+        usleep(CALIBRATION_POLL_US);
+        now = playoutNowUs();
+        int delay = queryDelay(sndCardFD);
+        if (delay < lastDelay) {
+            u32 change = lastDelay - delay;
+            step = step == 0 ? change : MIN(step, change);
+        }
+        lastDelay = delay;
+    }
+
+    *outStepBytes = step;
+    return now - start;
+}
+
+//99th percentile of the lateness of select() wakeups, both for plain timeouts and for a
+//card kept full (it should wake us up once per fragment)
+static i64 measureWakeupJitter(int sndCardFD, const u8* fragment, usize bytes, i64 fragmentUs)
+{
+    i64 lateness[2 * CALIBRATION_WAKEUPS];
+    usize count = 0;
+
+    for (u32 i = 0; i < CALIBRATION_WAKEUPS; i++) {
+        i64 requested = fragmentUs / 2;
+        struct timeval timeout = { .tv_sec = requested / 1000000, .tv_usec = requested % 1000000 };
+        i64 start = playoutNowUs();
+        if (select(0, NULL, NULL, NULL, &timeout) < 0 && errno != EINTR) {
+            panic("select() error!");
+        }
+        lateness[count++] = MAX(playoutNowUs() - start - requested, 0);
+    }
+
+    //Fill the card, then every wakeup should come one fragment after the previous one
+    i64 last = 0;
+    for (u32 i = 0; count < ARRAY_COUNT(lateness); i++) {
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(sndCardFD, &writeSet);
+        if (select(sndCardFD + 1, NULL, &writeSet, NULL, NULL) < 0) {
+            if (errno == EINTR) continue;
+            panic("select() error!");
+        }
+        i64 now = playoutNowUs();
+        writeFragment(sndCardFD, fragment, bytes);
+
+        //The first writes do not block until the card is full
+        if (last > 0 && now - last > fragmentUs / 2) {
+            lateness[count++] = MAX(now - last - fragmentUs, 0);
+        }
+        last = now;
+        if (i > 100 * CALIBRATION_WAKEUPS) {
+            //Never blocked: the card does not pace the writes
+            break;
+        }
+    }
+
+    return percentile99(lateness, count);
+}
+
+int runCalibration(enum payload payload, const char* profilePath)
+{
+    int format = payload == L16_1 ? AFMT_S16_BE : AFMT_MU_LAW;
+    int bytesPerSample = payload == L16_1 ? 2 : 1;
+
+    sndcard_profile_t profile;
+    if (profileLoad(profilePath, &profile)) {
+        printf("Updating sound card profile %s (%u entries)\n", profilePath, profile.count);
+    }
+
+    printf("fragment_bytes,output_latency_us,odelay_step_bytes,wakeup_jitter_us\n");
+    for (int fragmentBytes = CALIBRATION_MIN_FRAGMENT; fragmentBytes <= CALIBRATION_MAX_FRAGMENT; fragmentBytes *= 2) {
+        int sndCardFD = -1;
+        int cardFormat = format, channelNumber = 1, rate = CALIBRATION_RATE, obtainedFragment = fragmentBytes;
+        //Same configuration as a session: duplex
+        configSndcard(&sndCardFD, &cardFormat, &channelNumber, &rate, &obtainedFragment, true);
+
+        u32 bytesPerSecond = rate * channelNumber * bytesPerSample;
+        i64 fragmentUs = (i64)obtainedFragment * 1000000 / bytesPerSecond;
+        u8* fragment = malloc(obtainedFragment);
+        if (!fragment) {
+            panic("Could not allocate calibration buffer");
+        }
+        fillSilence(fragment, obtainedFragment, payload);
+
+        sndcard_calibration_t calibration = {
+            .format = cardFormat,
+            .fragmentBytes = obtainedFragment,
+        };
+        calibration.outputLatencyUs = measureDrain(sndCardFD, fragment, obtainedFragment, &calibration.odelayStepBytes);
+        calibration.wakeupJitterUs = measureWakeupJitter(sndCardFD, fragment, obtainedFragment, fragmentUs);
+
+        printf("%u,%u,%u,%u\n", calibration.fragmentBytes, calibration.outputLatencyUs,
+            calibration.odelayStepBytes, calibration.wakeupJitterUs);
+        if (calibration.odelayStepBytes == 0) {
+            fprintf(stderr, "WARNING: SNDCTL_DSP_GETODELAY does not seem to work with %d byte fragments.\n", obtainedFragment);
+        }
+        profileSet(&profile, &calibration);
+
+        free(fragment);
+        close(sndCardFD);
+    }
+
+    if (!profileSave(profilePath, &profile)) {
+        printError("Could not write sound card profile %s", profilePath);
+        return 1;
+    }
+    printf("Sound card profile written to %s\n", profilePath);
+    return 0;
+}
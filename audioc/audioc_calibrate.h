@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+#include "audiocArgs.h"
+
+//Calibration mode (--calibrate), the automated version of utilities/test_getodelay.c and
+//utilities/test_select_sndcard_timing.c. For every fragment size audioc may use with the
+//given payload, it opens the sound card and measures the output latency, the granularity
+//of the SNDCTL_DSP_GETODELAY updates and how late select() wakes up. The results are
+//stored in the profile at profilePath, replacing older ones for the same configuration.
+//Returns the process exit code.
+int runCalibration(enum payload payload, const char* profilePath);
@@ -0,0 +1,106 @@
+#include "audioc_capture.h"
+#include "audioc_arena.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/soundcard.h>
+
+bool captureInit(capture_t* capture, int sndCardFD, usize blockBytes)
+{
+    *capture = (capture_t) {
+        .sndCardFD = sndCardFD,
+        .blockBytes = blockBytes,
+        .useIptr = true,
+    };
+
+    int flags = fcntl(sndCardFD, F_GETFL);
+    if (flags < 0 || fcntl(sndCardFD, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    capture->block = arenaAlloc(blockBytes);
+    return capture->block != NULL;
+}
+
+void captureDestroy(capture_t* capture)
+{
+    arenaFree(capture->block);
+    capture->block = NULL;
+}
+
+//Card position of the next byte to be read: captured so far minus still waiting to be read
+static bool queryCardPosition(capture_t* capture, u64* outPosition)
+{
+    count_info info;
+    audio_buf_info space;
+    if (ioctl(capture->sndCardFD, SNDCTL_DSP_GETIPTR, &info) != 0
+        || ioctl(capture->sndCardFD, SNDCTL_DSP_GETISPACE, &space) != 0) {
+        return false;
+    }
+
+    capture->iptrPosition += (u32)info.bytes - capture->lastIptrBytes;
+    capture->lastIptrBytes = (u32)info.bytes;
+    *outPosition = capture->iptrPosition - MIN((u64)MAX(space.bytes, 0), capture->iptrPosition);
+    return true;
+}
+
+//Samples the card dropped since the last block
+static u64 overrunBytes(capture_t* capture)
+{
+    if (!capture->useIptr) {
+        return 0;
+    }
+
+    u64 cardPosition;
+    if (!queryCardPosition(capture, &cardPosition)) {
+        capture->useIptr = false;
+        return 0;
+    }
+
+    if (!capture->anchored) {
+        //Whatever the card captured before our first read is not part of the stream
+        capture->anchored = true;
+        capture->iptrOffset = cardPosition - capture->readBytes;
+        return 0;
+    }
+
+    u64 expected = capture->iptrOffset + capture->readBytes + capture->droppedBytes;
+    if (cardPosition <= expected) {
+        return 0;
+    }
+    //Whole blocks only: the card drops fragments, anything else is counter jitter
+    u64 dropped = cardPosition - expected;
+    return dropped - dropped % capture->blockBytes;
+}
+
+bool captureRead(capture_t* capture)
+{
+    if (capture->fill == capture->blockBytes) {
+        //The previous block was handed out
+        capture->position += capture->blockBytes;
+        capture->fill = 0;
+    }
+
+    isize result = read(capture->sndCardFD, capture->block + capture->fill, capture->blockBytes - capture->fill);
+    if (result < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return false;
+        }
+        panic("Error reading %lu bytes from sound card file", capture->blockBytes - capture->fill);
+    }
+
+    capture->fill += result;
+    capture->readBytes += result;
+    if (capture->fill < capture->blockBytes) {
+        capture->partialReads++;
+        return false;
+    }
+
+    u64 dropped = overrunBytes(capture);
+    capture->droppedBytes += dropped;
+    //The samples lost were captured before the ones in this block
+    capture->position += dropped;
+    return true;
+}
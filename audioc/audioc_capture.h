@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+
+//Non-blocking capture from the sound card.
+//The device is switched to O_NONBLOCK and every read takes whatever the card has, up to
+//the end of a staging block, so a short read never stops the event loop (or the
+//process). A block is handed out only once it is complete.
+//Each block carries its capture position: the number of bytes the card had captured
+//before its first byte. It normally advances by one block each time, but if the card
+//dropped samples because we did not read in time (overrun, seen through
+//SNDCTL_DSP_GETIPTR) the position jumps over them, so timestamps derived from it stay
+//aligned with the audio instead of with a packet counter.
+
+typedef struct {
+    int sndCardFD;
+    u8* block;              //Staging block
+    usize blockBytes;
+    usize fill;
+    u64 position;           //Capture position of block[0]
+    u64 readBytes;          //Bytes read since the start
+
+    bool useIptr;
+    bool anchored;
+    u32 lastIptrBytes;      //GETIPTR counter wraps, positions are accumulated from it
+    u64 iptrPosition;
+    u64 iptrOffset;         //Card position of the first byte we read
+    u64 droppedBytes;       //Lost in overruns
+
+    u64 partialReads;       //Reads that did not complete the block
+} capture_t;
+
+//Returns false if the device cannot be made non-blocking or the block cannot be allocated
+bool captureInit(capture_t* capture, int sndCardFD, usize blockBytes);
+void captureDestroy(capture_t* capture);
+
+//To be called when the card is readable. Returns true when capture->block is complete,
+//its capture position in capture->position. The block stays valid until the next call
+bool captureRead(capture_t* capture);
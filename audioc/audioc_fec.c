@@ -0,0 +1,202 @@
+#include "audioc_fec.h"
+
+#include <arpa/inet.h>
+
+typedef u8 fec_vec_t __attribute__((vector_size(16)));
+
+void fecXor(u8* dst, const u8* src, usize bytes)
+{
+    usize i = 0;
+    //memcpy keeps the loads and stores legal for unaligned buffers, it compiles to movdqu
+    for (; i + sizeof(fec_vec_t) <= bytes; i += sizeof(fec_vec_t)) {
+        fec_vec_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < bytes; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+/*
+ * Sender
+ */
+
+bool fecEncoderInit(fec_encoder_t* enc, u32 groupSize, usize maxPayloadBytes, u16 firstSeq, const allocator_t* allocator)
+{
+    ASSERT(groupSize >= 2 && groupSize <= FEC_MAX_GROUP);
+    *enc = (fec_encoder_t) {
+        .groupSize = groupSize,
+        .seq = firstSeq,
+        .maxPayloadBytes = maxPayloadBytes,
+        .allocator = allocator,
+    };
+    enc->parity = allocatorCalloc(allocator, 1, maxPayloadBytes);
+    return enc->parity != NULL;
+}
+
+void fecEncoderDestroy(fec_encoder_t* enc)
+{
+    allocatorFree(enc->allocator, enc->parity);
+    enc->parity = NULL;
+}
+
+usize fecEncoderAdd(fec_encoder_t* enc, const rtp_hdr_t* header, const u8* payload, usize payloadBytes, rtp_packet_t* outPacket)
+{
+    ASSERT(payloadBytes <= enc->maxPayloadBytes);
+    if (enc->count == 0) {
+        enc->snBase = header->seq;
+        enc->recoveryBits[0] = enc->recoveryBits[1] = 0;
+        enc->tsRecovery = 0;
+        enc->lengthRecovery = 0;
+        enc->protectionLength = 0;
+        memset(enc->parity, 0, enc->maxPayloadBytes);
+    }
+
+    enc->recoveryBits[0] ^= (header->p << 5) | (header->x << 4) | header->cc;
+    enc->recoveryBits[1] ^= (header->m << 7) | header->pt;
+    enc->tsRecovery ^= header->ts;
+    enc->lengthRecovery ^= (u16)payloadBytes;
+    enc->protectionLength = MAX(enc->protectionLength, (u16)payloadBytes);
+    fecXor(enc->parity, payload, payloadBytes);
+
+    if (++enc->count < enc->groupSize) {
+        return 0;
+    }
+    enc->count = 0;
+
+    outPacket->header = (rtp_hdr_t) {
+        .version = RTP_VERSION,
+        .pt = FEC_PAYLOAD_TYPE,
+        .seq = enc->seq++,
+        .ts = header->ts,
+    };
+
+    u8* fec = outPacket->payload;
+    fec[0] = enc->recoveryBits[0]; //E = 0, L = 0 (short mask)
+    fec[1] = enc->recoveryBits[1];
+    writeU16(fec + 2, enc->snBase);
+    writeU32(fec + 4, enc->tsRecovery);
+    writeU16(fec + 8, enc->lengthRecovery);
+
+    //Level 0 header: protection length and mask, MSB is snBase + 0
+    u8* level = fec + FEC_HEADER_SIZE;
+    writeU16(level, enc->protectionLength);
+    writeU16(level + 2, (u16)(0xFFFF << (FEC_MAX_GROUP - enc->groupSize)));
+
+    memcpy(level + FEC_LEVEL_HEADER_SIZE, enc->parity, enc->protectionLength);
+    return sizeof(rtp_hdr_t) + FEC_OVERHEAD + enc->protectionLength;
+}
+
+/*
+ * Receiver
+ */
+
+bool fecDecoderInit(fec_decoder_t* dec, usize maxPayloadBytes, const allocator_t* allocator)
+{
+    *dec = (fec_decoder_t) { .maxPayloadBytes = maxPayloadBytes, .allocator = allocator };
+    dec->storage = allocatorAlloc(allocator, FEC_STORE_SIZE * maxPayloadBytes);
+    if (!dec->storage) {
+        return false;
+    }
+    for (usize i = 0; i < FEC_STORE_SIZE; i++) {
+        dec->store[i].payload = dec->storage + i * maxPayloadBytes;
+    }
+    return true;
+}
+
+void fecDecoderDestroy(fec_decoder_t* dec)
+{
+    allocatorFree(dec->allocator, dec->storage);
+    dec->storage = NULL;
+}
+
+void fecDecoderStore(fec_decoder_t* dec, const rtp_hdr_t* header, const u8* payload, usize payloadBytes)
+{
+    fec_stored_packet_t* stored = &dec->store[header->seq % FEC_STORE_SIZE];
+    usize length = payloadBytes;
+    //Too long to be protected: forget whatever was in its place
+    stored->valid = payloadBytes <= dec->maxPayloadBytes;
+    if (!stored->valid) {
+        return;
+    }
+    stored->seq = header->seq;
+    stored->ts = header->ts;
+    stored->pt = header->pt;
+    stored->marker = header->m;
+    stored->length = (u16)length;
+    memcpy(stored->payload, payload, length);
+}
+
+isize fecDecoderRecover(fec_decoder_t* dec, const rtp_packet_t* fecPacket, usize packetSize, rtp_hdr_t* outHeader, u8* outPayload)
+{
+    if (packetSize < sizeof(rtp_hdr_t) + FEC_OVERHEAD) {
+        return -1;
+    }
+    const u8* fec = fecPacket->payload;
+    const u8* level = fec + FEC_HEADER_SIZE;
+    const u8* parity = level + FEC_LEVEL_HEADER_SIZE;
+
+    if (fec[0] & 0xC0) {
+        //Extension (E) or long mask (L) not supported
+        return -1;
+    }
+    u16 snBase = readU16(fec + 2);
+    u16 protectionLength = readU16(level);
+    u16 mask = readU16(level + 2);
+    if (protectionLength > dec->maxPayloadBytes
+        || protectionLength > packetSize - sizeof(rtp_hdr_t) - FEC_OVERHEAD) {
+        return -1;
+    }
+
+    //Find the single missing packet of the group
+    i32 missing = -1;
+    for (u32 i = 0; i < FEC_MAX_GROUP; i++) {
+        if (!(mask & (0x8000 >> i))) continue;
+        u16 seq = snBase + i;
+        fec_stored_packet_t* stored = &dec->store[seq % FEC_STORE_SIZE];
+        if (!stored->valid || stored->seq != seq) {
+            if (missing >= 0) {
+                return -1; //More than one lost, XOR parity cannot help
+            }
+            missing = i;
+        }
+    }
+    if (missing < 0) {
+        return -1;
+    }
+
+    u8 bits0 = fec[0], bits1 = fec[1];
+    u32 ts = readU32(fec + 4);
+    u16 length = readU16(fec + 8);
+    memcpy(outPayload, parity, protectionLength);
+
+    for (u32 i = 0; i < FEC_MAX_GROUP; i++) {
+        if (!(mask & (0x8000 >> i)) || (i32)i == missing) continue;
+        fec_stored_packet_t* stored = &dec->store[(u16)(snBase + i) % FEC_STORE_SIZE];
+        bits1 ^= (stored->marker << 7) | stored->pt;
+        ts ^= stored->ts;
+        length ^= stored->length;
+        fecXor(outPayload, stored->payload, MIN(stored->length, protectionLength));
+    }
+
+    if (length > protectionLength) {
+        return -1;
+    }
+
+    *outHeader = (rtp_hdr_t) {
+        .version = RTP_VERSION,
+        .p = (bits0 >> 5) & 1,
+        .x = (bits0 >> 4) & 1,
+        .cc = bits0 & 0x0F,
+        .m = bits1 >> 7,
+        .pt = bits1 & 0x7F,
+        .seq = snBase + missing,
+        .ts = ts,
+        .ssrc = fecPacket->header.ssrc,
+    };
+    fecDecoderStore(dec, outHeader, outPayload, length);
+    return length;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+#include "audioc_allocator.h"
+
+//Forward error correction with XOR parity, RFC 5109 (level 0, short mask).
+//After every group of k media packets the sender emits one FEC packet with the media
+//SSRC, payload type FEC_PAYLOAD_TYPE and a sequence number space of its own. The
+//receiver can rebuild any single packet lost in a group.
+
+#define FEC_PAYLOAD_TYPE 127     //Dynamic payload type for the FEC packets
+#define FEC_MAX_GROUP 16         //Short mask (L=0) protects up to 16 packets
+#define FEC_HEADER_SIZE 10
+#define FEC_LEVEL_HEADER_SIZE 4  //Protection length + short mask
+#define FEC_OVERHEAD (FEC_HEADER_SIZE + FEC_LEVEL_HEADER_SIZE)
+#define FEC_STORE_SIZE 64        //Received media packets kept for recovery, power of 2
+
+typedef struct {
+    u32 groupSize;
+    u32 count;            //Packets already in the current group
+    u16 snBase;
+    u16 seq;              //Sequence number of the next FEC packet
+    u8 recoveryBits[2];   //P, X, CC, M and PT recovery fields
+    u32 tsRecovery;
+    u16 lengthRecovery;
+    u16 protectionLength;
+    u8* parity;           //XOR of the payloads of the group
+    usize maxPayloadBytes;
+    const allocator_t* allocator;
+} fec_encoder_t;
+
+typedef struct {
+    bool valid;
+    u16 seq;
+    u32 ts;
+    u8 pt;
+    bool marker;
+    u16 length;
+    u8* payload;
+} fec_stored_packet_t;
+
+typedef struct {
+    fec_stored_packet_t store[FEC_STORE_SIZE];
+    u8* storage;
+    usize maxPayloadBytes;
+    const allocator_t* allocator;
+} fec_decoder_t;
+
+//XOR of src into dst, 16 bytes per operation
+void fecXor(u8* dst, const u8* src, usize bytes);
+
+//firstSeq is that of the first FEC packet, picked by the caller (at random, as RFC 3550
+//asks). Return false if memory could not be allocated
+bool fecEncoderInit(fec_encoder_t* enc, u32 groupSize, usize maxPayloadBytes, u16 firstSeq, const allocator_t* allocator);
+void fecEncoderDestroy(fec_encoder_t* enc);
+
+//Adds a sent media packet (header in host order) to the current group. When the group is
+//complete, writes the FEC packet into outPacket (RTP header in host order, to be converted
+//with htonRTP before sending; ssrc is left for the caller) and returns its total size.
+//Returns 0 otherwise. outPacket must hold sizeof(rtp_hdr_t) + FEC_OVERHEAD + maxPayloadBytes.
+usize fecEncoderAdd(fec_encoder_t* enc, const rtp_hdr_t* header, const u8* payload, usize payloadBytes, rtp_packet_t* outPacket);
+
+bool fecDecoderInit(fec_decoder_t* dec, usize maxPayloadBytes, const allocator_t* allocator);
+void fecDecoderDestroy(fec_decoder_t* dec);
+
+//Keeps a copy of a received media packet (header in host order) for later recoveries
+void fecDecoderStore(fec_decoder_t* dec, const rtp_hdr_t* header, const u8* payload, usize payloadBytes);
+
+//Processes a received FEC packet (RTP header in host order). If exactly one of the packets
+//it protects is missing, rebuilds it: header fields in *outHeader and payload in outPayload
+//(maxPayloadBytes long). Returns the recovered payload length, or -1 if nothing was recovered.
+isize fecDecoderRecover(fec_decoder_t* dec, const rtp_packet_t* fecPacket, usize packetSize, rtp_hdr_t* outHeader, u8* outPayload);
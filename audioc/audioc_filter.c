@@ -0,0 +1,79 @@
+#include "audioc_filter.h"
+
+#include <sys/socket.h>
+
+//A UDP socket filter sees the datagram from the UDP header on
+#define FILTER_RTP_OFFSET 8
+#define FILTER_ACCEPT 0xFFFFFFFF
+#define FILTER_DROP 0
+
+usize filterBuild(const filter_params_t* params, struct sock_filter* program)
+{
+    ASSERT(params->ptCount <= FILTER_MAX_PTS && params->ssrcCount <= FILTER_MAX_SSRCS);
+    usize n = 0;
+    //Jump offsets are relative to the next instruction, and are only known once the
+    //program is complete: they are filled in with the position of the final returns
+    usize dropJumps[1], acceptJumps[FILTER_MAX_SSRCS];
+    usize drops = 0, accepts = 0;
+    usize rtcpJump = 0;
+
+    //Version 2. A load past the end of the datagram drops it: it is shorter than a header
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, FILTER_RTP_OFFSET);
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xC0);
+    dropJumps[drops++] = n;
+    program[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x80, 0, 0);
+
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, FILTER_RTP_OFFSET + 1);
+    if (params->rtcp) {
+        //Marker bit and payload type together: 192-223 is RTCP, the rest goes on to the payload types
+        program[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 192, 0, 1);
+        rtcpJump = n;
+        program[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 223, 0, 0);
+    }
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x7F);
+    for (u32 i = 0; i < params->ptCount; i++) {
+        //Found: on to the SSRC check, after the last comparison and the drop following it
+        program[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, params->pts[i], params->ptCount - i, 0);
+    }
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, FILTER_DROP);
+
+    if (params->ssrcCount > 0) {
+        program[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, FILTER_RTP_OFFSET + 8);
+        for (u32 i = 0; i < params->ssrcCount; i++) {
+            acceptJumps[accepts++] = n;
+            program[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, params->ssrcs[i], 0, 0);
+        }
+        program[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, FILTER_DROP);
+    }
+
+    usize accept = n;
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, FILTER_ACCEPT);
+    usize drop = n;
+    program[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, FILTER_DROP);
+
+    //Version check: false goes to the drop; SSRCs: true goes to the accept
+    for (usize i = 0; i < drops; i++) {
+        program[dropJumps[i]].jf = drop - dropJumps[i] - 1;
+    }
+    for (usize i = 0; i < accepts; i++) {
+        program[acceptJumps[i]].jt = accept - acceptJumps[i] - 1;
+    }
+    if (params->rtcp) {
+        program[rtcpJump].jf = accept - rtcpJump - 1;
+    }
+    ASSERT(n <= FILTER_MAX_INSTRUCTIONS);
+    return n;
+}
+
+usize filterAttach(int sockId, const filter_params_t* params)
+{
+    struct sock_filter program[FILTER_MAX_INSTRUCTIONS];
+    struct sock_fprog filter = {
+        .len = filterBuild(params, program),
+        .filter = program,
+    };
+    if (setsockopt(sockId, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) != 0) {
+        return 0;
+    }
+    return filter.len;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.h"
+
+#include <linux/filter.h>
+
+//Kernel side packet filter (--filter): a classic BPF program attached to a UDP socket
+//with SO_ATTACH_FILTER, so datagrams we would drop anyway are dropped before they wake
+//us up or are copied to user space. It accepts RTP version 2 with one of the payload
+//types given (and, with an allow-list, only from those SSRCs), and optionally RTCP
+//(packet types 192-223, RFC 5761), which carries no SSRC to filter on at the same place.
+
+#define FILTER_MAX_PTS 8
+#define FILTER_MAX_SSRCS 16
+#define FILTER_MAX_INSTRUCTIONS (8 + FILTER_MAX_PTS + FILTER_MAX_SSRCS)
+
+typedef struct {
+    u8 pts[FILTER_MAX_PTS];
+    u32 ptCount;
+    u32 ssrcs[FILTER_MAX_SSRCS]; //Empty: any SSRC
+    u32 ssrcCount;
+    bool rtcp;
+} filter_params_t;
+
+//Writes the program into program (room for FILTER_MAX_INSTRUCTIONS). Returns the number
+//of instructions
+usize filterBuild(const filter_params_t* params, struct sock_filter* program);
+
+//Returns the number of instructions attached, 0 if the kernel refused the filter (errno is set)
+usize filterAttach(int sockId, const filter_params_t* params);
@@ -0,0 +1,310 @@
+#include "audioc_gateway.h"
+#include "audioc_nack.h"
+#include "audioc_arena.h"
+#include "audioc_playout.h"
+#include "g711.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+
+#define GATEWAY_EXPIRE_INTERVAL_US 10000000
+
+static volatile sig_atomic_t gatewayStopRequested = 0;
+
+static void gatewaySignalHandler(int sigNum)
+{
+    (void) sigNum;
+    gatewayStopRequested = 1;
+}
+
+static u16 readL16(const u8* p)
+{
+    return (u16)((p[0] << 8) | p[1]);
+}
+
+static void writeL16(u8* p, u16 sample)
+{
+    p[0] = sample >> 8;
+    p[1] = sample & 0xFF;
+}
+
+//8000 -> 16000 Hz: every input sample is preceded by its midpoint with the previous one
+static void upsample2(const u8* in, u8* out, usize samples, u16* lastSample)
+{
+    i32 previous = (i16)*lastSample;
+    for (usize i = 0; i < samples; i++) {
+        i32 sample = (i16)readL16(in + 2 * i);
+        writeL16(out + 4 * i, (u16)((previous + sample) >> 1));
+        writeL16(out + 4 * i + 2, (u16)sample);
+        previous = sample;
+    }
+    *lastSample = (u16)previous;
+}
+
+//16000 -> 8000 Hz: the average of each pair, a (weak) low pass before dropping every other sample
+static void downsample2(const u8* in, u8* out, usize outSamples)
+{
+    for (usize i = 0; i < outSamples; i++) {
+        i32 a = (i16)readL16(in + 4 * i);
+        i32 b = (i16)readL16(in + 4 * i + 2);
+        writeL16(out + 2 * i, (u16)((a + b) >> 1));
+    }
+}
+
+bool gatewayInit(gateway_t* gateway, gateway_side_t side0, gateway_side_t side1)
+{
+    if (side0.pt == side1.pt || (side0.pt == PCMU && side0.rate != 8000) || (side1.pt == PCMU && side1.rate != 8000)) {
+        return false;
+    }
+    *gateway = (gateway_t) {
+        .sides = { side0, side1 },
+        .streams = arenaCalloc(GATEWAY_MAX_STREAMS, sizeof(gateway_stream_t)),
+        .spareStreams = arenaCalloc(GATEWAY_MAX_STREAMS, sizeof(gateway_stream_t)),
+        .scratch = arenaAlloc(2 * GATEWAY_MAX_SAMPLES),
+    };
+    return gateway->streams && gateway->spareStreams && gateway->scratch;
+}
+
+void gatewayDestroy(gateway_t* gateway)
+{
+    arenaFree(gateway->streams);
+    arenaFree(gateway->spareStreams);
+    arenaFree(gateway->scratch);
+    gateway->streams = gateway->spareStreams = NULL;
+    gateway->scratch = NULL;
+}
+
+static u32 streamSlot(u32 side, u32 ssrc)
+{
+    return ((ssrc ^ side) * 2654435761u) & (GATEWAY_MAX_STREAMS - 1);
+}
+
+//Open addressing, linear probing. Returns NULL when the table is full
+static gateway_stream_t* findStream(gateway_t* gateway, u32 side, u32 ssrc, const rtp_hdr_t* header)
+{
+    u32 mask = GATEWAY_MAX_STREAMS - 1;
+    u32 slot = streamSlot(side, ssrc);
+    for (u32 probe = 0; probe < GATEWAY_MAX_STREAMS; probe++) {
+        gateway_stream_t* stream = &gateway->streams[(slot + probe) & mask];
+        if (!stream->used) {
+            *stream = (gateway_stream_t) {
+                .used = true,
+                .side = side,
+                .inSsrc = ssrc,
+                .outSsrc = ((u32)rand() << 16) ^ (u32)rand(),
+                .seqOffset = (u16)rand(),
+                .lastInTs = header->ts,
+                .lastOutTs = ((u32)rand() << 16) ^ (u32)rand(),
+            };
+            gateway->activeStreams++;
+            trace("New stream %X on side %u, sent as %X", ssrc, side, stream->outSsrc);
+            return stream;
+        }
+        if (stream->inSsrc == ssrc && stream->side == side) {
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+//Converts the payload, returns the bytes written to out (0 if it does not fit)
+static usize transcode(gateway_t* gateway, const gateway_side_t* from, const gateway_side_t* to,
+    gateway_stream_t* stream, const u8* in, usize bytes, u8* out)
+{
+    if (from->pt == PCMU) {
+        if (bytes > GATEWAY_MAX_SAMPLES) {
+            return 0;
+        }
+        if (to->rate == 8000) {
+            g711UlawToL16BE(in, out, bytes);
+            return 2 * bytes;
+        }
+        g711UlawToL16BE(in, gateway->scratch, bytes);
+        upsample2(gateway->scratch, out, bytes, &stream->lastSample);
+        return 4 * bytes;
+    }
+
+    usize samples = bytes / 2;
+    if (samples > GATEWAY_MAX_SAMPLES) {
+        return 0;
+    }
+    if (from->rate == 8000) {
+        g711L16BEToUlaw(in, out, samples);
+        return samples;
+    }
+    downsample2(in, gateway->scratch, samples / 2);
+    g711L16BEToUlaw(gateway->scratch, out, samples / 2);
+    return samples / 2;
+}
+
+usize gatewayTranslate(gateway_t* gateway, u32 fromSide, void* datagram, usize size, rtp_packet_t* out, i64 nowUs)
+{
+    const gateway_side_t* from = &gateway->sides[fromSide];
+    const gateway_side_t* to = &gateway->sides[fromSide ^ 1];
+
+    if (isRtcpPacket(datagram, size)) {
+        gateway->rtcp++;
+        return 0;
+    }
+    rtp_packet_t* packet = datagram;
+    const u8* payload;
+    usize payloadBytes;
+    if (size < sizeof(rtp_hdr_t)) {
+        gateway->dropped++;
+        return 0;
+    }
+    ntohRTP(&packet->header);
+    if (!validateRTPHeader(&packet->header, from->pt) || !rtpPayload(packet, size, &payload, &payloadBytes)) {
+        gateway->dropped++;
+        return 0;
+    }
+
+    gateway_stream_t* stream = findStream(gateway, fromSide, packet->header.ssrc, &packet->header);
+    if (!stream) {
+        gateway->tableFull++;
+        return 0;
+    }
+
+    usize outBytes = transcode(gateway, from, to, stream, payload, payloadBytes, out->payload);
+    if (outBytes == 0) {
+        gateway->dropped++;
+        return 0;
+    }
+
+    //Timestamps move as the input ones do, at the output rate. A late packet is placed
+    //before the newest one without moving the reference
+    i64 tsDifference = timestampDifference(stream->lastInTs, packet->header.ts) * to->rate / from->rate;
+    u32 outTs = stream->lastOutTs + (u32)tsDifference;
+    if (tsDifference > 0) {
+        stream->lastInTs = packet->header.ts;
+        stream->lastOutTs = outTs;
+    }
+    stream->lastSeenUs = nowUs;
+    stream->packets++;
+
+    out->header = (rtp_hdr_t) {
+        .version = RTP_VERSION,
+        .m = packet->header.m,
+        .pt = to->pt,
+        .seq = (u16)(packet->header.seq + stream->seqOffset),
+        .ts = outTs,
+        .ssrc = stream->outSsrc,
+    };
+    htonRTP(&out->header);
+    gateway->translated++;
+    return sizeof(rtp_hdr_t) + outBytes;
+}
+
+void gatewayExpire(gateway_t* gateway, i64 nowUs)
+{
+    u32 live = 0;
+    for (u32 i = 0; i < GATEWAY_MAX_STREAMS; i++) {
+        gateway_stream_t* stream = &gateway->streams[i];
+        live += stream->used && nowUs - stream->lastSeenUs <= GATEWAY_STREAM_TIMEOUT_US;
+    }
+    if (live == gateway->activeStreams) {
+        return;
+    }
+
+    //Open addressing cannot just empty a slot: the live streams are inserted in a new table
+    memset(gateway->spareStreams, 0, GATEWAY_MAX_STREAMS * sizeof(gateway_stream_t));
+    u32 mask = GATEWAY_MAX_STREAMS - 1;
+    for (u32 i = 0; i < GATEWAY_MAX_STREAMS; i++) {
+        gateway_stream_t* stream = &gateway->streams[i];
+        if (!stream->used) continue;
+        if (nowUs - stream->lastSeenUs > GATEWAY_STREAM_TIMEOUT_US) {
+            trace("Stream %X on side %u timed out after %lu packets", stream->inSsrc, stream->side, stream->packets);
+            continue;
+        }
+        u32 slot = streamSlot(stream->side, stream->inSsrc);
+        while (gateway->spareStreams[slot].used) {
+            slot = (slot + 1) & mask;
+        }
+        gateway->spareStreams[slot] = *stream;
+    }
+    gateway_stream_t* streams = gateway->streams;
+    gateway->streams = gateway->spareStreams;
+    gateway->spareStreams = streams;
+    gateway->activeStreams = live;
+}
+
+static void receiveSide(gateway_t* gateway, u32 side, void* datagram, rtp_packet_t* out)
+{
+    isize result = recvfrom(gateway->sides[side].sockId, datagram, MAX_DATAGRAM_SIZE, 0, NULL, NULL);
+    if (result < 0) {
+        panic("recvfrom error");
+    }
+    usize outSize = gatewayTranslate(gateway, side, datagram, result, out, playoutNowUs());
+    if (outSize == 0) {
+        return;
+    }
+    const gateway_side_t* to = &gateway->sides[side ^ 1];
+    if (sendto(to->sockId, out, outSize, 0, (struct sockaddr *)&to->sendAddr, sizeof(struct sockaddr_in)) < 0) {
+        printError("sendto error");
+    }
+}
+
+int runGateway(gateway_side_t side0, gateway_side_t side1)
+{
+    struct sigaction sigInfo = {
+        .sa_handler = gatewaySignalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if ((sigaction(SIGINT, &sigInfo, NULL)) < 0) {
+        panic("Error installing signal.");
+    }
+
+    gateway_t gateway;
+    void* datagram = arenaAlloc(MAX_DATAGRAM_SIZE);
+    rtp_packet_t* out = arenaAlloc(GATEWAY_MAX_OUT_SIZE);
+    if (!gatewayInit(&gateway, side0, side1) || !datagram || !out) {
+        panic("Could not set up the gateway");
+    }
+
+    printf("Gateway between %s (%u Hz) and %s (%u Hz), Ctrl+C to stop.\n", payloadToStr(side0.pt), side0.rate,
+        payloadToStr(side1.pt), side1.rate);
+
+    i64 lastExpire = playoutNowUs();
+    while (!gatewayStopRequested) {
+        i64 untilExpire = MAX(lastExpire + GATEWAY_EXPIRE_INTERVAL_US - playoutNowUs(), 0);
+        struct timeval timeout = {
+            .tv_sec = untilExpire / 1000000,
+            .tv_usec = untilExpire % 1000000,
+        };
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(side0.sockId, &readSet);
+        FD_SET(side1.sockId, &readSet);
+
+        int res = select(MAX(side0.sockId, side1.sockId) + 1, &readSet, NULL, NULL, &timeout);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            panic("select() error!");
+        }
+        for (u32 side = 0; side < 2; side++) {
+            if (res > 0 && FD_ISSET(gateway.sides[side].sockId, &readSet)) {
+                receiveSide(&gateway, side, datagram, out);
+            }
+        }
+
+        i64 now = playoutNowUs();
+        if (now - lastExpire >= GATEWAY_EXPIRE_INTERVAL_US) {
+            gatewayExpire(&gateway, now);
+            lastExpire = now;
+        }
+    }
+
+    printf("\nInterrupted audioc gateway\n");
+    printf("Packets translated: %lu, dropped: %lu, RTCP not translated: %lu, no room for the stream: %lu\n",
+        gateway.translated, gateway.dropped, gateway.rtcp, gateway.tableFull);
+    printf("Streams: %u\n", gateway.activeStreams);
+
+    gatewayDestroy(&gateway);
+    arenaFree(datagram);
+    arenaFree(out);
+    return 0;
+}
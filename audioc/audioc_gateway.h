@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+
+#include <netinet/in.h>
+
+//Streams (SSRCs of both sides) translated at once, power of 2
+#define GATEWAY_MAX_STREAMS 4096
+//Longest packet translated: 256 ms at 8000 Hz, 128 ms at 16000 Hz
+#define GATEWAY_MAX_SAMPLES 2048
+//Streams silent for this long are forgotten
+#define GATEWAY_STREAM_TIMEOUT_US 30000000
+
+//PCMU <-> L16 gateway between two groups. Every stream seen on one side is sent to the
+//other as a new stream: own SSRC, its sequence numbers shifted by a random offset (gaps
+//and reordering are kept) and its timestamps rebased and scaled to the other side rate
+typedef struct {
+    int sockId;
+    struct sockaddr_in sendAddr;
+    u8 pt;
+    u32 rate;
+} gateway_side_t;
+
+typedef struct {
+    bool used;
+    u8 side;                //Where it comes from
+    u32 inSsrc;
+    u32 outSsrc;
+    u16 seqOffset;
+    u32 lastInTs;           //Of the newest packet, to rebase the next ones
+    u32 lastOutTs;
+    u16 lastSample;         //Big endian L16, for the 8000 -> 16000 Hz interpolation
+    i64 lastSeenUs;
+    u64 packets;
+} gateway_stream_t;
+
+typedef struct {
+    gateway_side_t sides[2];
+    gateway_stream_t* streams;
+    gateway_stream_t* spareStreams; //To rebuild the table without the streams that timed out
+    u32 activeStreams;
+    u8* scratch;            //L16 at the PCMU side rate
+
+    u64 translated;
+    u64 dropped;            //Malformed, wrong payload or too long
+    u64 rtcp;               //Not translated: it describes the streams of the other side
+    u64 tableFull;
+} gateway_t;
+
+//side 0 and side 1 must have different payloads, and PCMU is always 8000 Hz
+bool gatewayInit(gateway_t* gateway, gateway_side_t side0, gateway_side_t side1);
+void gatewayDestroy(gateway_t* gateway);
+
+//Translates a datagram received on fromSide (modified: byte order of its header) into out,
+//which has room for GATEWAY_MAX_OUT_SIZE bytes. Returns the size of the packet for the
+//other side, 0 if nothing has to be sent
+#define GATEWAY_MAX_OUT_SIZE (sizeof(rtp_hdr_t) + 4 * GATEWAY_MAX_SAMPLES)
+usize gatewayTranslate(gateway_t* gateway, u32 fromSide, void* datagram, usize size, rtp_packet_t* out, i64 nowUs);
+
+//Forgets the streams not seen since GATEWAY_STREAM_TIMEOUT_US before nowUs
+void gatewayExpire(gateway_t* gateway, i64 nowUs);
+
+//Gateway mode (--gateway): translates between both sides until SIGINT. Returns the process
+//exit code
+int runGateway(gateway_side_t side0, gateway_side_t side1);
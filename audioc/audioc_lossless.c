@@ -0,0 +1,218 @@
+#include "audioc_lossless.h"
+#include "audioc_rtp.h"
+
+//Rice parameters above this never pay off for 16 bit residuals: the frame goes verbatim
+#define LOSSLESS_MAX_RICE 20
+
+//Residual of the fixed predictor of order at sample i (i >= order). Up to 2^20 for
+//16 bit samples
+static i32 residual(const i16* s, u32 i, u32 order)
+{
+    switch (order) {
+    case 0: return s[i];
+    case 1: return s[i] - s[i - 1];
+    case 2: return s[i] - 2 * s[i - 1] + s[i - 2];
+    case 3: return s[i] - 3 * s[i - 1] + 3 * s[i - 2] - s[i - 3];
+    default: return s[i] - 4 * s[i - 1] + 6 * s[i - 2] - 4 * s[i - 3] + s[i - 4];
+    }
+}
+
+//Signed to unsigned, small magnitudes first: 0, -1, 1, -2...
+static u32 zigzag(i32 value)
+{
+    return ((u32)value << 1) ^ (u32)(value >> 31);
+}
+
+static i32 unzigzag(u32 value)
+{
+    return (i32)(value >> 1) ^ -(i32)(value & 1);
+}
+
+static u64 riceBits(const i16* samples, u32 count, u32 order, u32 k)
+{
+    u64 bits = 0;
+    for (u32 i = order; i < count; i++) {
+        bits += (zigzag(residual(samples, i, order)) >> k) + 1 + k;
+    }
+    return bits;
+}
+
+typedef struct {
+    u8* out;
+    usize bytes;
+    u64 accumulator;
+    u32 bits;               //In the accumulator, less than 8 between writes
+} bit_writer_t;
+
+static void putBits(bit_writer_t* w, u32 value, u32 count)
+{
+    w->accumulator = (w->accumulator << count) | value;
+    w->bits += count;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        w->out[w->bytes++] = w->accumulator >> w->bits;
+    }
+}
+
+static void putRice(bit_writer_t* w, u32 value, u32 k)
+{
+    //Quotient in unary: ones, then a zero
+    for (u32 q = value >> k; q > 0; ) {
+        u32 run = MIN(q, 32);
+        putBits(w, run == 32 ? 0xFFFFFFFF : (1u << run) - 1, run);
+        q -= run;
+    }
+    putBits(w, 0, 1);
+    if (k > 0) {
+        putBits(w, value & ((1u << k) - 1), k);
+    }
+}
+
+static usize encodeVerbatim(const i16* samples, u32 count, u8* out)
+{
+    writeU16(out, count);
+    out[2] = LOSSLESS_VERBATIM;
+    out[3] = 0;
+    for (u32 i = 0; i < count; i++) {
+        writeU16(out + LOSSLESS_HEADER_SIZE + 2 * i, (u16)samples[i]);
+    }
+    return LOSSLESS_MAX_FRAME_BYTES(count);
+}
+
+usize losslessEncode(const i16* samples, u32 count, u8* out)
+{
+    ASSERT(count <= LOSSLESS_MAX_SAMPLES);
+    //The order with the smallest residuals, by their sum
+    u32 order = 0;
+    u64 bestSum = UINT64_MAX;
+    for (u32 o = 0; o <= MIN(LOSSLESS_MAX_ORDER, count); o++) {
+        u64 sum = 0;
+        for (u32 i = o; i < count; i++) {
+            sum += zigzag(residual(samples, i, o));
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            order = o;
+        }
+    }
+
+    //2^k near the mean residual, then the neighbours by their exact size
+    u32 n = MAX(count - order, 1);
+    u32 guess = 0;
+    while (guess < LOSSLESS_MAX_RICE && ((u64)n << (guess + 1)) <= bestSum) {
+        guess++;
+    }
+    u32 k = guess;
+    u64 bits = riceBits(samples, count, order, k);
+    for (u32 candidate = guess > 0 ? guess - 1 : 0; candidate <= MIN(guess + 1, LOSSLESS_MAX_RICE); candidate++) {
+        u64 candidateBits = candidate == guess ? bits : riceBits(samples, count, order, candidate);
+        if (candidateBits < bits) {
+            bits = candidateBits;
+            k = candidate;
+        }
+    }
+
+    usize bytes = LOSSLESS_HEADER_SIZE + 2 * order + (bits + 7) / 8;
+    if (bytes >= LOSSLESS_MAX_FRAME_BYTES(count)) {
+        return encodeVerbatim(samples, count, out);
+    }
+
+    writeU16(out, count);
+    out[2] = order;
+    out[3] = k;
+    for (u32 i = 0; i < order; i++) {
+        writeU16(out + LOSSLESS_HEADER_SIZE + 2 * i, (u16)samples[i]);
+    }
+    bit_writer_t w = { .out = out + LOSSLESS_HEADER_SIZE + 2 * order };
+    for (u32 i = order; i < count; i++) {
+        putRice(&w, zigzag(residual(samples, i, order)), k);
+    }
+    if (w.bits > 0) {
+        putBits(&w, 0, 8 - w.bits);
+    }
+    ASSERT(LOSSLESS_HEADER_SIZE + 2 * order + w.bytes == bytes);
+    return bytes;
+}
+
+typedef struct {
+    const u8* in;
+    usize size;
+    usize byte;
+    u32 bit;                //Next bit of in[byte], 0 is the most significant
+} bit_reader_t;
+
+static bool getBit(bit_reader_t* r, u32* value)
+{
+    if (r->byte >= r->size) {
+        return false;
+    }
+    *value = (r->in[r->byte] >> (7 - r->bit)) & 1;
+    if (++r->bit == 8) {
+        r->bit = 0;
+        r->byte++;
+    }
+    return true;
+}
+
+static bool getRice(bit_reader_t* r, u32 k, u32* value)
+{
+    u32 q = 0, bit;
+    while (1) {
+        if (!getBit(r, &bit)) return false;
+        if (bit == 0) break;
+        //A residual is at most 2^21 (zigzagged): anything longer is garbage
+        if (++q > (1u << 21)) return false;
+    }
+    u32 low = 0;
+    for (u32 i = 0; i < k; i++) {
+        if (!getBit(r, &bit)) return false;
+        low = (low << 1) | bit;
+    }
+    *value = (q << k) | low;
+    return true;
+}
+
+isize losslessDecode(const u8* frame, usize size, i16* samples, u32 maxSamples)
+{
+    if (size < LOSSLESS_HEADER_SIZE) {
+        return -1;
+    }
+    u32 count = readU16(frame);
+    u32 order = frame[2];
+    u32 k = frame[3];
+    if (count > maxSamples) {
+        return -1;
+    }
+
+    if (order == LOSSLESS_VERBATIM) {
+        if (size < LOSSLESS_MAX_FRAME_BYTES(count)) {
+            return -1;
+        }
+        for (u32 i = 0; i < count; i++) {
+            samples[i] = (i16)readU16(frame + LOSSLESS_HEADER_SIZE + 2 * i);
+        }
+        return count;
+    }
+    if (order > LOSSLESS_MAX_ORDER || order > count || k > LOSSLESS_MAX_RICE
+        || size < LOSSLESS_HEADER_SIZE + 2 * order) {
+        return -1;
+    }
+
+    for (u32 i = 0; i < order; i++) {
+        samples[i] = (i16)readU16(frame + LOSSLESS_HEADER_SIZE + 2 * i);
+    }
+    bit_reader_t r = {
+        .in = frame + LOSSLESS_HEADER_SIZE + 2 * order,
+        .size = size - LOSSLESS_HEADER_SIZE - 2 * order,
+    };
+    for (u32 i = order; i < count; i++) {
+        u32 value;
+        if (!getRice(&r, k, &value)) {
+            return -1;
+        }
+        //The prediction is the sample minus its residual of order 0
+        samples[i] = 0;
+        samples[i] = (i16)(unzigzag(value) - residual(samples, i, order));
+    }
+    return count;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+//Lossless audio frames for recordings (audioc_record.h): a fixed polynomial predictor
+//(the "fixed" linear predictors of FLAC, orders 0 to 4: the best for the frame is picked)
+//and Rice coding of the prediction residual, with the parameter chosen per frame. Samples
+//are 16 bit linear, or mu-law codes mapped to a monotonic -128..127 (losslessUlawToIndex):
+//prediction works on the companded values as well, and the u-law bytes come back exact.
+//
+//  Frame: sample count (2 bytes), order (1), Rice parameter (1), then the first order
+//         samples (2 bytes each) and the residuals, Rice coded, padded to a byte.
+//         Order LOSSLESS_VERBATIM: the samples as they are (2 bytes each), when coding
+//         would not make the frame smaller
+//  Every field in network byte order (big endian), bits most significant first.
+
+#define LOSSLESS_MAX_ORDER 4
+#define LOSSLESS_VERBATIM 0xFF
+#define LOSSLESS_HEADER_SIZE 4
+#define LOSSLESS_MAX_SAMPLES 65535
+
+//Largest frame of count samples: the verbatim one
+#define LOSSLESS_MAX_FRAME_BYTES(count) (LOSSLESS_HEADER_SIZE + 2 * (count))
+
+//Encodes count samples into out (LOSSLESS_MAX_FRAME_BYTES(count) bytes). Returns the
+//frame size
+usize losslessEncode(const i16* samples, u32 count, u8* out);
+
+//Decodes a frame into samples (room for maxSamples). Returns the number of samples, or -1
+//if the frame is malformed, truncated or larger than maxSamples
+isize losslessDecode(const u8* frame, usize size, i16* samples, u32 maxSamples);
+
+//Monotonic index of a mu-law code (the code of a larger linear value is a larger index)
+inline static i16 losslessUlawToIndex(u8 ulaw)
+{
+    u8 value = ~ulaw;
+    return (value & 0x80) ? -1 - (value & 0x7F) : value;
+}
+
+inline static u8 losslessIndexToUlaw(i16 index)
+{
+    return ~(u8)(index < 0 ? 0x80 | (-1 - index) : index);
+}
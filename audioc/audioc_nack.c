@@ -0,0 +1,126 @@
+#include "audioc_nack.h"
+
+#include <arpa/inet.h>
+
+/*
+ * Sender
+ */
+
+bool nackSenderInit(nack_sender_t* sender, usize maxPacketSize, const allocator_t* allocator)
+{
+    *sender = (nack_sender_t) {
+        .maxPacketSize = maxPacketSize,
+        .tokens = NACK_BURST * NACK_RETRANSMIT_COST,
+        .allocator = allocator,
+    };
+    sender->storage = allocatorAlloc(allocator, NACK_HISTORY_SIZE * maxPacketSize);
+    if (!sender->storage) {
+        return false;
+    }
+    for (u32 i = 0; i < NACK_HISTORY_SIZE; i++) {
+        sender->entries[i].data = sender->storage + i * maxPacketSize;
+    }
+    return true;
+}
+
+void nackSenderDestroy(nack_sender_t* sender)
+{
+    allocatorFree(sender->allocator, sender->storage);
+    sender->storage = NULL;
+}
+
+void nackSenderStore(nack_sender_t* sender, u16 seq, const void* packet, usize size)
+{
+    ASSERT(size <= sender->maxPacketSize);
+    nack_history_entry_t* entry = &sender->entries[seq % NACK_HISTORY_SIZE];
+    entry->valid = true;
+    entry->seq = seq;
+    entry->retransmissions = 0;
+    entry->size = size;
+    memcpy(entry->data, packet, size);
+
+    sender->tokens = MIN(sender->tokens + 1, NACK_BURST * NACK_RETRANSMIT_COST);
+}
+
+const nack_history_entry_t* nackSenderRetransmit(nack_sender_t* sender, u16 seq)
+{
+    nack_history_entry_t* entry = &sender->entries[seq % NACK_HISTORY_SIZE];
+    if (!entry->valid || entry->seq != seq || entry->retransmissions >= NACK_MAX_RETRANSMISSIONS) {
+        return NULL;
+    }
+    if (sender->tokens < NACK_RETRANSMIT_COST) {
+        return NULL;
+    }
+    sender->tokens -= NACK_RETRANSMIT_COST;
+    entry->retransmissions++;
+    return entry;
+}
+
+/*
+ * RTCP
+ */
+
+bool isRtcpPacket(const void* data, usize size)
+{
+    //RFC 5761, section 4: RTCP packet types 192-223 do not clash with the RTP ones in use
+    const u8* bytes = data;
+    return size >= 8 && (bytes[0] >> 6) == RTP_VERSION && bytes[1] >= 192 && bytes[1] <= 223;
+}
+
+usize nackBuild(u8* out, u32 senderSsrc, u32 mediaSsrc, u16 firstSeq, u32 count)
+{
+    ASSERT(count > 0);
+    u8* fci = out + 12;
+    u32 fciCount = 0;
+    u32 done = 0;
+    while (done < count && fciCount < NACK_MAX_FCI) {
+        u16 pid = firstSeq + done;
+        u16 blp = 0;
+        u32 inThisFci = MIN(count - done, 17);
+        for (u32 i = 1; i < inThisFci; i++) {
+            blp |= 1 << (i - 1);
+        }
+        writeU16(fci, pid);
+        writeU16(fci + 2, blp);
+        fci += 4;
+        fciCount++;
+        done += inThisFci;
+    }
+
+    //Length in 32 bit words minus one
+    out[0] = (RTP_VERSION << 6) | RTCP_FMT_GENERIC_NACK;
+    out[1] = RTCP_RTPFB;
+    writeU16(out + 2, 2 + fciCount);
+    writeU32(out + 4, senderSsrc);
+    writeU32(out + 8, mediaSsrc);
+    return fci - out;
+}
+
+usize nackParse(const u8* data, usize size, u32 mediaSsrc, u16* outSeqs, usize maxSeqs)
+{
+    usize found = 0;
+    usize offset = 0;
+    while (offset + 4 <= size) {
+        const u8* rtcp = data + offset;
+        usize length = (readU16(rtcp + 2) + 1) * 4;
+        if ((rtcp[0] >> 6) != RTP_VERSION || offset + length > size) {
+            break;
+        }
+
+        if (rtcp[1] == RTCP_RTPFB && (rtcp[0] & 0x1F) == RTCP_FMT_GENERIC_NACK
+            && length >= 12 && readU32(rtcp + 8) == mediaSsrc)
+        {
+            for (usize fci = 12; fci + 4 <= length; fci += 4) {
+                u16 pid = readU16(rtcp + fci);
+                u16 blp = readU16(rtcp + fci + 2);
+                for (u32 i = 0; i < 17 && found < maxSeqs; i++) {
+                    if (i == 0 || (blp & (1 << (i - 1)))) {
+                        outSeqs[found++] = pid + i;
+                    }
+                }
+            }
+        }
+        offset += length;
+    }
+    return found;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+#include "audioc_allocator.h"
+
+//Selective retransmission with RTCP generic NACKs (RFC 4585, section 6.2.1).
+//RTCP shares the RTP socket (RFC 5761 multiplexing): a datagram whose second byte is
+//in [192..223] is RTCP. The receiver NACKs the sequence numbers of a gap as soon as it
+//detects it; the sender answers from a ring with its last sent packets, which are sent
+//again unchanged, at most NACK_MAX_RETRANSMISSIONS times each.
+//Retransmissions are rate limited with a token bucket filled by the packets sent, so a
+//loss burst can never make a sender use more than 1/NACK_RETRANSMIT_COST more bandwidth.
+
+#define RTCP_RTPFB 205                //Transport layer feedback message
+#define RTCP_FMT_GENERIC_NACK 1
+#define NACK_HISTORY_SIZE 128         //Sent packets kept for retransmission, power of 2
+#define NACK_MAX_RETRANSMISSIONS 2
+#define NACK_RETRANSMIT_COST 4        //Sent packets that pay for one retransmission
+#define NACK_BURST 8                  //Retransmissions that can be sent back to back
+#define NACK_MAX_FCI 16               //Each FCI covers 17 sequence numbers
+#define NACK_MAX_PACKET_SIZE (12 + 4 * NACK_MAX_FCI)
+
+typedef struct {
+    bool valid;
+    u16 seq;
+    u8 retransmissions;
+    usize size;
+    u8* data; //Packet as it was sent (network byte order)
+} nack_history_entry_t;
+
+typedef struct {
+    nack_history_entry_t entries[NACK_HISTORY_SIZE];
+    u8* storage;
+    usize maxPacketSize;
+    u32 tokens;
+    const allocator_t* allocator;
+} nack_sender_t;
+
+//Returns false if memory could not be allocated
+bool nackSenderInit(nack_sender_t* sender, usize maxPacketSize, const allocator_t* allocator);
+void nackSenderDestroy(nack_sender_t* sender);
+
+//Keeps a copy of a sent media packet
+void nackSenderStore(nack_sender_t* sender, u16 seq, const void* packet, usize size);
+
+//Returns the stored packet with sequence number seq if it can be retransmitted now,
+//or NULL if it is no longer stored, was retransmitted too many times or the rate limit
+//was reached
+const nack_history_entry_t* nackSenderRetransmit(nack_sender_t* sender, u16 seq);
+
+//True if the datagram is RTCP rather than RTP
+bool isRtcpPacket(const void* data, usize size);
+
+//Writes into out a generic NACK from senderSsrc asking mediaSsrc for count packets
+//starting at firstSeq (up to 17 * NACK_MAX_FCI). out must hold NACK_MAX_PACKET_SIZE
+//bytes. Returns the packet size
+usize nackBuild(u8* out, u32 senderSsrc, u32 mediaSsrc, u16 firstSeq, u32 count);
+
+//Reads a (compound) RTCP packet and writes into outSeqs the sequence numbers that
+//generic NACKs for mediaSsrc ask for. Returns how many there are (up to maxSeqs)
+usize nackParse(const u8* data, usize size, u32 mediaSsrc, u16* outSeqs, usize maxSeqs);
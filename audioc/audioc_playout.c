@@ -0,0 +1,149 @@
+#include "audioc_playout.h"
+
+#include <math.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/soundcard.h>
+
+i64 playoutNowUs(void)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+        panic("Could not get current time from clock_gettime()!");
+    }
+    return (i64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void playoutInit(playout_scheduler_t* ps, int sndCardFD, u32 bytesPerSecond, i64 initialMarginUs)
+{
+    *ps = (playout_scheduler_t) {
+        .sndCardFD = sndCardFD,
+        .nominalBytesPerUs = bytesPerSecond / 1e6,
+        .bytesPerUs = bytesPerSecond / 1e6,
+        .useOptr = true,
+        .marginUs = MIN(MAX(initialMarginUs, PLAYOUT_MIN_MARGIN_US), PLAYOUT_MAX_MARGIN_US),
+    };
+
+    //Nothing has been played yet: positions are counted from the current GETOPTR counter
+    count_info info;
+    ps->queries++;
+    if (ioctl(sndCardFD, SNDCTL_DSP_GETOPTR, &info) == 0) {
+        ps->lastOptrBytes = (u32)info.bytes;
+    } else {
+        ps->useOptr = false;
+    }
+}
+
+//Bytes played by the card so far, asked to the card
+static u64 queryPosition(playout_scheduler_t* ps)
+{
+    ps->queries++;
+    if (ps->useOptr) {
+        count_info info;
+        if (ioctl(ps->sndCardFD, SNDCTL_DSP_GETOPTR, &info) == 0) {
+            u32 bytes = (u32)info.bytes;
+            ps->optrPosition += bytes - ps->lastOptrBytes;
+            ps->lastOptrBytes = bytes;
+            return ps->optrPosition;
+        }
+        ps->useOptr = false;
+    }
+
+    i32 bytesInCard = 0;
+    if (ioctl(ps->sndCardFD, SNDCTL_DSP_GETODELAY, &bytesInCard) < 0) {
+        panic("Error calling ioctl SNDCTL_DSP_GETODELAY");
+    }
+    return ps->written - MIN((u64)MAX(bytesInCard, 0), ps->written);
+}
+
+static void sample(playout_scheduler_t* ps, i64 nowUs)
+{
+    u64 position = MIN(queryPosition(ps), ps->written);
+
+    if (ps->anchored) {
+        //How far the model was from the card, in time
+        double predicted = ps->anchorPosition + ps->bytesPerUs * (nowUs - ps->anchorUs);
+        double errorUs = fabs(predicted - (double)position) / ps->bytesPerUs;
+        ps->modelErrorUs += 0.25 * (errorUs - ps->modelErrorUs);
+    }
+
+    //Fit the rate only over intervals in which the card was playing all the time
+    bool starved = position >= ps->written;
+    i64 elapsed = nowUs - ps->lastSampleUs;
+    if (ps->lastSampleUs > 0 && !starved && !ps->lastSampleStarved && elapsed >= PLAYOUT_SAMPLE_INTERVAL_US / 2) {
+        double rate = (double)(position - ps->lastSamplePosition) / elapsed;
+        double low = ps->nominalBytesPerUs * (1.0 - PLAYOUT_MAX_DRIFT);
+        double high = ps->nominalBytesPerUs * (1.0 + PLAYOUT_MAX_DRIFT);
+        ps->bytesPerUs += 0.1 * (MAX(low, MIN(high, rate)) - ps->bytesPerUs);
+    }
+
+    ps->anchored = true;
+    ps->anchorUs = nowUs;
+    ps->anchorPosition = position;
+    ps->lastSampleUs = nowUs;
+    ps->lastSamplePosition = position;
+    ps->lastSampleStarved = starved;
+}
+
+void playoutWritten(playout_scheduler_t* ps, usize bytes)
+{
+    i64 now = playoutNowUs();
+    ps->writes++;
+    if (ps->anchored && playoutCardDelay(ps, now) == 0) {
+        //The card stopped when it ran dry: it starts playing again from now
+        ps->anchorUs = now;
+        ps->anchorPosition = ps->written;
+    }
+    ps->written += bytes;
+    if (!ps->anchored) {
+        sample(ps, now);
+    }
+}
+
+u64 playoutCardDelay(playout_scheduler_t* ps, i64 nowUs)
+{
+    double position = ps->anchorPosition + ps->bytesPerUs * (nowUs - ps->anchorUs);
+    if (position >= (double)ps->written) {
+        return 0;
+    }
+    return ps->written - (u64)position;
+}
+
+i64 playoutUntilDelay(playout_scheduler_t* ps, i64 nowUs, u64 delayBytes)
+{
+    u64 cardDelay = playoutCardDelay(ps, nowUs);
+    if (cardDelay <= delayBytes) {
+        return 0;
+    }
+    return (i64)ceil((cardDelay - delayBytes) / ps->bytesPerUs);
+}
+
+i64 playoutTimeout(playout_scheduler_t* ps, i64 nowUs, usize bufferedBytes)
+{
+    if (!ps->anchored || nowUs - ps->lastSampleUs >= PLAYOUT_SAMPLE_INTERVAL_US) {
+        sample(ps, nowUs);
+    }
+
+    double remainingBytes = playoutCardDelay(ps, nowUs) + bufferedBytes;
+    i64 timeoutUs = (i64)(remainingBytes / ps->bytesPerUs) - ps->marginUs;
+    timeoutUs = MAX(timeoutUs, 0);
+    ps->deadlineUs = nowUs + timeoutUs;
+    return timeoutUs;
+}
+
+void playoutWakeup(playout_scheduler_t* ps, i64 nowUs, bool timedOut)
+{
+    ps->wakeups++;
+    if (!timedOut) {
+        return;
+    }
+
+    //Mean and mean deviation of the lateness, like the RTT estimator of TCP
+    double latenessUs = MAX(nowUs - ps->deadlineUs, 0);
+    double deviation = fabs(latenessUs - ps->latenessMeanUs);
+    ps->latenessMeanUs += 0.125 * (latenessUs - ps->latenessMeanUs);
+    ps->latenessDevUs += 0.25 * (deviation - ps->latenessDevUs);
+
+    i64 margin = (i64)(ps->latenessMeanUs + 4 * ps->latenessDevUs + ps->modelErrorUs);
+    ps->marginUs = MAX(PLAYOUT_MIN_MARGIN_US, MIN(PLAYOUT_MAX_MARGIN_US, margin));
+}
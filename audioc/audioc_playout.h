@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+
+//Playout scheduler driven by the sound card clock.
+//Instead of asking the card for its delay on every wakeup, it keeps a model of the
+//card's play position: position(t) = anchorPosition + bytesPerUs * (t - anchorUs), with
+//bytesPerUs fitted from SNDCTL_DSP_GETOPTR samples (SNDCTL_DSP_GETODELAY if GETOPTR is
+//not supported) taken every PLAYOUT_SAMPLE_INTERVAL_US. From it, it predicts when the
+//card and the jitter buffer will run dry. The safety margin before that deadline adapts
+//to how late select() actually wakes us up and to how far off the model was.
+
+#define PLAYOUT_SAMPLE_INTERVAL_US 250000
+#define PLAYOUT_INITIAL_MARGIN_US 10000   //The fixed margin audioc used before
+#define PLAYOUT_MIN_MARGIN_US 1000
+#define PLAYOUT_MAX_MARGIN_US 50000
+#define PLAYOUT_MAX_DRIFT 0.05            //Fitted rate stays within 5% of the nominal one
+
+typedef struct {
+    int sndCardFD;
+    double nominalBytesPerUs;
+    double bytesPerUs;      //Fitted consumption rate
+
+    u64 written;            //Bytes written to the card since the start
+    bool anchored;
+    i64 anchorUs;
+    u64 anchorPosition;     //Bytes played by the card at anchorUs
+
+    bool useOptr;
+    u32 lastOptrBytes;      //GETOPTR counter wraps, positions are accumulated from it
+    u64 optrPosition;
+    i64 lastSampleUs;
+    u64 lastSamplePosition;
+    bool lastSampleStarved; //The card had nothing left to play at the last sample
+
+    i64 deadlineUs;         //Wakeup time set by the last playoutTimeout()
+    double latenessMeanUs;
+    double latenessDevUs;
+    double modelErrorUs;
+    i64 marginUs;
+
+    u64 queries;            //ioctl calls
+    u64 wakeups;
+    u64 writes;             //write()/writev() calls
+} playout_scheduler_t;
+
+//Monotonic clock, in us
+i64 playoutNowUs(void);
+
+//initialMarginUs (clamped to [PLAYOUT_MIN_MARGIN_US, PLAYOUT_MAX_MARGIN_US]) is where the
+//margin adaptation starts: PLAYOUT_INITIAL_MARGIN_US, or what the sound card profile suggests
+void playoutInit(playout_scheduler_t* ps, int sndCardFD, u32 bytesPerSecond, i64 initialMarginUs);
+
+//To be called after writing bytes to the card
+void playoutWritten(playout_scheduler_t* ps, usize bytes);
+
+//Bytes still queued in the card at nowUs, according to the model
+u64 playoutCardDelay(playout_scheduler_t* ps, i64 nowUs);
+
+//Returns how long (in us) until the card has at most delayBytes queued, according to the model
+i64 playoutUntilDelay(playout_scheduler_t* ps, i64 nowUs, u64 delayBytes);
+
+//Returns how long we can wait (in us) before the card and the bufferedBytes we still hold
+//would run out, minus the safety margin. Samples the card position if it is due
+i64 playoutTimeout(playout_scheduler_t* ps, i64 nowUs, usize bufferedBytes);
+
+//To be called when select() returns. timedOut tells whether it was because the timeout
+//from playoutTimeout() expired, in which case how late we woke up updates the margin
+void playoutWakeup(playout_scheduler_t* ps, i64 nowUs, bool timedOut);
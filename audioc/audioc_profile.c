@@ -0,0 +1,89 @@
+#include "audioc_profile.h"
+
+#include <stdio.h>
+
+bool profileLoad(const char* path, sndcard_profile_t* profile)
+{
+    *profile = (sndcard_profile_t) {};
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) && profile->count < PROFILE_MAX_ENTRIES) {
+        if (line[0] == '#') {
+            continue;
+        }
+        sndcard_calibration_t entry;
+        if (sscanf(line, "%u %u %u %u %u", &entry.format, &entry.fragmentBytes, &entry.outputLatencyUs,
+                &entry.odelayStepBytes, &entry.wakeupJitterUs) == 5) {
+            profileSet(profile, &entry);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool profileSave(const char* path, const sndcard_profile_t* profile)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "# audioc sound card profile, written by audioc --calibrate\n");
+    fprintf(file, "# format fragment_bytes output_latency_us odelay_step_bytes wakeup_jitter_us\n");
+    for (u32 i = 0; i < profile->count; i++) {
+        const sndcard_calibration_t* entry = &profile->entries[i];
+        fprintf(file, "%u %u %u %u %u\n", entry->format, entry->fragmentBytes, entry->outputLatencyUs,
+            entry->odelayStepBytes, entry->wakeupJitterUs);
+    }
+
+    return fclose(file) == 0;
+}
+
+void profileSet(sndcard_profile_t* profile, const sndcard_calibration_t* calibration)
+{
+    sndcard_calibration_t* entry = (sndcard_calibration_t*)profileFind(profile, calibration->format, calibration->fragmentBytes);
+    if (!entry) {
+        if (profile->count == PROFILE_MAX_ENTRIES) {
+            return;
+        }
+        entry = &profile->entries[profile->count++];
+    }
+    *entry = *calibration;
+}
+
+const sndcard_calibration_t* profileFind(const sndcard_profile_t* profile, u32 format, u32 fragmentBytes)
+{
+    for (u32 i = 0; i < profile->count; i++) {
+        const sndcard_calibration_t* entry = &profile->entries[i];
+        if (entry->format == format && entry->fragmentBytes == fragmentBytes) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+u32 profileMarginUs(const sndcard_calibration_t* calibration, u32 bytesPerSecond)
+{
+    //We may wake up that late, and the card may report its delay that coarsely
+    u32 stepUs = (u64)calibration->odelayStepBytes * 1000000 / bytesPerSecond;
+    if (calibration->odelayStepBytes == 0) {
+        //GETODELAY does not work: all we know is the fragment
+        stepUs = (u64)calibration->fragmentBytes * 1000000 / bytesPerSecond;
+    }
+    return calibration->wakeupJitterUs + stepUs;
+}
+
+u32 profileCapacityMs(const sndcard_calibration_t* calibration, u32 bytesPerSecond)
+{
+    //What the card holds beyond its fragment, plus what may arrive while we are late,
+    //but never less than two fragments
+    u32 fragmentUs = (u64)calibration->fragmentBytes * 1000000 / bytesPerSecond;
+    u32 extraUs = calibration->outputLatencyUs + 4 * calibration->wakeupJitterUs;
+    extraUs = MAX(extraUs, 2 * fragmentUs);
+    return (extraUs + 999) / 1000;
+}
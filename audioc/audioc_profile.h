@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.h"
+
+//Sound card profile: what audioc --calibrate measured on this machine for each sound card
+//format and fragment size. audioc loads it at startup to size the jitter buffer and the
+//playout safety margin from measured values instead of fixed ones.
+//
+//The file is text, one line per measurement (lines starting with '#' are comments):
+//  format fragment_bytes output_latency_us odelay_step_bytes wakeup_jitter_us
+
+#define PROFILE_DEFAULT_PATH "audioc.profile"
+#define PROFILE_MAX_ENTRIES 32
+
+//Used when there is no profile for the card configuration
+#define PROFILE_DEFAULT_CAPACITY_MS 200
+
+typedef struct {
+    u32 format;            //AFMT_* value
+    u32 fragmentBytes;
+    u32 outputLatencyUs;   //From writing a fragment to an idle card until the card has played it
+    u32 odelayStepBytes;   //Smallest change seen in SNDCTL_DSP_GETODELAY, 0 if it does not work
+    u32 wakeupJitterUs;    //99th percentile of how late select() returns, timers and card
+} sndcard_calibration_t;
+
+typedef struct {
+    u32 count;
+    sndcard_calibration_t entries[PROFILE_MAX_ENTRIES];
+} sndcard_profile_t;
+
+//Returns false if the file cannot be read. Malformed lines are skipped
+bool profileLoad(const char* path, sndcard_profile_t* profile);
+bool profileSave(const char* path, const sndcard_profile_t* profile);
+
+//Adds the calibration, or replaces the one for the same format and fragment size
+void profileSet(sndcard_profile_t* profile, const sndcard_calibration_t* calibration);
+
+//Returns NULL if the format and fragment size were not calibrated
+const sndcard_calibration_t* profileFind(const sndcard_profile_t* profile, u32 format, u32 fragmentBytes);
+
+//Safety margin before the predicted depletion of the card
+u32 profileMarginUs(const sndcard_calibration_t* calibration, u32 bytesPerSecond);
+
+//Room to add to the jitter buffer over the buffering time, in ms
+u32 profileCapacityMs(const sndcard_calibration_t* calibration, u32 bytesPerSecond);
@@ -0,0 +1,66 @@
+#define _GNU_SOURCE //CPU_SET, sched_setaffinity
+#include "audioc_realtime.h"
+
+#include <stdio.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static void prefaultStack(void)
+{
+    volatile u8 stack[REALTIME_STACK_PREFAULT_BYTES];
+    for (usize i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+bool realtimeLockMemory(void)
+{
+    //Memory malloc() frees stays in the process (and locked), ready to be reused
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return false;
+    }
+    prefaultStack();
+    return true;
+}
+
+bool realtimeSetPriority(u32 priority)
+{
+    struct sched_param param = { .sched_priority = priority };
+    return sched_setscheduler(0, SCHED_FIFO, &param) == 0;
+}
+
+bool realtimePinCpu(u32 cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void realtimeCounters(realtime_counters_t* counters)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        panic("getrusage error");
+    }
+    *counters = (realtime_counters_t) {
+        .minorFaults = usage.ru_minflt,
+        .majorFaults = usage.ru_majflt,
+        .voluntarySwitches = usage.ru_nvcsw,
+        .involuntarySwitches = usage.ru_nivcsw,
+    };
+}
+
+void realtimePrintCounters(const realtime_counters_t* start)
+{
+    realtime_counters_t now;
+    realtimeCounters(&now);
+    printf("Page faults: %ld minor, %ld major\n", now.minorFaults - start->minorFaults, now.majorFaults - start->majorFaults);
+    printf("Context switches: %ld voluntary, %ld involuntary\n", now.voluntarySwitches - start->voluntarySwitches,
+        now.involuntarySwitches - start->involuntarySwitches);
+}
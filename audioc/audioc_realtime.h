@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+
+//Real-time setup for --realtime: memory locked in RAM, optionally SCHED_FIFO and a fixed
+//CPU. Each step can fail without privileges (CAP_IPC_LOCK / RLIMIT_MEMLOCK for
+//mlockall, CAP_SYS_NICE / RLIMIT_RTPRIO for SCHED_FIFO); audioc warns and goes on.
+
+//Stack touched at startup so the playout loop never faults it in
+#define REALTIME_STACK_PREFAULT_BYTES (256 * 1024)
+
+//Locks current and future memory, stops malloc() from giving memory back to the system or
+//using mmap() for big blocks, and pre-faults the stack. Returns false if mlockall() failed
+bool realtimeLockMemory(void);
+
+//priority in [1..99]
+bool realtimeSetPriority(u32 priority);
+bool realtimePinCpu(u32 cpu);
+
+//From getrusage(): what the kernel did to us
+typedef struct {
+    i64 minorFaults;
+    i64 majorFaults;
+    i64 voluntarySwitches;   //We blocked (select, a full card)
+    i64 involuntarySwitches; //We were preempted
+} realtime_counters_t;
+
+void realtimeCounters(realtime_counters_t* counters);
+
+//Prints the counters accumulated since 'start'
+void realtimePrintCounters(const realtime_counters_t* start);
@@ -0,0 +1,127 @@
+#include "audioc_reblock.h"
+#include "audioc_rtp.h"
+#include "../lib/circularBuffer.h"
+
+bool reblockerInit(reblocker_t* rb, void* cbuf, usize blockBytes, enum payload payload, const allocator_t* allocator)
+{
+    *rb = (reblocker_t) {
+        .cbuf = cbuf,
+        .blockBytes = blockBytes,
+        .payload = payload,
+        .allocator = allocator,
+    };
+    rb->partial = allocatorAlloc(allocator, blockBytes);
+    return rb->partial != NULL;
+}
+
+void reblockerDestroy(reblocker_t* rb)
+{
+    allocatorFree(rb->allocator, rb->partial);
+    rb->partial = NULL;
+}
+
+//Copies (or fills with silence, if data is NULL) up to bytes into the stream
+static usize append(reblocker_t* rb, const u8* data, usize bytes, bool* outFull)
+{
+    usize blocks = 0;
+    while (bytes > 0) {
+        usize copy;
+        if (rb->partialBytes == 0 && bytes >= rb->blockBytes) {
+            //Whole block, straight into the jitter buffer
+            copy = rb->blockBytes;
+            u8* block = cbuf_pointer_to_write(rb->cbuf);
+            if (block) {
+                if (data) {
+                    memcpy(block, data, copy);
+                } else {
+                    fillSilence(block, copy, rb->payload);
+                }
+                rb->blocksWritten++;
+                blocks++;
+            } else {
+                *outFull = true;
+            }
+        } else {
+            copy = MIN(bytes, rb->blockBytes - rb->partialBytes);
+            if (data) {
+                memcpy(rb->partial + rb->partialBytes, data, copy);
+            } else {
+                fillSilence(rb->partial + rb->partialBytes, copy, rb->payload);
+            }
+            rb->partialBytes += copy;
+
+            if (rb->partialBytes == rb->blockBytes) {
+                u8* block = cbuf_pointer_to_write(rb->cbuf);
+                if (block) {
+                    memcpy(block, rb->partial, rb->blockBytes);
+                    rb->blocksWritten++;
+                    blocks++;
+                } else {
+                    *outFull = true;
+                }
+                rb->partialBytes = 0;
+            }
+        }
+
+        if (data) {
+            data += copy;
+        }
+        bytes -= copy;
+    }
+    return blocks;
+}
+
+usize reblockerPush(reblocker_t* rb, const u8* data, usize bytes, bool* outFull)
+{
+    *outFull = false;
+    return append(rb, data, bytes, outFull);
+}
+
+usize reblockerPushSilence(reblocker_t* rb, usize bytes, bool* outFull)
+{
+    *outFull = false;
+    return append(rb, NULL, bytes, outFull);
+}
+
+usize reblockerFlush(reblocker_t* rb, usize* outSilenceBytes)
+{
+    bool full = false;
+    *outSilenceBytes = rb->blockBytes - rb->partialBytes;
+    usize blocks = append(rb, NULL, *outSilenceBytes, &full);
+    if (full) {
+        *outSilenceBytes = 0;
+    }
+    return blocks;
+}
+
+bool reblockerOverwrite(reblocker_t* rb, u64 blocksPlayed, u64 position, const u8* data, usize bytes)
+{
+    bool written = false;
+    while (bytes > 0) {
+        u64 blockNum = position / rb->blockBytes;
+        usize offset = position % rb->blockBytes;
+        usize chunk = MIN(bytes, rb->blockBytes - offset);
+
+        u8* block = NULL;
+        if (blockNum < blocksPlayed) {
+            //Already played, too late for these bytes
+        } else if (blockNum < rb->blocksWritten) {
+            block = cbuf_pointer_to_pending(rb->cbuf, (int)(blockNum - blocksPlayed));
+        } else if (blockNum == rb->blocksWritten && offset < rb->partialBytes) {
+            block = rb->partial;
+            chunk = MIN(chunk, rb->partialBytes - offset);
+        } else {
+            //Not in the stream yet
+            break;
+        }
+
+        if (block) {
+            memcpy(block + offset, data, chunk);
+            written = true;
+        }
+        position += chunk;
+        data += chunk;
+        bytes -= chunk;
+    }
+    return written;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.h"
+#include "audiocArgs.h"
+#include "audioc_allocator.h"
+
+//Turns the received audio, a stream of payloads of any length, into the fixed size blocks
+//the sound card plays. Bytes are appended to a partial block; each time it is completed
+//it is copied into the jitter buffer. Positions are counted in bytes since the start of
+//the stream, so block number = position / blockBytes.
+
+typedef struct {
+    void* cbuf;
+    usize blockBytes;
+    enum payload payload;  //For the silences
+    u8* partial;           //Block being assembled
+    usize partialBytes;
+    u64 blocksWritten;     //Blocks enqueued in cbuf since the start
+    const allocator_t* allocator;
+} reblocker_t;
+
+//Return false if memory could not be allocated
+bool reblockerInit(reblocker_t* rb, void* cbuf, usize blockBytes, enum payload payload, const allocator_t* allocator);
+void reblockerDestroy(reblocker_t* rb);
+
+//Stream position of the next byte to be pushed
+inline static u64 reblockerPosition(const reblocker_t* rb)
+{
+    return rb->blocksWritten * rb->blockBytes + rb->partialBytes;
+}
+
+//Appends bytes to the stream. Returns the number of blocks completed and enqueued in cbuf.
+//*outFull is set to true if cbuf was full and a block had to be dropped
+usize reblockerPush(reblocker_t* rb, const u8* data, usize bytes, bool* outFull);
+usize reblockerPushSilence(reblocker_t* rb, usize bytes, bool* outFull);
+
+//Completes the partial block with silence, or enqueues a whole block of silence if there
+//is no partial block, so that there is something to play right now. Writes into
+//*outSilenceBytes how much silence was added. Returns the number of blocks enqueued
+usize reblockerFlush(reblocker_t* rb, usize* outSilenceBytes);
+
+//Overwrites bytes of the stream starting at position (e.g. a recovered packet in place of
+//the silence that concealed it). Bytes already played (blocksPlayed blocks have been read
+//from cbuf) are skipped. Returns true if any byte was written
+bool reblockerOverwrite(reblocker_t* rb, u64 blocksPlayed, u64 position, const u8* data, usize bytes);
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE //O_DIRECT
+#include "audioc_record.h"
+#include "audioc_rtp.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+/*
+ * Writer thread
+ */
+
+//prefix-nnnnn.acr
+#define RECORD_MAX_FILE_PATH (RECORD_MAX_PATH + 16)
+
+static void recordPath(const recorder_t* recorder, u32 segment, char* path)
+{
+    snprintf(path, RECORD_MAX_FILE_PATH, "%s-%05u.acr", recorder->prefix, segment);
+}
+
+static void openSegment(record_writer_t* writer, recorder_t* recorder, u32 segment)
+{
+    char path[RECORD_MAX_FILE_PATH];
+    recordPath(recorder, segment, path);
+    recorder->fileBytes = 0;
+    recorder->direct = true;
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (recorder->fd < 0 && errno == EINVAL) {
+        //tmpfs and some others
+        recorder->direct = false;
+        writer->buffered = true;
+        recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (recorder->fd < 0) {
+        printError("Could not create the recording segment %s", path);
+        writer->errors++;
+    }
+}
+
+static bool writeAll(int fd, const u8* data, usize bytes)
+{
+    while (bytes > 0) {
+        isize n = write(fd, data, bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+static void writeBuffer(record_writer_t* writer, record_buffer_t* buffer)
+{
+    recorder_t* recorder = buffer->recorder;
+    if (buffer->first) {
+        openSegment(writer, recorder, buffer->segment);
+    }
+    if (recorder->fd < 0) {
+        return;
+    }
+
+    //Only the last buffer of a segment is not full: padded to the alignment, and the
+    //padding cut off once written
+    usize bytes = buffer->bytes;
+    if (recorder->direct && bytes % RECORD_ALIGNMENT != 0) {
+        usize padded = (bytes + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+        memset(buffer->data + bytes, 0, padded - bytes);
+        bytes = padded;
+    }
+    bool written = writeAll(recorder->fd, buffer->data, bytes);
+    recorder->fileBytes += buffer->bytes;
+    if (written && buffer->last && bytes != buffer->bytes) {
+        written = ftruncate(recorder->fd, recorder->fileBytes) == 0;
+    }
+    if (!written) {
+        printError("Could not write to the recording segment %u of %s", buffer->segment, recorder->prefix);
+        writer->errors++;
+        close(recorder->fd);
+        recorder->fd = -1;
+        return;
+    }
+    writer->bytesWritten += buffer->bytes;
+
+    if (buffer->last) {
+        close(recorder->fd);
+        recorder->fd = -1;
+        writer->segments++;
+    }
+}
+
+static void* writerThread(void* context)
+{
+    record_writer_t* writer = context;
+    //Created by a --realtime thread it would inherit its priority: disk writes must never
+    //compete with the playout
+    struct sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        while (!writer->head && !writer->stopping) {
+            pthread_cond_wait(&writer->ready, &writer->lock);
+        }
+        record_buffer_t* buffer = writer->head;
+        if (!buffer) {
+            break;
+        }
+        writer->head = buffer->next;
+        if (!writer->head) {
+            writer->tail = NULL;
+        }
+        pthread_mutex_unlock(&writer->lock);
+
+        writeBuffer(writer, buffer);
+
+        pthread_mutex_lock(&writer->lock);
+        buffer->next = writer->free;
+        writer->free = buffer;
+        writer->freeCount++;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+bool recordWriterStart(record_writer_t* writer, u32 recorders)
+{
+    u32 count = recorders + RECORD_SPARE_BUFFERS;
+    *writer = (record_writer_t) {
+        .buffers = calloc(count, sizeof(record_buffer_t)),
+    };
+    //Not from the arena: O_DIRECT needs the alignment
+    void* memory = NULL;
+    if (!writer->buffers || posix_memalign(&memory, RECORD_ALIGNMENT, (usize)count * RECORD_BUFFER_BYTES) != 0) {
+        free(writer->buffers);
+        return false;
+    }
+    writer->memory = memory;
+    for (u32 i = 0; i < count; i++) {
+        writer->buffers[i].data = writer->memory + (usize)i * RECORD_BUFFER_BYTES;
+        writer->buffers[i].next = writer->free;
+        writer->free = &writer->buffers[i];
+    }
+    writer->freeCount = count;
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->ready, NULL);
+    if (pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+        free(writer->buffers);
+        free(writer->memory);
+        return false;
+    }
+    return true;
+}
+
+void recordWriterStop(record_writer_t* writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    free(writer->buffers);
+    free(writer->memory);
+}
+
+/*
+ * Recorders
+ */
+
+//Takes from the writer the buffers that appending bytes needs, all or none
+static bool reserve(recorder_t* recorder, usize bytes)
+{
+    usize room = recorder->buffer ? RECORD_BUFFER_BYTES - recorder->buffer->bytes : 0;
+    u32 needed = bytes > room ? (bytes - room + RECORD_BUFFER_BYTES - 1) / RECORD_BUFFER_BYTES : 0;
+    if (needed == 0) {
+        return true;
+    }
+    record_writer_t* writer = recorder->writer;
+    pthread_mutex_lock(&writer->lock);
+    bool available = writer->freeCount >= needed;
+    if (available) {
+        for (u32 i = 0; i < needed; i++) {
+            record_buffer_t* buffer = writer->free;
+            writer->free = buffer->next;
+            buffer->next = recorder->spare;
+            recorder->spare = buffer;
+        }
+        writer->freeCount -= needed;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return available;
+}
+
+static void submit(recorder_t* recorder, bool last)
+{
+    record_buffer_t* buffer = recorder->buffer;
+    buffer->last = last;
+    buffer->next = NULL;
+    recorder->buffer = NULL;
+
+    record_writer_t* writer = recorder->writer;
+    pthread_mutex_lock(&writer->lock);
+    if (writer->tail) {
+        writer->tail->next = buffer;
+    } else {
+        writer->head = buffer;
+    }
+    writer->tail = buffer;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+//Within what reserve() took
+static void append(recorder_t* recorder, const u8* data, usize bytes)
+{
+    while (bytes > 0) {
+        if (recorder->buffer && recorder->buffer->bytes == RECORD_BUFFER_BYTES) {
+            submit(recorder, false);
+        }
+        if (!recorder->buffer) {
+            record_buffer_t* buffer = recorder->spare;
+            ASSERT(buffer);
+            recorder->spare = buffer->next;
+            *buffer = (record_buffer_t) {
+                .recorder = recorder,
+                .data = buffer->data,
+                .segment = recorder->segment,
+                .first = recorder->segmentBytes == 0,
+            };
+            recorder->buffer = buffer;
+        }
+        record_buffer_t* buffer = recorder->buffer;
+        usize chunk = MIN(bytes, RECORD_BUFFER_BYTES - buffer->bytes);
+        memcpy(buffer->data + buffer->bytes, data, chunk);
+        buffer->bytes += chunk;
+        recorder->segmentBytes += chunk;
+        recorder->recordedBytes += chunk;
+        data += chunk;
+        bytes -= chunk;
+    }
+}
+
+static void closeSegment(recorder_t* recorder)
+{
+    if (recorder->segmentBytes == 0) {
+        return;
+    }
+    //Without a free buffer for it the segment goes without index
+    usize indexBytes = recorder->indexCount * RECORD_INDEX_ENTRY_SIZE + RECORD_INDEX_TRAILER_SIZE;
+    if (reserve(recorder, indexBytes)) {
+        u8 entry[RECORD_INDEX_ENTRY_SIZE];
+        for (u32 i = 0; i < recorder->indexCount; i++) {
+            writeU32(entry, recorder->index[2 * i]);
+            writeU32(entry + 4, recorder->index[2 * i + 1]);
+            append(recorder, entry, sizeof(entry));
+        }
+        writeU32(entry, recorder->indexCount);
+        memcpy(entry + 4, RECORD_INDEX_MAGIC, 4);
+        append(recorder, entry, sizeof(entry));
+    }
+    submit(recorder, true);
+    recorder->segment++;
+    recorder->segmentBytes = 0;
+    recorder->indexCount = 0;
+}
+
+//Opens the segment, or the next one when position is past its end, before the frame
+static void writeFrame(recorder_t* recorder, u64 position, const u8* body, usize bodyBytes)
+{
+    if (recorder->segmentBytes > 0 && position - recorder->segmentStart >= recorder->segmentLength) {
+        closeSegment(recorder);
+    }
+    bool opening = recorder->segmentBytes == 0;
+    usize headerBytes = opening ? RECORD_HEADER_SIZE : 0;
+    if (!reserve(recorder, headerBytes + RECORD_FRAME_HEADER_SIZE + bodyBytes)) {
+        recorder->droppedFrames++;
+        return;
+    }
+
+    if (opening) {
+        recorder->segmentStart = position;
+        recorder->nextIndexPosition = 0;
+        u8 header[RECORD_HEADER_SIZE] = {0};
+        memcpy(header, RECORD_MAGIC, 4);
+        header[4] = recorder->format;
+        writeU32(header + 8, recorder->rate);
+        writeU32(header + 12, recorder->segment);
+        writeU32(header + 16, position >> 32);
+        writeU32(header + 20, (u32)position);
+        append(recorder, header, sizeof(header));
+    }
+
+    u32 relative = position - recorder->segmentStart;
+    if (relative >= recorder->nextIndexPosition && recorder->indexCount < recorder->indexCapacity) {
+        recorder->index[2 * recorder->indexCount] = relative;
+        recorder->index[2 * recorder->indexCount + 1] = recorder->segmentBytes;
+        recorder->indexCount++;
+        recorder->nextIndexPosition = (relative / recorder->indexInterval + 1) * recorder->indexInterval;
+    }
+
+    u8 header[RECORD_FRAME_HEADER_SIZE];
+    writeU32(header, bodyBytes);
+    writeU32(header + 4, relative);
+    append(recorder, header, sizeof(header));
+    append(recorder, body, bodyBytes);
+}
+
+static void flushPending(recorder_t* recorder)
+{
+    if (recorder->pendingCount == 0) {
+        return;
+    }
+    usize bytes = losslessEncode(recorder->pending, recorder->pendingCount, recorder->frame);
+    writeFrame(recorder, recorder->position, recorder->frame, bytes);
+    recorder->position += recorder->pendingCount;
+    recorder->pendingCount = 0;
+}
+
+bool recorderOpen(recorder_t* recorder, record_writer_t* writer, const char* directory, const char* name,
+    record_format_t format, u32 rate, u32 segmentSeconds)
+{
+    *recorder = (recorder_t) {
+        .writer = writer,
+        .format = format,
+        .rate = format == RECORD_RTP ? RECORD_RTP_RATE : rate,
+        .indexInterval = format == RECORD_RTP ? RECORD_RTP_INDEX_US : RECORD_FRAME_SAMPLES,
+        .fd = -1,
+    };
+    snprintf(recorder->prefix, sizeof(recorder->prefix), "%s/%s", directory, name);
+    recorder->segmentLength = (u64)MIN(MAX(segmentSeconds, 1), RECORD_MAX_SEGMENT_SECONDS) * recorder->rate;
+    recorder->indexCapacity = recorder->segmentLength / recorder->indexInterval + 2;
+    recorder->index = malloc(recorder->indexCapacity * 2 * sizeof(u32));
+    return recorder->index != NULL;
+}
+
+bool recordOpenSession(const record_params_t* params, record_writer_t* writer, u16 port,
+    record_format_t audioFormat, recorder_t* audio, recorder_t* rtp)
+{
+    char name[32];
+    *audio = (recorder_t) { .fd = -1 };
+    *rtp = (recorder_t) { .fd = -1 };
+    if (params->audioDirectory) {
+        snprintf(name, sizeof(name), "audio-%u", port);
+        if (!recorderOpen(audio, writer, params->audioDirectory, name, audioFormat, 8000, params->audioSeconds)) {
+            return false;
+        }
+    }
+    if (params->rtpDirectory) {
+        snprintf(name, sizeof(name), "rtp-%u", port);
+        if (!recorderOpen(rtp, writer, params->rtpDirectory, name, RECORD_RTP, 0, params->rtpSeconds)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void recorderAudio(recorder_t* recorder, const u8* data, usize bytes)
+{
+    if (!recorder->writer) {
+        return;
+    }
+    recorder->inputBytes += bytes;
+    while (bytes > 0) {
+        i16* sample = &recorder->pending[recorder->pendingCount];
+        if (recorder->format == RECORD_ULAW) {
+            *sample = losslessUlawToIndex(*data);
+            data++;
+            bytes--;
+        } else if (recorder->hasCarry) {
+            *sample = (i16)(recorder->carry << 8 | data[0]);
+            recorder->hasCarry = false;
+            data++;
+            bytes--;
+        } else if (bytes >= 2) {
+            *sample = (i16)readU16(data);
+            data += 2;
+            bytes -= 2;
+        } else {
+            recorder->carry = *data;
+            recorder->hasCarry = true;
+            return;
+        }
+        if (++recorder->pendingCount == RECORD_FRAME_SAMPLES) {
+            flushPending(recorder);
+        }
+    }
+}
+
+void recorderPacket(recorder_t* recorder, const void* datagram, usize size, i64 arrivalNs)
+{
+    if (!recorder->writer) {
+        return;
+    }
+    if (!recorder->started) {
+        recorder->started = true;
+        recorder->startNs = arrivalNs;
+    }
+    recorder->inputBytes += size;
+    //Arrival times of software stamps may go back a little: positions do not
+    recorder->position = MAX(recorder->position, (u64)MAX(arrivalNs - recorder->startNs, 0) / 1000);
+    writeFrame(recorder, recorder->position, datagram, size);
+}
+
+void recorderClose(recorder_t* recorder)
+{
+    if (!recorder->writer) {
+        return;
+    }
+    flushPending(recorder);
+    closeSegment(recorder);
+    free(recorder->index);
+    recorder->index = NULL;
+}
+
+void recordPrint(const record_writer_t* writer, const recorder_t* recorders, u32 count)
+{
+    u64 audioIn = 0, audioOut = 0, rtpIn = 0, dropped = 0;
+    for (u32 i = 0; i < count; i++) {
+        const recorder_t* r = &recorders[i];
+        if (r->format == RECORD_RTP) {
+            rtpIn += r->inputBytes;
+        } else {
+            audioIn += r->inputBytes;
+            audioOut += r->recordedBytes;
+        }
+        dropped += r->droppedFrames;
+    }
+    printf("Recorded %u segments, %lu bytes written%s, %u errors, %lu frames dropped (the writer fell behind)\n",
+        writer->segments, writer->bytesWritten, writer->buffered ? " (not all with O_DIRECT)" : " with O_DIRECT",
+        writer->errors, dropped);
+    if (audioIn > 0) {
+        printf("\tAudio: %lu bytes played, recorded in %lu (%.1f%%)\n", audioIn, audioOut, 100.0 * audioOut / audioIn);
+    }
+    if (rtpIn > 0) {
+        printf("\tRTP: %lu bytes of datagrams\n", rtpIn);
+    }
+}
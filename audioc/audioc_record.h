@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_lossless.h"
+
+#include <pthread.h>
+
+//Session recording (--record, --record-rtp) in segment files of a fixed duration. The
+//audio played and the datagrams received are teed into recorders, which only encode and
+//copy into memory buffers; a writer thread, shared by every recorder of the process (one
+//per session of --server), does all the file I/O with O_DIRECT (a buffered write() when
+//the file system refuses it), so the disk never stalls the playout. When the writer falls
+//behind and no buffer is free, frames are dropped, never waited for.
+//
+//  Segment: header, frames, seek index
+//  Header (RECORD_HEADER_SIZE): "ACR1", format (1 byte), 3 reserved, rate (4), segment
+//      number (4), position of the segment start since the recording started (8)
+//  Frame: body size (4), position since the segment start (4), body: a lossless frame
+//      (audioc_lossless.h) for audio, the datagram as received for RTP
+//  Index: (position, offset of the frame in the file) pairs of 4 bytes, every audio frame
+//      or every RECORD_RTP_INDEX_US of packets, then the number of pairs (4) and "ACRI"
+//  Positions are samples for audio, microseconds of arrival time for RTP. Every field is
+//  in network byte order. A segment without index (the recording was cut short) can still
+//  be read frame by frame.
+
+#define RECORD_MAGIC "ACR1"
+#define RECORD_INDEX_MAGIC "ACRI"
+#define RECORD_HEADER_SIZE 24
+#define RECORD_FRAME_HEADER_SIZE 8
+#define RECORD_INDEX_ENTRY_SIZE 8
+#define RECORD_INDEX_TRAILER_SIZE 8
+//256 ms at 8 kHz: the seek granularity of audio
+#define RECORD_FRAME_SAMPLES 2048
+#define RECORD_RTP_INDEX_US 250000
+#define RECORD_RTP_RATE 1000000
+
+#define RECORD_MAX_SEGMENT_SECONDS 600
+//Unit of hand-off to the writer and of its writes. Multiple of RECORD_ALIGNMENT
+#define RECORD_BUFFER_BYTES (16 * 1024)
+//Of O_DIRECT buffers, file offsets and lengths
+#define RECORD_ALIGNMENT 4096
+//Buffers of the writer: each recorder holds one being filled, the rest absorb the writes
+//in flight
+#define RECORD_SPARE_BUFFERS 32
+#define RECORD_MAX_PATH 256
+
+//What --record and --record-rtp ask for. NULL directory: not recorded
+typedef struct {
+    const char* audioDirectory;
+    u32 audioSeconds;
+    const char* rtpDirectory;
+    u32 rtpSeconds;
+} record_params_t;
+
+typedef enum {
+    RECORD_L16 = 1,         //Audio, big endian 16 bit samples (payload L16)
+    RECORD_ULAW,            //Audio, mu-law codes (payload PCMU), coded as their indices
+    RECORD_RTP,             //Datagrams received, RTP and RTCP
+} record_format_t;
+
+struct recorder;
+
+typedef struct record_buffer {
+    struct record_buffer* next;
+    struct recorder* recorder;
+    u8* data;               //RECORD_BUFFER_BYTES, aligned for O_DIRECT
+    u32 bytes;
+    u32 segment;
+    bool first;             //Creates the segment file
+    bool last;              //Closes it
+} record_buffer_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    bool stopping;
+    record_buffer_t* free;  //Stack
+    u32 freeCount;
+    record_buffer_t* head;  //To be written, in order
+    record_buffer_t* tail;
+
+    record_buffer_t* buffers;
+    u8* memory;
+
+    //Writer thread, read once it stopped
+    u64 bytesWritten;
+    u32 segments;
+    u32 errors;
+    bool buffered;          //Some file did not take O_DIRECT
+} record_writer_t;
+
+typedef struct recorder {
+    record_writer_t* writer;
+    char prefix[RECORD_MAX_PATH]; //Segment n is prefix-nnnnn.acr
+    record_format_t format;
+    u32 rate;
+    u64 segmentLength;      //In position units
+    u64 indexInterval;
+
+    //Playout or receive thread
+    bool started;
+    i64 startNs;            //RTP: arrival of the first datagram
+    u64 position;           //Next sample (audio) or last arrival (RTP) since the start
+    u32 segment;
+    u64 segmentStart;
+    u32 segmentBytes;       //Offset of the next frame, 0 if the segment is not open
+    u64 nextIndexPosition;
+    u32* index;             //Pairs (position, offset)
+    u32 indexCount;
+    u32 indexCapacity;
+    record_buffer_t* buffer; //Being filled
+    record_buffer_t* spare; //Taken from the writer for the frame being appended
+    i16 pending[RECORD_FRAME_SAMPLES];
+    u32 pendingCount;
+    u8 carry;               //L16: first byte of a sample split between two calls
+    bool hasCarry;
+    u8 frame[RECORD_FRAME_HEADER_SIZE + LOSSLESS_MAX_FRAME_BYTES(RECORD_FRAME_SAMPLES)];
+
+    //Writer thread
+    int fd;
+    bool direct;
+    u64 fileBytes;
+
+    u64 inputBytes;         //As played or received
+    u64 recordedBytes;      //Headers, frames and indexes given to the writer
+    u64 droppedFrames;      //No buffer was free
+} recorder_t;
+
+//Starts the writer thread with buffers for recorders recorders. Returns false if the
+//memory or the thread could not be had
+bool recordWriterStart(record_writer_t* writer, u32 recorders);
+
+//Writes everything queued and stops the thread. Close the recorders first
+void recordWriterStop(record_writer_t* writer);
+
+//Records into directory/name-nnnnn.acr, segmentSeconds per file (rounded to whole
+//frames for audio). Audio is at rate samples per second. Returns false if out of memory
+bool recorderOpen(recorder_t* recorder, record_writer_t* writer, const char* directory, const char* name,
+    record_format_t format, u32 rate, u32 segmentSeconds);
+
+//The recorders params asks for, of the session on port: audio-PORT (at 8000 Hz) and
+//rtp-PORT. Those not asked for are zeroed. Returns false if out of memory
+bool recordOpenSession(const record_params_t* params, record_writer_t* writer, u16 port,
+    record_format_t audioFormat, recorder_t* audio, recorder_t* rtp);
+
+//Audio as played (PCMU bytes, or L16 big endian), gaps included. Recorders never opened
+//(zeroed) ignore it, and the other calls below
+void recorderAudio(recorder_t* recorder, const u8* data, usize bytes);
+
+//A datagram as received (network byte order), arrival time in ns of any clock
+void recorderPacket(recorder_t* recorder, const void* datagram, usize size, i64 arrivalNs);
+
+//Encodes what is pending and closes the segment
+void recorderClose(recorder_t* recorder);
+
+//Figures of the writer and of count recorders (closed, the writer stopped)
+void recordPrint(const record_writer_t* writer, const recorder_t* recorders, u32 count);
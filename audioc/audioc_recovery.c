@@ -0,0 +1,76 @@
+#include "audioc_recovery.h"
+#include "audioc_rtp.h"
+
+void concealedGapAdd(concealed_gaps_t* gaps, u32 ts, u32 samples, u64 position)
+{
+    if (samples == 0) {
+        return;
+    }
+    gaps->gaps[gaps->next] = (concealed_gap_t) {
+        .used = true,
+        .ts = ts,
+        .samples = samples,
+        .position = position,
+    };
+    gaps->next = (gaps->next + 1) % RECOVERY_MAX_GAPS;
+}
+
+void concealedGapTruncate(concealed_gaps_t* gaps, u64 position, u32 bytesPerSample)
+{
+    for (u32 i = 0; i < RECOVERY_MAX_GAPS; i++) {
+        concealed_gap_t* gap = &gaps->gaps[i];
+        if (!gap->used || gap->position + (u64)gap->samples * bytesPerSample <= position) {
+            continue;
+        }
+        if (gap->position >= position) {
+            gap->used = false;
+        } else {
+            gap->samples = (position - gap->position) / bytesPerSample;
+        }
+    }
+}
+
+bool concealedGapFill(concealed_gaps_t* gaps, reblocker_t* rb, u64 blocksPlayed, u32 bytesPerSample,
+    u32 ts, const u8* payload, usize bytes)
+{
+    u32 samples = bytes / bytesPerSample;
+    for (u32 i = 0; i < RECOVERY_MAX_GAPS; i++) {
+        concealed_gap_t* gap = &gaps->gaps[i];
+        if (!gap->used) {
+            continue;
+        }
+
+        //Part of the packet inside the gap
+        i64 start = timestampDifference(gap->ts, ts);
+        i64 end = start + samples;
+        if (end <= 0 || start >= gap->samples) {
+            continue;
+        }
+        i64 fillStart = MAX(start, 0);
+        i64 fillEnd = MIN(end, (i64)gap->samples);
+
+        bool written = reblockerOverwrite(rb, blocksPlayed, gap->position + fillStart * bytesPerSample,
+            payload + (fillStart - start) * bytesPerSample, (fillEnd - fillStart) * bytesPerSample);
+
+        //What is left of the gap, at both sides of the filled samples
+        concealed_gap_t left = *gap, right = *gap;
+        left.samples = fillStart;
+        right.ts = gap->ts + fillEnd;
+        right.samples = gap->samples - fillEnd;
+        right.position = gap->position + fillEnd * bytesPerSample;
+
+        gap->used = false;
+        if (left.samples > 0) {
+            *gap = left;
+            if (gaps->next == i) {
+                //Do not let the right part replace it
+                gaps->next = (gaps->next + 1) % RECOVERY_MAX_GAPS;
+            }
+        }
+        if (right.samples > 0) {
+            concealedGapAdd(gaps, right.ts, right.samples, right.position);
+        }
+        return written;
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_reblock.h"
+
+//Gaps left by lost packets whose replacement silence is still queued in the jitter
+//buffer. A late copy of a packet in a gap (FEC recovery, redundancy, retransmission)
+//overwrites that silence as long as it has not been played yet. Gaps are kept by RTP
+//timestamp, so packets of any duration can fill them.
+
+#define RECOVERY_MAX_GAPS 64 //Gaps remembered at the same time, the oldest is forgotten first
+
+typedef struct {
+    bool used;
+    u32 ts;        //Timestamp of the first missing sample
+    u32 samples;
+    u64 position;  //Stream position (see reblocker_t) of the first missing sample
+} concealed_gap_t;
+
+typedef struct {
+    concealed_gap_t gaps[RECOVERY_MAX_GAPS];
+    u32 next;
+} concealed_gaps_t;
+
+//Records that the samples [ts, ts + samples) were concealed with silence at position
+void concealedGapAdd(concealed_gaps_t* gaps, u32 ts, u32 samples, u64 position);
+
+//Forgets what was concealed at or after position: the jitter buffer was full and the
+//block starting there was dropped, so the bytes that follow take its place in the stream
+void concealedGapTruncate(concealed_gaps_t* gaps, u64 position, u32 bytesPerSample);
+
+//Writes the samples of a late packet starting at timestamp ts over the silence that
+//concealed them, if they have not been played yet. blocksPlayed is the number of blocks
+//read from the jitter buffer since the session started. Returns true if any sample made it
+bool concealedGapFill(concealed_gaps_t* gaps, reblocker_t* rb, u64 blocksPlayed, u32 bytesPerSample,
+    u32 ts, const u8* payload, usize bytes);
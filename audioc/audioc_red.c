@@ -0,0 +1,120 @@
+#include "audioc_red.h"
+#include "g711.h"
+
+bool redEncoderInit(red_encoder_t* enc, u32 depth, bool pcmuBackup, u8 primaryPt, usize fragmentBytes,
+    const allocator_t* allocator)
+{
+    ASSERT(depth >= 1 && depth <= RED_MAX_DEPTH);
+    bool transcode = pcmuBackup && primaryPt == L16_1;
+    *enc = (red_encoder_t) {
+        .depth = depth,
+        .primaryPt = primaryPt,
+        .backupPt = transcode ? PCMU : primaryPt,
+        //L16 samples are 2 bytes long, PCMU ones 1 byte
+        .backupBytes = transcode ? fragmentBytes / 2 : fragmentBytes,
+        .allocator = allocator,
+    };
+    if (enc->backupBytes > RED_MAX_BLOCK_BYTES) {
+        return false;
+    }
+
+    for (u32 i = 0; i < depth; i++) {
+        enc->history[i] = allocatorAlloc(allocator, enc->backupBytes);
+        if (!enc->history[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void redEncoderDestroy(red_encoder_t* enc)
+{
+    for (u32 i = 0; i < RED_MAX_DEPTH; i++) {
+        allocatorFree(enc->allocator, enc->history[i]);
+        enc->history[i] = NULL;
+    }
+}
+
+usize redEncoderBuild(red_encoder_t* enc, const u8* primary, usize primaryBytes, u32 samplesPerPacket, u8* outPayload)
+{
+    ASSERT(enc->depth * samplesPerPacket <= RED_MAX_TS_OFFSET);
+    u8* header = outPayload;
+    u8* data = outPayload + enc->count * RED_BLOCK_HEADER_SIZE + RED_PRIMARY_HEADER_SIZE;
+
+    //Oldest fragment first
+    for (u32 age = enc->count; age >= 1; age--) {
+        u32 slot = (enc->next + enc->depth - age) % enc->depth;
+        u32 tsOffset = age * samplesPerPacket;
+        u32 bits = (tsOffset << 10) | (u32)enc->backupBytes;
+
+        header[0] = 0x80 | enc->backupPt;
+        header[1] = (u8)(bits >> 16);
+        header[2] = (u8)(bits >> 8);
+        header[3] = (u8)bits;
+        header += RED_BLOCK_HEADER_SIZE;
+
+        memcpy(data, enc->history[slot], enc->backupBytes);
+        data += enc->backupBytes;
+    }
+    *header = enc->primaryPt;
+    memcpy(data, primary, primaryBytes);
+    data += primaryBytes;
+
+    //Keep the primary for the next packets
+    u8* saved = enc->history[enc->next];
+    if (enc->backupPt == enc->primaryPt) {
+        ASSERT(primaryBytes == enc->backupBytes);
+        memcpy(saved, primary, primaryBytes);
+    } else {
+        g711L16BEToUlaw(primary, saved, enc->backupBytes);
+    }
+    enc->next = (enc->next + 1) % enc->depth;
+    enc->count = MIN(enc->count + 1, enc->depth);
+
+    return data - outPayload;
+}
+
+isize redSplit(const u8* payload, usize payloadBytes, red_block_t* blocks, usize maxBlocks)
+{
+    usize count = 0;
+    usize offset = 0;
+    usize dataBytes = 0;
+
+    //Headers
+    while (true) {
+        if (count == maxBlocks || offset >= payloadBytes) {
+            return -1;
+        }
+        const u8* header = payload + offset;
+        red_block_t* block = &blocks[count++];
+        block->pt = header[0] & 0x7F;
+        if (!(header[0] & 0x80)) {
+            //Primary block, takes the rest of the payload
+            block->tsOffset = 0;
+            offset += RED_PRIMARY_HEADER_SIZE;
+            break;
+        }
+        if (offset + RED_BLOCK_HEADER_SIZE > payloadBytes) {
+            return -1;
+        }
+        u32 bits = ((u32)header[1] << 16) | ((u32)header[2] << 8) | header[3];
+        block->tsOffset = bits >> 10;
+        block->bytes = bits & 0x3FF;
+        dataBytes += block->bytes;
+        offset += RED_BLOCK_HEADER_SIZE;
+    }
+
+    if (offset + dataBytes > payloadBytes) {
+        return -1;
+    }
+
+    //Data
+    for (usize i = 0; i < count - 1; i++) {
+        blocks[i].data = payload + offset;
+        offset += blocks[i].bytes;
+    }
+    blocks[count - 1].data = payload + offset;
+    blocks[count - 1].bytes = payloadBytes - offset;
+
+    return count;
+}
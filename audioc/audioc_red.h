@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+#include "audioc_allocator.h"
+
+//Redundant audio data, RFC 2198.
+//Every packet carries, besides the current fragment (primary block), copies of the
+//previous RED_MAX_DEPTH fragments at most, optionally in PCMU when the primary is L16.
+//A receiver that lost a packet fills the gap with the copy carried by a later one.
+//
+//  Payload: [block header (4 bytes)] * redundant blocks, primary header (1 byte),
+//           redundant data (oldest first), primary data
+
+#define RED_PAYLOAD_TYPE 122        //Dynamic payload type for redundant audio packets
+#define RED_MAX_DEPTH 2             //Previous fragments carried in each packet
+#define RED_MAX_BLOCKS (RED_MAX_DEPTH + 1)
+#define RED_BLOCK_HEADER_SIZE 4     //F + block PT, timestamp offset (14 bits), length (10 bits)
+#define RED_PRIMARY_HEADER_SIZE 1   //F + block PT
+#define RED_MAX_BLOCK_BYTES 1023
+#define RED_MAX_TS_OFFSET 16383
+
+//Largest RED payload when the primary fragment is fragmentBytes long
+#define RED_MAX_PAYLOAD(fragmentBytes) \
+    (RED_MAX_DEPTH * (RED_BLOCK_HEADER_SIZE + (fragmentBytes)) + RED_PRIMARY_HEADER_SIZE + (fragmentBytes))
+
+typedef struct {
+    u32 depth;
+    u8 primaryPt;
+    u8 backupPt;
+    usize backupBytes;          //Length of each redundant block
+    u8* history[RED_MAX_DEPTH]; //Last fragments sent, already in the backup encoding
+    u32 next;                   //history slot for the next fragment
+    u32 count;                  //Fragments in history, up to depth
+    const allocator_t* allocator;
+} red_encoder_t;
+
+//One block of a received packet. data points into the packet, nothing is copied
+typedef struct {
+    u8 pt;
+    u32 tsOffset;  //How many timestamp units before the packet timestamp the block starts
+    const u8* data;
+    usize bytes;
+} red_block_t;
+
+//pcmuBackup sends the redundant copies of L16 fragments as PCMU. Return false if the
+//fragments do not fit in a RFC 2198 block or memory could not be allocated
+bool redEncoderInit(red_encoder_t* enc, u32 depth, bool pcmuBackup, u8 primaryPt, usize fragmentBytes,
+    const allocator_t* allocator);
+void redEncoderDestroy(red_encoder_t* enc);
+
+//Writes into outPayload the RED payload for the primary fragment, with the fragments
+//given in the previous calls as redundant blocks, and remembers the primary for the next
+//ones. outPayload must hold RED_MAX_PAYLOAD(primaryBytes). Returns the payload length
+usize redEncoderBuild(red_encoder_t* enc, const u8* primary, usize primaryBytes, u32 samplesPerPacket, u8* outPayload);
+
+//Splits a received RED payload in its blocks, the primary one last. Returns the number
+//of blocks, or -1 if the payload is malformed or has more than maxBlocks blocks
+isize redSplit(const u8* payload, usize payloadBytes, red_block_t* blocks, usize maxBlocks);
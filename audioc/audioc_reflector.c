@@ -0,0 +1,296 @@
+#define _GNU_SOURCE //sendmmsg
+#include "audioc_reflector.h"
+#include "audioc_arena.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+
+static volatile sig_atomic_t reflectorStopRequested = 0;
+
+static void reflectorSignalHandler(int sigNum)
+{
+    (void) sigNum;
+    reflectorStopRequested = 1;
+}
+
+bool reflectorInit(reflector_t* reflector)
+{
+    *reflector = (reflector_t) {
+        .sendSockId = socket(AF_INET, SOCK_DGRAM, 0),
+        .subscribers = arenaCalloc(REFLECTOR_MAX_SUBSCRIBERS, sizeof(struct sockaddr_in)),
+        .messages = arenaCalloc(REFLECTOR_MAX_SUBSCRIBERS, sizeof(struct mmsghdr)),
+        .segmentMessages = arenaCalloc(REFLECTOR_MAX_SUBSCRIBERS, sizeof(struct mmsghdr)),
+    };
+    if (reflector->sendSockId < 0 || !reflector->subscribers || !reflector->messages || !reflector->segmentMessages) {
+        return false;
+    }
+    reflector->gso = socketGsoAvailable(reflector->sendSockId);
+
+    //A whole fan-out may be queued at once
+    int sendBuffer = 4 * 1024 * 1024;
+    setsockopt(reflector->sendSockId, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+
+    for (u32 i = 0; i < REFLECTOR_MAX_SUBSCRIBERS; i++) {
+        reflector->messages[i].msg_hdr = (struct msghdr) {
+            .msg_name = &reflector->subscribers[i],
+            .msg_namelen = sizeof(struct sockaddr_in),
+            .msg_iov = &reflector->packet,
+            .msg_iovlen = 1,
+        };
+        reflector->segmentMessages[i] = reflector->messages[i];
+        reflector->segmentMessages[i].msg_hdr.msg_control = reflector->segmentControl.buffer;
+        reflector->segmentMessages[i].msg_hdr.msg_controllen = sizeof(reflector->segmentControl.buffer);
+    }
+    return true;
+}
+
+void reflectorDestroy(reflector_t* reflector)
+{
+    if (reflector->sendSockId >= 0) {
+        close(reflector->sendSockId);
+    }
+    arenaFree(reflector->subscribers);
+    arenaFree(reflector->messages);
+    arenaFree(reflector->segmentMessages);
+    reflector->subscribers = NULL;
+    reflector->messages = NULL;
+    reflector->segmentMessages = NULL;
+}
+
+static isize findSubscriber(const reflector_t* reflector, struct sockaddr_in subscriber)
+{
+    for (u32 i = 0; i < reflector->count; i++) {
+        const struct sockaddr_in* s = &reflector->subscribers[i];
+        if (s->sin_addr.s_addr == subscriber.sin_addr.s_addr && s->sin_port == subscriber.sin_port) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool reflectorAdd(reflector_t* reflector, struct sockaddr_in subscriber)
+{
+    if (reflector->count == REFLECTOR_MAX_SUBSCRIBERS || findSubscriber(reflector, subscriber) >= 0) {
+        return false;
+    }
+    subscriber.sin_family = AF_INET;
+    reflector->subscribers[reflector->count++] = subscriber;
+    return true;
+}
+
+bool reflectorRemove(reflector_t* reflector, struct sockaddr_in subscriber)
+{
+    isize index = findSubscriber(reflector, subscriber);
+    if (index < 0) {
+        return false;
+    }
+    //The messages keep pointing to the same slots: only the addresses move
+    reflector->subscribers[index] = reflector->subscribers[--reflector->count];
+    return true;
+}
+
+//Sends messages to the subscribers from next on, each message being datagrams datagrams.
+//Returns where it stopped: the end, or the subscriber whose segmented send the kernel
+//refused (EIO: the device cannot checksum it, EINVAL: too many segments)
+static u32 sendFrom(reflector_t* reflector, struct mmsghdr* messages, u32 next, u32 datagrams)
+{
+    while (next < reflector->count) {
+        int n = sendmmsg(reflector->sendSockId, &messages[next], MIN(reflector->count - next, REFLECTOR_BATCH), 0);
+        reflector->calls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (datagrams > 1 && (errno == EIO || errno == EINVAL)) break;
+            //Only the first message of the batch failed: skip that subscriber
+            reflector->sendErrors += datagrams;
+            next++;
+            continue;
+        }
+        reflector->sent += (u64)n * datagrams;
+        next += n;
+    }
+    return next;
+}
+
+void reflectorFanOut(reflector_t* reflector, const void* datagram, usize size, u32 segmentBytes)
+{
+    u32 segments = 1;
+    if (segmentBytes > 0 && segmentBytes < size) {
+        segments = (size + segmentBytes - 1) / segmentBytes;
+    } else {
+        segmentBytes = size;
+    }
+    reflector->packets += segments;
+
+    u32 next = 0;
+    if (segments > 1 && reflector->gso) {
+        //As it came: the kernel splits it again for each subscriber
+        reflector->packet = (struct iovec) { .iov_base = (void*) datagram, .iov_len = size };
+        socketSegmentControl(&reflector->segmentControl, segmentBytes);
+        next = sendFrom(reflector, reflector->segmentMessages, 0, segments);
+        reflector->segmentedSends += next;
+        if (next == reflector->count) {
+            return;
+        }
+        reflector->gso = false;
+        printError("The kernel refused UDP_SEGMENT, sending datagram by datagram");
+    }
+
+    for (u32 i = 0; i < segments; i++) {
+        usize offset = (usize)i * segmentBytes;
+        reflector->packet = (struct iovec) { .iov_base = (u8*) datagram + offset, .iov_len = MIN(segmentBytes, size - offset) };
+        sendFrom(reflector, reflector->messages, next, 1);
+    }
+}
+
+static bool parseSubscriber(const char* text, struct sockaddr_in* subscriber)
+{
+    char ip[INET_ADDRSTRLEN];
+    u32 port;
+    if (sscanf(text, "%15[0-9.]:%u", ip, &port) != 2 || port == 0 || port > 65535) {
+        return false;
+    }
+    *subscriber = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    return inet_pton(AF_INET, ip, &subscriber->sin_addr) == 1;
+}
+
+void reflectorCommand(reflector_t* reflector, const char* command, char* reply, usize replySize)
+{
+    struct sockaddr_in subscriber;
+    if (strncmp(command, "add ", 4) == 0 && parseSubscriber(command + 4, &subscriber)) {
+        bool added = reflectorAdd(reflector, subscriber);
+        snprintf(reply, replySize, added ? "ok %u\n" : "error: already subscribed or full (%u)\n", reflector->count);
+    } else if (strncmp(command, "del ", 4) == 0 && parseSubscriber(command + 4, &subscriber)) {
+        bool removed = reflectorRemove(reflector, subscriber);
+        snprintf(reply, replySize, removed ? "ok %u\n" : "error: not subscribed (%u)\n", reflector->count);
+    } else if (strncmp(command, "list", 4) == 0) {
+        usize used = snprintf(reply, replySize, "%u subscribers\n", reflector->count);
+        for (u32 i = 0; i < reflector->count && used < replySize; i++) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &reflector->subscribers[i].sin_addr, ip, sizeof(ip));
+            used += snprintf(reply + used, replySize - used, "%s:%u\n", ip, ntohs(reflector->subscribers[i].sin_port));
+        }
+    } else {
+        snprintf(reply, replySize, "error: use 'add IP:PORT', 'del IP:PORT' or 'list'\n");
+    }
+}
+
+static int openControlSocket(u16 port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockId < 0) {
+        panic("socket error");
+    }
+    if (bind(sockId, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        panic("Control socket bind error on port %u!\n", port);
+    }
+    return sockId;
+}
+
+static void control(reflector_t* reflector, int controlSockId)
+{
+    char command[REFLECTOR_MAX_COMMAND + 1];
+    //Replies to 'list' hold every subscriber, but have to fit in a datagram
+    static char reply[MAX_DATAGRAM_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+
+    isize length = recvfrom(controlSockId, command, REFLECTOR_MAX_COMMAND, 0, (struct sockaddr *)&from, &fromLength);
+    if (length < 0) {
+        printError("recvfrom error on the control socket");
+        return;
+    }
+    while (length > 0 && (command[length - 1] == '\n' || command[length - 1] == '\r')) {
+        length--;
+    }
+    command[length] = '\0';
+
+    reflectorCommand(reflector, command, reply, sizeof(reply));
+    trace("Control '%s': %s", command, reply);
+    if (sendto(controlSockId, reply, strlen(reply), 0, (struct sockaddr *)&from, fromLength) < 0) {
+        printError("Could not reply to a control command");
+    }
+}
+
+static i64 cpuTimeUs(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        panic("getrusage error");
+    }
+    return (i64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int runReflector(int groupSockId, u16 controlPort)
+{
+    struct sigaction sigInfo = {
+        .sa_handler = reflectorSignalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if ((sigaction(SIGINT, &sigInfo, NULL)) < 0) {
+        panic("Error installing signal.");
+    }
+
+    reflector_t reflector;
+    //Up to SOCKET_MAX_SEGMENTS datagrams of the group at once
+    u8* datagram = arenaAlloc(SOCKET_GRO_BUFFER_BYTES);
+    if (!reflectorInit(&reflector) || !datagram) {
+        panic("Could not set up the reflector");
+    }
+    bool gro = socketEnableGro(groupSockId);
+    int controlSockId = openControlSocket(controlPort);
+    i64 startCpu = cpuTimeUs();
+
+    printf("Reflecting the group to its subscribers, control on 127.0.0.1:%u, Ctrl+C to stop.\n", controlPort);
+
+    while (!reflectorStopRequested) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(groupSockId, &readSet);
+        FD_SET(controlSockId, &readSet);
+
+        if (select(MAX(groupSockId, controlSockId) + 1, &readSet, NULL, NULL, NULL) < 0) {
+            if (errno == EINTR) continue;
+            panic("select() error!");
+        }
+
+        if (FD_ISSET(controlSockId, &readSet)) {
+            control(&reflector, controlSockId);
+        }
+        if (FD_ISSET(groupSockId, &readSet)) {
+            u32 segmentBytes;
+            isize result = socketReceiveSegments(groupSockId, datagram, SOCKET_GRO_BUFFER_BYTES, &segmentBytes);
+            if (result < 0) {
+                panic("recvfrom error");
+            }
+            reflectorFanOut(&reflector, datagram, result, segmentBytes);
+        }
+    }
+
+    i64 cpuUs = cpuTimeUs() - startCpu;
+    printf("\nInterrupted audioc reflector\n");
+    printf("Packets received: %lu, sent: %lu to %u subscribers, send errors: %lu\n", reflector.packets,
+        reflector.sent, reflector.count, reflector.sendErrors);
+    printf("UDP GRO: %s, GSO: %s, messages split by the kernel: %lu\n", gro ? "on" : "off",
+        reflector.gso ? "on" : "off", reflector.segmentedSends);
+    printf("sendmmsg() calls: %lu, CPU time: %ld us (%.2f us per packet sent)\n", reflector.calls, cpuUs,
+        reflector.sent > 0 ? (double)cpuUs / reflector.sent : 0.0);
+
+    close(controlSockId);
+    reflectorDestroy(&reflector);
+    arenaFree(datagram);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define REFLECTOR_MAX_SUBSCRIBERS 4096
+//Messages per sendmmsg() call, the kernel takes at most UIO_MAXIOV
+#define REFLECTOR_BATCH 1024
+#define REFLECTOR_MAX_COMMAND 128
+
+//Multicast to unicast reflector: every datagram received from the group is sent once to
+//each subscriber. All the messages of a packet share one iovec pointing to the received
+//datagram, so nothing is copied per subscriber, and they leave in sendmmsg() batches.
+//Datagrams the group socket got coalesced by UDP GRO (audioc_socket.h) leave the same way,
+//one message per subscriber that the kernel splits again (GSO); if it refuses, they are
+//sent one by one from then on
+typedef struct {
+    int sendSockId;
+    struct sockaddr_in* subscribers;
+    struct mmsghdr* messages; //messages[i] goes to subscribers[i], built once
+    struct mmsghdr* segmentMessages; //The same, with segmentControl
+    struct iovec packet;
+    socket_segment_control_t segmentControl;
+    u32 count;
+    bool gso;
+
+    u64 packets;
+    u64 sent;
+    u64 sendErrors;
+    u64 calls;              //sendmmsg() calls
+    u64 segmentedSends;     //Messages of many datagrams, split by the kernel
+} reflector_t;
+
+bool reflectorInit(reflector_t* reflector);
+void reflectorDestroy(reflector_t* reflector);
+
+//False if the subscriber is already there or there is no room
+bool reflectorAdd(reflector_t* reflector, struct sockaddr_in subscriber);
+//False if it was not subscribed
+bool reflectorRemove(reflector_t* reflector, struct sockaddr_in subscriber);
+
+//Sends the datagram to every subscriber. A failed subscriber does not stop the others.
+//segmentBytes other than 0: size holds datagrams of that size (the last may be shorter),
+//as UDP GRO coalesced them
+void reflectorFanOut(reflector_t* reflector, const void* datagram, usize size, u32 segmentBytes);
+
+//Runs one control command ("add IP:PORT", "del IP:PORT" or "list") and writes the reply
+//(at most replySize bytes, NUL terminated)
+void reflectorCommand(reflector_t* reflector, const char* command, char* reply, usize replySize);
+
+//Reflector mode (--reflect): forwards what arrives at groupSockId until SIGINT, taking
+//commands as UDP datagrams on 127.0.0.1:controlPort; each gets a reply to its sender.
+//Returns the process exit code
+int runReflector(int groupSockId, u16 controlPort);
@@ -0,0 +1,66 @@
+#include "audioc_report.h"
+
+usize reportBuild(u8* out, u32 senderSsrc, const report_t* report)
+{
+    //Lengths in 32 bit words minus one
+    out[0] = (RTP_VERSION << 6) | 1;
+    out[1] = RTCP_RR;
+    writeU16(out + 2, 7);
+    writeU32(out + 4, senderSsrc);
+
+    u8* block = out + 8;
+    writeU32(block, report->ssrc);
+    writeU32(block + 4, ((u32)report->fractionLost << 24) | ((u32)report->cumulativeLost & 0xFFFFFF));
+    writeU32(block + 8, report->highestSeq);
+    writeU32(block + 12, report->jitter);
+    //We do not answer sender reports: no LSR / DLSR
+    writeU32(block + 16, 0);
+    writeU32(block + 20, 0);
+
+    u8* app = block + 24;
+    app[0] = RTP_VERSION << 6;
+    app[1] = RTCP_APP;
+    writeU16(app + 2, 4);
+    writeU32(app + 4, senderSsrc);
+    memcpy(app + 8, REPORT_APP_NAME, 4);
+    writeU32(app + 12, report->socketDrops);
+    writeU32(app + 16, report->localLost);
+    return app + 20 - out;
+}
+
+bool reportParse(const u8* data, usize size, u32 mediaSsrc, report_t* report)
+{
+    bool found = false;
+    usize offset = 0;
+    while (offset + 4 <= size) {
+        const u8* rtcp = data + offset;
+        usize length = (readU16(rtcp + 2) + 1) * 4;
+        if ((rtcp[0] >> 6) != RTP_VERSION || offset + length > size) {
+            break;
+        }
+
+        if (rtcp[1] == RTCP_RR) {
+            u32 blocks = rtcp[0] & 0x1F;
+            for (u32 i = 0; i < blocks && 8 + 24 * (i + 1) <= length; i++) {
+                const u8* block = rtcp + 8 + 24 * i;
+                if (readU32(block) != mediaSsrc) continue;
+                u32 lost = readU32(block + 4);
+                *report = (report_t) {
+                    .ssrc = mediaSsrc,
+                    .fractionLost = lost >> 24,
+                    //Sign extension of the 24 bits
+                    .cumulativeLost = (i32)(lost << 8) >> 8,
+                    .highestSeq = readU32(block + 8),
+                    .jitter = readU32(block + 12),
+                };
+                found = true;
+            }
+        } else if (found && rtcp[1] == RTCP_APP && length >= 20 && memcmp(rtcp + 8, REPORT_APP_NAME, 4) == 0) {
+            report->hasDrops = true;
+            report->socketDrops = readU32(rtcp + 12);
+            report->localLost = readU32(rtcp + 16);
+        }
+        offset += length;
+    }
+    return found;
+}
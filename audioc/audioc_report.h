@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+
+//RTCP receiver reports (RFC 3550, section 6.4.2) about the stream we receive, followed in
+//the same compound packet by an APP packet (section 6.7) with the datagrams our own socket
+//dropped because we did not read them in time (SO_RXQ_OVFL). Those are left out of the
+//loss of the report block, so the sender can tell a lossy network from a slow receiver.
+
+#define RTCP_RR 201
+#define RTCP_APP 204
+#define REPORT_APP_NAME "LDRP"       //Local drops
+#define REPORT_INTERVAL_US 5000000
+#define REPORT_PACKET_SIZE (8 + 24 + 20)
+
+typedef struct {
+    u32 ssrc;               //Source reported on
+    u8 fractionLost;        //Network loss since the previous report, out of 256
+    i32 cumulativeLost;     //Network loss since the start, 24 bits
+    u32 highestSeq;         //Extended: cycles in the upper 16 bits
+    u32 jitter;             //Timestamp units
+    bool hasDrops;          //The APP packet was there
+    u32 socketDrops;        //Datagrams dropped by the socket of the reporter
+    u32 localLost;          //Packets of the stream among them
+} report_t;
+
+//Writes into out (REPORT_PACKET_SIZE bytes) a compound RR + APP from senderSsrc. Returns
+//the packet size
+usize reportBuild(u8* out, u32 senderSsrc, const report_t* report);
+
+//Reads a (compound) RTCP packet. Returns true and fills report if it has a report block
+//about mediaSsrc (and the drops of its APP packet, if any)
+bool reportParse(const u8* data, usize size, u32 mediaSsrc, report_t* report);
@@ -1,4 +1,5 @@
 #include "audioc_rtp.h"
+#include "../lib/circularBuffer.h"
 
 #include <stdio.h>
 
@@ -30,7 +31,79 @@ void htonRTP(rtp_hdr_t* header) {
     header->ts = htonl(header->ts);
 }
 
-u8 silenceMU8[256] = {
+bool validateRTPHeader(const rtp_hdr_t* header, u8 expectedPt)
+{
+    return header->version == RTP_VERSION && header->pt == expectedPt;
+}
+
+bool rtpPayload(const rtp_packet_t* packet, usize size, const u8** outPayload, usize* outBytes)
+{
+    const rtp_hdr_t* header = &packet->header;
+    const u8* bytes = (const u8*)packet;
+    usize offset = sizeof(rtp_hdr_t) + header->cc * sizeof(u32);
+    usize end = size;
+    if (size < offset) {
+        return false;
+    }
+
+    if (header->x) {
+        //16 bit profile specific id and 16 bit length in 32 bit words
+        if (offset + 4 > size) {
+            return false;
+        }
+        u16 extensionWords = (bytes[offset + 2] << 8) | bytes[offset + 3];
+        offset += 4 + extensionWords * sizeof(u32);
+        if (offset > size) {
+            return false;
+        }
+    }
+
+    if (header->p) {
+        //The last byte counts the padding bytes, itself included
+        u8 padding = bytes[size - 1];
+        if (padding == 0 || offset + padding > size) {
+            return false;
+        }
+        end -= padding;
+    }
+
+    *outPayload = bytes + offset;
+    *outBytes = end - offset;
+    return true;
+}
+
+void fillSilence(u8* dst, usize bytes, enum payload payload)
+{
+    usize patternSize;
+    const u8* pattern;
+    if (payload == PCMU) {
+        patternSize = ARRAY_COUNT(silenceMU8);
+        pattern = silenceMU8;
+    } else {
+        patternSize = ARRAY_COUNT(silenceL16BE);
+        pattern = silenceL16BE;
+    }
+    while (bytes > 0) {
+        usize copy = MIN(bytes, patternSize);
+        memcpy(dst, pattern, copy);
+        dst += copy;
+        bytes -= copy;
+    }
+}
+
+bool pushSilence(void* cbuf, usize fragmentSize, isize *outCbufCount, enum payload payload)
+{
+    u8* bufferBlock = (u8*)cbuf_pointer_to_write(cbuf);
+    if (bufferBlock) {
+        fillSilence(bufferBlock, fragmentSize, payload);
+        //memset(bufferBlock, 0, fragmentSize);
+        *outCbufCount = (*outCbufCount) + 1;
+        return true;
+    }
+    return false;
+}
+
+const u8 silenceMU8[256] = {
     0xFA, 0xFA, 0xFB, 0xFC, 0xFD, 0xFD, 0xFD, 0xFC, 0xFC, 0xFE, 
     0xFE, 0xFE, 0xFE, 0x7E, 0x7E, 0x7C, 0x7C, 0x7C, 0x7A, 0x79, 
     0x77, 0x79, 0x78, 0x76, 0x77, 0x79, 0x7C, 0x79, 0x7B, 0x7D, 
@@ -59,7 +132,7 @@ u8 silenceMU8[256] = {
     0xF4, 0xFB, 0xFD, 0xFB, 0xEF, 0xFB, 
 };
 
-u8 silenceL16BE[512] = {
+const u8 silenceL16BE[512] = {
     0xFF, 0xA0, 0xFF, 0x6E, 0xFF, 0x4E, 0xFF, 0x56, 0xFF, 0x64, 
     0xFF, 0x79, 0xFF, 0x76, 0xFF, 0xA9, 0xFF, 0xB8, 0xFF, 0xD8, 
     0x0, 0x4, 0xFF, 0xDA, 0x0, 0x3, 0xFF, 0xEA, 0xFF, 0xCA, 
@@ -4,6 +4,8 @@
 #include "../lib/rtp.h"
 #include "audiocArgs.h"
 
+#include <arpa/inet.h>
+
 #pragma pack(push, 1)
 typedef struct {
     rtp_hdr_t header;
@@ -15,8 +17,24 @@ void printRTPHeader(rtp_hdr_t* rtp);
 void ntohRTP(rtp_hdr_t* header);
 void htonRTP(rtp_hdr_t* header);
 
-extern u8 silenceMU8[256];
-extern u8 silenceL16BE[512];
+//Returns false if the header (already in host order) is not RTP version 2 or its
+//payload type is not expectedPt
+bool validateRTPHeader(const rtp_hdr_t* header, u8 expectedPt);
+
+//Finds the payload of a received packet (header already in host order), skipping the
+//CSRC list and the header extension and leaving out the padding. Returns false if the
+//packet is malformed
+bool rtpPayload(const rtp_packet_t* packet, usize size, const u8** outPayload, usize* outBytes);
+
+//Writes bytes of comfort noise for the given payload into dst
+void fillSilence(u8* dst, usize bytes, enum payload payload);
+
+//Writes a block of fragmentSize bytes of comfort noise for the given payload into the
+//next free block of cbuf and increments *outCbufCount. Returns false if cbuf is full
+bool pushSilence(void* cbuf, usize fragmentSize, isize *outCbufCount, enum payload payload);
+
+extern const u8 silenceMU8[256];
+extern const u8 silenceL16BE[512];
 
 //Safely calculate the difference between sequence numbers taking wrapping into account
 inline static i32 seqNumDifference(u16 from, u16 to)
@@ -30,6 +48,33 @@ inline static i64 timestampDifference(u32 from, u32 to)
     return (i64)(i32)(to - from);
 }
 
+//Network byte order fields of RTP extensions (FEC, RED) and RTCP packets, at any alignment
+inline static void writeU16(u8* p, u16 value)
+{
+    value = htons(value);
+    memcpy(p, &value, sizeof(value));
+}
+
+inline static void writeU32(u8* p, u32 value)
+{
+    value = htonl(value);
+    memcpy(p, &value, sizeof(value));
+}
+
+inline static u16 readU16(const u8* p)
+{
+    u16 value;
+    memcpy(&value, p, sizeof(value));
+    return ntohs(value);
+}
+
+inline static u32 readU32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return ntohl(value);
+}
+
 inline static const char* payloadToStr(enum payload pt) {
     switch (pt)
     {
@@ -0,0 +1,66 @@
+#include "audioc_rtpdump.h"
+
+#include <arpa/inet.h>
+
+//rtptools RD_hdr_t and RD_packet_t, every field in network byte order
+#pragma pack(push, 1)
+typedef struct {
+    u32 startSec;
+    u32 startUsec;
+    u32 source;
+    u16 port;
+    u16 padding;
+} rtpdump_header_t;
+
+typedef struct {
+    u16 length;             //Of this header and the packet
+    u16 rtpLength;          //Of the packet for RTP, 0 for RTCP
+    u32 offsetMs;           //Since the start of the recording
+} rtpdump_packet_t;
+#pragma pack(pop)
+
+bool rtpdumpOpen(rtpdump_t* dump, const char* path, struct in_addr source, u16 port, i64 startNs)
+{
+    *dump = (rtpdump_t) { .file = fopen(path, "wb"), .startNs = startNs };
+    if (!dump->file) {
+        return false;
+    }
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &source, address, sizeof(address));
+    fprintf(dump->file, "#!rtpplay1.0 %s/%u\n", address, port);
+    rtpdump_header_t header = {
+        .startSec = htonl(startNs / 1000000000),
+        .startUsec = htonl(startNs % 1000000000 / 1000),
+        .source = source.s_addr,
+        .port = htons(port),
+    };
+    return fwrite(&header, sizeof(header), 1, dump->file) == 1;
+}
+
+void rtpdumpWrite(rtpdump_t* dump, const void* datagram, usize size, bool rtcp, i64 arrivalNs)
+{
+    //The length field is 16 bits
+    if (!dump->file || size > UINT16_MAX - sizeof(rtpdump_packet_t)) {
+        return;
+    }
+    rtpdump_packet_t packet = {
+        .length = htons(sizeof(packet) + size),
+        .rtpLength = htons(rtcp ? 0 : size),
+        .offsetMs = htonl((u32)(MAX(arrivalNs - dump->startNs, 0) / 1000000)),
+    };
+    if (fwrite(&packet, sizeof(packet), 1, dump->file) != 1 || fwrite(datagram, size, 1, dump->file) != 1) {
+        printError("Could not write to the rtpdump file, recording stopped");
+        fclose(dump->file);
+        dump->file = NULL;
+        return;
+    }
+    dump->packets++;
+}
+
+void rtpdumpClose(rtpdump_t* dump)
+{
+    if (dump->file) {
+        fclose(dump->file);
+        dump->file = NULL;
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "common.h"
+
+#include <stdio.h>
+#include <netinet/in.h>
+
+//Recorder of received packets in the rtpdump format of rtptools ('rtpplay1.0'), so a
+//session can be replayed with rtpplay or turned into the text traces netem_proxy -j
+//reads with 'rtpdump -F ascii'. Packets are written as received, with their arrival time
+typedef struct {
+    FILE* file;
+    i64 startNs;
+    u64 packets;
+} rtpdump_t;
+
+//source and port: of the session, for the file header. startNs: time of the first
+//packet, CLOCK_REALTIME as the arrival times. Returns false if the file cannot be created
+bool rtpdumpOpen(rtpdump_t* dump, const char* path, struct in_addr source, u16 port, i64 startNs);
+
+//A datagram (network byte order), RTP or RTCP, that arrived at arrivalNs
+void rtpdumpWrite(rtpdump_t* dump, const void* datagram, usize size, bool rtcp, i64 arrivalNs);
+
+void rtpdumpClose(rtpdump_t* dump);
@@ -0,0 +1,566 @@
+#define _GNU_SOURCE //CPU_SET, sched_setaffinity
+#include "audioc_server.h"
+#include "audioc_session.h"
+#include "audioc_rtp.h"
+#include "audioc_playout.h"
+#include "audioc_realtime.h"
+#include "audioc_arena.h"
+#include "audioc_profile.h"
+#include "audioc_socket.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#define SERVER_MAX_EVENTS 256
+//Playout does not try to catch up with more than this after a stall: the rest is skipped
+#define SERVER_MAX_LATE_BLOCKS 10
+
+typedef struct {
+    audioc_session_t* session;
+    int sockId;
+    struct sockaddr_in sendAddr;
+    u16 port;
+    u32 index;          //In the sessions of its thread
+    bool parked;        //Idle: not played out, free to migrate
+    u32 socketDrops;    //SO_RXQ_OVFL, cumulative
+    recorder_t* audio;  //--record and --record-rtp, NULL without them
+    recorder_t* rtp;
+    bool playing;       //Buffering is over and the session is not parked
+    i64 lastPacketUs;
+    i64 nextBlockUs;    //When the next block is due
+    u64 packets;
+} server_session_t;
+
+typedef struct {
+    pthread_t thread;
+    u32 id;
+    u32 cpu;
+    int epollFd;
+    int timerFd;
+    int inboxFd;        //Signals sessions migrated to this thread
+
+    server_session_t** sessions;
+    u32 count;          //Published with atomics: other threads read it to balance
+    u32 active;         //Not parked
+
+    pthread_mutex_t inboxLock;
+    server_session_t** inbox;
+    u32 inboxCount;
+
+    rtp_packet_t* datagram;
+    i64 lastBalanceUs;
+
+    u64 packets;
+    u64 wakeups;
+    u64 rejected;       //Packets the session refused (wrong payload) or failed sends
+    u64 migratedIn;
+    u64 migratedOut;
+} server_thread_t;
+
+static volatile sig_atomic_t serverStopRequested = 0;
+
+static server_thread_t* threads;
+static u32 threadCount;
+static u32 sessionCount;
+static i64 blockUs;
+static record_writer_t recordWriter;
+
+static void serverSignalHandler(int sigNum)
+{
+    (void) sigNum;
+    serverStopRequested = 1;
+}
+
+static bool sendToGroup(void* context, const void* packet, usize size)
+{
+    server_session_t* s = context;
+    return sendto(s->sockId, packet, size, 0, (struct sockaddr *)&s->sendAddr, sizeof(struct sockaddr_in)) >= 0;
+}
+
+//FNV-1a of the group and the port
+static u32 hashGroupPort(struct in_addr group, u16 port)
+{
+    u8 key[6];
+    memcpy(key, &group.s_addr, 4);
+    key[4] = port >> 8;
+    key[5] = port & 0xFF;
+    u32 hash = 2166136261u;
+    for (usize i = 0; i < sizeof(key); i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int openServerSocket(struct in_addr multicastIp, u16 port, struct sockaddr_in* outSendAddr)
+{
+    struct sockaddr_in sendAddr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr = multicastIp,
+    };
+
+    int sockId = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (sockId < 0) {
+        panic("socket error for port %u", port);
+    }
+
+    int enable = 1;
+    if (setsockopt(sockId, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
+        panic("setsockopt(SO_REUSEADDR) failed!\n");
+    }
+    if (bind(sockId, (struct sockaddr *)&sendAddr, sizeof(struct sockaddr_in)) < 0) {
+        panic("Socket bind error for port %u!\n", port);
+    }
+
+    struct ip_mreq mcRequest = {0};
+    mcRequest.imr_multiaddr = multicastIp;
+    mcRequest.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(sockId, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mcRequest, sizeof(struct ip_mreq)) < 0) {
+        panic("Failed to join multicast group on port %u, setsockopt error", port);
+    }
+
+    u8 loopback = 0;
+    if (setsockopt(sockId, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(u8)) < 0) {
+        panic("Failed to disable MC loopback, setsockopt error");
+    }
+
+    *outSendAddr = sendAddr;
+    return sockId;
+}
+
+//One socket per session, plus the epoll, timer and inbox of every thread
+static void raiseFileLimit(u32 fdsNeeded)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= fdsNeeded) {
+        return;
+    }
+    limit.rlim_cur = MIN((rlim_t)fdsNeeded, limit.rlim_max);
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < fdsNeeded) {
+        fprintf(stderr, "WARNING: %u file descriptors are needed, the limit is %lu.\n", fdsNeeded, (unsigned long)limit.rlim_cur);
+    }
+}
+
+static void watch(server_thread_t* thread, int fd, void* tag)
+{
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = tag,
+    };
+    if (epoll_ctl(thread->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        panic("epoll_ctl error");
+    }
+}
+
+static void addSession(server_thread_t* thread, server_session_t* s)
+{
+    s->index = thread->count;
+    thread->sessions[thread->count] = s;
+    __atomic_store_n(&thread->count, thread->count + 1, __ATOMIC_RELAXED);
+    if (!s->parked) {
+        thread->active++;
+    }
+    watch(thread, s->sockId, s);
+}
+
+static void removeSession(server_thread_t* thread, server_session_t* s)
+{
+    if (epoll_ctl(thread->epollFd, EPOLL_CTL_DEL, s->sockId, NULL) != 0) {
+        panic("epoll_ctl error");
+    }
+    u32 last = thread->count - 1;
+    thread->sessions[s->index] = thread->sessions[last];
+    thread->sessions[s->index]->index = s->index;
+    __atomic_store_n(&thread->count, last, __ATOMIC_RELAXED);
+    if (!s->parked) {
+        thread->active--;
+    }
+}
+
+static void park(server_thread_t* thread, server_session_t* s)
+{
+    s->parked = true;
+    //The clock of its playout stops too: the first packet after the pause starts it again
+    //from then, rather than catching up with every block due while it was idle
+    s->playing = false;
+    thread->active--;
+}
+
+static void receiveAll(server_thread_t* thread, server_session_t* s, i64 now)
+{
+    while (1) {
+        isize result = socketReceive(s->sockId, thread->datagram, MAX_DATAGRAM_SIZE, &s->socketDrops);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printError("recv error on port %u", s->port);
+            }
+            return;
+        }
+
+        s->packets++;
+        thread->packets++;
+        s->lastPacketUs = now;
+        if (s->parked) {
+            s->parked = false;
+            thread->active++;
+        }
+
+        audiocSessionSocketDrops(s->session, s->socketDrops);
+        if (s->rtp) {
+            recorderPacket(s->rtp, thread->datagram, result, now * 1000);
+        }
+        //A wrong peer must not take the other sessions down: its packets are just refused
+        audioc_status_t status = audiocSessionReceive(s->session, thread->datagram, result);
+        if (status == AUDIOC_WRONG_PAYLOAD || status == AUDIOC_SEND_FAILED) {
+            thread->rejected++;
+        }
+        if (!s->playing && !audiocSessionBuffering(s->session)) {
+            s->playing = true;
+            s->nextBlockUs = now;
+        }
+    }
+}
+
+//Plays, against the clock, every block due: what the sound card would do
+static void playDue(server_session_t* s, i64 now)
+{
+    if (now - s->nextBlockUs > SERVER_MAX_LATE_BLOCKS * blockUs) {
+        s->nextBlockUs = now - SERVER_MAX_LATE_BLOCKS * blockUs;
+    }
+    while (s->nextBlockUs <= now) {
+        if (audiocSessionBufferedBlocks(s->session) == 0) {
+            audiocSessionTick(s->session);
+        }
+        struct iovec iov[2];
+        int iovCount = audiocSessionPlayout(s->session, 1, iov);
+        if (iovCount > 0) {
+            for (int i = 0; s->audio && i < iovCount; i++) {
+                recorderAudio(s->audio, iov[i].iov_base, iov[i].iov_len);
+            }
+            audiocSessionPlayed(s->session, iov[0].iov_len + (iovCount > 1 ? iov[1].iov_len : 0));
+        }
+        s->nextBlockUs += blockUs;
+    }
+}
+
+//Parked sessions have no playout in progress: they can move without a glitch
+static void balance(server_thread_t* thread)
+{
+    server_thread_t* lightest = thread;
+    for (u32 i = 0; i < threadCount; i++) {
+        if (__atomic_load_n(&threads[i].count, __ATOMIC_RELAXED) < __atomic_load_n(&lightest->count, __ATOMIC_RELAXED)) {
+            lightest = &threads[i];
+        }
+    }
+    if (thread->count <= __atomic_load_n(&lightest->count, __ATOMIC_RELAXED) + SERVER_BALANCE_SLACK) {
+        return;
+    }
+
+    for (u32 i = 0; i < thread->count; i++) {
+        server_session_t* s = thread->sessions[i];
+        if (s->parked) {
+            removeSession(thread, s);
+            thread->migratedOut++;
+
+            pthread_mutex_lock(&lightest->inboxLock);
+            lightest->inbox[lightest->inboxCount++] = s;
+            pthread_mutex_unlock(&lightest->inboxLock);
+            u64 one = 1;
+            if (write(lightest->inboxFd, &one, sizeof(one)) != sizeof(one)) {
+                printError("eventfd write error");
+            }
+            return;
+        }
+    }
+}
+
+static void takeInbox(server_thread_t* thread)
+{
+    u64 signals;
+    if (read(thread->inboxFd, &signals, sizeof(signals)) != sizeof(signals)) {
+        return;
+    }
+    pthread_mutex_lock(&thread->inboxLock);
+    for (u32 i = 0; i < thread->inboxCount; i++) {
+        addSession(thread, thread->inbox[i]);
+        thread->migratedIn++;
+    }
+    thread->inboxCount = 0;
+    pthread_mutex_unlock(&thread->inboxLock);
+}
+
+static void tick(server_thread_t* thread, i64 now)
+{
+    u64 expirations;
+    if (read(thread->timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+
+    for (u32 i = 0; i < thread->count; i++) {
+        server_session_t* s = thread->sessions[i];
+        if (s->parked) continue;
+        if (now - s->lastPacketUs > SERVER_IDLE_US) {
+            park(thread, s);
+            continue;
+        }
+        if (s->playing) {
+            playDue(s, now);
+        }
+    }
+}
+
+static void* serverThread(void* arg)
+{
+    server_thread_t* thread = arg;
+    if (!realtimePinCpu(thread->cpu)) {
+        fprintf(stderr, "WARNING: could not pin server thread %u to CPU %u (%s).\n", thread->id, thread->cpu, strerror(errno));
+    }
+
+    struct itimerspec period = {
+        .it_interval = { .tv_nsec = SERVER_TICK_US * 1000 },
+        .it_value = { .tv_nsec = SERVER_TICK_US * 1000 },
+    };
+    if (timerfd_settime(thread->timerFd, 0, &period, NULL) != 0) {
+        panic("timerfd_settime error");
+    }
+    thread->lastBalanceUs = playoutNowUs();
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStopRequested) {
+        int n = epoll_wait(thread->epollFd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            panic("epoll_wait error");
+        }
+        thread->wakeups++;
+
+        i64 now = playoutNowUs();
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &thread->timerFd) {
+                tick(thread, now);
+            } else if (tag == &thread->inboxFd) {
+                takeInbox(thread);
+            } else {
+                receiveAll(thread, tag, now);
+            }
+        }
+
+        //Only once the whole batch is handled: a session moved away may still have events in it
+        if (now - thread->lastBalanceUs >= SERVER_BALANCE_INTERVAL_US) {
+            thread->lastBalanceUs = now;
+            balance(thread);
+        }
+    }
+    return NULL;
+}
+
+static void initThread(server_thread_t* thread, u32 id, u32 cpus)
+{
+    *thread = (server_thread_t) {
+        .id = id,
+        .cpu = id % cpus,
+        .epollFd = epoll_create1(0),
+        .timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK),
+        .inboxFd = eventfd(0, EFD_NONBLOCK),
+        //Any thread may end up with every session
+        .sessions = arenaAlloc(sessionCount * sizeof(server_session_t*)),
+        .inbox = arenaAlloc(sessionCount * sizeof(server_session_t*)),
+        .datagram = arenaAlloc(MAX_DATAGRAM_SIZE),
+    };
+    if (thread->epollFd < 0 || thread->timerFd < 0 || thread->inboxFd < 0) {
+        panic("Could not set up the event loop of server thread %u", id);
+    }
+    if (!thread->sessions || !thread->inbox || !thread->datagram) {
+        panic("Could not allocate server thread %u", id);
+    }
+    pthread_mutex_init(&thread->inboxLock, NULL);
+    watch(thread, thread->timerFd, &thread->timerFd);
+    watch(thread, thread->inboxFd, &thread->inboxFd);
+}
+
+static void printReport(server_session_t* sessions, double seconds, usize fullSessionBytes)
+{
+    printf("\nInterrupted audioc server\n");
+
+    u64 packets = 0, wakeups = 0;
+    for (u32 i = 0; i < threadCount; i++) {
+        server_thread_t* thread = &threads[i];
+        printf("Thread %u (CPU %u): %u sessions (%u active), %lu packets, %.0f wakeups/s, %lu refused, migrated %lu in / %lu out\n",
+            thread->id, thread->cpu, thread->count, thread->active, thread->packets, thread->wakeups / seconds,
+            thread->rejected, thread->migratedIn, thread->migratedOut);
+        packets += thread->packets;
+        wakeups += thread->wakeups;
+    }
+
+    audioc_stats_t total = {};
+    usize memory = 0;
+    for (u32 i = 0; i < sessionCount; i++) {
+        audioc_stats_t stats;
+        audiocSessionStats(sessions[i].session, &stats);
+        total.packetsPlayed += stats.packetsPlayed;
+        total.lostPackets += stats.lostPackets;
+        total.socketDrops += stats.socketDrops;
+        total.localLost += stats.localLost;
+        total.silencesPlayed += stats.silencesPlayed + stats.timeouts;
+        total.fecRecovered += stats.fecRecovered;
+        total.redRecovered += stats.redRecovered;
+        total.lateRecovered += stats.lateRecovered;
+        total.malformed += stats.malformed;
+        total.unplayable += stats.unplayable;
+        total.bufferDrops += stats.bufferDrops;
+        memory += audiocSessionMemory(sessions[i].session) + sizeof(server_session_t);
+    }
+
+    printf("Total: %u sessions, %lu packets, %d blocks played, %d lost, %d silent, %d recovered\n", sessionCount,
+        packets, total.packetsPlayed, total.lostPackets, total.silencesPlayed,
+        total.fecRecovered + total.redRecovered + total.lateRecovered);
+    printf("Dropped by the sockets: %d datagrams, %d of the lost packets\n", total.socketDrops, total.localLost);
+    printf("Dropped by the sessions: %d malformed datagrams, %d packets that cannot be played, %d blocks (jitter buffer full)\n",
+        total.malformed, total.unplayable, total.bufferDrops);
+    printf("Per session: %lu bytes of memory (a sending session takes %lu), %.2f wakeups/s, %.1f packets/s\n",
+        memory / sessionCount, fullSessionBytes, wakeups / seconds / sessionCount, packets / seconds / sessionCount);
+    fflush(stdout);
+}
+
+int runServer(struct in_addr multicastIp, u16 port, u32 ssrc, u8 payload, u32 packetDuration,
+    u32 bufferingTime, u32 sessions, u32 threadsRequested, const filter_params_t* filter,
+    const record_params_t* record)
+{
+    if ((u32)port + sessions - 1 > 65535) {
+        panic("%u sessions from port %u do not fit in the port range", sessions, port);
+    }
+
+    struct sigaction sigInfo = {
+        .sa_handler = serverSignalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if ((sigaction(SIGINT, &sigInfo, NULL)) < 0) {
+        panic("Error installing signal.");
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus = MAX(cpus, 1);
+    sessionCount = sessions;
+    threadCount = threadsRequested > 0 ? threadsRequested : (u32)cpus;
+    raiseFileLimit(sessionCount + 3 * threadCount + 16);
+
+    //As a normal session would, without a sound card to round the fragment
+    u32 bytesPerSample = payload == L16_1 ? 2 : 1;
+    u32 bytesPerSecond = 8000 * bytesPerSample;
+    u32 blockBytes = packetDuration * bytesPerSecond / 1000;
+    if (blockBytes == 0) {
+        panic("Packet duration too short");
+    }
+    blockUs = (i64)packetDuration * 1000;
+    u32 bufferingBlocks = bufferingTime * bytesPerSecond / 1000 / blockBytes;
+    u32 capacityBlocks = (bufferingTime + PROFILE_DEFAULT_CAPACITY_MS) * bytesPerSecond / 1000 / blockBytes;
+
+    audioc_session_config_t config = {
+        .pt = payload,
+        .fragmentBytes = blockBytes,
+        .packetBytes = blockBytes,
+        .bytesPerSample = bytesPerSample,
+        .bufferingBlocks = bufferingBlocks,
+        .capacityBlocks = MAX(capacityBlocks, MAX(bufferingBlocks, 1)),
+        .send = sendToGroup,
+        .allocator = &arenaAllocator,
+    };
+
+    //What the receive-only configuration saves, for the report
+    audioc_session_t* full = audiocSessionCreate(&config);
+    usize fullSessionBytes = full ? audiocSessionMemory(full) : 0;
+    audiocSessionDestroy(full);
+    config.receiveOnly = true;
+
+    threads = arenaAlloc(threadCount * sizeof(server_thread_t));
+    server_session_t* all = arenaCalloc(sessionCount, sizeof(server_session_t));
+    if (!threads || !all) {
+        panic("Could not allocate %u sessions", sessionCount);
+    }
+    for (u32 i = 0; i < threadCount; i++) {
+        initThread(&threads[i], i, cpus);
+    }
+    //Audio and RTP recorders of session i at 2 * i and 2 * i + 1
+    recorder_t* recorders = NULL;
+    if (record) {
+        recorders = arenaCalloc(2 * sessionCount, sizeof(recorder_t));
+        if (!recorders || !recordWriterStart(&recordWriter, 2 * sessionCount)) {
+            panic("Could not set up the recording of %u sessions", sessionCount);
+        }
+    }
+
+    for (u32 i = 0; i < sessionCount; i++) {
+        server_session_t* s = &all[i];
+        s->port = port + i;
+        s->parked = true;
+        s->sockId = openServerSocket(multicastIp, s->port, &s->sendAddr);
+        if (filter && !filterAttach(s->sockId, filter)) {
+            printError("Could not attach the packet filter to port %u", s->port);
+        }
+        socketEnableDrops(s->sockId);
+        socketSizeBuffers(s->sockId, bufferingTime, packetDuration, blockBytes + sizeof(rtp_hdr_t));
+        if (record) {
+            s->audio = &recorders[2 * i];
+            s->rtp = &recorders[2 * i + 1];
+            if (!recordOpenSession(record, &recordWriter, s->port, payload == L16_1 ? RECORD_L16 : RECORD_ULAW,
+                s->audio, s->rtp)) {
+                panic("Could not set up the recording of session %u", i);
+            }
+        }
+        config.ssrc = ssrc + i;
+        config.sendContext = s;
+        s->session = audiocSessionCreate(&config);
+        if (!s->session) {
+            panic("Could not set up session %u", i);
+        }
+        addSession(&threads[hashGroupPort(multicastIp, s->port) % threadCount], s);
+    }
+
+    printf("Serving %u sessions on ports %u-%u with %u threads, Ctrl+C to stop.\n", sessionCount, port,
+        port + sessionCount - 1, threadCount);
+    i64 start = playoutNowUs();
+    for (u32 i = 0; i < threadCount; i++) {
+        if (pthread_create(&threads[i].thread, NULL, serverThread, &threads[i]) != 0) {
+            panic("Could not start server thread %u", i);
+        }
+    }
+    for (u32 i = 0; i < threadCount; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    printReport(all, (playoutNowUs() - start) / 1e6, fullSessionBytes);
+    if (record) {
+        for (u32 i = 0; i < 2 * sessionCount; i++) {
+            recorderClose(&recorders[i]);
+        }
+        recordWriterStop(&recordWriter);
+        recordPrint(&recordWriter, recorders, 2 * sessionCount);
+        arenaFree(recorders);
+    }
+
+    for (u32 i = 0; i < sessionCount; i++) {
+        audiocSessionDestroy(all[i].session);
+        close(all[i].sockId);
+    }
+    for (u32 i = 0; i < threadCount; i++) {
+        close(threads[i].epollFd);
+        close(threads[i].timerFd);
+        close(threads[i].inboxFd);
+        arenaFree(threads[i].sessions);
+        arenaFree(threads[i].inbox);
+        arenaFree(threads[i].datagram);
+    }
+    arenaFree(all);
+    arenaFree(threads);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+#include "audiocArgs.h"
+#include "audioc_filter.h"
+#include "audioc_record.h"
+
+#include <arpa/inet.h>
+
+//Event loop wakeup that plays the due blocks of every session of a thread
+#define SERVER_TICK_US 5000
+//A session with no packets for this long is parked: no playout until a packet arrives
+#define SERVER_IDLE_US 2000000
+#define SERVER_BALANCE_INTERVAL_US 1000000
+//Sessions a thread may have over the lightest one before it hands idle ones over
+#define SERVER_BALANCE_SLACK 2
+
+//Receive-only multi-session server (--server). Session i listens on the group at port
+//port + i with SSRC ssrc + i, buffers and conceals like a normal session and plays out
+//against the clock, discarding the audio. Sessions are sharded over threadCount event
+//loops (one per online CPU if 0, each pinned to its CPU) by a hash of group and port;
+//parked sessions migrate from crowded threads to the lightest one. Runs until SIGINT,
+//then prints per thread and per session figures. With filter, it is attached to every
+//session socket (--filter). With record, every session is recorded (--record, --record-rtp)
+//by one writer thread. Returns the process exit code.
+int runServer(struct in_addr multicastIp, u16 port, u32 ssrc, u8 payload, u32 packetDuration,
+    u32 bufferingTime, u32 sessionCount, u32 threadCount, const filter_params_t* filter,
+    const record_params_t* record);
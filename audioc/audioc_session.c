@@ -0,0 +1,988 @@
+#include "audioc_session.h"
+#include "audioc_rtp.h"
+#include "audioc_fec.h"
+#include "audioc_reblock.h"
+#include "audioc_recovery.h"
+#include "audioc_red.h"
+#include "audioc_nack.h"
+#include "audioc_report.h"
+#include "g711.h"
+#include "../lib/circularBuffer.h"
+
+#include <stdio.h>
+
+//--adapt: packets sent between decisions, and the share of them NACKed above which
+//PCMU is sent (and below which L16 comes back)
+#define ADAPT_WINDOW_PACKETS 250
+#define ADAPT_TO_PCMU_LOSS 0.05
+#define ADAPT_TO_L16_LOSS 0.01
+
+//Payload types have 7 bits
+#define RECEIVED_PT_NONE 0xFF
+
+struct audioc_session {
+    audioc_session_config_t config;
+    audioc_stats_t stats;
+
+    //Receive side
+    bool buffering;
+    u16 inputSequenceNum;
+    u32 nextTimeStamp;      //Timestamp expected for the first sample of the next packet
+    void* circularBuffer;
+    isize cbufAccumulated;  //in blocks
+    usize cardPartialBytes; //Bytes of the next block to play already played
+    reblocker_t reblocker;
+    concealed_gaps_t concealedGaps;
+    fec_decoder_t fecDecoder; //Set up when the first FEC packet arrives
+    usize fecMaxPayload;
+    rtp_packet_t* fecPacket; //Sent FEC packets, recovered media packets and decoded RED copies
+    usize scratchPayloadBytes;
+    u8 receivedPt;          //Payload the peer sends now, converted to config.pt if different
+    u8* convertBuffer;      //Set up when the peer first sends the other payload
+    usize memoryBytes;
+
+    //Receiver reports, RFC 3550 appendix A.1 without the probation
+    bool reporting;         //A stream has been received
+    u32 remoteSsrc;
+    u16 baseSeq;
+    u16 maxSeq;
+    u32 seqCycles;
+    u32 packetsReceived;
+    u32 expectedPrior;      //At the previous report
+    u32 receivedPrior;
+    i32 localLostPrior;
+    i32 localLostBase;      //When the stream started
+    u32 socketDrops;        //Last cumulative count of the socket
+    u32 pendingDrops;       //Not yet matched with a gap of the stream
+
+    //Send side
+    u16 outputSequenceNum;
+    rtp_packet_t* outPacket; //Packet being filled with captured audio
+    usize outPacketFill;
+    u64 outPacketPosition;  //Capture position of the first byte of outPacket
+    u64 packedUpTo;         //Capture position up to which samples are in a packet
+    fec_encoder_t fecEncoder;
+    red_encoder_t redEncoder;
+    rtp_packet_t* redPacket;
+    nack_sender_t nackSender;
+    u8 sendPt;              //config.pt, or PCMU while --adapt finds too much loss
+    u32 windowSent;
+    u32 windowNacked;
+};
+
+static void* sessionAlloc(audioc_session_t* session, usize bytes)
+{
+    session->memoryBytes += bytes;
+    return allocatorAlloc(session->config.allocator, bytes);
+}
+
+static void sessionFree(audioc_session_t* session, void* memory)
+{
+    allocatorFree(session->config.allocator, memory);
+}
+
+static bool sendPacket(audioc_session_t* session, const void* packet, usize size)
+{
+    return session->config.send(session->config.sendContext, packet, size);
+}
+
+static void emit(audioc_session_t* session, audioc_event_t event, u32 value)
+{
+    if (session->config.event) {
+        session->config.event(session->config.eventContext, event, value);
+    }
+}
+
+audioc_session_t* audiocSessionCreate(const audioc_session_config_t* config)
+{
+    if (config->fragmentBytes == 0 || config->packetBytes == 0 || config->bytesPerSample == 0 || !config->send
+        || config->capacityBlocks < MAX(config->bufferingBlocks, 1) || (config->fecGroup > 0 && config->redDepth > 0)
+        || (config->adaptPayload && (config->pt != L16_1 || config->redDepth > 0))) {
+        return NULL;
+    }
+
+    audioc_session_t* session = allocatorCalloc(config->allocator, 1, sizeof(audioc_session_t));
+    if (!session) {
+        return NULL;
+    }
+    session->config = *config;
+    session->buffering = config->bufferingBlocks > 0;
+    session->outputSequenceNum = config->firstSeq;
+    session->receivedPt = RECEIVED_PT_NONE;
+    session->sendPt = config->pt;
+
+    usize expectedPacketSize = config->packetBytes + sizeof(rtp_hdr_t);
+    //FEC packets carry a whole payload plus their own headers, RED packets up to RED_MAX_DEPTH extra fragments
+    usize maxPacketSize = MAX(expectedPacketSize + FEC_OVERHEAD, sizeof(rtp_hdr_t) + RED_MAX_PAYLOAD(config->packetBytes));
+    session->fecMaxPayload = MAX(config->packetBytes, MAX_PACKET_SIZE - sizeof(rtp_hdr_t));
+    //A RED copy in PCMU doubles its size when decoded to L16
+    session->scratchPayloadBytes = MAX(maxPacketSize - sizeof(rtp_hdr_t), 2 * session->fecMaxPayload);
+    session->memoryBytes = sizeof(audioc_session_t) + config->fragmentBytes;
+
+    session->circularBuffer = cbuf_create_buffer_at(sessionAlloc(session, cbuf_memory_size(config->capacityBlocks, config->fragmentBytes)),
+        config->capacityBlocks, config->fragmentBytes);
+    session->fecPacket = sessionAlloc(session, sizeof(rtp_hdr_t) + session->scratchPayloadBytes);
+    bool ok = session->circularBuffer && session->fecPacket
+        && reblockerInit(&session->reblocker, session->circularBuffer, config->fragmentBytes, config->pt,
+            config->allocator);
+    if (ok && !config->receiveOnly) {
+        session->outPacket = sessionAlloc(session, maxPacketSize);
+        session->memoryBytes += NACK_HISTORY_SIZE * maxPacketSize;
+        ok = session->outPacket && nackSenderInit(&session->nackSender, maxPacketSize, config->allocator);
+        if (ok && config->fecGroup > 0) {
+            session->memoryBytes += config->packetBytes;
+            ok = fecEncoderInit(&session->fecEncoder, config->fecGroup, config->packetBytes, config->fecFirstSeq,
+                config->allocator);
+        }
+        if (ok && config->redDepth > 0) {
+            session->redPacket = sessionAlloc(session, maxPacketSize);
+            session->memoryBytes += config->redDepth * config->packetBytes;
+            ok = session->redPacket
+                && redEncoderInit(&session->redEncoder, config->redDepth, config->redPcmu, config->pt, config->packetBytes,
+                    config->allocator);
+        }
+    }
+
+    if (!ok) {
+        audiocSessionDestroy(session);
+        return NULL;
+    }
+    return session;
+}
+
+void audiocSessionDestroy(audioc_session_t* session)
+{
+    if (!session) {
+        return;
+    }
+    sessionFree(session, session->fecPacket);
+    sessionFree(session, session->convertBuffer);
+    sessionFree(session, session->outPacket);
+    sessionFree(session, session->redPacket);
+    reblockerDestroy(&session->reblocker);
+    sessionFree(session, session->circularBuffer);
+    fecEncoderDestroy(&session->fecEncoder);
+    fecDecoderDestroy(&session->fecDecoder);
+    redEncoderDestroy(&session->redEncoder);
+    nackSenderDestroy(&session->nackSender);
+    sessionFree(session, session);
+}
+
+/*
+ * Send side
+ */
+
+//Payload bytes of the packets sent: half of packetBytes while L16 is sent as PCMU
+static usize sentPayloadBytes(const audioc_session_t* session)
+{
+    return session->sendPt == session->config.pt ? session->config.packetBytes : session->config.packetBytes / 2;
+}
+
+static bool sendAudioPacket(audioc_session_t* session, rtp_packet_t* packet, u16 seq, u32 ts)
+{
+    packet->header = (rtp_hdr_t) {
+        .version = RTP_VERSION,
+        .pt = session->sendPt,
+        .ssrc = session->config.ssrc,
+        .seq = seq,
+        .ts = ts,
+    };
+
+    htonRTP(&packet->header);
+
+    if (!sendPacket(session, packet, sentPayloadBytes(session) + sizeof(rtp_hdr_t))) {
+        return false;
+    }
+    emit(session, AUDIOC_EVENT_SENT, 0);
+    return true;
+}
+
+//Adds the packet just sent to the FEC group, and sends the parity packet when the group is complete
+static bool sendFecPacket(audioc_session_t* session, rtp_packet_t* packet, u16 seq, u32 ts)
+{
+    rtp_hdr_t header = {
+        .version = RTP_VERSION,
+        .pt = session->sendPt,
+        .ssrc = session->config.ssrc,
+        .seq = seq,
+        .ts = ts,
+    };
+    rtp_packet_t* fecPacket = session->fecPacket;
+    usize fecSize = fecEncoderAdd(&session->fecEncoder, &header, packet->payload, sentPayloadBytes(session), fecPacket);
+    if (fecSize == 0) {
+        return true;
+    }
+
+    fecPacket->header.ssrc = session->config.ssrc;
+    htonRTP(&fecPacket->header);
+    return sendPacket(session, fecPacket, fecSize);
+}
+
+//Sends the fragment in packet as the primary block of a RFC 2198 packet, together with
+//the previous fragments. Returns the size of the packet sent, 0 on error
+static usize sendRedPacket(audioc_session_t* session, rtp_packet_t* packet, u16 seq, u32 ts)
+{
+    const audioc_session_config_t* config = &session->config;
+    rtp_packet_t* redPacket = session->redPacket;
+    u32 samplesPerPacket = config->packetBytes / config->bytesPerSample;
+    usize payloadBytes = redEncoderBuild(&session->redEncoder, packet->payload, config->packetBytes, samplesPerPacket, redPacket->payload);
+
+    redPacket->header = (rtp_hdr_t) {
+        .version = RTP_VERSION,
+        .pt = RED_PAYLOAD_TYPE,
+        .ssrc = config->ssrc,
+        .seq = seq,
+        .ts = ts,
+    };
+    htonRTP(&redPacket->header);
+
+    usize packetSize = sizeof(rtp_hdr_t) + payloadBytes;
+    if (!sendPacket(session, redPacket, packetSize)) {
+        return 0;
+    }
+    emit(session, AUDIOC_EVENT_SENT, 0);
+    return packetSize;
+}
+
+//Sends the packet with the protection selected in the configuration, and keeps it in
+//case it is NACKed
+static bool sendFragment(audioc_session_t* session, rtp_packet_t* packet, u16 seq, u32 ts)
+{
+    if (session->config.redDepth > 0) {
+        usize packetSize = sendRedPacket(session, packet, seq, ts);
+        nackSenderStore(&session->nackSender, seq, session->redPacket, packetSize);
+        return packetSize > 0;
+    }
+
+    if (session->sendPt != session->config.pt) {
+        //In place: each sample is read before its byte is written
+        g711L16BEToUlaw(packet->payload, packet->payload, session->config.packetBytes / 2);
+    }
+    if (!sendAudioPacket(session, packet, seq, ts)) {
+        return false;
+    }
+    nackSenderStore(&session->nackSender, seq, packet, sentPayloadBytes(session) + sizeof(rtp_hdr_t));
+    if (session->config.fecGroup > 0) {
+        return sendFecPacket(session, packet, seq, ts);
+    }
+    return true;
+}
+
+//Every ADAPT_WINDOW_PACKETS, picks the payload from the share of them the receivers NACKed
+static void adaptPayload(audioc_session_t* session)
+{
+    if (++session->windowSent < ADAPT_WINDOW_PACKETS) {
+        return;
+    }
+    double loss = (double)session->windowNacked / session->windowSent;
+    u8 pt = session->sendPt;
+    if (pt == L16_1 && loss > ADAPT_TO_PCMU_LOSS) {
+        pt = PCMU;
+    } else if (pt == PCMU && loss < ADAPT_TO_L16_LOSS) {
+        pt = L16_1;
+    }
+    if (pt != session->sendPt) {
+        emit(session, AUDIOC_EVENT_SEND_PAYLOAD, pt);
+        session->sendPt = pt;
+        session->stats.sendPayloadChanges++;
+    }
+    session->windowSent = 0;
+    session->windowNacked = 0;
+}
+
+static bool sendCapturedPacket(audioc_session_t* session)
+{
+    //The timestamp comes from where the samples were captured, not from the packets sent
+    u32 ts = session->config.firstTs + session->outPacketPosition / session->config.bytesPerSample;
+    bool sent = sendFragment(session, session->outPacket, session->outputSequenceNum, ts);
+
+    session->outputSequenceNum++;
+    session->outPacketPosition += session->config.packetBytes;
+    session->outPacketFill = 0;
+    session->stats.packetsRecorded++;
+    if (session->config.adaptPayload) {
+        adaptPayload(session);
+    }
+    return sent;
+}
+
+//Packets and fragments may have different sizes: what is left of the fragment waits in outPacket
+audioc_status_t audiocSessionCapture(audioc_session_t* session, const u8* fragment, u64 position)
+{
+    const audioc_session_config_t* config = &session->config;
+    rtp_packet_t* outPacket = session->outPacket;
+    usize remaining = config->fragmentBytes;
+    if (config->receiveOnly) {
+        return AUDIOC_DROPPED;
+    }
+    bool sent = true;
+
+    if (session->outPacketFill > 0 && position != session->packedUpTo) {
+        //Samples were lost: complete the packet with silence, the receiver will see
+        //the rest of the jump in the timestamps
+        fillSilence(outPacket->payload + session->outPacketFill, config->packetBytes - session->outPacketFill, config->pt);
+        session->outPacketFill = config->packetBytes;
+        session->packedUpTo = session->outPacketPosition + config->packetBytes;
+        sent &= sendCapturedPacket(session);
+    }
+    if (position < session->packedUpTo) {
+        //Covered by that silence
+        usize skip = MIN(session->packedUpTo - position, remaining);
+        fragment += skip;
+        remaining -= skip;
+        position += skip;
+    }
+    if (session->outPacketFill == 0) {
+        session->outPacketPosition = position;
+    }
+
+    while (remaining > 0) {
+        usize copy = MIN(remaining, config->packetBytes - session->outPacketFill);
+        memcpy(outPacket->payload + session->outPacketFill, fragment, copy);
+        session->outPacketFill += copy;
+        fragment += copy;
+        remaining -= copy;
+        session->packedUpTo = session->outPacketPosition + session->outPacketFill;
+
+        if (session->outPacketFill == config->packetBytes) {
+            sent &= sendCapturedPacket(session);
+        }
+    }
+    return sent ? AUDIOC_OK : AUDIOC_SEND_FAILED;
+}
+
+//Sends again the packets asked for by the generic NACKs in a received RTCP packet
+static audioc_status_t answerNacks(audioc_session_t* session, const u8* rtcp, usize size)
+{
+    u16 seqs[17 * NACK_MAX_FCI];
+    if (session->config.receiveOnly) {
+        //Nothing sent, nothing to retransmit
+        return AUDIOC_OK;
+    }
+    usize count = nackParse(rtcp, size, session->config.ssrc, seqs, ARRAY_COUNT(seqs));
+    session->windowNacked += count;
+    for (usize i = 0; i < count; i++) {
+        const nack_history_entry_t* entry = nackSenderRetransmit(&session->nackSender, seqs[i]);
+        if (!entry) {
+            continue;
+        }
+        if (!sendPacket(session, entry->data, entry->size)) {
+            return AUDIOC_SEND_FAILED;
+        }
+        session->stats.retransmissions++;
+        emit(session, AUDIOC_EVENT_RETRANSMITTED, 0);
+    }
+    return AUDIOC_OK;
+}
+
+//Asks the sender of mediaSsrc for count packets starting at firstSeq
+static bool sendNack(audioc_session_t* session, u32 mediaSsrc, u16 firstSeq, u32 count)
+{
+    u8 nack[NACK_MAX_PACKET_SIZE];
+    usize size = nackBuild(nack, session->config.ssrc, mediaSsrc, firstSeq, count);
+    if (!sendPacket(session, nack, size)) {
+        return false;
+    }
+    session->stats.nacksSent++;
+    return true;
+}
+
+/*
+ * Receive side
+ */
+
+//Points *data to the audio in the playout format (config.pt), converted into dst (with
+//room for dstBytes) if it came in the other payload. Returns false if it cannot be played
+static bool toPlayoutFormat(const audioc_session_t* session, u8 pt, const u8** data, usize* bytes, u8* dst, usize dstBytes)
+{
+    u8 playoutPt = session->config.pt;
+    if (pt == playoutPt) {
+        return *bytes % session->config.bytesPerSample == 0;
+    }
+    if (pt == PCMU && playoutPt == L16_1 && *bytes * 2 <= dstBytes) {
+        g711UlawToL16BE(*data, dst, *bytes);
+        *bytes *= 2;
+    } else if (pt == L16_1 && playoutPt == PCMU && *bytes % 2 == 0 && *bytes / 2 <= dstBytes) {
+        g711L16BEToUlaw(*data, dst, *bytes / 2);
+        *bytes /= 2;
+    } else {
+        return false;
+    }
+    *data = dst;
+    return true;
+}
+
+//Payloads of up to fecMaxPayload bytes in the other format are converted here
+static u8* convertBuffer(audioc_session_t* session)
+{
+    if (!session->convertBuffer) {
+        session->convertBuffer = sessionAlloc(session, 2 * session->fecMaxPayload);
+    }
+    return session->convertBuffer;
+}
+
+//Rebuilds a lost packet from a received FEC packet and puts it in place of the silence
+//that was enqueued for it, if it has not been played yet
+static void recoverFromFec(audioc_session_t* session, rtp_packet_t* received, isize size)
+{
+    rtp_hdr_t header;
+    rtp_packet_t* fecPacket = session->fecPacket;
+    if (!session->fecDecoder.storage) {
+        //The media packets received so far were not kept, recovery starts with the next group
+        if (!fecDecoderInit(&session->fecDecoder, session->fecMaxPayload, session->config.allocator)) {
+            fecDecoderDestroy(&session->fecDecoder);
+            return;
+        }
+        session->memoryBytes += FEC_STORE_SIZE * session->fecMaxPayload;
+        return;
+    }
+    isize length = fecDecoderRecover(&session->fecDecoder, received, size, &header, fecPacket->payload);
+    const u8* data = fecPacket->payload;
+    usize bytes = length;
+    if (length <= 0 || (header.pt != session->config.pt && !convertBuffer(session))
+        || !toPlayoutFormat(session, header.pt, &data, &bytes, session->convertBuffer, 2 * session->fecMaxPayload)) {
+        return;
+    }
+
+    if (concealedGapFill(&session->concealedGaps, &session->reblocker, session->stats.packetsPlayed,
+            session->config.bytesPerSample, header.ts, data, bytes)) {
+        session->stats.fecRecovered++;
+        session->stats.lostPackets--;
+        emit(session, AUDIOC_EVENT_FEC_RECOVERED, 0);
+    }
+}
+
+//Writes the redundant blocks of a received RED packet straight from the packet into the
+//jitter buffer, over the silence that concealed them, if it has not been played yet
+static void recoverFromRedundancy(audioc_session_t* session, const red_block_t* blocks, isize redundantBlocks, u32 ts)
+{
+    const audioc_session_config_t* config = &session->config;
+    for (isize i = 0; i < redundantBlocks; i++) {
+        const red_block_t* block = &blocks[i];
+        const u8* data = block->data;
+        usize bytes = block->bytes;
+        if (block->tsOffset == 0) {
+            continue;
+        }
+
+        //A PCMU backup copy, or any copy sent in the other payload, is converted into the scratch packet
+        if (!toPlayoutFormat(session, block->pt, &data, &bytes, session->fecPacket->payload, session->scratchPayloadBytes)) {
+            continue;
+        }
+
+        if (concealedGapFill(&session->concealedGaps, &session->reblocker, session->stats.packetsPlayed,
+                config->bytesPerSample, ts - block->tsOffset, data, bytes)) {
+            session->stats.redRecovered++;
+            session->stats.lostPackets--;
+            emit(session, AUDIOC_EVENT_RED_RECOVERED, 0);
+        }
+    }
+}
+
+//Finds the audio fragment of a received media packet (header already in host order).
+//For RFC 2198 packets it is the primary block: header->pt is replaced with the primary
+//payload type and the redundant blocks are returned in redBlocks.
+//Returns false if the packet is malformed
+static bool packetPrimaryPayload(rtp_packet_t* packet, isize size, red_block_t* redBlocks, isize* outRedundantBlocks,
+    const u8** outPayload, usize* outPayloadBytes)
+{
+    *outRedundantBlocks = 0;
+    if (size < (isize)sizeof(rtp_hdr_t) || !rtpPayload(packet, size, outPayload, outPayloadBytes)) {
+        return false;
+    }
+    if (packet->header.pt != RED_PAYLOAD_TYPE) {
+        return true;
+    }
+
+    isize count = redSplit(*outPayload, *outPayloadBytes, redBlocks, RED_MAX_BLOCKS);
+    if (count < 1) {
+        return false;
+    }
+
+    red_block_t* primary = &redBlocks[count - 1];
+    packet->header.pt = primary->pt;
+    *outPayload = primary->data;
+    *outPayloadBytes = primary->bytes;
+    *outRedundantBlocks = count - 1;
+    return true;
+}
+
+//Keeps the packet in case it has to be rebuilt with a later one, once FEC is in use
+static void storeForFec(audioc_session_t* session, const rtp_hdr_t* header, const u8* payload, usize payloadBytes)
+{
+    if (session->fecDecoder.storage) {
+        fecDecoderStore(&session->fecDecoder, header, payload, payloadBytes);
+    }
+}
+
+//The jitter buffer was full and the reblocker dropped a block: what follows takes its
+//place, so the positions of the gaps concealed from there on no longer hold
+static void blockDropped(audioc_session_t* session)
+{
+    const reblocker_t* reblocker = &session->reblocker;
+    concealedGapTruncate(&session->concealedGaps, reblocker->blocksWritten * reblocker->blockBytes,
+        session->config.bytesPerSample);
+    session->stats.bufferDrops++;
+}
+
+//Before playout starts nothing is concealed: packets are just queued
+static void receiveWhileBuffering(audioc_session_t* session, const rtp_hdr_t* header, const u8* payload, usize payloadBytes)
+{
+    //Packets may have any duration, the reblocker turns them into playout blocks
+    bool full;
+    session->cbufAccumulated += reblockerPush(&session->reblocker, payload, payloadBytes, &full);
+    if (full) {
+        blockDropped(session);
+    }
+
+    emit(session, AUDIOC_EVENT_RECEIVED, 0);
+
+    session->inputSequenceNum = header->seq;
+    session->nextTimeStamp = header->ts + payloadBytes / session->config.bytesPerSample;
+    if (session->cbufAccumulated >= (isize)session->config.bufferingBlocks) {
+        session->buffering = false;
+    }
+}
+
+static audioc_status_t receiveWhilePlaying(audioc_session_t* session, const rtp_hdr_t* header, const u8* payload, usize payloadBytes)
+{
+    const audioc_session_config_t* config = &session->config;
+    audioc_stats_t* stats = &session->stats;
+    reblocker_t* reblocker = &session->reblocker;
+
+    i32 seqDifference = seqNumDifference(session->inputSequenceNum, header->seq);
+    //Samples missing between the last packet and this one
+    i64 tsGap = timestampDifference(session->nextTimeStamp, header->ts);
+
+    if(seqDifference < 1 || tsGap < 0) {
+        //Received previous samples, ignore
+        //Either last packet was longer than the gap it left or
+        //this is a retransmission? ignore
+
+        //Unless it is a packet we concealed and have not played yet
+        if (seqDifference < 1 && concealedGapFill(&session->concealedGaps, reblocker, stats->packetsPlayed,
+                config->bytesPerSample, header->ts, payload, payloadBytes)) {
+            stats->lateRecovered++;
+            stats->lostPackets--;
+            emit(session, AUDIOC_EVENT_LATE_RECOVERED, 0);
+        }
+        return AUDIOC_OK;
+    }
+
+    bool sent = true;
+    if (tsGap > 0) {
+        //Either packets have been lost (seqDifference - 1 of them) or samples have
+        //been skipped (not sent, no loss occured), we need to introduce a silence.
+        //Leave room for this packet in the buffer
+        i64 lostPackets = seqDifference - 1;
+        i64 freeBytes = (config->capacityBlocks - session->cbufAccumulated) * (i64)config->fragmentBytes
+            - (i64)reblocker->partialBytes - (i64)payloadBytes;
+        i64 silenceBytes = MAX(0, MIN(tsGap * config->bytesPerSample, freeBytes));
+        i64 silenceBlocks = silenceBytes / config->fragmentBytes;
+
+        //We assume the lost packets come first
+        for (i64 i = 0; i < lostPackets; i++) {
+            emit(session, AUDIOC_EVENT_LOST, 0);
+        }
+        for (i64 i = lostPackets; i < silenceBlocks; i++) {
+            emit(session, AUDIOC_EVENT_SILENCE, 0);
+        }
+        stats->lostPackets += lostPackets;
+        stats->silencesPlayed += MAX(0, silenceBlocks - lostPackets);
+        //A datagram dropped by the socket shows up as a gap in the next packet read
+        stats->localLost += MIN(lostPackets, (i64)session->pendingDrops);
+
+        u64 gapPosition = reblockerPosition(reblocker);
+        bool full;
+        session->cbufAccumulated += reblockerPushSilence(reblocker, silenceBytes, &full);
+        if (full) {
+            blockDropped(session);
+        } else if (lostPackets > 0) {
+            //Keep its place in case FEC, redundancy or a retransmission rebuild it before it is played
+            concealedGapAdd(&session->concealedGaps, session->nextTimeStamp, silenceBytes / config->bytesPerSample, gapPosition);
+        }
+
+        if (config->nack && lostPackets > 0) {
+            sent = sendNack(session, header->ssrc, session->inputSequenceNum + 1, lostPackets);
+        }
+    }
+
+    //Add the samples we just received, the reblocker turns them into playout blocks
+    bool full;
+    session->cbufAccumulated += reblockerPush(reblocker, payload, payloadBytes, &full);
+    if (full) {
+        blockDropped(session);
+    }
+
+    emit(session, AUDIOC_EVENT_RECEIVED, 0);
+
+    session->inputSequenceNum = header->seq;
+    session->nextTimeStamp = header->ts + payloadBytes / config->bytesPerSample;
+    session->pendingDrops = 0;
+    return sent ? AUDIOC_OK : AUDIOC_SEND_FAILED;
+}
+
+//Sequence numbers of the stream, for the receiver reports
+static void countReceived(audioc_session_t* session, const rtp_hdr_t* header)
+{
+    if (!session->reporting || header->ssrc != session->remoteSsrc) {
+        session->reporting = true;
+        session->remoteSsrc = header->ssrc;
+        session->baseSeq = session->maxSeq = header->seq;
+        session->seqCycles = session->packetsReceived = session->expectedPrior = session->receivedPrior = 0;
+        session->localLostPrior = session->localLostBase = session->stats.localLost;
+    } else if (seqNumDifference(session->maxSeq, header->seq) > 0) {
+        if (header->seq < session->maxSeq) {
+            session->seqCycles += 1 << 16;
+        }
+        session->maxSeq = header->seq;
+    }
+    session->packetsReceived++;
+}
+
+static void readReport(audioc_session_t* session, const void* rtcp, usize size)
+{
+    report_t report;
+    if (!reportParse(rtcp, size, session->config.ssrc, &report)) {
+        return;
+    }
+    session->stats.peerReports++;
+    session->stats.peerNetworkLost = report.cumulativeLost;
+    if (report.hasDrops) {
+        session->stats.peerLocalLost = report.localLost;
+    }
+}
+
+audioc_status_t audiocSessionReceive(audioc_session_t* session, void* datagram, usize size)
+{
+    rtp_packet_t* packet = datagram;
+    if (isRtcpPacket(packet, size)) {
+        readReport(session, datagram, size);
+        return answerNacks(session, datagram, size);
+    }
+    if (size < sizeof(rtp_hdr_t)) {
+        session->stats.malformed++;
+        return AUDIOC_DROPPED;
+    }
+
+    rtp_hdr_t* header = &packet->header;
+    ntohRTP(header);
+
+    if (header->pt == FEC_PAYLOAD_TYPE) {
+        //Nothing is concealed while buffering, so there is nothing to recover
+        if (!session->buffering) {
+            recoverFromFec(session, packet, size);
+        }
+        return AUDIOC_OK;
+    }
+
+    const u8* payload;
+    usize payloadBytes;
+    red_block_t redBlocks[RED_MAX_BLOCKS];
+    isize redundantBlocks;
+    if (!packetPrimaryPayload(packet, size, redBlocks, &redundantBlocks, &payload, &payloadBytes)
+        || header->version != RTP_VERSION) {
+        session->stats.malformed++;
+        return AUDIOC_DROPPED;
+    }
+    if (header->pt != PCMU && header->pt != L16_1) {
+        session->stats.unplayable++;
+        return AUDIOC_WRONG_PAYLOAD;
+    }
+    if (header->pt != session->receivedPt) {
+        //Timestamps count samples at 8000 Hz in both: only the bytes per sample change
+        if (session->receivedPt != RECEIVED_PT_NONE) {
+            emit(session, AUDIOC_EVENT_PEER_PAYLOAD, header->pt);
+            session->stats.payloadChanges++;
+        }
+        session->receivedPt = header->pt;
+    }
+    countReceived(session, header);
+    //As sent, FEC protects the payload bytes of the packet
+    storeForFec(session, header, payload, payloadBytes);
+
+    if (payloadBytes == 0 || (header->pt != session->config.pt && !convertBuffer(session))
+        || !toPlayoutFormat(session, header->pt, &payload, &payloadBytes, session->convertBuffer, 2 * session->fecMaxPayload)) {
+        session->stats.unplayable++;
+        return AUDIOC_DROPPED;
+    }
+
+    if (session->buffering) {
+        receiveWhileBuffering(session, header, payload, payloadBytes);
+        return AUDIOC_OK;
+    }
+
+    audioc_status_t status = receiveWhilePlaying(session, header, payload, payloadBytes);
+    //Done after the primary, so the silences for the gap it revealed are already enqueued
+    recoverFromRedundancy(session, redBlocks, redundantBlocks, header->ts);
+    return status;
+}
+
+void audiocSessionSocketDrops(audioc_session_t* session, u32 socketDrops)
+{
+    if (socketDrops > session->socketDrops) {
+        session->pendingDrops += socketDrops - session->socketDrops;
+        session->stats.socketDrops += socketDrops - session->socketDrops;
+        session->socketDrops = socketDrops;
+    }
+}
+
+audioc_status_t audiocSessionReport(audioc_session_t* session, u32 jitter)
+{
+    if (!session->reporting) {
+        return AUDIOC_OK;
+    }
+    const audioc_stats_t* stats = &session->stats;
+    u32 highestSeq = session->seqCycles + session->maxSeq;
+    u32 expected = highestSeq - session->baseSeq + 1;
+    //Loss the network caused: what our socket dropped is reported apart
+    i64 lost = (i64)expected - session->packetsReceived - (stats->localLost - session->localLostBase);
+    i64 expectedInterval = expected - session->expectedPrior;
+    i64 lostInterval = expectedInterval - (session->packetsReceived - session->receivedPrior)
+        - (stats->localLost - session->localLostPrior);
+    session->expectedPrior = expected;
+    session->receivedPrior = session->packetsReceived;
+    session->localLostPrior = stats->localLost;
+
+    report_t report = {
+        .ssrc = session->remoteSsrc,
+        .fractionLost = expectedInterval > 0 && lostInterval > 0 ? MIN(lostInterval * 256 / expectedInterval, 255) : 0,
+        .cumulativeLost = MAX(MIN(lost, 0x7FFFFF), -0x800000),
+        .highestSeq = highestSeq,
+        .jitter = jitter,
+        .socketDrops = stats->socketDrops,
+        .localLost = stats->localLost - session->localLostBase,
+    };
+    u8 packet[REPORT_PACKET_SIZE];
+    if (!sendPacket(session, packet, reportBuild(packet, session->config.ssrc, &report))) {
+        return AUDIOC_SEND_FAILED;
+    }
+    session->stats.reportsSent++;
+    return AUDIOC_OK;
+}
+
+/*
+ * Playout
+ */
+
+bool audiocSessionBuffering(const audioc_session_t* session)
+{
+    return session->buffering;
+}
+
+usize audiocSessionBufferedBlocks(const audioc_session_t* session)
+{
+    return session->cbufAccumulated;
+}
+
+int audiocSessionPlayout(audioc_session_t* session, usize maxBlocks, struct iovec iov[2])
+{
+    void* first;
+    void* second;
+    int firstBlocks, secondBlocks;
+    int blocks = cbuf_readable_regions(session->circularBuffer, MIN(maxBlocks, (usize)session->cbufAccumulated),
+        &first, &firstBlocks, &second, &secondBlocks);
+    if (blocks == 0) {
+        return 0;
+    }
+
+    usize fragmentBytes = session->config.fragmentBytes;
+    iov[0] = (struct iovec) {
+        .iov_base = (u8*)first + session->cardPartialBytes,
+        .iov_len = firstBlocks * fragmentBytes - session->cardPartialBytes,
+    };
+    iov[1] = (struct iovec) { .iov_base = second, .iov_len = secondBlocks * fragmentBytes };
+    return secondBlocks > 0 ? 2 : 1;
+}
+
+usize audiocSessionPlayed(audioc_session_t* session, usize bytes)
+{
+    //A partly played block stays in the buffer, the rest of it goes first next time
+    usize played = session->cardPartialBytes + bytes;
+    usize blocks = played / session->config.fragmentBytes;
+    session->cardPartialBytes = played % session->config.fragmentBytes;
+
+    cbuf_advance_read(session->circularBuffer, blocks);
+    session->cbufAccumulated -= blocks;
+    session->stats.packetsPlayed += blocks;
+    for (usize i = 0; i < blocks; i++) {
+        emit(session, AUDIOC_EVENT_PLAYED, 0);
+    }
+    return blocks;
+}
+
+void audiocSessionTick(audioc_session_t* session)
+{
+    //Complete the block being assembled (or add a new one) with silence
+    usize silenceBytes;
+    usize blocks = reblockerFlush(&session->reblocker, &silenceBytes);
+    //If the buffer is somehow full something has gone wrong
+    if (blocks == 0){
+        blockDropped(session);
+    }
+    session->cbufAccumulated += blocks;
+    //Increment input counters as if it arrived correctly
+    session->stats.timeouts++;
+    //silences do not increment the sequence number
+    session->nextTimeStamp += silenceBytes / session->config.bytesPerSample;
+    emit(session, AUDIOC_EVENT_TICK, 0);
+}
+
+void audiocSessionStats(const audioc_session_t* session, audioc_stats_t* stats)
+{
+    *stats = session->stats;
+}
+
+usize audiocSessionMemory(const audioc_session_t* session)
+{
+    return session->memoryBytes;
+}
+
+/* TEST of the loss recovery: a sender session, a link that drops some of its packets
+ * and a receiver session. The only code in the library that prints or exits.
+ * To execute it, link libaudioc with following code  */
+
+/* #include "audioc_session.h"
+void _audiocSessionTest(void);
+int main (void)
+{
+    _audiocSessionTest();
+} */
+
+#define TEST_BLOCK_BYTES 160    //20 ms of PCMU, one block per packet
+#define TEST_PACKETS 24
+#define TEST_FIRST_SEQ 65530    //Wraps around during the test
+
+typedef struct {
+    const char* name;
+    u32 fecGroup;
+    u32 redDepth;
+    u16 lost[4];                //Media packets the link drops, counted from the first one sent
+    usize lostCount;
+    i32 fecRecovered;
+    i32 redRecovered;
+    i32 lostPackets;
+} session_test_t;
+
+typedef struct {
+    const session_test_t* test;
+    audioc_session_t* receiver;
+    u8 datagram[MAX_PACKET_SIZE];
+} test_link_t;
+
+static bool testLinkSend(void* context, const void* packet, usize size)
+{
+    test_link_t* link = context;
+    rtp_hdr_t header = *(const rtp_hdr_t*)packet;
+    ntohRTP(&header);
+    if (header.pt != FEC_PAYLOAD_TYPE) {
+        for (usize i = 0; i < link->test->lostCount; i++) {
+            if ((u16)(header.seq - TEST_FIRST_SEQ) == link->test->lost[i]) {
+                return true;
+            }
+        }
+    }
+    if (size > sizeof(link->datagram)) {
+        return false;
+    }
+    //The receiver turns the header to host order in place
+    memcpy(link->datagram, packet, size);
+    return audiocSessionReceive(link->receiver, link->datagram, size) == AUDIOC_OK;
+}
+
+static void testSessionFail(const session_test_t* test, const char* what, i32 expected, i32 returned)
+{
+    printf("_audiocSessionTest %s error in test %s; expected %d, returned %d\n", what, test->name, expected, returned);
+    exit(1);
+}
+
+static void testSessionLoss(const session_test_t* test)
+{
+    test_link_t link = { .test = test };
+    audioc_session_config_t config = {
+        .ssrc = 1,
+        .pt = PCMU,
+        .fragmentBytes = TEST_BLOCK_BYTES,
+        .packetBytes = TEST_BLOCK_BYTES,
+        .bytesPerSample = 1,
+        .bufferingBlocks = 2,
+        .capacityBlocks = 2 * TEST_PACKETS,
+        .receiveOnly = true,
+        .send = testLinkSend,
+        .sendContext = &link,
+    };
+    link.receiver = audiocSessionCreate(&config);
+    config.ssrc = 2;
+    config.receiveOnly = false;
+    config.fecGroup = test->fecGroup;
+    config.redDepth = test->redDepth;
+    config.firstSeq = TEST_FIRST_SEQ;
+    config.fecFirstSeq = 7;
+    audioc_session_t* sender = audiocSessionCreate(&config);
+    if (!link.receiver || !sender) {
+        printf("_audiocSessionTest CREATE error in test %s\n", test->name);
+        exit(1);
+    }
+
+    //Every block is filled with its number, the silences that conceal a loss never are
+    u8 block[TEST_BLOCK_BYTES];
+    for (u32 i = 0; i < TEST_PACKETS; i++) {
+        memset(block, i, sizeof(block));
+        audioc_status_t status = audiocSessionCapture(sender, block, (u64)i * TEST_BLOCK_BYTES);
+        if (status != AUDIOC_OK) {
+            testSessionFail(test, "CAPTURE", AUDIOC_OK, status);
+        }
+    }
+
+    audioc_stats_t stats;
+    audiocSessionStats(link.receiver, &stats);
+    if (stats.fecRecovered != test->fecRecovered) {
+        testSessionFail(test, "FEC_RECOVERED", test->fecRecovered, stats.fecRecovered);
+    }
+    if (stats.redRecovered != test->redRecovered) {
+        testSessionFail(test, "RED_RECOVERED", test->redRecovered, stats.redRecovered);
+    }
+    if (stats.lostPackets != test->lostPackets) {
+        testSessionFail(test, "LOST_PACKETS", test->lostPackets, stats.lostPackets);
+    }
+
+    //What is played: the blocks received or recovered in their place, silence for the others
+    struct iovec iov[2];
+    int regions = audiocSessionPlayout(link.receiver, TEST_PACKETS, iov);
+    i32 played = 0;
+    i32 intact = 0;
+    for (int r = 0; r < regions; r++) {
+        for (usize offset = 0; offset < iov[r].iov_len; offset += TEST_BLOCK_BYTES) {
+            memset(block, played++, sizeof(block));
+            intact += memcmp((u8*)iov[r].iov_base + offset, block, sizeof(block)) == 0;
+        }
+    }
+    if (played != TEST_PACKETS) {
+        testSessionFail(test, "PLAYOUT", TEST_PACKETS, played);
+    }
+    if (intact != TEST_PACKETS - test->lostPackets) {
+        testSessionFail(test, "CONTENT", TEST_PACKETS - test->lostPackets, intact);
+    }
+
+    audiocSessionDestroy(sender);
+    audiocSessionDestroy(link.receiver);
+}
+
+void _audiocSessionTest(void)
+{
+    //Playout starts with the second packet. FEC recovery starts with the group after the
+    //first FEC packet received from then on (packets 4 to 7)
+    session_test_t tests[] = {
+        {"no protection", 0, 0, {5, 9, 10}, 3, 0, 0, 3},
+        //One loss per group is rebuilt, two are not
+        {"FEC", 4, 0, {5, 9, 10, 13}, 4, 2, 0, 2},
+        //The next packet carries the one before: only the last loss of each run comes back
+        {"RED", 0, 1, {5, 9, 10, 17}, 4, 0, 3, 1},
+        {"RED depth 2", 0, 2, {5, 9, 10, 17}, 4, 0, 4, 0},
+        /* you can add more tests here */
+    };
+    for (usize i = 0; i < ARRAY_COUNT(tests); i++) {
+        testSessionLoss(&tests[i]);
+    }
+    printf("Tests PASSED (number of tests: %zu)\n", ARRAY_COUNT(tests));
+}
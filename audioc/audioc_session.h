@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.h"
+#include "audiocArgs.h"
+#include "audioc_allocator.h"
+
+#include <sys/uio.h>
+
+//libaudioc: one audioc session (RTP audio in both directions between us and a group)
+//without any I/O of its own. The caller owns the socket, the sound card and the clock:
+//- received datagrams are fed with audiocSessionReceive()
+//- captured fragments are fed with audiocSessionCapture()
+//- blocks to play are pulled with audiocSessionPlayout() / audiocSessionPlayed()
+//- when nothing arrived in time to be played, audiocSessionTick() conceals it
+//- every packet the session wants to send (audio, FEC, RED, NACKs, retransmissions)
+//  goes through the send callback given at creation
+//All the state is in the session object, and its memory comes from the allocator in the
+//configuration: a process may drive any number of sessions. Nothing here exits the process
+//or prints; problems are reported with the return values and counted in the stats, and what
+//happens to each packet can be followed with the event callback.
+
+typedef struct audioc_session audioc_session_t;
+
+//Returns false if the packet could not be sent
+typedef bool (*audioc_send_fn)(void* context, const void* packet, usize size);
+
+//What happened to a packet or block. The values are the markers audioc prints with -v
+typedef enum {
+    AUDIOC_EVENT_SENT = '.',
+    AUDIOC_EVENT_RETRANSMITTED = 'R',
+    AUDIOC_EVENT_RECEIVED = '+',
+    AUDIOC_EVENT_LOST = 'x',
+    AUDIOC_EVENT_SILENCE = '~',       //Concealed with silence, besides the lost packets
+    AUDIOC_EVENT_FEC_RECOVERED = 'f',
+    AUDIOC_EVENT_RED_RECOVERED = 'r',
+    AUDIOC_EVENT_LATE_RECOVERED = 'n',
+    AUDIOC_EVENT_PLAYED = '-',
+    AUDIOC_EVENT_TICK = 't',
+    AUDIOC_EVENT_PEER_PAYLOAD = 'P',  //value: the payload type the peer switched to
+    AUDIOC_EVENT_SEND_PAYLOAD = 'S',  //value: the payload type --adapt switched to
+} audioc_event_t;
+
+//Called for every event, from the call that caused it. value is 0 unless said otherwise
+typedef void (*audioc_event_fn)(void* context, audioc_event_t event, u32 value);
+
+typedef struct {
+    u32 ssrc;
+    u8 pt;                  //enum payload: what is captured and played. Received audio in the
+                            //other payload is converted to it
+    u32 fragmentBytes;      //Playout (and capture) block
+    u32 packetBytes;        //Audio in each packet we send
+    u32 bytesPerSample;
+    u32 bufferingBlocks;    //Blocks buffered before playout starts
+    u32 capacityBlocks;     //Jitter buffer size, at least bufferingBlocks
+
+    u32 fecGroup;           //See audioc_ext_args_t, 0 to disable
+    u32 redDepth;
+    bool redPcmu;
+    bool nack;
+    bool receiveOnly;       //Nothing will be captured: no send side state (nor NACK answers)
+    bool adaptPayload;      //See audioc_ext_args_t (--adapt), needs pt L16 and no RED
+
+    u16 firstSeq;           //Of the packets we send
+    u16 fecFirstSeq;        //Of the FEC packets we send (their own sequence)
+    u32 firstTs;            //Timestamp of the first captured sample
+
+    audioc_send_fn send;
+    void* sendContext;
+    audioc_event_fn event;  //NULL if not needed
+    void* eventContext;
+    const allocator_t* allocator; //NULL: malloc(). Must outlive the session
+} audioc_session_config_t;
+
+typedef enum {
+    AUDIOC_OK = 0,
+    AUDIOC_DROPPED,         //Malformed or useless packet, ignored (stats malformed or unplayable)
+    AUDIOC_WRONG_PAYLOAD,   //The peer sends a payload type that cannot be played: packet ignored
+    AUDIOC_SEND_FAILED,     //The send callback failed
+} audioc_status_t;
+
+typedef struct {
+    i32 packetsPlayed;      //Blocks played
+    i32 silencesPlayed;
+    i32 timeouts;           //Technically count as silences
+    i32 lostPackets;
+    i32 packetsRecorded;    //Packets sent
+    i32 fecRecovered;       //Lost packets rebuilt from FEC before being played
+    i32 redRecovered;       //Lost packets replaced by a redundant copy before being played
+    i32 lateRecovered;      //Lost packets that arrived late (retransmitted) before being played
+    i32 nacksSent;
+    i32 retransmissions;    //Packets sent again after a NACK
+    i32 payloadChanges;     //Times the peer switched between PCMU and L16
+    i32 sendPayloadChanges; //Times --adapt switched what we send
+    i32 socketDrops;        //Datagrams our socket dropped because we did not read them in time
+    i32 localLost;          //Lost packets (in lostPackets) that were among them, not lost by the network
+    i32 reportsSent;        //RTCP receiver reports
+    i32 peerReports;        //Receiver reports about our packets
+    i32 peerNetworkLost;    //As reported by the last of them
+    i32 peerLocalLost;      //Dropped by the socket of the peer
+    i32 malformed;          //Datagrams dropped: not RTP, or RED that does not parse
+    i32 unplayable;         //Packets dropped: a payload type or size that cannot be played
+    i32 bufferDrops;        //Blocks dropped: the jitter buffer was full
+} audioc_stats_t;
+
+//Returns NULL if the configuration is not valid or memory could not be allocated
+audioc_session_t* audiocSessionCreate(const audioc_session_config_t* config);
+void audiocSessionDestroy(audioc_session_t* session);
+
+//A datagram received on the session port, RTP or RTCP (multiplexed). It is modified
+//(byte order of the header)
+audioc_status_t audiocSessionReceive(audioc_session_t* session, void* datagram, usize size);
+
+//A captured fragment of config.fragmentBytes, whose first byte was captured at byte
+//position (since the start of capture, gaps mean lost samples). Sends every packet completed
+audioc_status_t audiocSessionCapture(audioc_session_t* session, const u8* fragment, u64 position);
+
+//True until bufferingBlocks have been received: nothing should be played yet
+bool audiocSessionBuffering(const audioc_session_t* session);
+
+//Blocks waiting to be played
+usize audiocSessionBufferedBlocks(const audioc_session_t* session);
+
+//Up to maxBlocks blocks ready to be played, as at most 2 regions (the jitter buffer wraps
+//around) without what was already played of the first one. Returns the number of iovecs
+//used, 0 if there is nothing to play. The data stays valid until audiocSessionPlayed()
+int audiocSessionPlayout(audioc_session_t* session, usize maxBlocks, struct iovec iov[2]);
+
+//bytes from audiocSessionPlayout() were played. Returns the number of blocks completed
+usize audiocSessionPlayed(audioc_session_t* session, usize bytes);
+
+//Playout is about to run out of audio and nothing has arrived: completes the block being
+//assembled (or adds one) with silence
+void audiocSessionTick(audioc_session_t* session);
+
+//The cumulative count of datagrams the socket dropped (SO_RXQ_OVFL), before the datagram
+//it came with is received: the gap that datagram reveals is counted as local, not network loss
+void audiocSessionSocketDrops(audioc_session_t* session, u32 socketDrops);
+
+//Sends an RTCP receiver report about the stream received, if any, with jitter (timestamp
+//units) measured by the caller. To be called every REPORT_INTERVAL_US (audioc_report.h)
+audioc_status_t audiocSessionReport(audioc_session_t* session, u32 jitter);
+
+void audiocSessionStats(const audioc_session_t* session, audioc_stats_t* stats);
+
+//Bytes of memory the session allocated
+usize audiocSessionMemory(const audioc_session_t* session);
@@ -0,0 +1,115 @@
+#include "audioc_socket.h"
+
+#include <stdio.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+//The kernel doubles what is asked, for its bookkeeping, and reports the doubled size
+static void raiseBuffer(int sockId, int option, int forceOption, int bytes, const char* limit)
+{
+    int current = 0;
+    socklen_t length = sizeof(int);
+    if (getsockopt(sockId, SOL_SOCKET, option, &current, &length) < 0 || current >= 2 * bytes) {
+        return;
+    }
+    //Capped by the sysctl, unless we are allowed to go past it
+    if (setsockopt(sockId, SOL_SOCKET, forceOption, &bytes, sizeof(int)) < 0) {
+        setsockopt(sockId, SOL_SOCKET, option, &bytes, sizeof(int));
+    }
+    length = sizeof(int);
+    if (getsockopt(sockId, SOL_SOCKET, option, &current, &length) == 0 && current < 2 * bytes) {
+        fprintf(stderr, "WARNING: socket buffer of %d bytes, %d wanted: raise %s.\n", current / 2, bytes, limit);
+    }
+    trace("Socket buffer %s: %d bytes", option == SO_RCVBUF ? "SO_RCVBUF" : "SO_SNDBUF", current);
+}
+
+void socketSizeBuffers(int sockId, u32 bufferingMs, u32 packetMs, usize packetBytes)
+{
+    int datagramBytes = packetBytes + SOCKET_DATAGRAM_OVERHEAD;
+    u32 packets = MAX(bufferingMs / MAX(packetMs, 1) + 1, SOCKET_MIN_RECEIVE_PACKETS / SOCKET_STREAM_FACTOR);
+    raiseBuffer(sockId, SO_RCVBUF, SO_RCVBUFFORCE, packets * SOCKET_STREAM_FACTOR * datagramBytes, "net.core.rmem_max");
+    raiseBuffer(sockId, SO_SNDBUF, SO_SNDBUFFORCE, SOCKET_SEND_BURST_PACKETS * datagramBytes, "net.core.wmem_max");
+}
+
+bool socketEnableDrops(int sockId)
+{
+    int enable = 1;
+    return setsockopt(sockId, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(int)) == 0;
+}
+
+isize socketReceive(int sockId, void* buffer, usize size, u32* drops)
+{
+    struct iovec iov = { .iov_base = buffer, .iov_len = size };
+    union {
+        char buffer[CMSG_SPACE(sizeof(u32))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    isize result = recvmsg(sockId, &message, 0);
+    if (result < 0) {
+        return result;
+    }
+    //Only there once something was dropped
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(drops, CMSG_DATA(cmsg), sizeof(u32));
+        }
+    }
+    return result;
+}
+
+bool socketEnableGro(int sockId)
+{
+    int enable = 1;
+    return setsockopt(sockId, SOL_UDP, UDP_GRO, &enable, sizeof(int)) == 0;
+}
+
+bool socketGsoAvailable(int sockId)
+{
+    int segmentBytes;
+    socklen_t length = sizeof(int);
+    return getsockopt(sockId, SOL_UDP, UDP_SEGMENT, &segmentBytes, &length) == 0;
+}
+
+isize socketReceiveSegments(int sockId, void* buffer, usize size, u32* segmentBytes)
+{
+    struct iovec iov = { .iov_base = buffer, .iov_len = size };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    isize result = recvmsg(sockId, &message, 0);
+    if (result < 0) {
+        return result;
+    }
+    //Only there when the kernel coalesced something
+    *segmentBytes = result;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gsoSize;
+            memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(int));
+            *segmentBytes = MIN((u32)MAX(gsoSize, 1), (u32)result);
+        }
+    }
+    return result;
+}
+
+void socketSegmentControl(socket_segment_control_t* control, u16 segmentBytes)
+{
+    struct cmsghdr* cmsg = &control->align;
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(u16));
+    memcpy(CMSG_DATA(cmsg), &segmentBytes, sizeof(u16));
+}
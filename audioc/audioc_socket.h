@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+
+#include <sys/socket.h>
+
+//Socket buffers sized for the stream instead of the system default. The receive buffer
+//holds everything that arrives while we do not read, up to the whole buffering time (a
+//stall that long plays silence anyway); beyond it the kernel drops datagrams, which
+//SO_RXQ_OVFL counts (audioc_arrival.h). The kernel charges a datagram its whole buffer
+//(sk_buff and driver allocation), not just the payload.
+#define SOCKET_DATAGRAM_OVERHEAD 768
+//Room for packets of other senders and for FEC, RED and retransmissions on top of ours
+#define SOCKET_STREAM_FACTOR 2
+#define SOCKET_MIN_RECEIVE_PACKETS 64
+//Datagrams sent back to back: a FEC packet and a batch of retransmissions after a block
+#define SOCKET_SEND_BURST_PACKETS 32
+
+//Raises SO_RCVBUF and SO_SNDBUF to what a stream of packetBytes datagrams every packetMs
+//needs, never lowers them. Says so if net.core.rmem_max or wmem_max capped them
+void socketSizeBuffers(int sockId, u32 bufferingMs, u32 packetMs, usize packetBytes);
+
+//Counts of dropped datagrams alone, without arrival times (audioc_arrival.h has both)
+bool socketEnableDrops(int sockId);
+
+//recv() that updates *drops with the count of datagrams the socket dropped so far
+isize socketReceive(int sockId, void* buffer, usize size, u32* drops);
+
+//UDP GRO and GSO (Linux 5.0 and 4.18): the kernel hands us up to SOCKET_MAX_SEGMENTS
+//datagrams of one flow and one size (the last may be shorter) coalesced in one buffer,
+//and splits such a buffer into datagrams on the way out, one system call and one trip
+//through the stack for all of them. Without them datagrams come and go one by one
+#define SOCKET_MAX_SEGMENTS 64
+//What one receive may hold once coalesced
+#define SOCKET_GRO_BUFFER_BYTES 65536
+
+bool socketEnableGro(int sockId);
+
+//The kernel takes UDP_SEGMENT on sockId. A device without checksum offload may still
+//refuse it (EIO) when sending
+bool socketGsoAvailable(int sockId);
+
+//recv() of what GRO may have coalesced: *segmentBytes is the size of every datagram in
+//buffer but the last, the whole size when there is only one
+isize socketReceiveSegments(int sockId, void* buffer, usize size, u32* segmentBytes);
+
+//Control message (msg_control) of a send the kernel splits into segmentBytes datagrams
+typedef union {
+    char buffer[CMSG_SPACE(sizeof(u16))];
+    struct cmsghdr align;
+} socket_segment_control_t;
+
+void socketSegmentControl(socket_segment_control_t* control, u16 segmentBytes);
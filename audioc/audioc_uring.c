@@ -0,0 +1,535 @@
+#include "audioc_uring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#define URING_BUFFER_GROUP 0
+//Room for the control messages arrivalParse() reads, as arrivalReceive() has
+#define URING_CONTROL_BYTES (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct scm_timestamping)) \
+    + CMSG_SPACE(sizeof(u32)) + CMSG_SPACE(sizeof(int)))
+
+//user_data: what completed in the top byte, which one (slot, timeout generation) below
+typedef enum {
+    URING_RECEIVE = 1,
+    URING_CARD_READ,
+    URING_CARD_WRITE,
+    URING_TIMEOUT,
+    URING_TIMEOUT_UPDATE,   //Posts only when the timeout was gone
+    URING_TIMEOUT_REMOVE,
+    URING_SEND,
+} uring_request_t;
+
+#define URING_USER_DATA(request, value) ((u64)(request) << 56 | (value))
+#define URING_REQUEST(userData) ((userData) >> 56)
+#define URING_VALUE(userData) ((userData) & (((u64)1 << 56) - 1))
+
+static int uringSetup(u32 entries, struct io_uring_params* params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, u32 submit, u32 minComplete, u32 flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, u32 opcode, void* arg, u32 count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static u32 roundUpPowerOf2(u32 value)
+{
+    u32 power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+//Submits what is queued, then waits for minComplete completions
+static int submit(uring_t* ring, u32 minComplete)
+{
+    __atomic_store_n(ring->sqTail, ring->sqQueued, __ATOMIC_RELEASE);
+    u32 count = ring->sqQueued - ring->sqSubmitted;
+    ring->enters++;
+    int result = uringEnter(ring->fd, count, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (result >= 0) {
+        ring->sqSubmitted += result;
+    }
+    //What follows is a new batch, not linked to the sends submitted
+    ring->lastSend = NULL;
+    ring->quickCompletions = 0;
+    return result;
+}
+
+//A zeroed entry. When the queue is full what it holds is submitted first
+static struct io_uring_sqe* getSqe(uring_t* ring)
+{
+    if (ring->sqQueued - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries) {
+        if (submit(ring, 0) < 0) {
+            panic("io_uring_enter error");
+        }
+    }
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sqQueued & ring->sqMask];
+    ring->sqQueued++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static bool mapRings(uring_t* ring, const struct io_uring_params* params)
+{
+    ring->ringBytes = params->sq_off.array + params->sq_entries * sizeof(u32);
+    ring->cqBytes = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params->features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        ring->ringBytes = MAX(ring->ringBytes, ring->cqBytes);
+    }
+    ring->ringMap = mmap(NULL, ring->ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+        IORING_OFF_SQ_RING);
+    if (ring->ringMap == MAP_FAILED) {
+        ring->ringMap = NULL;
+        return false;
+    }
+    ring->cqMap = single ? ring->ringMap : mmap(NULL, ring->cqBytes, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqMap == MAP_FAILED) {
+        ring->cqMap = NULL;
+        return false;
+    }
+    ring->sqesBytes = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+        IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    u8* sq = ring->ringMap;
+    ring->sqHead = (u32*)(sq + params->sq_off.head);
+    ring->sqTail = (u32*)(sq + params->sq_off.tail);
+    ring->sqMask = *(u32*)(sq + params->sq_off.ring_mask);
+    ring->sqEntries = params->sq_entries;
+    ring->sqQueued = ring->sqSubmitted = *ring->sqTail;
+    //Entry i of the queue is always sqes[i]
+    u32* array = (u32*)(sq + params->sq_off.array);
+    for (u32 i = 0; i < params->sq_entries; i++) {
+        array[i] = i;
+    }
+    u8* cq = ring->cqMap;
+    ring->cqHead = (u32*)(cq + params->cq_off.head);
+    ring->cqTail = (u32*)(cq + params->cq_off.tail);
+    ring->cqMask = *(u32*)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params->cq_off.cqes);
+    return true;
+}
+
+static void recycleBuffer(uring_t* ring, u16 id)
+{
+    struct io_uring_buf* buffer = &ring->bufferRing->bufs[ring->bufferTail & (ring->bufferCount - 1)];
+    buffer->addr = (u64)(uintptr_t)(ring->buffers + (usize)id * ring->bufferBytes);
+    buffer->len = ring->bufferBytes;
+    buffer->bid = id;
+    ring->bufferTail++;
+}
+
+static bool setupBuffers(uring_t* ring)
+{
+    ring->bufferRingBytes = ring->bufferCount * sizeof(struct io_uring_buf);
+    ring->bufferRing = mmap(NULL, ring->bufferRingBytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    ring->buffers = mmap(NULL, (usize)ring->bufferCount * ring->bufferBytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring->bufferRing == MAP_FAILED || ring->buffers == MAP_FAILED) {
+        return false;
+    }
+    struct io_uring_buf_reg registration = {
+        .ring_addr = (u64)(uintptr_t)ring->bufferRing,
+        .ring_entries = ring->bufferCount,
+        .bgid = URING_BUFFER_GROUP,
+    };
+    if (uringRegister(ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        return false;
+    }
+    for (u32 i = 0; i < ring->bufferCount; i++) {
+        recycleBuffer(ring, i);
+    }
+    __atomic_store_n(&ring->bufferRing->tail, ring->bufferTail, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void armReceive(uring_t* ring)
+{
+    struct io_uring_sqe* sqe = getSqe(ring);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = ring->sockId;
+    sqe->addr = (u64)(uintptr_t)&ring->recvLayout;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_USER_DATA(URING_RECEIVE, 0);
+    ring->receiving = true;
+}
+
+//Arms the receive right away: a kernel with provided buffer rings (5.19) but without
+//multishot recvmsg (6.0) refuses it as soon as it is submitted. Any other completion is
+//left for reap()
+static bool armReceiveChecked(uring_t* ring)
+{
+    armReceive(ring);
+    if (submit(ring, 0) < 0) {
+        return false;
+    }
+    u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (u32 head = *ring->cqHead; head != tail; head++) {
+        const struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        if (URING_REQUEST(cqe->user_data) == URING_RECEIVE && cqe->res == -EINVAL) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool uringOpen(uring_t* ring, int sockId, int cardFd, u32 datagramBytes, u32 buffers, uring_handler_t handler,
+    void* context)
+{
+    *ring = (uring_t) {
+        .fd = -1,
+        .sockId = sockId,
+        .cardFd = cardFd,
+        .handler = handler,
+        .context = context,
+        .bufferCount = roundUpPowerOf2(MIN(MAX(buffers, URING_MIN_BUFFERS), URING_MAX_BUFFERS)),
+        .slotBytes = datagramBytes,
+    };
+    ring->recvLayout.msg_namelen = sizeof(struct sockaddr_in);
+    ring->recvLayout.msg_controllen = URING_CONTROL_BYTES;
+    //The datagram follows the header, the name and the control messages, 8 byte aligned
+    usize headerBytes = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + URING_CONTROL_BYTES;
+    ring->bufferBytes = (headerBytes + datagramBytes + 63) & ~(usize)63;
+
+    //Completions of every buffer in use and of every request can wait to be reaped
+    struct io_uring_params params = {
+        .flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER,
+        .cq_entries = roundUpPowerOf2(ring->bufferCount + 2 * URING_ENTRIES),
+    };
+    ring->fd = uringSetup(URING_ENTRIES, &params);
+    if (ring->fd < 0 && errno == EINVAL) {
+        //Before 6.0
+        params = (struct io_uring_params) { .flags = IORING_SETUP_CQSIZE, .cq_entries = params.cq_entries };
+        ring->fd = uringSetup(URING_ENTRIES, &params);
+    }
+    if (ring->fd < 0) {
+        printError("Could not create an io_uring (not in this kernel, or disabled by kernel.io_uring_disabled)");
+        uringClose(ring);
+        return false;
+    }
+    if (!mapRings(ring, &params)) {
+        printError("Could not map the io_uring");
+        uringClose(ring);
+        return false;
+    }
+    if (!setupBuffers(ring)) {
+        printError("Could not set up %u io_uring buffers of %u bytes (provided buffer rings need Linux 5.19)",
+            ring->bufferCount, ring->bufferBytes);
+        uringClose(ring);
+        return false;
+    }
+
+    if (!armReceiveChecked(ring)) {
+        printError("The kernel has no multishot recvmsg for io_uring (Linux 6.0)");
+        uringClose(ring);
+        return false;
+    }
+
+    u8* slotMemory = malloc(URING_SEND_SLOTS * (usize)ring->slotBytes);
+    if (!slotMemory) {
+        printError("Could not allocate the io_uring send slots");
+        uringClose(ring);
+        return false;
+    }
+    for (u32 i = 0; i < URING_SEND_SLOTS; i++) {
+        uring_slot_t* slot = &ring->slots[i];
+        slot->data = slotMemory + (usize)i * ring->slotBytes;
+        slot->iov.iov_base = slot->data;
+        slot->message.msg_name = &slot->to;
+        slot->message.msg_namelen = sizeof(struct sockaddr_in);
+        slot->message.msg_iov = &slot->iov;
+        slot->message.msg_iovlen = 1;
+    }
+
+    trace("io_uring: %u receive buffers of %u bytes, %u send slots", ring->bufferCount, ring->bufferBytes,
+        URING_SEND_SLOTS);
+    return true;
+}
+
+void uringClose(uring_t* ring)
+{
+    //Closing the ring cancels what is in flight and drops its buffer registration
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqesBytes);
+    }
+    if (ring->cqMap && ring->cqMap != ring->ringMap) {
+        munmap(ring->cqMap, ring->cqBytes);
+    }
+    if (ring->ringMap) {
+        munmap(ring->ringMap, ring->ringBytes);
+    }
+    if (ring->bufferRing && ring->bufferRing != MAP_FAILED) {
+        munmap(ring->bufferRing, ring->bufferRingBytes);
+    }
+    if (ring->buffers && ring->buffers != MAP_FAILED) {
+        munmap(ring->buffers, (usize)ring->bufferCount * ring->bufferBytes);
+    }
+    free(ring->slots[0].data);
+    ring->fd = -1;
+    ring->sqes = NULL;
+    ring->ringMap = ring->cqMap = NULL;
+    ring->bufferRing = NULL;
+    ring->buffers = NULL;
+    ring->slots[0].data = NULL;
+}
+
+static void armPoll(uring_t* ring, u32 events, uring_request_t request)
+{
+    struct io_uring_sqe* sqe = getSqe(ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = ring->cardFd;
+    sqe->poll32_events = events;
+    sqe->user_data = URING_USER_DATA(request, 0);
+}
+
+static i64 monotonicNowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (i64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//The timeout armed is moved to the new deadline, with no completion unless it was gone
+//(fired or about to). One fired for an earlier deadline is told apart by the clock
+static void armTimeout(uring_t* ring)
+{
+    struct io_uring_sqe* sqe = getSqe(ring);
+    if (ring->timing) {
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+        sqe->addr = URING_USER_DATA(URING_TIMEOUT, ring->timeoutGeneration);
+        sqe->addr2 = (u64)(uintptr_t)&ring->deadline;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = URING_USER_DATA(URING_TIMEOUT_UPDATE, ring->timeoutGeneration);
+        return;
+    }
+    ring->timeoutGeneration++;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (u64)(uintptr_t)&ring->deadline;
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = URING_USER_DATA(URING_TIMEOUT, ring->timeoutGeneration);
+    ring->timing = true;
+}
+
+//Waits with no deadline: the timeout armed goes, its cancellation posted right away
+static void removeTimeout(uring_t* ring)
+{
+    struct io_uring_sqe* sqe = getSqe(ring);
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->addr = URING_USER_DATA(URING_TIMEOUT, ring->timeoutGeneration);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = URING_USER_DATA(URING_TIMEOUT_REMOVE, 0);
+    ring->timing = false;
+    ring->quickCompletions++;
+}
+
+//The buffer holds the header, the name and control room of recvLayout, then the datagram
+static void handleDatagram(uring_t* ring, u8* buffer, u32 bytes)
+{
+    struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)buffer;
+    u8* name = buffer + sizeof(*out);
+    u8* control = name + ring->recvLayout.msg_namelen;
+    u8* datagram = control + ring->recvLayout.msg_controllen;
+    if (bytes < sizeof(*out) || (out->flags & MSG_TRUNC)) {
+        ring->truncated++;
+        return;
+    }
+
+    struct msghdr message = { .msg_control = control, .msg_controllen = out->controllen };
+    arrival_t arrival;
+    arrivalParse(&message, &arrival);
+    struct sockaddr_in from = {0};
+    memcpy(&from, name, MIN(out->namelen, sizeof(from)));
+    ring->datagrams++;
+    ring->handler(ring->context, datagram, out->payloadlen, &from, &arrival);
+}
+
+//Handles every completion there is. Returns the datagrams handled
+static u32 reap(uring_t* ring, bool wantCardWrite, uring_events_t* events, bool* fired)
+{
+    u32 head = *ring->cqHead;
+    u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    u32 datagrams = 0;
+    for (; head != tail; head++) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        u64 value = URING_VALUE(cqe->user_data);
+        switch (URING_REQUEST(cqe->user_data)) {
+        case URING_RECEIVE:
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                ring->receiving = false;
+            }
+            if (cqe->res == -ENOBUFS) {
+                ring->shortages++;
+            } else if (cqe->res == -EINVAL) {
+                panic("The kernel has no multishot recvmsg for io_uring (Linux 6.0), use --io=select");
+            } else if (cqe->res < 0) {
+                errno = -cqe->res;
+                panic("recvmsg error");
+            }
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                u16 id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                handleDatagram(ring, ring->buffers + (usize)id * ring->bufferBytes, MAX(cqe->res, 0));
+                recycleBuffer(ring, id);
+                datagrams++;
+            }
+            break;
+        case URING_CARD_READ:
+            ring->cardReading = false;
+            events->cardReadable |= cqe->res > 0;
+            break;
+        case URING_CARD_WRITE:
+            //May come after the caller stopped asking: only then it is news
+            ring->cardWriting = false;
+            events->cardWritable |= cqe->res > 0 && wantCardWrite;
+            break;
+        case URING_TIMEOUT:
+            if (value == ring->timeoutGeneration && cqe->res == -ETIME) {
+                ring->timing = false;
+                *fired |= ring->deadlineWanted && monotonicNowNs() >= ring->deadlineNs;
+            }
+            break;
+        case URING_TIMEOUT_UPDATE:
+            //Armed again, for the deadline, by the wait
+            if (value == ring->timeoutGeneration) {
+                ring->timing = false;
+            }
+            break;
+        case URING_SEND:
+            //Sends complete in order: this one and every one before it are done
+            if (cqe->res < 0 && ring->sendErrors++ == 0) {
+                errno = -cqe->res;
+                printError("A send queued to the io_uring failed, the next ones are only counted");
+            }
+            if ((i32)(value + 1 - ring->slotDone) > 0) {
+                ring->slotDone = value + 1;
+            }
+            break;
+        default:
+            //URING_TIMEOUT_REMOVE: the timeout may have fired already
+            break;
+        }
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    //Buffers handled go back to the kernel at once
+    __atomic_store_n(&ring->bufferRing->tail, ring->bufferTail, __ATOMIC_RELEASE);
+    return datagrams;
+}
+
+bool uringWait(uring_t* ring, bool wantCardWrite, i64 timeoutUs, uring_events_t* events)
+{
+    *events = (uring_events_t) {};
+    ring->waits++;
+    if (ring->cardFd >= 0 && wantCardWrite && !ring->cardWriting) {
+        armPoll(ring, POLLOUT, URING_CARD_WRITE);
+        ring->cardWriting = true;
+    }
+    ring->deadlineWanted = timeoutUs >= 0;
+    if (ring->deadlineWanted) {
+        ring->deadlineNs = monotonicNowNs() + timeoutUs * 1000;
+        ring->deadline.tv_sec = ring->deadlineNs / 1000000000;
+        ring->deadline.tv_nsec = ring->deadlineNs % 1000000000;
+        armTimeout(ring);
+    } else if (ring->timing) {
+        removeTimeout(ring);
+    }
+
+    bool fired = false;
+    u32 datagrams = 0;
+    while (!events->cardReadable && !events->cardWritable && !fired && datagrams == 0) {
+        //Multishot receives stop when the buffers run out, polls after each event, and
+        //the timeout may have been gone when it was moved
+        if (!ring->receiving) {
+            armReceive(ring);
+        }
+        if (ring->cardFd >= 0 && !ring->cardReading) {
+            armPoll(ring, POLLIN, URING_CARD_READ);
+            ring->cardReading = true;
+        }
+        if (ring->deadlineWanted && !ring->timing) {
+            armTimeout(ring);
+        }
+        //The completions of the sends and of a timeout removed do not end the wait
+        if (submit(ring, 1 + ring->quickCompletions) < 0) {
+            if (errno == EINTR) {
+                return false;
+            }
+            //EBUSY: completions are waiting to be reaped
+            if (errno != EBUSY && errno != EAGAIN) {
+                panic("io_uring_enter error");
+            }
+        }
+        datagrams += reap(ring, wantCardWrite, events, &fired);
+    }
+    events->timedOut = fired && !events->cardReadable && !events->cardWritable && datagrams == 0;
+    return true;
+}
+
+bool uringSend(uring_t* ring, const void* datagram, usize size, const struct sockaddr_in* to)
+{
+    if (ring->slotNext - ring->slotDone == URING_SEND_SLOTS || size > ring->slotBytes) {
+        ring->sendFallbacks++;
+        return sendto(ring->sockId, datagram, size, 0, (const struct sockaddr *)to, sizeof(struct sockaddr_in)) >= 0;
+    }
+    u32 sequence = ring->slotNext++;
+    uring_slot_t* slot = &ring->slots[sequence & (URING_SEND_SLOTS - 1)];
+    memcpy(slot->data, datagram, size);
+    slot->iov.iov_len = size;
+    slot->to = *to;
+
+    //In order: each send starts once the one queued before it is done, and only the last
+    //of the chain posts its success. A full queue was just submitted: nothing to link to
+    struct io_uring_sqe* sqe = getSqe(ring);
+    if (ring->lastSend) {
+        ring->lastSend->flags |= IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    } else {
+        ring->quickCompletions++;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ring->sockId;
+    sqe->addr = (u64)(uintptr_t)&slot->message;
+    sqe->user_data = URING_USER_DATA(URING_SEND, sequence);
+    ring->lastSend = sqe;
+    ring->sends++;
+    return true;
+}
+
+void uringPrint(const uring_t* ring)
+{
+    printf("io_uring: %lu datagrams in %lu waits, %lu system calls (%.2f per datagram)\n", ring->datagrams,
+        ring->waits, ring->enters, ring->datagrams > 0 ? (double)ring->enters / ring->datagrams : 0.0);
+    printf("\tTruncated (over %lu bytes): %lu, out of buffers: %lu times\n",
+        ring->bufferBytes - (ring->recvLayout.msg_controllen + ring->recvLayout.msg_namelen
+            + sizeof(struct io_uring_recvmsg_out)), ring->truncated, ring->shortages);
+    printf("\tSends queued: %lu, sent with sendto(): %lu, failed: %lu\n", ring->sends, ring->sendFallbacks,
+        ring->sendErrors);
+}
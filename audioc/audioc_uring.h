@@ -0,0 +1,130 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_arrival.h"
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+//io_uring event loop (--io=uring), in place of select(): a single io_uring_enter() per
+//wait submits everything queued since the last one and sleeps until something completes.
+//  - Datagrams: a multishot recvmsg() stays armed on the socket, each datagram landing
+//    in a buffer the kernel takes from a ring of them, so none costs a system call. The
+//    buffer goes back to the ring as soon as the handler returns (the payload is copied
+//    to its jitter buffer block, as with select())
+//  - Sends: copied into slots and queued linked, so they leave in order, with the next
+//    wait. Only the last of each chain (or one that fails) posts a completion
+//  - The sound card: one-shot polls armed by the wait, so readiness is level-triggered as
+//    with select()
+//  - Deadlines: one timeout request on the monotonic clock, moved by each wait to its
+//    deadline without a completion, so only real events wake us
+//
+//Everything is set up with raw system calls, no library. It needs Linux 6.0 (multishot
+//recvmsg and provided buffer rings); uringOpen() fails, saying why, when the kernel
+//lacks it, and the caller goes on with select().
+
+#define URING_ENTRIES 128
+//Sends in flight: a captured packet, its FEC or retransmissions, of a few waits. Power of 2
+#define URING_SEND_SLOTS 64
+//Power of 2, up to URING_MAX_BUFFERS (kernel limit)
+#define URING_MIN_BUFFERS 64
+#define URING_MAX_BUFFERS 32768
+
+//Called for every datagram, which lives in the ring's buffer until it returns: whatever
+//has to be kept is copied. The datagram is 8 byte aligned and may be modified in place
+typedef void (*uring_handler_t)(void* context, void* datagram, usize size, const struct sockaddr_in* from,
+    const arrival_t* arrival);
+
+//What a wait returned for, of the ring or of select(), so the loops handle both alike
+typedef struct {
+    bool cardReadable;
+    bool cardWritable;
+    bool socketReadable;    //select() only: the ring hands datagrams to its handler
+    bool timedOut;          //Nothing else happened before the deadline
+} uring_events_t;
+
+typedef struct {
+    u8* data;
+    struct iovec iov;
+    struct msghdr message;
+    struct sockaddr_in to;
+} uring_slot_t;
+
+typedef struct {
+    int fd;
+    u32* sqHead;
+    u32* sqTail;
+    u32 sqMask;
+    u32 sqEntries;
+    u32 sqQueued;           //Our tail, published on submit
+    u32 sqSubmitted;
+    struct io_uring_sqe* sqes;
+    u32* cqHead;
+    u32* cqTail;
+    u32 cqMask;
+    struct io_uring_cqe* cqes;
+    void* ringMap;          //SQ and CQ rings, one mapping or two
+    usize ringBytes;
+    void* cqMap;
+    usize cqBytes;
+    usize sqesBytes;
+
+    int sockId;
+    int cardFd;             //-1: none
+    uring_handler_t handler;
+    void* context;
+
+    //Provided buffers
+    struct io_uring_buf_ring* bufferRing;
+    usize bufferRingBytes;
+    u8* buffers;
+    u32 bufferBytes;
+    u32 bufferCount;
+    u16 bufferTail;
+    struct msghdr recvLayout; //Name and control room at the start of every buffer
+
+    bool receiving;
+    bool cardReading;
+    bool cardWriting;
+    bool timing;            //A timeout request is armed
+    bool deadlineWanted;
+    u64 timeoutGeneration;  //Of the timeout armed: completions of earlier ones are ignored
+    i64 deadlineNs;         //CLOCK_MONOTONIC
+    struct __kernel_timespec deadline;
+    u32 quickCompletions;   //Of what is queued, posted right away but not events
+
+    //Slots are used in order: sends complete in order
+    uring_slot_t slots[URING_SEND_SLOTS];
+    u32 slotNext;           //Sequence of the next send
+    u32 slotDone;           //Sequence of the first send not completed
+    u32 slotBytes;
+    struct io_uring_sqe* lastSend; //Queued, not submitted yet: the next send links to it
+
+    u64 enters;             //System calls of the ring
+    u64 waits;
+    u64 datagrams;
+    u64 truncated;          //Larger than a buffer, dropped
+    u64 shortages;          //The kernel ran out of buffers, the receive was re-armed
+    u64 sends;
+    u64 sendFallbacks;      //No slot or too large: sent with sendto()
+    u64 sendErrors;
+} uring_t;
+
+//Sets the ring up for sockId (and cardFd, -1 if none): buffers receive buffers (rounded
+//up to a power of 2) of datagramBytes each, datagrams handed to handler. Sends up to
+//datagramBytes go through the ring. Returns false (with a message) if it could not be
+//set up
+bool uringOpen(uring_t* ring, int sockId, int cardFd, u32 datagramBytes, u32 buffers, uring_handler_t handler,
+    void* context);
+void uringClose(uring_t* ring);
+
+//Submits what is queued and waits, handling datagrams, until the card is readable (or
+//writable, when wantCardWrite), datagrams were handled or timeoutUs (-1: none) passed.
+//Returns false if a signal interrupted it
+bool uringWait(uring_t* ring, bool wantCardWrite, i64 timeoutUs, uring_events_t* events);
+
+//Queues a datagram to be sent with the next wait. Errors of queued sends are only
+//counted. Returns false if it was sent right away and that failed
+bool uringSend(uring_t* ring, const void* datagram, usize size, const struct sockaddr_in* to);
+
+void uringPrint(const uring_t* ring);
@@ -0,0 +1,330 @@
+#include "audioc_xdp.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+//Ethernet, IPv4 without options and UDP: all the program lets through
+#define XDP_HEADERS_BYTES (14 + 20 + 8)
+//Frames start XDP_PACKET_HEADROOM (256) bytes into theirs, then our headroom: 2 bytes
+//leave the RTP header 4 byte aligned, as rtp_hdr_t needs
+#define XDP_UMEM_HEADROOM 2
+#define XDP_MAX_INSTRUCTIONS 32
+#define XDP_LOG_BYTES 65536
+
+static int bpf(int command, union bpf_attr* attr)
+{
+    return syscall(__NR_bpf, command, attr, sizeof(*attr));
+}
+
+#define EBPF(opcode, dst, src, offset, immediate) \
+    ((struct bpf_insn) { .code = (opcode), .dst_reg = (dst), .src_reg = (src), .off = (offset), .imm = (immediate) })
+
+//Program: unfragmented IPv4 UDP to a multicast group on port goes to the socket of its
+//receive queue in the map, anything else (or a queue with no socket) to the kernel stack
+static usize buildProgram(int mapFd, u16 port, struct bpf_insn* program)
+{
+    usize n = 0;
+    //Jump offsets to the final XDP_PASS are only known at the end
+    usize passJumps[8];
+    usize passes = 0;
+
+    //r2: data, r3: data_end. The verifier only allows reads checked against data_end
+    program[n++] = EBPF(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0);
+    program[n++] = EBPF(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0);
+    program[n++] = EBPF(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    program[n++] = EBPF(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, XDP_HEADERS_BYTES);
+    passJumps[passes++] = n;
+    program[n++] = EBPF(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+
+    //Loads are in host order: the constants are compared in network order
+    struct { u8 size; i16 offset; i32 mask; i32 value; } checks[] = {
+        { BPF_H, 12, 0, htons(0x0800) },    //IPv4 EtherType, so no VLAN tag
+        { BPF_B, 14, 0, 0x45 },             //Version 4, no options
+        { BPF_H, 20, htons(0x3FFF), 0 },    //Not a fragment: no MF flag, no offset
+        { BPF_B, 23, 0, IPPROTO_UDP },
+        { BPF_B, 30, 0xF0, 0xE0 },          //224.0.0.0/4
+        { BPF_H, 36, 0, htons(port) },      //Destination port
+    };
+    for (usize i = 0; i < ARRAY_COUNT(checks); i++) {
+        program[n++] = EBPF(BPF_LDX | checks[i].size | BPF_MEM, BPF_REG_5, BPF_REG_2, checks[i].offset, 0);
+        if (checks[i].mask != 0) {
+            program[n++] = EBPF(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, checks[i].mask);
+        }
+        passJumps[passes++] = n;
+        program[n++] = EBPF(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, checks[i].value);
+    }
+
+    //bpf_redirect_map(map, rx_queue_index, XDP_PASS): XDP_PASS if the queue has no socket
+    program[n++] = EBPF(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0);
+    program[n++] = EBPF(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, mapFd);
+    program[n++] = EBPF(0, 0, 0, 0, 0);
+    program[n++] = EBPF(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS);
+    program[n++] = EBPF(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    program[n++] = EBPF(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    usize pass = n;
+    program[n++] = EBPF(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);
+    program[n++] = EBPF(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    for (usize i = 0; i < passes; i++) {
+        program[passJumps[i]].off = pass - passJumps[i] - 1;
+    }
+    ASSERT(passes <= ARRAY_COUNT(passJumps) && n <= XDP_MAX_INSTRUCTIONS);
+    return n;
+}
+
+static int loadProgram(int mapFd, u16 port)
+{
+    struct bpf_insn program[XDP_MAX_INSTRUCTIONS];
+    static char log[XDP_LOG_BYTES];
+    union bpf_attr attr = {};
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (u64)(uintptr_t)program;
+    attr.insn_cnt = buildProgram(mapFd, port, program);
+    attr.license = (u64)(uintptr_t)"GPL";
+    attr.log_buf = (u64)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+
+    int progFd = bpf(BPF_PROG_LOAD, &attr);
+    if (progFd < 0 && log[0] != '\0') {
+        trace("XDP program rejected by the verifier:\n%s", log);
+    }
+    return progFd;
+}
+
+//Driver mode where the driver has it, else generic (SKB) mode
+static int attachProgram(int progFd, u32 ifindex)
+{
+    u32 modes[] = { 0, XDP_FLAGS_SKB_MODE };
+    int linkFd = -1;
+    for (usize i = 0; i < ARRAY_COUNT(modes) && linkFd < 0; i++) {
+        union bpf_attr attr = {};
+        attr.link_create.prog_fd = progFd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = modes[i];
+        linkFd = bpf(BPF_LINK_CREATE, &attr);
+    }
+    return linkFd;
+}
+
+static bool mapRing(xdp_ring_t* ring, int sockId, const struct xdp_ring_offset* offsets, u32 size,
+    usize descBytes, off_t pageOffset)
+{
+    ring->size = size;
+    ring->mapBytes = offsets->desc + size * descBytes;
+    ring->map = mmap(NULL, ring->mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sockId, pageOffset);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return false;
+    }
+    u8* base = ring->map;
+    ring->producer = (u32*)(base + offsets->producer);
+    ring->consumer = (u32*)(base + offsets->consumer);
+    ring->flags = (u32*)(base + offsets->flags);
+    ring->descs = base + offsets->desc;
+    return true;
+}
+
+static bool setupSocket(xdp_socket_t* xdp, u32 ifindex, u32 queue)
+{
+    xdp->umem = mmap(NULL, XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xdp->umem == MAP_FAILED) {
+        xdp->umem = NULL;
+        return false;
+    }
+    struct xdp_umem_reg umem = {
+        .addr = (u64)(uintptr_t)xdp->umem,
+        .len = XDP_FRAMES * XDP_FRAME_SIZE,
+        .chunk_size = XDP_FRAME_SIZE,
+        .headroom = XDP_UMEM_HEADROOM,
+    };
+    int fillSize = XDP_FRAMES, completionSize = 64, rxSize = XDP_RX_RING_SIZE;
+    if (setsockopt(xdp->sockId, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) < 0
+        || setsockopt(xdp->sockId, SOL_XDP, XDP_UMEM_FILL_RING, &fillSize, sizeof(int)) < 0
+        || setsockopt(xdp->sockId, SOL_XDP, XDP_UMEM_COMPLETION_RING, &completionSize, sizeof(int)) < 0
+        || setsockopt(xdp->sockId, SOL_XDP, XDP_RX_RING, &rxSize, sizeof(int)) < 0)
+    {
+        return false;
+    }
+
+    struct xdp_mmap_offsets offsets;
+    socklen_t length = sizeof(offsets);
+    if (getsockopt(xdp->sockId, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) < 0
+        || !mapRing(&xdp->fill, xdp->sockId, &offsets.fr, fillSize, sizeof(u64), XDP_UMEM_PGOFF_FILL_RING)
+        || !mapRing(&xdp->completion, xdp->sockId, &offsets.cr, completionSize, sizeof(u64), XDP_UMEM_PGOFF_COMPLETION_RING)
+        || !mapRing(&xdp->rx, xdp->sockId, &offsets.rx, rxSize, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING))
+    {
+        return false;
+    }
+
+    //Every frame starts in the fill ring, ready for the kernel
+    u64* fill = xdp->fill.descs;
+    for (u32 i = 0; i < XDP_FRAMES; i++) {
+        fill[i] = (u64)i * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(xdp->fill.producer, XDP_FRAMES, __ATOMIC_RELEASE);
+
+    struct sockaddr_xdp address = {
+        .sxdp_family = AF_XDP,
+        .sxdp_ifindex = ifindex,
+        .sxdp_queue_id = queue,
+        .sxdp_flags = XDP_USE_NEED_WAKEUP,
+    };
+    if (bind(xdp->sockId, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        return false;
+    }
+    struct xdp_options options;
+    length = sizeof(options);
+    xdp->zeroCopy = getsockopt(xdp->sockId, SOL_XDP, XDP_OPTIONS, &options, &length) == 0
+        && (options.flags & XDP_OPTIONS_ZEROCOPY);
+    return true;
+}
+
+bool xdpOpen(xdp_socket_t* xdp, const char* interface, u32 queue, u16 port)
+{
+    *xdp = (xdp_socket_t) { .sockId = -1, .mapFd = -1, .progFd = -1, .linkFd = -1, .port = port };
+
+    u32 ifindex = if_nametoindex(interface);
+    if (ifindex == 0) {
+        printError("No interface %s", interface);
+        return false;
+    }
+    xdp->sockId = socket(AF_XDP, SOCK_RAW, 0);
+    if (xdp->sockId < 0 || !setupSocket(xdp, ifindex, queue)) {
+        printError("Could not set up an AF_XDP socket on %s queue %u", interface, queue);
+        xdpClose(xdp);
+        return false;
+    }
+
+    //The socket is in the map before the program can redirect anything to it
+    union bpf_attr attr = {};
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(u32);
+    attr.value_size = sizeof(u32);
+    attr.max_entries = queue + 1;
+    xdp->mapFd = bpf(BPF_MAP_CREATE, &attr);
+    if (xdp->mapFd >= 0) {
+        u32 key = queue, value = xdp->sockId;
+        attr = (union bpf_attr) {};
+        attr.map_fd = xdp->mapFd;
+        attr.key = (u64)(uintptr_t)&key;
+        attr.value = (u64)(uintptr_t)&value;
+        if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+            close(xdp->mapFd);
+            xdp->mapFd = -1;
+        }
+    }
+    if (xdp->mapFd < 0 || (xdp->progFd = loadProgram(xdp->mapFd, port)) < 0) {
+        printError("Could not load the XDP program");
+        xdpClose(xdp);
+        return false;
+    }
+    xdp->linkFd = attachProgram(xdp->progFd, ifindex);
+    if (xdp->linkFd < 0) {
+        printError("Could not attach the XDP program to %s (is there another one?)", interface);
+        xdpClose(xdp);
+        return false;
+    }
+
+    trace("AF_XDP on %s queue %u, %s mode, port %u", interface, queue, xdp->zeroCopy ? "zero copy" : "copy", port);
+    return true;
+}
+
+void xdpClose(xdp_socket_t* xdp)
+{
+    int fds[] = { xdp->linkFd, xdp->progFd, xdp->mapFd, xdp->sockId };
+    for (usize i = 0; i < ARRAY_COUNT(fds); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    xdp_ring_t* rings[] = { &xdp->fill, &xdp->completion, &xdp->rx };
+    for (usize i = 0; i < ARRAY_COUNT(rings); i++) {
+        if (rings[i]->map) {
+            munmap(rings[i]->map, rings[i]->mapBytes);
+        }
+    }
+    if (xdp->umem) {
+        munmap(xdp->umem, XDP_FRAMES * XDP_FRAME_SIZE);
+    }
+    *xdp = (xdp_socket_t) { .sockId = -1, .mapFd = -1, .progFd = -1, .linkFd = -1 };
+}
+
+//What the program checked, again (it is cheap), plus the lengths: returns the UDP payload
+static bool udpPayload(u8* frame, usize size, u16 port, u8** payload, usize* payloadBytes)
+{
+    if (size < XDP_HEADERS_BYTES || frame[12] != 0x08 || frame[13] != 0x00 || frame[14] != 0x45) {
+        return false;
+    }
+    u8* ip = frame + 14;
+    u8* udp = ip + 20;
+    usize ipBytes = (ip[2] << 8) | ip[3];
+    usize udpBytes = (udp[4] << 8) | udp[5];
+    //Lengths of any value may come (a span port sees everything): the UDP one is checked
+    //against the frame too, so a short IP length cannot let it run past the frame
+    if (ip[9] != IPPROTO_UDP || ((udp[2] << 8) | udp[3]) != port || ipBytes < 20 || ipBytes > size - 14
+        || udpBytes < 8 || udpBytes > ipBytes - 20 || udpBytes > size - XDP_HEADERS_BYTES + 8)
+    {
+        return false;
+    }
+    *payload = udp + 8;
+    *payloadBytes = udpBytes - 8;
+    return true;
+}
+
+u32 xdpReceive(xdp_socket_t* xdp, xdp_handler_t handler, void* context)
+{
+    u32 rxMask = xdp->rx.size - 1, fillMask = xdp->fill.size - 1;
+    u32 consumer = *xdp->rx.consumer;
+    u32 available = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE) - consumer;
+    u32 count = MIN(available, XDP_BATCH);
+
+    //The fill ring holds every frame, so there is always room for the ones given back
+    u32 fillProducer = *xdp->fill.producer;
+    struct xdp_desc* descs = xdp->rx.descs;
+    u64* fill = xdp->fill.descs;
+    for (u32 i = 0; i < count; i++) {
+        struct xdp_desc* desc = &descs[(consumer + i) & rxMask];
+        u8* payload;
+        usize payloadBytes;
+        if (udpPayload(xdp->umem + desc->addr, desc->len, xdp->port, &payload, &payloadBytes)) {
+            handler(context, (rtp_packet_t*)payload, payloadBytes);
+        } else {
+            xdp->foreign++;
+        }
+        fill[(fillProducer + i) & fillMask] = desc->addr & ~(u64)(XDP_FRAME_SIZE - 1);
+    }
+    __atomic_store_n(xdp->rx.consumer, consumer + count, __ATOMIC_RELEASE);
+    __atomic_store_n(xdp->fill.producer, fillProducer + count, __ATOMIC_RELEASE);
+    xdp->frames += count;
+
+    //Copy mode and some drivers only look at the fill ring again when asked to
+    if (count > 0 && (__atomic_load_n(xdp->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+        recvfrom(xdp->sockId, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+    return count;
+}
+
+u64 xdpDropped(const xdp_socket_t* xdp)
+{
+    struct xdp_statistics statistics;
+    socklen_t length = sizeof(statistics);
+    if (getsockopt(xdp->sockId, SOL_XDP, XDP_STATISTICS, &statistics, &length) < 0) {
+        return 0;
+    }
+    //An empty fill ring shows up in rx_dropped too
+    return statistics.rx_dropped + statistics.rx_ring_full;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+#include "audioc_rtp.h"
+
+//AF_XDP ingress (--xdp): frames of one receive queue of an interface are redirected by
+//an XDP program to a socket whose memory (UMEM) we map, and RTP is parsed in place in
+//the frame, with no system call or copy per packet. The program only takes unfragmented
+//IPv4 UDP to a multicast group on our port, of any group (as a span port carries them);
+//everything else, and every queue but ours, goes on to the kernel stack as usual.
+//
+//Everything is set up with raw bpf() and socket calls, no library. It needs CAP_NET_ADMIN
+//and CAP_BPF (or root); xdpOpen() fails, saying why, when they or the kernel support are
+//missing, and the caller keeps using its socket.
+
+//Frames of the UMEM, each holding one received frame. Power of 2
+#define XDP_FRAME_SIZE 2048
+#define XDP_FRAMES 4096
+#define XDP_RX_RING_SIZE 2048
+//Descriptors handled per xdpReceive()
+#define XDP_BATCH 64
+
+typedef struct {
+    u32* producer;
+    u32* consumer;
+    u32* flags;
+    void* descs;            //u64 frame addresses (fill, completion) or struct xdp_desc (rx)
+    u32 size;
+    void* map;
+    usize mapBytes;
+} xdp_ring_t;
+
+typedef struct {
+    int sockId;
+    int mapFd;
+    int progFd;
+    int linkFd;             //The program is detached when it is closed, on exit too
+    u8* umem;
+    xdp_ring_t fill;
+    xdp_ring_t completion;  //Unused, the kernel requires it
+    xdp_ring_t rx;
+    u16 port;
+    bool zeroCopy;          //The driver writes into the UMEM, else the kernel copies
+
+    u64 frames;
+    u64 foreign;            //Not RTP over UDP to our port, should not get here
+} xdp_socket_t;
+
+//Called for every RTP packet, which lives in the UMEM until it returns: whatever has to
+//be kept is copied (the jitter buffer). The packet may be modified in place
+typedef void (*xdp_handler_t)(void* context, rtp_packet_t* packet, usize size);
+
+//Redirects queue of interface to a new AF_XDP socket. Returns false (with a message) if
+//it could not be set up
+bool xdpOpen(xdp_socket_t* xdp, const char* interface, u32 queue, u16 port);
+void xdpClose(xdp_socket_t* xdp);
+
+//Hands up to XDP_BATCH received packets to handler and gives their frames back to the
+//kernel. Returns the number of frames consumed, 0 if there were none: wait for
+//xdp->sockId to be readable
+u32 xdpReceive(xdp_socket_t* xdp, xdp_handler_t handler, void* context);
+
+//Frames the kernel dropped because our rings were full or out of frames
+u64 xdpDropped(const xdp_socket_t* xdp);
@@ -11,6 +11,8 @@
 * Common constants
 */
 #define MAX_PACKET_SIZE (1024 + 12)
+//Largest UDP payload over IPv4. Received packets may be bigger than the ones we send
+#define MAX_DATAGRAM_SIZE 65507
 
 /*
 * Common types
@@ -0,0 +1,113 @@
+#include "g711.h"
+
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 32635
+
+const i16 ulawToLinearTable[256] = {
+    -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+    -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+    -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+    -11900, -11388, -10876, -10364, -9852, -9340, -8828, -8316,
+    -7932, -7676, -7420, -7164, -6908, -6652, -6396, -6140,
+    -5884, -5628, -5372, -5116, -4860, -4604, -4348, -4092,
+    -3900, -3772, -3644, -3516, -3388, -3260, -3132, -3004,
+    -2876, -2748, -2620, -2492, -2364, -2236, -2108, -1980,
+    -1884, -1820, -1756, -1692, -1628, -1564, -1500, -1436,
+    -1372, -1308, -1244, -1180, -1116, -1052, -988, -924,
+    -876, -844, -812, -780, -748, -716, -684, -652,
+    -620, -588, -556, -524, -492, -460, -428, -396,
+    -372, -356, -340, -324, -308, -292, -276, -260,
+    -244, -228, -212, -196, -180, -164, -148, -132,
+    -120, -112, -104, -96, -88, -80, -72, -64,
+    -56, -48, -40, -32, -24, -16, -8, 0,
+    32124, 31100, 30076, 29052, 28028, 27004, 25980, 24956,
+    23932, 22908, 21884, 20860, 19836, 18812, 17788, 16764,
+    15996, 15484, 14972, 14460, 13948, 13436, 12924, 12412,
+    11900, 11388, 10876, 10364, 9852, 9340, 8828, 8316,
+    7932, 7676, 7420, 7164, 6908, 6652, 6396, 6140,
+    5884, 5628, 5372, 5116, 4860, 4604, 4348, 4092,
+    3900, 3772, 3644, 3516, 3388, 3260, 3132, 3004,
+    2876, 2748, 2620, 2492, 2364, 2236, 2108, 1980,
+    1884, 1820, 1756, 1692, 1628, 1564, 1500, 1436,
+    1372, 1308, 1244, 1180, 1116, 1052, 988, 924,
+    876, 844, 812, 780, 748, 716, 684, 652,
+    620, 588, 556, 524, 492, 460, 428, 396,
+    372, 356, 340, 324, 308, 292, 276, 260,
+    244, 228, 212, 196, 180, 164, 148, 132,
+    120, 112, 104, 96, 88, 80, 72, 64,
+    56, 48, 40, 32, 24, 16, 8, 0,
+};
+
+u8 linearToUlaw(i16 sample)
+{
+    i32 pcm = sample;
+    u8 sign = 0;
+    if (pcm < 0) {
+        pcm = -pcm;
+        sign = 0x80;
+    }
+    pcm = MIN(pcm, ULAW_CLIP) + ULAW_BIAS;
+
+    //Segment = position of the highest set bit above bit 7 (pcm >= ULAW_BIAS, so >= 1)
+    u32 exponent = 31 - __builtin_clz((u32)pcm >> 7);
+    u32 mantissa = (pcm >> (exponent + 3)) & 0x0F;
+    return (u8)~(sign | (exponent << 4) | mantissa);
+}
+
+void g711UlawToL16BE(const u8* in, u8* out, usize samples)
+{
+    for (usize i = 0; i < samples; i++) {
+        u16 sample = (u16)ulawToLinearTable[in[i]];
+        out[2 * i] = sample >> 8;
+        out[2 * i + 1] = sample & 0xFF;
+    }
+}
+
+typedef u16 g711_words_t __attribute__((vector_size(16)));
+typedef i16 g711_samples_t __attribute__((vector_size(16)));
+typedef u8 g711_codes_t __attribute__((vector_size(8)));
+
+//linearToUlaw() for 8 samples at a time. The segment is counted with comparisons and
+//the mantissa shifted one step per segment, so there are no per-lane shift amounts and
+//no branches: every step is a plain SSE2 (or NEON) instruction
+static g711_codes_t linearToUlaw8(g711_samples_t pcm)
+{
+    //Comparisons give all ones lanes: masks to select with
+    g711_samples_t negative = pcm < 0;
+    g711_samples_t sign = negative & 0x80;
+    //-32768 has no positive counterpart, it is clipped anyway
+    pcm += (pcm == -32768) & 1;
+    pcm = (-pcm & negative) | (pcm & ~negative);
+    g711_samples_t clip = pcm > ULAW_CLIP;
+    pcm = ((ULAW_CLIP & clip) | (pcm & ~clip)) + ULAW_BIAS; //<= 32767, still fits
+
+    g711_samples_t exponent = {};
+    g711_samples_t mantissa = pcm >> 3;
+    #pragma GCC unroll 7
+    for (int segment = 1; segment < 8; segment++) {
+        g711_samples_t above = pcm >= (i16)(0x80 << segment);
+        exponent -= above;
+        mantissa = (mantissa & ~above) | ((mantissa >> 1) & above);
+    }
+    g711_samples_t code = ~(sign | (exponent << 4) | (mantissa & 0x0F));
+    return __builtin_convertvector(code & 0xFF, g711_codes_t);
+}
+
+void g711L16BEToUlaw(const u8* in, u8* out, usize samples)
+{
+    usize i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        g711_words_t words;
+        memcpy(&words, in + 2 * i, sizeof(words));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        //Big endian to host, with shifts: a byte shuffle needs SSSE3
+        words = (words << 8) | (words >> 8);
+#endif
+        g711_codes_t codes = linearToUlaw8((g711_samples_t) words);
+        memcpy(out + i, &codes, sizeof(codes));
+    }
+    for (; i < samples; i++) {
+        i16 sample = (i16)((in[2 * i] << 8) | in[2 * i + 1]);
+        out[i] = linearToUlaw(sample);
+    }
+}
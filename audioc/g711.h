@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common.h"
+
+//G.711 mu-law codec (ITU-T G.711, as used by RTP payload type 0 - PCMU)
+
+extern const i16 ulawToLinearTable[256];
+
+inline static i16 ulawToLinear(u8 ulaw)
+{
+    return ulawToLinearTable[ulaw];
+}
+
+u8 linearToUlaw(i16 sample);
+
+//Block conversions. L16BE buffers hold big endian 16 bit samples, the format of the
+//L16 payload (RTP payload type 101 in audioc) and of the sound card in that mode
+void g711UlawToL16BE(const u8* in, u8* out, usize samples);
+void g711L16BEToUlaw(const u8* in, u8* out, usize samples);
@@ -0,0 +1,633 @@
+//
+//  Micro-benchmarks for the hot primitives of audioc.
+//  Build with
+//  > ./build.sh bench
+//  and run
+//  > bin/audioc_bench [-j] [-rREPETITIONS] [-sSCALE] [FILTER]
+//
+//  Every benchmark runs once to warm up caches and branch predictors, then
+//  REPETITIONS timed runs of a fixed number of iterations. Results are printed
+//  as CSV (default) or JSON (-j), one row per benchmark, in nanoseconds per
+//  iteration. The column set and order are stable so outputs can be diffed and
+//  tracked across commits.
+//
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../audioc/common.h"
+#include "../audioc/audioc_rtp.h"
+#include "../audioc/g711.h"
+#include "../audioc/audioc_reflector.h"
+#include "../audioc/audioc_gateway.h"
+#include "../audioc/audioc_filter.h"
+#include "../audioc/audioc_lossless.h"
+#include "../audioc/audioc_record.h"
+#include "../lib/circularBuffer.h"
+
+#define BENCH_MAX_REPETITIONS 101
+#define BENCH_BLOCK_BYTES 256 //32 ms PCMU, the default audioc fragment
+#define BENCH_BUFFER_BLOCKS 16
+
+typedef void (*bench_fn_t)(void* ctx, u64 iterations);
+
+typedef struct {
+    const char* name;
+    bench_fn_t fn;
+    void* (*setup)(void);
+    void (*teardown)(void* ctx);
+    u64 iterations; //per repetition, before scaling
+} bench_case_t;
+
+typedef struct {
+    double min, median, mean, max, stddev; //ns per iteration
+} bench_result_t;
+
+//Results are written here so the compiler cannot drop the benchmarked work
+volatile u64 benchSink;
+
+#define CLOBBER_MEMORY() __asm__ volatile("" ::: "memory")
+
+static u64 nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000ull + (u64)t.tv_nsec;
+}
+
+/*
+ * Circular buffer
+ */
+
+static void* setupCbuf(void)
+{
+    return cbuf_create_buffer(BENCH_BUFFER_BLOCKS, BENCH_BLOCK_BYTES);
+}
+
+static void teardownCbuf(void* ctx)
+{
+    cbuf_destroy_buffer(ctx);
+}
+
+static void benchCbufWriteRead(void* ctx, u64 iterations)
+{
+    u64 sum = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        u8* w = cbuf_pointer_to_write(ctx);
+        u8* r = cbuf_pointer_to_read(ctx);
+        sum += (w - r);
+        CLOBBER_MEMORY();
+    }
+    benchSink = sum;
+}
+
+/*
+ * RTP header byte order
+ */
+
+static void* setupHeader(void)
+{
+    rtp_hdr_t* header = calloc(1, sizeof(rtp_hdr_t));
+    *header = (rtp_hdr_t) { .version = RTP_VERSION, .pt = PCMU, .seq = 1234, .ts = 567890, .ssrc = 0xCAFE };
+    return header;
+}
+
+static void benchHtonNtohRTP(void* ctx, u64 iterations)
+{
+    rtp_hdr_t* header = ctx;
+    for (u64 i = 0; i < iterations; i++) {
+        htonRTP(header);
+        CLOBBER_MEMORY();
+        ntohRTP(header);
+        CLOBBER_MEMORY();
+    }
+    benchSink = header->seq;
+}
+
+/*
+ * Sequence number and timestamp arithmetic
+ */
+
+#define BENCH_SEQ_COUNT 4096
+
+static void* setupSequence(void)
+{
+    u32* values = malloc(BENCH_SEQ_COUNT * sizeof(u32));
+    u32 x = 0xFFFF0000u;
+    for (u32 i = 0; i < BENCH_SEQ_COUNT; i++) {
+        //Mostly consecutive, some gaps and reorderings, wrapping around
+        x += (i % 17 == 0) ? 3 : (i % 29 == 0) ? (u32)-1 : 1;
+        values[i] = x;
+    }
+    return values;
+}
+
+static void benchSeqTsDifference(void* ctx, u64 iterations)
+{
+    u32* values = ctx;
+    i64 sum = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        u32 from = values[i % BENCH_SEQ_COUNT];
+        u32 to = values[(i + 1) % BENCH_SEQ_COUNT];
+        sum += seqNumDifference((u16)from, (u16)to);
+        sum += timestampDifference(from * 256, to * 256);
+    }
+    benchSink = (u64)sum;
+}
+
+/*
+ * Silence insertion
+ */
+
+static void benchPushSilencePCMU(void* ctx, u64 iterations)
+{
+    isize count = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        pushSilence(ctx, BENCH_BLOCK_BYTES, &count, PCMU);
+        cbuf_pointer_to_read(ctx);
+        CLOBBER_MEMORY();
+    }
+    benchSink = count;
+}
+
+static void* setupCbufL16(void)
+{
+    return cbuf_create_buffer(BENCH_BUFFER_BLOCKS, 2 * BENCH_BLOCK_BYTES);
+}
+
+static void benchPushSilenceL16(void* ctx, u64 iterations)
+{
+    isize count = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        pushSilence(ctx, 2 * BENCH_BLOCK_BYTES, &count, L16_1);
+        cbuf_pointer_to_read(ctx);
+        CLOBBER_MEMORY();
+    }
+    benchSink = count;
+}
+
+/*
+ * G.711
+ */
+
+typedef struct {
+    u8 ulaw[BENCH_BLOCK_BYTES];
+    u8 l16[2 * BENCH_BLOCK_BYTES];
+} g711_ctx_t;
+
+static void* setupG711(void)
+{
+    g711_ctx_t* ctx = malloc(sizeof(g711_ctx_t));
+    for (u32 i = 0; i < BENCH_BLOCK_BYTES; i++) {
+        ctx->ulaw[i] = silenceMU8[i % ARRAY_COUNT(silenceMU8)];
+    }
+    g711UlawToL16BE(ctx->ulaw, ctx->l16, BENCH_BLOCK_BYTES);
+    return ctx;
+}
+
+static void benchG711Decode(void* ctx, u64 iterations)
+{
+    g711_ctx_t* g = ctx;
+    for (u64 i = 0; i < iterations; i++) {
+        g711UlawToL16BE(g->ulaw, g->l16, BENCH_BLOCK_BYTES);
+        CLOBBER_MEMORY();
+    }
+    benchSink = g->l16[0];
+}
+
+static void benchG711Encode(void* ctx, u64 iterations)
+{
+    g711_ctx_t* g = ctx;
+    for (u64 i = 0; i < iterations; i++) {
+        g711L16BEToUlaw(g->l16, g->ulaw, BENCH_BLOCK_BYTES);
+        CLOBBER_MEMORY();
+    }
+    benchSink = g->ulaw[0];
+}
+
+/*
+ * Full receive cycle: loopback UDP datagram -> recvfrom -> ntohRTP -> validate ->
+ * sequence analysis -> jitter buffer enqueue (and dequeue, to keep it from filling)
+ */
+
+typedef struct {
+    int sendSock, recvSock;
+    struct sockaddr_in addr;
+    rtp_packet_t* out;
+    rtp_packet_t* in;
+    void* cbuf;
+    u16 seq;
+} receive_ctx_t;
+
+static void* setupReceive(void)
+{
+    receive_ctx_t* ctx = calloc(1, sizeof(receive_ctx_t));
+    ctx->recvSock = socket(AF_INET, SOCK_DGRAM, 0);
+    ctx->sendSock = socket(AF_INET, SOCK_DGRAM, 0);
+    ctx->addr = (struct sockaddr_in) { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(ctx->addr);
+    if (ctx->recvSock < 0 || ctx->sendSock < 0
+        || bind(ctx->recvSock, (struct sockaddr*)&ctx->addr, sizeof(ctx->addr)) < 0
+        || getsockname(ctx->recvSock, (struct sockaddr*)&ctx->addr, &len) < 0)
+    {
+        panic("Could not create loopback sockets");
+    }
+    ctx->out = calloc(1, MAX_PACKET_SIZE);
+    ctx->in = calloc(1, MAX_PACKET_SIZE);
+    ctx->cbuf = cbuf_create_buffer(BENCH_BUFFER_BLOCKS, BENCH_BLOCK_BYTES);
+    return ctx;
+}
+
+static void teardownReceive(void* ctx)
+{
+    receive_ctx_t* r = ctx;
+    close(r->sendSock);
+    close(r->recvSock);
+    free(r->out);
+    free(r->in);
+    cbuf_destroy_buffer(r->cbuf);
+    free(r);
+}
+
+static void benchReceiveCycle(void* ctx, u64 iterations)
+{
+    receive_ctx_t* r = ctx;
+    usize packetSize = sizeof(rtp_hdr_t) + BENCH_BLOCK_BYTES;
+    u16 lastSeq = r->seq;
+    u64 lost = 0;
+
+    for (u64 i = 0; i < iterations; i++) {
+        //Sender side, not part of the receive path but needed to feed it
+        r->out->header = (rtp_hdr_t) { .version = RTP_VERSION, .pt = PCMU, .seq = ++r->seq, .ts = r->seq * BENCH_BLOCK_BYTES, .ssrc = 1 };
+        htonRTP(&r->out->header);
+        if (sendto(r->sendSock, r->out, packetSize, 0, (struct sockaddr*)&r->addr, sizeof(r->addr)) < 0) {
+            panic("sendto error");
+        }
+
+        isize result = recvfrom(r->recvSock, r->in, packetSize, 0, NULL, NULL);
+        if (result != (isize)packetSize) {
+            panic("recvfrom error");
+        }
+        ntohRTP(&r->in->header);
+        if (!validateRTPHeader(&r->in->header, PCMU)) {
+            panic("Invalid RTP header");
+        }
+        lost += seqNumDifference(lastSeq, r->in->header.seq) - 1;
+        lastSeq = r->in->header.seq;
+
+        void* bufferBlock = cbuf_pointer_to_write(r->cbuf);
+        memcpy(bufferBlock, r->in->payload, BENCH_BLOCK_BYTES);
+        cbuf_pointer_to_read(r->cbuf);
+    }
+    benchSink = lost;
+}
+
+/*
+ * Reflector fan-out: one 256 byte packet sent to 1000 loopback subscribers with sendmmsg.
+ * At 50 packets/s, one core handles the fan-out if an iteration takes less than 20 ms
+ * (the share of a core is ns/iteration * 50 / 1e9)
+ */
+
+#define BENCH_SUBSCRIBERS 1000
+
+typedef struct {
+    reflector_t reflector;
+    int sinkSock;
+    u8 packet[sizeof(rtp_hdr_t) + BENCH_BLOCK_BYTES];
+} fanout_ctx_t;
+
+static void* setupFanOut(void)
+{
+    fanout_ctx_t* ctx = calloc(1, sizeof(fanout_ctx_t));
+    //Every subscriber is a different 127.x.y.z address, all of them delivered to one socket
+    struct sockaddr_in sink = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t len = sizeof(sink);
+    ctx->sinkSock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (!reflectorInit(&ctx->reflector) || ctx->sinkSock < 0
+        || bind(ctx->sinkSock, (struct sockaddr*)&sink, sizeof(sink)) < 0
+        || getsockname(ctx->sinkSock, (struct sockaddr*)&sink, &len) < 0)
+    {
+        panic("Could not set up the reflector");
+    }
+    for (u32 i = 0; i < BENCH_SUBSCRIBERS; i++) {
+        sink.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + i);
+        reflectorAdd(&ctx->reflector, sink);
+    }
+    rtp_hdr_t header = { .version = RTP_VERSION, .pt = PCMU, .ssrc = 1 };
+    htonRTP(&header);
+    memcpy(ctx->packet, &header, sizeof(header));
+    return ctx;
+}
+
+static void teardownFanOut(void* ctx)
+{
+    fanout_ctx_t* f = ctx;
+    reflectorDestroy(&f->reflector);
+    close(f->sinkSock);
+    free(f);
+}
+
+static void benchFanOut(void* ctx, u64 iterations)
+{
+    fanout_ctx_t* f = ctx;
+    for (u64 i = 0; i < iterations; i++) {
+        reflectorFanOut(&f->reflector, f->packet, sizeof(f->packet), 0);
+    }
+    //The sink is not read: the kernel drops what does not fit in its buffer
+    benchSink = f->reflector.sent + f->reflector.sendErrors;
+}
+
+/*
+ * Gateway: 20 ms PCMU packets of 256 streams translated to L16 at 16000 Hz (the costliest
+ * direction). One iteration is one packet; a pair of streams at 50 packets/s each way
+ * takes 100 iterations per second
+ */
+
+#define BENCH_GATEWAY_STREAMS 256
+#define BENCH_GATEWAY_SAMPLES 160
+
+typedef struct {
+    gateway_t gateway;
+    u8 in[sizeof(rtp_hdr_t) + BENCH_GATEWAY_SAMPLES];
+    u8 packet[sizeof(rtp_hdr_t) + BENCH_GATEWAY_SAMPLES];
+    rtp_packet_t* out;
+    u32 seq;
+} gateway_ctx_t;
+
+static void* setupGateway(void)
+{
+    gateway_ctx_t* ctx = calloc(1, sizeof(gateway_ctx_t));
+    gateway_side_t pcmu = { .pt = PCMU, .rate = 8000 };
+    gateway_side_t l16 = { .pt = L16_1, .rate = 16000 };
+    ctx->out = malloc(GATEWAY_MAX_OUT_SIZE);
+    if (!gatewayInit(&ctx->gateway, pcmu, l16) || !ctx->out) {
+        panic("Could not set up the gateway");
+    }
+    for (u32 i = 0; i < BENCH_GATEWAY_SAMPLES; i++) {
+        ctx->in[sizeof(rtp_hdr_t) + i] = silenceMU8[i % ARRAY_COUNT(silenceMU8)] ^ (i & 0x0F);
+    }
+    return ctx;
+}
+
+static void teardownGateway(void* ctx)
+{
+    gateway_ctx_t* g = ctx;
+    gatewayDestroy(&g->gateway);
+    free(g->out);
+    free(g);
+}
+
+static void benchGateway(void* ctx, u64 iterations)
+{
+    gateway_ctx_t* g = ctx;
+    usize total = 0;
+    for (u64 i = 0; i < iterations; i++, g->seq++) {
+        //The header is turned to host order in place, so every packet starts from a copy
+        rtp_hdr_t header = { .version = RTP_VERSION, .pt = PCMU, .seq = g->seq / BENCH_GATEWAY_STREAMS,
+            .ts = g->seq / BENCH_GATEWAY_STREAMS * BENCH_GATEWAY_SAMPLES, .ssrc = g->seq % BENCH_GATEWAY_STREAMS };
+        htonRTP(&header);
+        memcpy(g->packet, &header, sizeof(header));
+        memcpy(g->packet + sizeof(header), g->in + sizeof(header), BENCH_GATEWAY_SAMPLES);
+        total += gatewayTranslate(&g->gateway, 0, g->packet, sizeof(g->packet), g->out, 0);
+    }
+    benchSink = total;
+}
+
+/*
+ * Kernel packet filter: a group where 9 of every 10 datagrams are of a payload we do not
+ * play, received on loopback with and without the filter. One iteration sends the 10
+ * datagrams and receives until the socket is empty, so both cases pay the same sends
+ */
+
+#define BENCH_FOREIGN_PER_PACKET 9
+
+typedef struct {
+    int rxSock;
+    int txSock;
+    u8 ours[sizeof(rtp_hdr_t) + BENCH_BLOCK_BYTES];
+    u8 foreign[sizeof(rtp_hdr_t) + BENCH_BLOCK_BYTES];
+    u8 received[MAX_DATAGRAM_SIZE];
+} foreign_ctx_t;
+
+static void* setupForeign(bool filtered)
+{
+    foreign_ctx_t* ctx = calloc(1, sizeof(foreign_ctx_t));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    ctx->rxSock = socket(AF_INET, SOCK_DGRAM, 0);
+    ctx->txSock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ctx->rxSock < 0 || ctx->txSock < 0 || bind(ctx->rxSock, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || getsockname(ctx->rxSock, (struct sockaddr*)&addr, &len) < 0
+        || connect(ctx->txSock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        panic("Could not set up the loopback sockets");
+    }
+    filter_params_t params = { .pts = { PCMU }, .ptCount = 1, .rtcp = true };
+    if (filtered && !filterAttach(ctx->rxSock, &params)) {
+        panic("Could not attach the packet filter");
+    }
+
+    rtp_hdr_t header = { .version = RTP_VERSION, .pt = PCMU, .ssrc = 1 };
+    htonRTP(&header);
+    memcpy(ctx->ours, &header, sizeof(header));
+    header = (rtp_hdr_t) { .version = RTP_VERSION, .pt = 96, .ssrc = 2 };
+    htonRTP(&header);
+    memcpy(ctx->foreign, &header, sizeof(header));
+    return ctx;
+}
+
+static void* setupForeignUnfiltered(void)
+{
+    return setupForeign(false);
+}
+
+static void* setupForeignFiltered(void)
+{
+    return setupForeign(true);
+}
+
+static void teardownForeign(void* ctx)
+{
+    foreign_ctx_t* f = ctx;
+    close(f->rxSock);
+    close(f->txSock);
+    free(f);
+}
+
+static void benchForeign(void* ctx, u64 iterations)
+{
+    foreign_ctx_t* f = ctx;
+    u64 accepted = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        send(f->txSock, f->ours, sizeof(f->ours), 0);
+        for (u32 j = 0; j < BENCH_FOREIGN_PER_PACKET; j++) {
+            send(f->txSock, f->foreign, sizeof(f->foreign), 0);
+        }
+        //What a session does with each datagram before it looks any further
+        isize result;
+        while ((result = recv(f->rxSock, f->received, sizeof(f->received), MSG_DONTWAIT)) > 0) {
+            rtp_hdr_t* header = (rtp_hdr_t*)f->received;
+            accepted += (usize)result >= sizeof(rtp_hdr_t) && header->version == RTP_VERSION && header->pt == PCMU;
+        }
+    }
+    benchSink = accepted;
+}
+
+/*
+ * Lossless coding of a recording frame (256 ms), a tone over a little noise
+ */
+
+typedef struct {
+    i16 samples[RECORD_FRAME_SAMPLES];
+    u8 frame[LOSSLESS_MAX_FRAME_BYTES(RECORD_FRAME_SAMPLES)];
+    usize bytes;
+} lossless_ctx_t;
+
+static void* setupLossless(void)
+{
+    lossless_ctx_t* ctx = malloc(sizeof(lossless_ctx_t));
+    srand(1);
+    for (u32 i = 0; i < RECORD_FRAME_SAMPLES; i++) {
+        ctx->samples[i] = (i16)(4000 * sin(2 * M_PI * 440 * i / 8000.0) + rand() % 64 - 32);
+    }
+    ctx->bytes = losslessEncode(ctx->samples, RECORD_FRAME_SAMPLES, ctx->frame);
+    return ctx;
+}
+
+static void benchLosslessEncode(void* ctx, u64 iterations)
+{
+    lossless_ctx_t* l = ctx;
+    usize bytes = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        bytes += losslessEncode(l->samples, RECORD_FRAME_SAMPLES, l->frame);
+        CLOBBER_MEMORY();
+    }
+    benchSink = bytes;
+}
+
+static void benchLosslessDecode(void* ctx, u64 iterations)
+{
+    lossless_ctx_t* l = ctx;
+    isize count = 0;
+    for (u64 i = 0; i < iterations; i++) {
+        count += losslessDecode(l->frame, l->bytes, l->samples, RECORD_FRAME_SAMPLES);
+        CLOBBER_MEMORY();
+    }
+    benchSink = count;
+}
+
+/*
+ * Harness
+ */
+
+static const bench_case_t benchCases[] = {
+    { "cbuf_write_read",        benchCbufWriteRead,   setupCbuf,      teardownCbuf,    4000000 },
+    { "htonRTP_ntohRTP",        benchHtonNtohRTP,     setupHeader,    NULL,            4000000 },
+    { "seq_ts_difference",      benchSeqTsDifference, setupSequence,  NULL,            8000000 },
+    { "pushSilence_PCMU_256B",  benchPushSilencePCMU, setupCbuf,      teardownCbuf,    1000000 },
+    { "pushSilence_L16_512B",   benchPushSilenceL16,  setupCbufL16,   teardownCbuf,    1000000 },
+    { "g711_decode_256",        benchG711Decode,      setupG711,      NULL,             200000 },
+    { "g711_encode_256",        benchG711Encode,      setupG711,      NULL,             200000 },
+    { "receive_validate_enqueue", benchReceiveCycle,  setupReceive,   teardownReceive,   20000 },
+    { "reflect_fanout_1000",    benchFanOut,          setupFanOut,    teardownFanOut,       200 },
+    { "gateway_pcmu_to_l16_16k", benchGateway,        setupGateway,   teardownGateway,  200000 },
+    { "receive_foreign_9of10",  benchForeign,         setupForeignUnfiltered, teardownForeign, 20000 },
+    { "receive_foreign_9of10_filtered", benchForeign, setupForeignFiltered, teardownForeign,  20000 },
+    { "lossless_encode_2048",   benchLosslessEncode,  setupLossless,  NULL,              2000 },
+    { "lossless_decode_2048",   benchLosslessDecode,  setupLossless,  NULL,              2000 },
+};
+
+static int compareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static bench_result_t runCase(const bench_case_t* c, u32 repetitions, double scale)
+{
+    void* ctx = c->setup ? c->setup() : NULL;
+    u64 iterations = MAX((u64)(c->iterations * scale), 1ull);
+    double samples[BENCH_MAX_REPETITIONS];
+
+    c->fn(ctx, iterations); //warm-up
+    for (u32 r = 0; r < repetitions; r++) {
+        u64 start = nowNs();
+        c->fn(ctx, iterations);
+        samples[r] = (double)(nowNs() - start) / iterations;
+    }
+
+    if (c->teardown) {
+        c->teardown(ctx);
+    } else {
+        free(ctx);
+    }
+
+    qsort(samples, repetitions, sizeof(double), compareDouble);
+    bench_result_t result = { .min = samples[0], .max = samples[repetitions - 1] };
+    result.median = (repetitions % 2) ? samples[repetitions / 2]
+        : (samples[repetitions / 2 - 1] + samples[repetitions / 2]) / 2;
+    for (u32 r = 0; r < repetitions; r++) {
+        result.mean += samples[r] / repetitions;
+    }
+    for (u32 r = 0; r < repetitions; r++) {
+        result.stddev += (samples[r] - result.mean) * (samples[r] - result.mean) / repetitions;
+    }
+    result.stddev = sqrt(result.stddev);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    u32 repetitions = 15;
+    double scale = 1.0;
+    const char* filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else if (strncmp(argv[i], "-r", 2) == 0 && sscanf(argv[i] + 2, "%u", &repetitions) == 1
+            && repetitions > 0 && repetitions <= BENCH_MAX_REPETITIONS) {
+        } else if (strncmp(argv[i], "-s", 2) == 0 && sscanf(argv[i] + 2, "%lf", &scale) == 1 && scale > 0) {
+        } else if (argv[i][0] != '-') {
+            filter = argv[i];
+        } else {
+            fprintf(stderr, "audioc_bench [-j] [-rREPETITIONS (1..%d)] [-sSCALE] [FILTER]\n", BENCH_MAX_REPETITIONS);
+            return 1;
+        }
+    }
+
+    if (json) {
+        printf("{\"unit\":\"ns/iteration\",\"repetitions\":%u,\"benchmarks\":[", repetitions);
+    } else {
+        printf("benchmark,iterations,repetitions,min_ns,median_ns,mean_ns,max_ns,stddev_ns\n");
+    }
+
+    bool first = true;
+    for (usize i = 0; i < ARRAY_COUNT(benchCases); i++) {
+        const bench_case_t* c = &benchCases[i];
+        if (filter && !strstr(c->name, filter)) continue;
+
+        bench_result_t r = runCase(c, repetitions, scale);
+        u64 iterations = MAX((u64)(c->iterations * scale), 1ull);
+        if (json) {
+            printf("%s\n  {\"name\":\"%s\",\"iterations\":%lu,\"min\":%.3f,\"median\":%.3f,\"mean\":%.3f,\"max\":%.3f,\"stddev\":%.3f}",
+                first ? "" : ",", c->name, iterations, r.min, r.median, r.mean, r.max, r.stddev);
+        } else {
+            printf("%s,%lu,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n", c->name, iterations, repetitions,
+                r.min, r.median, r.mean, r.max, r.stddev);
+        }
+        fflush(stdout);
+        first = false;
+    }
+
+    if (json) {
+        printf("\n]}\n");
+    }
+    return 0;
+}
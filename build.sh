@@ -1,7 +1,26 @@
 #!/bin/bash
 mkdir -p bin
 FILES="lib/*.c audioc/*.c"
-FLAGS="-Wall -Wextra -std=gnu99"
+FLAGS="-Wall -Wextra -std=gnu99 -pthread"
+if [ "$1" == "bench" ]; then
+    # Micro-benchmarks (bench/): optimized, no sanitizers, all of audioc but its main()
+    FILES="lib/*.c $(ls audioc/*.c | grep -v '^audioc/audioc.c$') bench/*.c"
+    gcc $FLAGS -O2 $FILES -o bin/audioc_bench -lm
+    exit $?
+fi
+if [ "$1" == "lib" ]; then
+    # libaudioc: the session library (audioc_session.h) and what it needs, no sound card nor sockets,
+    # nor global state (traces, arena): the caller provides the allocator and the event callback
+    FILES="lib/circularBuffer.c audioc/audioc_session.c audioc/audioc_rtp.c audioc/audioc_fec.c audioc/audioc_red.c
+        audioc/audioc_nack.c audioc/audioc_report.c audioc/audioc_reblock.c audioc/audioc_recovery.c audioc/g711.c"
+    rm -f bin/libaudioc.a
+    for f in $FILES; do
+        gcc $FLAGS -O2 -c $f -o bin/$(basename ${f%.c}).o || exit 1
+        ar rcs bin/libaudioc.a bin/$(basename ${f%.c}).o
+        rm bin/$(basename ${f%.c}).o
+    done
+    exit 0
+fi
 FLAGS="$FLAGS -ggdb -O0"
 FLAGS="$FLAGS -fsanitize=address -fno-omit-frame-pointer -fsanitize=undefined"
 gcc $FLAGS $FILES -o bin/audioc -lm
\ No newline at end of file
@@ -10,9 +10,14 @@
 #include "circularBuffer.h"
 
 
-void *cbuf_create_buffer (int numberOfBlocks, int blockSize)
+int cbuf_memory_size (int numberOfBlocks, int blockSize)
+{
+    return numberOfBlocks * blockSize + 5 * sizeof (int);
+}
+
+
+void *cbuf_create_buffer_at (void *memory, int numberOfBlocks, int blockSize)
 {
-    void *buffer;
     int *pointerToInt;
 
     /* Reserve space for 5 integers at the beginning, to store 
@@ -22,22 +27,34 @@ void *cbuf_create_buffer (int numberOfBlocks, int blockSize)
        - index pointing to the first full block
        - number of filled blocks  */
 
-    if ( (buffer= malloc (numberOfBlocks * blockSize  + 5 * sizeof (int)) )== NULL) 
+    if (memory == NULL)
     {
-        printf ("Error reserving memory in circularBuffer\n");
         return (NULL);
     }
 
-
     /* initiallizing structure */
-    pointerToInt = (int *) buffer;
+    pointerToInt = (int *) memory;
     *(pointerToInt ) = numberOfBlocks;
     *(pointerToInt + 1) = blockSize;
     *(pointerToInt + 2) = 0; 
     *(pointerToInt + 3) = 0; 
     *(pointerToInt + 4) = 0; 
 
-    return buffer;
+    return memory;
+}
+
+
+void *cbuf_create_buffer (int numberOfBlocks, int blockSize)
+{
+    void *buffer;
+
+    if ( (buffer= malloc (cbuf_memory_size (numberOfBlocks, blockSize)) )== NULL) 
+    {
+        printf ("Error reserving memory in circularBuffer\n");
+        return (NULL);
+    }
+
+    return cbuf_create_buffer_at (buffer, numberOfBlocks, blockSize);
 }
 
 
@@ -106,6 +123,84 @@ void *cbuf_pointer_to_read(void *buffer)
 }
 
 
+void *cbuf_pointer_to_pending(void *buffer, int position)
+{
+    int *ptrNextFullBlock, *ptrBlockNumber, *ptrBlockSize; 
+    int *ptrFullBlockNmb;
+
+    ptrBlockNumber = (int *) buffer;
+    ptrBlockSize = (int *) (buffer + 1 * sizeof (int));
+    ptrNextFullBlock = (int *) (buffer + 3 * sizeof (int));
+    ptrFullBlockNmb = (int *) (buffer + 4 * sizeof (int));
+
+    if ( position < 0 || position >= (*ptrFullBlockNmb) )
+    { /* no such block in the buffer */
+        return (NULL);
+    }
+    return buffer + 5 * sizeof (int) + (((* ptrNextFullBlock) + position) % (* ptrBlockNumber)) * (* ptrBlockSize);
+}
+
+
+int cbuf_readable_regions(void *buffer, int maxBlocks, void **first, int *firstBlocks, 
+        void **second, int *secondBlocks)
+{
+    int *ptrNextFullBlock, *ptrBlockNumber, *ptrBlockSize; 
+    int *ptrFullBlockNmb;
+    int blocks;
+
+    ptrBlockNumber = (int *) buffer;
+    ptrBlockSize = (int *) (buffer + 1 * sizeof (int));
+    ptrNextFullBlock = (int *) (buffer + 3 * sizeof (int));
+    ptrFullBlockNmb = (int *) (buffer + 4 * sizeof (int));
+
+    blocks = (*ptrFullBlockNmb) < maxBlocks ? (*ptrFullBlockNmb) : maxBlocks;
+    if (blocks <= 0)
+    { /* circular buffer is empty */
+        *first = NULL;
+        *firstBlocks = 0;
+        *second = NULL;
+        *secondBlocks = 0;
+        return (0);
+    }
+
+    *first = buffer + 5 * sizeof (int) + (* ptrNextFullBlock) * (* ptrBlockSize);
+    if ((* ptrNextFullBlock) + blocks <= (* ptrBlockNumber))
+    { /* contiguous */
+        *firstBlocks = blocks;
+        *second = NULL;
+        *secondBlocks = 0;
+    }
+    else
+    { /* wraps around the end of the buffer memory */
+        *firstBlocks = (* ptrBlockNumber) - (* ptrNextFullBlock);
+        *second = buffer + 5 * sizeof (int);
+        *secondBlocks = blocks - (*firstBlocks);
+    }
+    return (blocks);
+}
+
+
+int cbuf_advance_read(void *buffer, int blocks)
+{
+    int *ptrNextFullBlock, *ptrBlockNumber; 
+    int *ptrFullBlockNmb;
+
+    ptrBlockNumber = (int *) buffer;
+    ptrNextFullBlock = (int *) (buffer + 3 * sizeof (int));
+    ptrFullBlockNmb = (int *) (buffer + 4 * sizeof (int));
+
+    if (blocks > (*ptrFullBlockNmb)) {
+        blocks = (*ptrFullBlockNmb);
+    }
+    if (blocks <= 0) {
+        return (0);
+    }
+    (* ptrNextFullBlock) = ((*ptrNextFullBlock) + blocks) % (* ptrBlockNumber); 
+    (*ptrFullBlockNmb) = (*ptrFullBlockNmb) - blocks;
+    return (blocks);
+}
+
+
 void cbuf_destroy_buffer (void *buffer)
 {
     free (buffer);
@@ -213,5 +308,59 @@ void _cbuf_test_buffer(void)
     }
     cbuf_destroy_buffer(buffer);
 
+    /* cbuf_pointer_to_pending: blocks are counted from the next one to be read */
+    buffer = cbuf_create_buffer(buffer_blocks, sizeof(int));
+    for (test = 1; test <= buffer_blocks; test++) {
+        *(int *) cbuf_pointer_to_write(buffer) = test;
+    }
+    cbuf_pointer_to_read(buffer);
+    *(int *) cbuf_pointer_to_write(buffer) = buffer_blocks + 1; /* wraps around */
+    for (test = 0; test < buffer_blocks; test++) {
+        data_pointer = (int *) cbuf_pointer_to_pending(buffer, test);
+        if (data_pointer == NULL || *data_pointer != test + 2) {
+            printf("_cbuf_test_buffer PENDING error at position %d\n", test);
+            cbuf_destroy_buffer(buffer);
+            exit(1);
+        }
+    }
+    if (cbuf_pointer_to_pending(buffer, buffer_blocks) != NULL || cbuf_pointer_to_pending(buffer, -1) != NULL) {
+        printf("_cbuf_test_buffer PENDING error out of range\n");
+        cbuf_destroy_buffer(buffer);
+        exit(1);
+    }
+    cbuf_destroy_buffer(buffer);
+
+    /* cbuf_readable_regions: blocks are split where the buffer memory wraps around */
+    buffer = cbuf_create_buffer(buffer_blocks, sizeof(int));
+    for (test = 1; test <= buffer_blocks; test++) {
+        *(int *) cbuf_pointer_to_write(buffer) = test;
+    }
+    cbuf_advance_read(buffer, 3);
+    *(int *) cbuf_pointer_to_write(buffer) = buffer_blocks + 1; /* wraps around */
+    {
+        void *first, *second;
+        int firstBlocks, secondBlocks;
+        if (cbuf_readable_regions(buffer, buffer_blocks, &first, &firstBlocks, &second, &secondBlocks) != 3
+            || firstBlocks != 2 || secondBlocks != 1 || *(int *) first != 4 || ((int *) first)[1] != 5
+            || *(int *) second != buffer_blocks + 1) {
+            printf("_cbuf_test_buffer REGIONS error with wrap around\n");
+            cbuf_destroy_buffer(buffer);
+            exit(1);
+        }
+        if (cbuf_readable_regions(buffer, 1, &first, &firstBlocks, &second, &secondBlocks) != 1
+            || firstBlocks != 1 || second != NULL || secondBlocks != 0) {
+            printf("_cbuf_test_buffer REGIONS error with maxBlocks\n");
+            cbuf_destroy_buffer(buffer);
+            exit(1);
+        }
+        if (cbuf_advance_read(buffer, buffer_blocks) != 3 || cbuf_has_block(buffer)
+            || cbuf_readable_regions(buffer, buffer_blocks, &first, &firstBlocks, &second, &secondBlocks) != 0) {
+            printf("_cbuf_test_buffer ADVANCE error\n");
+            cbuf_destroy_buffer(buffer);
+            exit(1);
+        }
+    }
+    cbuf_destroy_buffer(buffer);
+
     printf("Tests PASSED (number of tests: %d)\n", tests);
 }
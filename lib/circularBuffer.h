@@ -24,6 +24,18 @@ void *cbuf_create_buffer (
         );
 
 
+/* Number of bytes of memory needed by a buffer with 'numberOfBlocks' blocks
+ * of 'blockSize' bytes. */
+int cbuf_memory_size (int numberOfBlocks, int blockSize);
+
+
+/* Same as cbuf_create_buffer(), but the buffer is built in 'memory', provided 
+ * by the caller, of at least cbuf_memory_size(numberOfBlocks, blockSize) bytes 
+ * (e.g., memory already locked in RAM). Returns NULL if 'memory' is NULL. 
+ * The caller releases 'memory'; do not call cbuf_destroy_buffer() on it. */
+void *cbuf_create_buffer_at (void *memory, int numberOfBlocks, int blockSize);
+
+
 /* Receives buffer pointer created by cbuf_create_buffer.
  * Returns a pointer to the first ("empty") available block to write on it, 
  * or NULL if there are no blocks (be sure that this 
@@ -47,6 +59,37 @@ void *cbuf_pointer_to_read (void *buffer);
 int cbuf_has_block (void *buffer);
 
 
+/* Receives buffer pointer created by cbuf_create_buffer.
+ * Returns a pointer to the block with data at 'position', counting from the 
+ * first available block to be read (position 0 is the block that the next 
+ * cbuf_pointer_to_read() would return), or NULL if the buffer does not hold 
+ * that many blocks. 
+ * It DOES NOT move any pointer. It allows to overwrite a block that was already
+ * written but not read yet (e.g., the silence inserted for a lost packet, when 
+ * the packet is recovered later). */
+void *cbuf_pointer_to_pending (void *buffer, int position);
+
+
+/* Receives buffer pointer created by cbuf_create_buffer.
+ * Gives up to 'maxBlocks' blocks with data, starting from the first available 
+ * block to be read, as at most two regions of contiguous memory (e.g., to pass 
+ * them to writev): '*first' points to '*firstBlocks' blocks that end, at most, at 
+ * the end of the buffer memory; if the blocks wrap around, '*second' points to the 
+ * '*secondBlocks' that follow, at the beginning of the buffer memory (otherwise 
+ * it is NULL and '*secondBlocks' is 0). 
+ * Returns the total number of blocks given (0 if the buffer is empty). 
+ * It DOES NOT move the pointer; once the blocks are used, call cbuf_advance_read(). */
+int cbuf_readable_regions (void *buffer, int maxBlocks, void **first, int *firstBlocks, 
+        void **second, int *secondBlocks);
+
+
+/* Receives buffer pointer created by cbuf_create_buffer.
+ * Marks the first 'blocks' blocks with data as read, as calling 'blocks' times 
+ * cbuf_pointer_to_read() would. 
+ * Returns the number of blocks released (fewer if the buffer did not hold that many). */
+int cbuf_advance_read (void *buffer, int blocks);
+
+
 /* Frees memory of the buffer. 
  * Must be executed before exiting from the process */
 void cbuf_destroy_buffer (void *buffer);
@@ -0,0 +1,174 @@
+/*  Reader of the segment files of 'audioc --record' and '--record-rtp' (audioc_record.h).
+    Audio segments are decoded to the samples as they were played: mu-law bytes (PCMU)
+    or big endian 16 bit samples (L16), to be played with, for instance,
+        aplay -t raw -f MU_LAW -r 8000 out.raw      (PCMU)
+        aplay -t raw -f S16_BE -r 8000 out.raw      (L16)
+    RTP segments are listed, one datagram per line. With -s the seek index takes the
+    reader to the frame holding that second without reading the frames before it.
+
+Compile:
+    gcc -Wall -Wextra -std=gnu99 -O2 -I../audioc -o acr_decode acr_decode.c ../audioc/audioc_lossless.c ../audioc/common.c
+
+Execute:
+    ./acr_decode SEGMENT.acr [-sSECONDS] [-i] > out.raw
+
+    -s: start that many seconds (decimals allowed) into the segment
+    -i: print the header and the seek index to stderr
+*/
+
+#include "audioc_record.h"
+#include "audioc_rtp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    u8* data;
+    usize size;
+    record_format_t format;
+    u32 rate;
+    u32 segment;
+    u64 start;
+    const u8* index;        //Pairs, NULL if the segment has none
+    u32 indexCount;
+    usize framesEnd;        //Where the index starts, or the end of the file
+} segment_t;
+
+static u8* readFile(const char* path, usize* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    usize capacity = 1 << 20, used = 0;
+    u8* data = malloc(capacity);
+    while (data) {
+        used += fread(data + used, 1, capacity - used, file);
+        if (used < capacity) break;
+        capacity *= 2;
+        data = realloc(data, capacity);
+    }
+    fclose(file);
+    *size = used;
+    return data;
+}
+
+static bool parseSegment(segment_t* s)
+{
+    if (s->size < RECORD_HEADER_SIZE || memcmp(s->data, RECORD_MAGIC, 4) != 0) {
+        return false;
+    }
+    s->format = s->data[4];
+    s->rate = readU32(s->data + 8);
+    s->segment = readU32(s->data + 12);
+    s->start = (u64)readU32(s->data + 16) << 32 | readU32(s->data + 20);
+    s->framesEnd = s->size;
+
+    const u8* trailer = s->data + s->size - RECORD_INDEX_TRAILER_SIZE;
+    if (s->size >= RECORD_HEADER_SIZE + RECORD_INDEX_TRAILER_SIZE && memcmp(trailer + 4, RECORD_INDEX_MAGIC, 4) == 0) {
+        u32 count = readU32(trailer);
+        usize indexBytes = (usize)count * RECORD_INDEX_ENTRY_SIZE + RECORD_INDEX_TRAILER_SIZE;
+        if (indexBytes <= s->size - RECORD_HEADER_SIZE) {
+            s->indexCount = count;
+            s->index = s->data + s->size - indexBytes;
+            s->framesEnd = s->size - indexBytes;
+        }
+    }
+    return s->rate > 0;
+}
+
+//Offset of the last indexed frame at or before position, the first frame without index
+static usize seek(const segment_t* s, u64 position)
+{
+    usize offset = RECORD_HEADER_SIZE;
+    u32 low = 0, high = s->indexCount;
+    while (low < high) {
+        u32 middle = (low + high) / 2;
+        if (readU32(s->index + middle * RECORD_INDEX_ENTRY_SIZE) <= position) {
+            offset = readU32(s->index + middle * RECORD_INDEX_ENTRY_SIZE + 4);
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return offset;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = NULL;
+    double startSeconds = 0;
+    bool printIndex = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-s", 2) == 0) {
+            startSeconds = atof(argv[i] + 2);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            printIndex = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s SEGMENT.acr [-sSECONDS] [-i] > out.raw\n", argv[0]);
+        return 1;
+    }
+
+    segment_t s = {0};
+    s.data = readFile(path, &s.size);
+    if (!s.data || !parseSegment(&s)) {
+        fprintf(stderr, "%s is not a recording segment\n", path);
+        return 1;
+    }
+    if (printIndex) {
+        fprintf(stderr, "Format %u, rate %u, segment %u, starts at %lu, %u index entries\n", s.format, s.rate,
+            s.segment, s.start, s.indexCount);
+        for (u32 i = 0; i < s.indexCount; i++) {
+            fprintf(stderr, "\t%u at %u\n", readU32(s.index + i * RECORD_INDEX_ENTRY_SIZE),
+                readU32(s.index + i * RECORD_INDEX_ENTRY_SIZE + 4));
+        }
+    }
+
+    u64 target = startSeconds * s.rate;
+    static i16 samples[LOSSLESS_MAX_SAMPLES];
+    static u8 out[2 * LOSSLESS_MAX_SAMPLES];
+    for (usize offset = seek(&s, target); offset + RECORD_FRAME_HEADER_SIZE <= s.framesEnd; ) {
+        u32 bodyBytes = readU32(s.data + offset);
+        u32 position = readU32(s.data + offset + 4);
+        const u8* body = s.data + offset + RECORD_FRAME_HEADER_SIZE;
+        offset += RECORD_FRAME_HEADER_SIZE + bodyBytes;
+        if (offset > s.framesEnd) {
+            fprintf(stderr, "Truncated frame at position %u\n", position);
+            return 1;
+        }
+
+        if (s.format == RECORD_RTP) {
+            //RTCP (packet types 192-223) shows as pt 64-95
+            if (position < target || bodyBytes < sizeof(rtp_hdr_t)) continue;
+            printf("%.6f %u bytes: pt %u seq %u ts %u ssrc %u\n", (double)position / s.rate, bodyBytes,
+                body[1] & 0x7F, readU16(body + 2), readU32(body + 4), readU32(body + 8));
+            continue;
+        }
+
+        isize count = losslessDecode(body, bodyBytes, samples, LOSSLESS_MAX_SAMPLES);
+        if (count < 0) {
+            fprintf(stderr, "Malformed frame at position %u\n", position);
+            return 1;
+        }
+        //The frame holding the start is decoded whole, and cut
+        u32 skip = position < target ? MIN(target - position, (u64)count) : 0;
+        usize bytes = 0;
+        for (isize i = skip; i < count; i++) {
+            if (s.format == RECORD_ULAW) {
+                out[bytes++] = losslessIndexToUlaw(samples[i]);
+            } else {
+                writeU16(out + bytes, (u16)samples[i]);
+                bytes += 2;
+            }
+        }
+        if (fwrite(out, 1, bytes, stdout) != bytes) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,714 @@
+/*  Network impairment proxy.
+    Receives UDP (RTP) datagrams on a unicast or multicast address and relays them
+    to another unicast or multicast address, applying configurable impairments:
+        - Gilbert-Elliott burst loss (-g)
+        - Jitter sampled from a real rtpdump trace (-j), FIFO preserving
+        - Reordering: a packet is held back behind its followers (-r)
+        - Duplication (-d)
+        - Rate limiting with a bounded queue (-b, -q)
+
+    Every impairment draws from its own RNG stream, derived from a single seed (-s),
+    so two runs with the same seed and the same input drop, delay and duplicate
+    exactly the same packets.
+
+Compile:
+    gcc -Wall -Wextra -std=gnu99 -O2 -o netem_proxy netem_proxy.c common.c -lm
+
+Execute:
+    ./netem_proxy LISTEN_ADDR DEST_ADDR [-pLISTEN_PORT] [-PDEST_PORT] [-sSEED]
+        [-gP,R[,K,H]] [-jRTPDUMP_TRACE] [-rPROB,HOLD_MS] [-dPROB] [-bKBPS] [-qQUEUE_MS] [-c]
+
+    A typical setup relays one direction of an audioc session between two groups
+    (audioc disables multicast loopback, so the proxy must run on a third host, or one
+    proxy per direction with each audioc peer on its own group):
+        ./netem_proxy 239.0.1.1 239.0.1.2 -s7 -g0.02,0.3 -j../trazas/rtpdump_oviedo_3000 -r0.01,40 -d0.005
+
+    -gP,R[,K,H]: P = P(good->bad), R = P(bad->good), K = P(no loss | good) (default 1),
+                 H = P(no loss | bad) (default 0). -g0.01,1 is Bernoulli loss of 1%.
+    -j: trace as printed by 'rtpdump -F ascii', lines with arrival time and RTP ts. The
+        one way delay of every packet relative to the fastest one forms the distribution.
+    Ctrl+C prints the impairment counters.
+*/
+
+#define _GNU_SOURCE //recvmmsg, sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+
+#define PROXY_MAX_DATAGRAM 1500
+#define PROXY_POOL_SIZE 16384 //Packets that can be waiting for departure at the same time
+#define PROXY_BATCH 64
+#define PROXY_TRACE_RATE 8000 //RTP clock of the traces we record (PCMU/L16 at 8 kHz)
+
+/*
+ * Random numbers: splitmix64 to derive the streams, xorshift64* for each stream
+ */
+
+typedef struct {
+    u64 state;
+} rng_t;
+
+static u64 splitmix64(u64* x)
+{
+    u64 z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static u64 rngNext(rng_t* rng)
+{
+    u64 x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+//Uniform in [0, 1)
+static double rngUniform(rng_t* rng)
+{
+    return (rngNext(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Impairment configuration and state
+ */
+
+typedef struct {
+    struct sockaddr_in listenAddr;
+    struct sockaddr_in destAddr;
+    u64 seed;
+    //Gilbert-Elliott
+    bool lossEnabled;
+    double pGoodToBad, pBadToGood, keepInGood, keepInBad;
+    //Jitter (ns), sorted
+    u64* delays;
+    usize delayCount;
+    //Reordering
+    double reorderProb;
+    u64 reorderHoldNs;
+    //Duplication
+    double duplicateProb;
+    //Rate limit
+    u64 rateBps; //0 = unlimited
+    u64 maxQueueNs;
+} proxy_config_t;
+
+typedef struct {
+    u64 received;
+    u64 forwarded;
+    u64 lost;
+    u64 duplicated;
+    u64 reordered;
+    u64 rateDropped;
+    u64 poolDropped;
+} proxy_stats_t;
+
+typedef struct {
+    u64 departure; //ns, CLOCK_MONOTONIC
+    u64 order;     //tie breaker, keeps FIFO order for equal departures
+    u16 len;
+    u8 data[PROXY_MAX_DATAGRAM];
+} proxy_packet_t;
+
+static proxy_stats_t stats = {};
+static volatile sig_atomic_t stopRequested = 0;
+
+static void signalHandler(int sigNum)
+{
+    (void) sigNum;
+    stopRequested = 1;
+}
+
+static u64 nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000ull + (u64)t.tv_nsec;
+}
+
+/*
+ * Departure scheduler: binary min-heap of indices into a fixed packet pool
+ */
+
+typedef struct {
+    proxy_packet_t* pool;
+    u32* freeList;
+    u32 freeCount;
+    u32* heap;
+    u32 heapCount;
+    u64 nextOrder;
+} scheduler_t;
+
+static bool packetBefore(scheduler_t* s, u32 a, u32 b)
+{
+    proxy_packet_t* pa = &s->pool[a];
+    proxy_packet_t* pb = &s->pool[b];
+    return pa->departure < pb->departure || (pa->departure == pb->departure && pa->order < pb->order);
+}
+
+static void schedulerInit(scheduler_t* s)
+{
+    s->pool = malloc(sizeof(proxy_packet_t) * PROXY_POOL_SIZE);
+    s->freeList = malloc(sizeof(u32) * PROXY_POOL_SIZE);
+    s->heap = malloc(sizeof(u32) * PROXY_POOL_SIZE);
+    if (!s->pool || !s->freeList || !s->heap) {
+        panic("Could not allocate the packet pool");
+    }
+    for (u32 i = 0; i < PROXY_POOL_SIZE; i++) {
+        s->freeList[i] = PROXY_POOL_SIZE - 1 - i;
+    }
+    s->freeCount = PROXY_POOL_SIZE;
+    s->heapCount = 0;
+    s->nextOrder = 0;
+}
+
+static proxy_packet_t* schedulerAlloc(scheduler_t* s, u32* outIndex)
+{
+    if (s->freeCount == 0) {
+        return NULL;
+    }
+    *outIndex = s->freeList[--s->freeCount];
+    return &s->pool[*outIndex];
+}
+
+static void schedulerPush(scheduler_t* s, u32 index)
+{
+    s->pool[index].order = s->nextOrder++;
+    u32 pos = s->heapCount++;
+    s->heap[pos] = index;
+    while (pos > 0) {
+        u32 parent = (pos - 1) / 2;
+        if (!packetBefore(s, s->heap[pos], s->heap[parent])) break;
+        u32 tmp = s->heap[parent];
+        s->heap[parent] = s->heap[pos];
+        s->heap[pos] = tmp;
+        pos = parent;
+    }
+}
+
+static u32 schedulerPop(scheduler_t* s)
+{
+    u32 top = s->heap[0];
+    s->heap[0] = s->heap[--s->heapCount];
+    u32 pos = 0;
+    while (1) {
+        u32 left = 2 * pos + 1;
+        u32 right = left + 1;
+        u32 smallest = pos;
+        if (left < s->heapCount && packetBefore(s, s->heap[left], s->heap[smallest])) smallest = left;
+        if (right < s->heapCount && packetBefore(s, s->heap[right], s->heap[smallest])) smallest = right;
+        if (smallest == pos) break;
+        u32 tmp = s->heap[smallest];
+        s->heap[smallest] = s->heap[pos];
+        s->heap[pos] = tmp;
+        pos = smallest;
+    }
+    return top;
+}
+
+static void schedulerRelease(scheduler_t* s, u32 index)
+{
+    s->freeList[s->freeCount++] = index;
+}
+
+/*
+ * Trace loading
+ */
+
+static int compareU64(const void* a, const void* b)
+{
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+    return (x > y) - (x < y);
+}
+
+//Builds the delay distribution from an 'rtpdump -F ascii' trace:
+//  1640882756.340532 RTP len=268 from=... seq=0 ts=0 ssrc=0x1
+//The transit time of each packet is arrival - ts/rate; subtracting the minimum
+//gives the queueing delay (jitter) the network added to it.
+static void loadJitterTrace(proxy_config_t* config, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        panic("Could not open jitter trace %s", path);
+    }
+
+    usize capacity = 1024;
+    usize count = 0;
+    double* transit = malloc(capacity * sizeof(double));
+    bool haveFirst = false;
+    u32 firstTs = 0;
+    double firstArrival = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        double arrival;
+        if (sscanf(line, "%lf", &arrival) != 1) continue;
+        const char* tsField = strstr(line, " ts=");
+        if (!tsField) continue;
+        u32 ts;
+        if (sscanf(tsField, " ts=%u", &ts) != 1) continue;
+
+        if (!haveFirst) {
+            haveFirst = true;
+            firstTs = ts;
+            firstArrival = arrival;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            transit = realloc(transit, capacity * sizeof(double));
+        }
+        //u32 subtraction handles timestamp wrapping
+        double mediaTime = (double)(u32)(ts - firstTs) / PROXY_TRACE_RATE;
+        transit[count++] = (arrival - firstArrival) - mediaTime;
+    }
+    fclose(f);
+
+    if (count == 0) {
+        panic("No RTP packets found in jitter trace %s", path);
+    }
+
+    double minTransit = transit[0];
+    for (usize i = 1; i < count; i++) {
+        minTransit = MIN(minTransit, transit[i]);
+    }
+
+    config->delays = malloc(count * sizeof(u64));
+    for (usize i = 0; i < count; i++) {
+        config->delays[i] = (u64)((transit[i] - minTransit) * 1e9);
+    }
+    config->delayCount = count;
+    free(transit);
+    qsort(config->delays, count, sizeof(u64), compareU64);
+
+    printf("Loaded %lu delay samples from %s (median %.3f ms, max %.3f ms)\n", count, path,
+        config->delays[count / 2] / 1e6, config->delays[count - 1] / 1e6);
+}
+
+/*
+ * Arguments
+ */
+
+static void printHelp(void)
+{
+    printf("\nnetem_proxy LISTEN_ADDR DEST_ADDR [-pLISTEN_PORT] [-PDEST_PORT] [-sSEED] [-gP,R[,K,H]] "
+        "[-jRTPDUMP_TRACE] [-rPROB,HOLD_MS] [-dPROB] [-bKBPS] [-qQUEUE_MS] [-c]\n\n");
+}
+
+static bool parseAddress(const char* str, struct sockaddr_in* addr)
+{
+    addr->sin_family = AF_INET;
+    return inet_pton(AF_INET, str, &addr->sin_addr) == 1;
+}
+
+static void parseArgs(int argc, char** argv, proxy_config_t* config)
+{
+    u16 listenPort = 5004, destPort = 5004;
+    int numOfNames = 0;
+    double rateKbps = 0, queueMs = 200, holdMs = 0;
+
+    config->seed = 1;
+    config->keepInGood = 1.0;
+    config->keepInBad = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        if (arg[0] != '-') {
+            struct sockaddr_in* addr = numOfNames == 0 ? &config->listenAddr : &config->destAddr;
+            if (numOfNames > 1 || !parseAddress(arg, addr)) {
+                printf("\nUnexpected address '%s'\n", arg);
+                printHelp();
+                exit(1);
+            }
+            numOfNames++;
+            continue;
+        }
+
+        char* value = arg + 2;
+        int parsed = 1, expected = 1;
+        switch (arg[1]) {
+        case 'p': parsed = sscanf(value, "%hu", &listenPort); break;
+        case 'P': parsed = sscanf(value, "%hu", &destPort); break;
+        case 's': parsed = sscanf(value, "%lu", &config->seed); break;
+        case 'g':
+            parsed = sscanf(value, "%lf,%lf,%lf,%lf", &config->pGoodToBad, &config->pBadToGood,
+                &config->keepInGood, &config->keepInBad);
+            parsed = parsed >= 2 ? 1 : 0;
+            config->lossEnabled = true;
+            break;
+        case 'j': loadJitterTrace(config, value); break;
+        case 'r':
+            parsed = sscanf(value, "%lf,%lf", &config->reorderProb, &holdMs);
+            expected = 2;
+            break;
+        case 'd': parsed = sscanf(value, "%lf", &config->duplicateProb); break;
+        case 'b': parsed = sscanf(value, "%lf", &rateKbps); break;
+        case 'q': parsed = sscanf(value, "%lf", &queueMs); break;
+        case 'c': DEBUG_TRACES_ENABLED = true; break;
+        default:
+            printf("\nI do not understand -%c\n", arg[1]);
+            printHelp();
+            exit(1);
+        }
+        if (parsed != expected) {
+            printf("\nCould not parse the value of -%c ('%s')\n", arg[1], value);
+            printHelp();
+            exit(1);
+        }
+    }
+
+    if (numOfNames != 2) {
+        printf("\nNeed both listen and destination addresses.\n");
+        printHelp();
+        exit(1);
+    }
+
+    config->listenAddr.sin_port = htons(listenPort);
+    config->destAddr.sin_port = htons(destPort);
+    config->reorderHoldNs = (u64)(holdMs * 1e6);
+    config->rateBps = (u64)(rateKbps * 1000.0);
+    config->maxQueueNs = (u64)(queueMs * 1e6);
+}
+
+/*
+ * Sockets
+ */
+
+static int openListenSocket(struct sockaddr_in* addr)
+{
+    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockId < 0) {
+        panic("socket error");
+    }
+
+    int enable = 1;
+    if (setsockopt(sockId, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
+        panic("setsockopt(SO_REUSEADDR) failed!");
+    }
+
+    //Bursts of tens of thousands of packets per second must not overflow while we send
+    int rcvBuf = 4 * 1024 * 1024;
+    setsockopt(sockId, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(int));
+
+    if (bind(sockId, (struct sockaddr*)addr, sizeof(struct sockaddr_in)) < 0) {
+        panic("Socket bind error!");
+    }
+
+    if (IN_CLASSD(ntohl(addr->sin_addr.s_addr))) {
+        struct ip_mreq mcRequest = {0};
+        mcRequest.imr_multiaddr = addr->sin_addr;
+        mcRequest.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(sockId, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mcRequest, sizeof(struct ip_mreq)) < 0) {
+            panic("Failed to join multicast group, setsockopt error");
+        }
+    }
+
+    if (fcntl(sockId, F_SETFL, O_NONBLOCK) < 0) {
+        panic("Could not make the listen socket non-blocking");
+    }
+    return sockId;
+}
+
+static int openSendSocket(void)
+{
+    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockId < 0) {
+        panic("socket error");
+    }
+    //Receivers on this host must see the relayed packets
+    u8 loopback = 1;
+    if (setsockopt(sockId, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(u8)) < 0) {
+        panic("Failed to enable MC loopback, setsockopt error");
+    }
+    int sndBuf = 4 * 1024 * 1024;
+    setsockopt(sockId, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(int));
+    return sockId;
+}
+
+/*
+ * Impairment pipeline
+ */
+
+typedef struct {
+    proxy_config_t* config;
+    scheduler_t sched;
+    rng_t lossRng, jitterRng, reorderRng, dupRng;
+    bool badState;
+    u64 fifoDeparture; //departure of the last in-order packet, jitter never reorders
+    u64 linkFreeAt;    //rate limiter: time at which the link finishes the queued bytes
+} proxy_t;
+
+static void proxyInit(proxy_t* proxy, proxy_config_t* config)
+{
+    proxy->config = config;
+    schedulerInit(&proxy->sched);
+    u64 seed = config->seed;
+    proxy->lossRng.state = splitmix64(&seed) | 1;
+    proxy->jitterRng.state = splitmix64(&seed) | 1;
+    proxy->reorderRng.state = splitmix64(&seed) | 1;
+    proxy->dupRng.state = splitmix64(&seed) | 1;
+    proxy->badState = false;
+    proxy->fifoDeparture = 0;
+    proxy->linkFreeAt = 0;
+}
+
+static bool gilbertElliottDrop(proxy_t* proxy)
+{
+    proxy_config_t* c = proxy->config;
+    if (!c->lossEnabled) return false;
+
+    double u = rngUniform(&proxy->lossRng);
+    if (proxy->badState) {
+        if (u < c->pBadToGood) proxy->badState = false;
+    } else {
+        if (u < c->pGoodToBad) proxy->badState = true;
+    }
+    double keep = proxy->badState ? c->keepInBad : c->keepInGood;
+    return rngUniform(&proxy->lossRng) >= keep;
+}
+
+//Applies rate limiting to a packet that would leave at 'departure'.
+//Returns false if the bottleneck queue is over its limit (tail drop).
+static bool rateLimit(proxy_t* proxy, u64* departure, usize len)
+{
+    proxy_config_t* c = proxy->config;
+    if (c->rateBps == 0) return true;
+
+    u64 start = MAX(*departure, proxy->linkFreeAt);
+    if (start - *departure > c->maxQueueNs) {
+        return false;
+    }
+    u64 serialization = (u64)len * 8ull * 1000000000ull / c->rateBps;
+    proxy->linkFreeAt = start + serialization;
+    *departure = proxy->linkFreeAt;
+    return true;
+}
+
+static void schedulePacket(proxy_t* proxy, u32 index, u64 now)
+{
+    proxy_config_t* c = proxy->config;
+    proxy_packet_t* packet = &proxy->sched.pool[index];
+
+    if (gilbertElliottDrop(proxy)) {
+        stats.lost++;
+        verboseInfo("x");
+        schedulerRelease(&proxy->sched, index);
+        return;
+    }
+
+    u64 delay = 0;
+    if (c->delayCount > 0) {
+        delay = c->delays[rngNext(&proxy->jitterRng) % c->delayCount];
+    }
+    u64 departure = now + delay;
+
+    //Held back packets skip the FIFO constraint, so followers overtake them. They cross
+    //the bottleneck first and are held after it, so the link is not busy while they wait
+    bool held = c->reorderProb > 0 && rngUniform(&proxy->reorderRng) < c->reorderProb;
+    if (!held) {
+        departure = MAX(departure, proxy->fifoDeparture);
+    }
+
+    if (!rateLimit(proxy, &departure, packet->len)) {
+        stats.rateDropped++;
+        verboseInfo("q");
+        schedulerRelease(&proxy->sched, index);
+        return;
+    }
+    u64 linkDeparture = departure;
+    if (held) {
+        departure += c->reorderHoldNs;
+        stats.reordered++;
+        verboseInfo("r");
+    } else {
+        proxy->fifoDeparture = departure;
+    }
+
+    packet->departure = departure;
+    schedulerPush(&proxy->sched, index);
+
+    if (c->duplicateProb > 0 && rngUniform(&proxy->dupRng) < c->duplicateProb) {
+        u32 dupIndex;
+        proxy_packet_t* dup = schedulerAlloc(&proxy->sched, &dupIndex);
+        if (dup) {
+            dup->len = packet->len;
+            memcpy(dup->data, packet->data, packet->len);
+            dup->departure = linkDeparture;
+            if (rateLimit(proxy, &dup->departure, dup->len)) {
+                dup->departure += departure - linkDeparture;
+                schedulerPush(&proxy->sched, dupIndex);
+                stats.duplicated++;
+                verboseInfo("d");
+            } else {
+                schedulerRelease(&proxy->sched, dupIndex);
+            }
+        }
+    }
+}
+
+//Reads every pending datagram with recvmmsg batches
+static void receiveAll(proxy_t* proxy, int sockId)
+{
+    struct mmsghdr msgs[PROXY_BATCH];
+    struct iovec iovs[PROXY_BATCH];
+    u32 indices[PROXY_BATCH];
+
+    while (1) {
+        int batch = 0;
+        for (; batch < PROXY_BATCH; batch++) {
+            proxy_packet_t* packet = schedulerAlloc(&proxy->sched, &indices[batch]);
+            if (!packet) break;
+            iovs[batch] = (struct iovec) { .iov_base = packet->data, .iov_len = PROXY_MAX_DATAGRAM };
+            msgs[batch] = (struct mmsghdr) { .msg_hdr = { .msg_iov = &iovs[batch], .msg_iovlen = 1 } };
+        }
+
+        if (batch == 0) {
+            //Pool exhausted: drain one datagram into the void so the socket does not stall
+            u8 scratch[PROXY_MAX_DATAGRAM];
+            if (recv(sockId, scratch, sizeof(scratch), 0) < 0) return;
+            stats.received++;
+            stats.poolDropped++;
+            continue;
+        }
+
+        int n = recvmmsg(sockId, msgs, batch, MSG_DONTWAIT, NULL);
+        u64 now = nowNs();
+        for (int i = 0; i < MAX(n, 0); i++) {
+            proxy->sched.pool[indices[i]].len = msgs[i].msg_len;
+            stats.received++;
+            schedulePacket(proxy, indices[i], now);
+        }
+        //Give back the slots that were not filled, in reverse to keep the free list order
+        for (int i = batch - 1; i >= MAX(n, 0); i--) {
+            schedulerRelease(&proxy->sched, indices[i]);
+        }
+
+        if (n < batch) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                panic("recvmmsg error");
+            }
+            return;
+        }
+    }
+}
+
+//Sends every packet whose departure time has come, in sendmmsg batches
+static void sendDue(proxy_t* proxy, int sockId, u64 now)
+{
+    struct mmsghdr msgs[PROXY_BATCH];
+    struct iovec iovs[PROXY_BATCH];
+    u32 indices[PROXY_BATCH];
+
+    while (proxy->sched.heapCount > 0 && proxy->sched.pool[proxy->sched.heap[0]].departure <= now) {
+        int batch = 0;
+        while (batch < PROXY_BATCH && proxy->sched.heapCount > 0
+            && proxy->sched.pool[proxy->sched.heap[0]].departure <= now)
+        {
+            u32 index = schedulerPop(&proxy->sched);
+            proxy_packet_t* packet = &proxy->sched.pool[index];
+            indices[batch] = index;
+            iovs[batch] = (struct iovec) { .iov_base = packet->data, .iov_len = packet->len };
+            msgs[batch] = (struct mmsghdr) { .msg_hdr = {
+                .msg_name = &proxy->config->destAddr,
+                .msg_namelen = sizeof(struct sockaddr_in),
+                .msg_iov = &iovs[batch],
+                .msg_iovlen = 1,
+            } };
+            batch++;
+        }
+
+        int sent = 0;
+        while (sent < batch) {
+            int n = sendmmsg(sockId, msgs + sent, batch - sent, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                printError("sendmmsg error, dropping %d packets", batch - sent);
+                break;
+            }
+            sent += n;
+        }
+        stats.forwarded += sent;
+
+        for (int i = 0; i < batch; i++) {
+            schedulerRelease(&proxy->sched, indices[i]);
+        }
+    }
+}
+
+static void printStats(void)
+{
+    printf("\nReceived packets: %lu\n", stats.received);
+    printf("Forwarded packets: %lu\n", stats.forwarded);
+    printf("\tLost (Gilbert-Elliott): %lu\n", stats.lost);
+    printf("\tDuplicated: %lu\n", stats.duplicated);
+    printf("\tReordered: %lu\n", stats.reordered);
+    printf("\tDropped by rate limiter: %lu\n", stats.rateDropped);
+    printf("\tDropped by full packet pool: %lu\n", stats.poolDropped);
+}
+
+int main(int argc, char** argv)
+{
+    proxy_config_t config = {};
+    parseArgs(argc, argv, &config);
+
+    struct sigaction sigInfo = {
+        .sa_handler = signalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if (sigaction(SIGINT, &sigInfo, NULL) < 0) {
+        panic("Error installing signal.");
+    }
+
+    int listenSock = openListenSocket(&config.listenAddr);
+    int sendSock = openSendSocket();
+
+    static proxy_t proxy;
+    proxyInit(&proxy, &config);
+
+    trace("Relaying with seed %lu", config.seed);
+
+    while (!stopRequested) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(listenSock, &readSet);
+
+        struct timeval timeout;
+        struct timeval* timeoutPtr = NULL;
+        if (proxy.sched.heapCount > 0) {
+            u64 now = nowNs();
+            u64 next = proxy.sched.pool[proxy.sched.heap[0]].departure;
+            u64 waitNs = next > now ? next - now : 0;
+            timeout.tv_sec = waitNs / 1000000000ull;
+            timeout.tv_usec = (waitNs % 1000000000ull) / 1000;
+            timeoutPtr = &timeout;
+        }
+
+        int res = select(listenSock + 1, &readSet, NULL, NULL, timeoutPtr);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            panic("select() error!");
+        }
+
+        if (res > 0 && FD_ISSET(listenSock, &readSet)) {
+            receiveAll(&proxy, listenSock);
+        }
+        sendDue(&proxy, sendSock, nowNs());
+    }
+
+    printStats();
+    free(config.delays);
+    return 0;
+}
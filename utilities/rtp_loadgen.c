@@ -0,0 +1,532 @@
+/*  Synthetic multi-stream RTP load generator.
+    Emits N concurrent RTP streams, each one with its own SSRC, payload type and
+    packet duration, to a multicast group or to a list of unicast targets. Packets are
+    paced by a timerfd tick and handed to the kernel with sendmmsg batches; the RTP
+    header of every stream is its own, the payload buffer is shared by all streams with
+    the same payload size. With UDP GSO (Linux 4.18) the packets of a batch going to the
+    same destination with the same size leave as one message of up to 64 packets that
+    the kernel splits, so most of the stack is crossed once per message instead of once
+    per packet; if the kernel or the device refuses it, packets go one by one again.
+
+    Together with 'audioc ... --bench' it finds the number of streams at which a single
+    receiver saturates a core.
+
+Compile:
+    gcc -Wall -Wextra -std=gnu99 -O2 -o rtp_loadgen rtp_loadgen.c common.c
+
+Execute:
+    ./rtp_loadgen DEST_ADDR[,DEST_ADDR...] [-pPORT] [-nSTREAMS] [-yPT[,PT...]] [-lMS[,MS...]]
+        [-sFIRST_SSRC] [-tSECONDS] [-TTICK_US] [-G] [-c]
+
+    -G: no UDP GSO, every packet a message of its own
+    Stream i uses SSRC FIRST_SSRC+i, the (i mod count)-th payload type of -y, the
+    (i mod count)-th packet duration of -l and the (i mod count)-th destination.
+    Example, 500 streams mixing PCMU/L16 and 20/40 ms packets:
+        ./rtp_loadgen 239.0.1.1 -n500 -y0,101 -l20,40
+        ../bin/audioc 239.0.1.1 1 --bench
+    AF_XDP receive (audioc --xdp, as root) over a veth pair, the generator in its own
+    network namespace:
+        ip netns add gen
+        ip link add vxa type veth peer name vxb netns gen
+        ip link set vxa up
+        ip -n gen link set vxb up
+        ip -n gen addr add 10.77.0.2/24 dev vxb
+        ip -n gen route add 224.0.0.0/4 dev vxb
+        ../bin/audioc 239.0.1.1 1 --bench --xdp=vxa
+        ip netns exec gen ./rtp_loadgen 239.0.1.1 -n4000
+*/
+
+#define _GNU_SOURCE //sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+
+#define LOADGEN_MAX_LIST 16
+#define LOADGEN_BATCH 1024 //UIO_MAXIOV, the sendmmsg limit
+#define LOADGEN_RATE 8000
+//Packets per UDP GSO message (UDP_MAX_SEGMENTS of older kernels), and its size limit
+#define LOADGEN_MAX_SEGMENTS 64
+#define LOADGEN_MAX_MESSAGE_BYTES 65507
+
+#define PT_PCMU 0
+#define PT_L16_1 101
+
+#pragma pack(push, 1)
+typedef struct {
+    u8 vpxcc;
+    u8 mpt;
+    u16 seq;
+    u32 ts;
+    u32 ssrc;
+} loadgen_rtp_hdr_t;
+#pragma pack(pop)
+
+typedef struct {
+    loadgen_rtp_hdr_t header; //network byte order, ready to send
+    u16 seq;
+    u32 ts;
+    u32 samplesPerPacket;
+    u32 periodTicks;
+    u8* payload;
+    u32 payloadBytes;
+    struct sockaddr_in* dest;
+    i32 next; //timing wheel list
+} loadgen_stream_t;
+
+typedef struct {
+    struct sockaddr_in dests[LOADGEN_MAX_LIST];
+    u32 destCount;
+    u32 payloads[LOADGEN_MAX_LIST];
+    u32 payloadCount;
+    u32 durations[LOADGEN_MAX_LIST]; //ms
+    u32 durationCount;
+    u16 port;
+    u32 streamCount;
+    u32 firstSsrc;
+    u32 seconds; //0 = until Ctrl+C
+    u32 tickUs;
+    bool noGso;
+} loadgen_config_t;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void signalHandler(int sigNum)
+{
+    (void) sigNum;
+    stopRequested = 1;
+}
+
+static void printHelp(void)
+{
+    printf("\nrtp_loadgen DEST_ADDR[,DEST_ADDR...] [-pPORT] [-nSTREAMS] [-yPT[,PT...]] [-lMS[,MS...]] "
+        "[-sFIRST_SSRC] [-tSECONDS] [-TTICK_US] [-G] [-c]\n\n");
+}
+
+//Parses "a,b,c" into values. Returns the number of values
+static u32 parseList(const char* str, u32* values)
+{
+    u32 count = 0;
+    const char* p = str;
+    while (*p && count < LOADGEN_MAX_LIST) {
+        char* end;
+        values[count++] = (u32)strtoul(p, &end, 10);
+        if (end == p) return 0;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static void parseArgs(int argc, char** argv, loadgen_config_t* config)
+{
+    *config = (loadgen_config_t) {
+        .port = 5004,
+        .streamCount = 1,
+        .firstSsrc = 1000,
+        .tickUs = 1000,
+        .payloads = { PT_PCMU },
+        .payloadCount = 1,
+        .durations = { 20 },
+        .durationCount = 1,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        if (arg[0] != '-') {
+            char* save;
+            for (char* tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                if (config->destCount == LOADGEN_MAX_LIST) {
+                    panic("Too many destinations (max %d)", LOADGEN_MAX_LIST);
+                }
+                struct sockaddr_in* dest = &config->dests[config->destCount++];
+                dest->sin_family = AF_INET;
+                if (inet_pton(AF_INET, tok, &dest->sin_addr) != 1) {
+                    printf("\nInternet address string '%s' not recognized\n", tok);
+                    exit(1);
+                }
+            }
+            continue;
+        }
+
+        char* value = arg + 2;
+        bool ok = true;
+        switch (arg[1]) {
+        case 'p': ok = sscanf(value, "%hu", &config->port) == 1; break;
+        case 'n': ok = sscanf(value, "%u", &config->streamCount) == 1 && config->streamCount > 0; break;
+        case 'y': ok = (config->payloadCount = parseList(value, config->payloads)) > 0; break;
+        case 'l': ok = (config->durationCount = parseList(value, config->durations)) > 0; break;
+        case 's': ok = sscanf(value, "%u", &config->firstSsrc) == 1; break;
+        case 't': ok = sscanf(value, "%u", &config->seconds) == 1; break;
+        case 'T': ok = sscanf(value, "%u", &config->tickUs) == 1 && config->tickUs > 0; break;
+        case 'G': config->noGso = true; break;
+        case 'c': DEBUG_TRACES_ENABLED = true; break;
+        default:
+            printf("\nI do not understand -%c\n", arg[1]);
+            printHelp();
+            exit(1);
+        }
+        if (!ok) {
+            printf("\nCould not parse the value of -%c ('%s')\n", arg[1], value);
+            printHelp();
+            exit(1);
+        }
+    }
+
+    if (config->destCount == 0) {
+        printf("\nNeed at least one destination address.\n");
+        printHelp();
+        exit(1);
+    }
+
+    for (u32 i = 0; i < config->payloadCount; i++) {
+        if (config->payloads[i] != PT_PCMU && config->payloads[i] != PT_L16_1) {
+            printf("\nUnrecognized payload number %u. Must be either %d or %d.\n", config->payloads[i], PT_PCMU, PT_L16_1);
+            exit(1);
+        }
+    }
+    for (u32 i = 0; i < config->destCount; i++) {
+        config->dests[i].sin_port = htons(config->port);
+    }
+}
+
+typedef struct {
+    u8* data;
+    u32 bytes;
+    u32 pt;
+} loadgen_payload_t;
+
+//One shared payload buffer per payload type and size, filled with the codec's silence
+static u8* sharedPayload(loadgen_payload_t* cache, u32* cacheCount, u32 bytes, u32 pt)
+{
+    for (u32 i = 0; i < *cacheCount; i++) {
+        if (cache[i].bytes == bytes && cache[i].pt == pt) {
+            return cache[i].data;
+        }
+    }
+    u8* data = malloc(bytes);
+    if (!data) {
+        panic("Could not allocate payload");
+    }
+    memset(data, pt == PT_PCMU ? 0xFF : 0x00, bytes);
+    cache[(*cacheCount)++] = (loadgen_payload_t) { .data = data, .bytes = bytes, .pt = pt };
+    return data;
+}
+
+typedef union {
+    char buffer[CMSG_SPACE(sizeof(u16))];
+    struct cmsghdr align;
+} loadgen_segment_control_t;
+
+//The packets of a batch, and with GSO the same packets grouped in messages by destination
+//and size, their iovec pairs end to end
+typedef struct {
+    int sockId;
+    bool gso;
+    u32 batch;
+    struct mmsghdr msgs[LOADGEN_BATCH];
+    struct iovec iovs[LOADGEN_BATCH][2];
+
+    struct mmsghdr groupMsgs[LOADGEN_BATCH];
+    struct iovec groupIovs[2 * LOADGEN_BATCH];
+    loadgen_segment_control_t controls[LOADGEN_BATCH];
+    u32 groupOf[LOADGEN_BATCH];
+    u32 groupPackets[LOADGEN_BATCH];
+    u32 groupBytes[LOADGEN_BATCH]; //Of each packet, the segment size
+    u32 groupStart[LOADGEN_BATCH];
+
+    u64 sentPackets;
+    u64 sentMessages;
+    u64 sendCalls;
+    u64 sendErrors;
+} loadgen_sender_t;
+
+static void queuePacket(loadgen_sender_t* sender, loadgen_stream_t* stream)
+{
+    u32 i = sender->batch++;
+    sender->iovs[i][0] = (struct iovec) { .iov_base = &stream->header, .iov_len = sizeof(loadgen_rtp_hdr_t) };
+    sender->iovs[i][1] = (struct iovec) { .iov_base = stream->payload, .iov_len = stream->payloadBytes };
+    sender->msgs[i] = (struct mmsghdr) { .msg_hdr = {
+        .msg_name = stream->dest,
+        .msg_namelen = sizeof(struct sockaddr_in),
+        .msg_iov = sender->iovs[i],
+        .msg_iovlen = 2,
+    } };
+}
+
+//Sends count messages, packets[i] packets in message i (NULL: one each). Returns the
+//messages sent, fewer than count only if the kernel refused to segment one
+static u32 sendMessages(loadgen_sender_t* sender, struct mmsghdr* msgs, u32 count, const u32* packets)
+{
+    u32 sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(sender->sockId, msgs + sent, count - sent, 0);
+        sender->sendCalls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            //EIO: the device cannot checksum it, EINVAL: too many segments for this kernel
+            if (packets && packets[sent] > 1 && (errno == EIO || errno == EINVAL)) {
+                return sent;
+            }
+            for (; sent < count; sent++) {
+                sender->sendErrors += packets ? packets[sent] : 1;
+            }
+            break;
+        }
+        for (int i = 0; i < n; i++, sent++) {
+            sender->sentPackets += packets ? packets[sent] : 1;
+        }
+        sender->sentMessages += n;
+    }
+    return count;
+}
+
+//Fills the group messages from the batch. Returns their number
+static u32 groupBatch(loadgen_sender_t* sender)
+{
+    u32 groups = 0;
+    for (u32 i = 0; i < sender->batch; i++) {
+        const struct msghdr* msg = &sender->msgs[i].msg_hdr;
+        usize bytes = sender->iovs[i][0].iov_len + sender->iovs[i][1].iov_len;
+        //The newest group of a destination and size is the only one that may have room
+        i32 g = groups - 1;
+        for (; g >= 0; g--) {
+            if (sender->groupMsgs[g].msg_hdr.msg_name == msg->msg_name && sender->groupBytes[g] == bytes) break;
+        }
+        if (g < 0 || sender->groupPackets[g] == LOADGEN_MAX_SEGMENTS
+            || (sender->groupPackets[g] + 1) * bytes > LOADGEN_MAX_MESSAGE_BYTES)
+        {
+            g = groups++;
+            sender->groupPackets[g] = 0;
+            sender->groupBytes[g] = bytes;
+            sender->groupMsgs[g].msg_hdr = (struct msghdr) {
+                .msg_name = msg->msg_name,
+                .msg_namelen = sizeof(struct sockaddr_in),
+            };
+        }
+        sender->groupOf[i] = g;
+        sender->groupPackets[g]++;
+    }
+
+    u32 start = 0;
+    for (u32 g = 0; g < groups; g++) {
+        sender->groupStart[g] = start;
+        start += 2 * sender->groupPackets[g];
+        struct msghdr* msg = &sender->groupMsgs[g].msg_hdr;
+        msg->msg_iov = &sender->groupIovs[sender->groupStart[g]];
+        if (sender->groupPackets[g] > 1) {
+            u16 segmentBytes = sender->groupBytes[g];
+            struct cmsghdr* cmsg = &sender->controls[g].align;
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(u16));
+            memcpy(CMSG_DATA(cmsg), &segmentBytes, sizeof(u16));
+            msg->msg_control = sender->controls[g].buffer;
+            msg->msg_controllen = sizeof(sender->controls[g].buffer);
+        }
+    }
+    for (u32 i = 0; i < sender->batch; i++) {
+        struct msghdr* msg = &sender->groupMsgs[sender->groupOf[i]].msg_hdr;
+        msg->msg_iov[msg->msg_iovlen++] = sender->iovs[i][0];
+        msg->msg_iov[msg->msg_iovlen++] = sender->iovs[i][1];
+    }
+    return groups;
+}
+
+//Headers are referenced by the batch, so it is flushed before a stream is reused
+static void flush(loadgen_sender_t* sender)
+{
+    if (!sender->gso) {
+        sendMessages(sender, sender->msgs, sender->batch, NULL);
+        sender->batch = 0;
+        return;
+    }
+
+    u32 groups = groupBatch(sender);
+    u32 sent = sendMessages(sender, sender->groupMsgs, groups, sender->groupPackets);
+    if (sent < groups) {
+        printf("WARNING: the kernel refused UDP GSO (%s), sending packet by packet.\n", strerror(errno));
+        sender->gso = false;
+        //The rest, one message per packet
+        u32 count = 0;
+        for (u32 g = sent; g < groups; g++) {
+            const struct msghdr* groupMsg = &sender->groupMsgs[g].msg_hdr;
+            for (u32 k = 0; k < sender->groupPackets[g]; k++) {
+                sender->msgs[count++] = (struct mmsghdr) { .msg_hdr = {
+                    .msg_name = groupMsg->msg_name,
+                    .msg_namelen = sizeof(struct sockaddr_in),
+                    .msg_iov = &groupMsg->msg_iov[2 * k],
+                    .msg_iovlen = 2,
+                } };
+            }
+        }
+        sendMessages(sender, sender->msgs, count, NULL);
+    }
+    sender->batch = 0;
+}
+
+int main(int argc, char** argv)
+{
+    loadgen_config_t config;
+    parseArgs(argc, argv, &config);
+
+    struct sigaction sigInfo = {
+        .sa_handler = signalHandler,
+        .sa_flags = 0,
+    };
+    sigemptyset(&sigInfo.sa_mask);
+    if (sigaction(SIGINT, &sigInfo, NULL) < 0) {
+        panic("Error installing signal.");
+    }
+
+    int sockId = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockId < 0) {
+        panic("socket error");
+    }
+    //Receivers on this host must see the generated packets
+    u8 loopback = 1;
+    if (setsockopt(sockId, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(u8)) < 0) {
+        panic("Failed to enable MC loopback, setsockopt error");
+    }
+    int sndBuf = 8 * 1024 * 1024;
+    setsockopt(sockId, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(int));
+
+    static loadgen_sender_t sender;
+    sender.sockId = sockId;
+    //The kernel knows UDP_SEGMENT; whether the device takes it is only seen when sending
+    int segmentBytes;
+    socklen_t optionLength = sizeof(int);
+    sender.gso = !config.noGso && getsockopt(sockId, SOL_UDP, UDP_SEGMENT, &segmentBytes, &optionLength) == 0;
+
+    /*
+     * Streams and timing wheel. The wheel has one slot per tick of the longest period;
+     * a stream sits in the slot of its next departure and moves periodTicks ahead
+     * every time it sends.
+     */
+    u32 maxPeriodTicks = 1;
+    loadgen_stream_t* streams = calloc(config.streamCount, sizeof(loadgen_stream_t));
+    loadgen_payload_t payloadCache[LOADGEN_MAX_LIST * LOADGEN_MAX_LIST];
+    u32 payloadCacheCount = 0;
+    srand(config.firstSsrc);
+
+    for (u32 i = 0; i < config.streamCount; i++) {
+        loadgen_stream_t* stream = &streams[i];
+        u32 pt = config.payloads[i % config.payloadCount];
+        u32 durationMs = config.durations[i % config.durationCount];
+        u32 bytesPerSample = pt == PT_PCMU ? 1 : 2;
+
+        stream->samplesPerPacket = durationMs * LOADGEN_RATE / 1000;
+        stream->payloadBytes = stream->samplesPerPacket * bytesPerSample;
+        if (stream->payloadBytes + sizeof(loadgen_rtp_hdr_t) > 65507) {
+            panic("Packet duration %u ms is too long", durationMs);
+        }
+        stream->payload = sharedPayload(payloadCache, &payloadCacheCount, stream->payloadBytes, pt);
+        stream->periodTicks = MAX(1u, (u32)((u64)durationMs * 1000 / config.tickUs));
+        stream->dest = &config.dests[i % config.destCount];
+        stream->seq = (u16)rand();
+        stream->ts = (u32)rand();
+        stream->header = (loadgen_rtp_hdr_t) {
+            .vpxcc = 2 << 6,
+            .mpt = (u8)pt,
+            .ssrc = htonl(config.firstSsrc + i),
+        };
+        maxPeriodTicks = MAX(maxPeriodTicks, stream->periodTicks);
+    }
+
+    u32 wheelSize = maxPeriodTicks + 1;
+    i32* wheel = malloc(wheelSize * sizeof(i32));
+    for (u32 i = 0; i < wheelSize; i++) {
+        wheel[i] = -1;
+    }
+    //Spread the streams over their period so they do not all fire in the same tick
+    for (u32 i = 0; i < config.streamCount; i++) {
+        u32 slot = i % streams[i].periodTicks;
+        streams[i].next = wheel[slot];
+        wheel[slot] = i;
+    }
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (timerFd < 0) {
+        panic("timerfd_create error");
+    }
+    struct itimerspec timerSpec = {
+        .it_interval = { .tv_sec = config.tickUs / 1000000, .tv_nsec = (config.tickUs % 1000000) * 1000 },
+        .it_value = { .tv_sec = config.tickUs / 1000000, .tv_nsec = (config.tickUs % 1000000) * 1000 },
+    };
+    if (timerfd_settime(timerFd, 0, &timerSpec, NULL) < 0) {
+        panic("timerfd_settime error");
+    }
+
+    u64 missedTicks = 0;
+    u64 tick = 0;
+    u64 lastTick = config.seconds > 0 ? (u64)config.seconds * 1000000 / config.tickUs : 0;
+
+    printf("Sending %u streams to %u destination(s), tick %u us%s. Ctrl+C to stop.\n",
+        config.streamCount, config.destCount, config.tickUs, sender.gso ? ", UDP GSO" : "");
+
+    while (!stopRequested && (lastTick == 0 || tick < lastTick)) {
+        u64 expirations;
+        if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            if (errno == EINTR) continue;
+            panic("timerfd read error");
+        }
+        missedTicks += expirations - 1;
+
+        for (u64 e = 0; e < expirations; e++, tick++) {
+            u32 slot = tick % wheelSize;
+            i32 index = wheel[slot];
+            wheel[slot] = -1;
+
+            while (index >= 0) {
+                loadgen_stream_t* stream = &streams[index];
+                i32 nextIndex = stream->next;
+
+                stream->header.seq = htons(stream->seq);
+                stream->header.ts = htonl(stream->ts);
+                stream->seq++;
+                stream->ts += stream->samplesPerPacket;
+
+                queuePacket(&sender, stream);
+
+                u32 nextSlot = (tick + stream->periodTicks) % wheelSize;
+                stream->next = wheel[nextSlot];
+                wheel[nextSlot] = index;
+                index = nextIndex;
+
+                if (sender.batch == LOADGEN_BATCH || (index < 0 && e + 1 < expirations)) {
+                    flush(&sender);
+                }
+            }
+        }
+
+        flush(&sender);
+        verboseInfo(".");
+    }
+
+    double seconds = tick * (double)config.tickUs / 1e6;
+    printf("\nSent packets: %lu in %.1f s (%.0f packets/s)\n", sender.sentPackets, seconds,
+        seconds > 0 ? sender.sentPackets / seconds : 0);
+    printf("sendmmsg calls: %lu (%.1f packets per call), messages: %lu (%.1f packets each%s)\n", sender.sendCalls,
+        sender.sendCalls > 0 ? (double)sender.sentPackets / sender.sendCalls : 0, sender.sentMessages,
+        sender.sentMessages > 0 ? (double)sender.sentPackets / sender.sentMessages : 0,
+        sender.gso ? ", UDP GSO" : "");
+    printf("Send errors: %lu, missed ticks: %lu\n", sender.sendErrors, missedTicks);
+
+    for (u32 i = 0; i < payloadCacheCount; i++) {
+        free(payloadCache[i].data);
+    }
+    free(wheel);
+    free(streams);
+    close(timerFd);
+    close(sockId);
+    return 0;
+}
@@ -7,6 +7,10 @@ Compile:
 
 Execute:
     ./test_getodelay
+
+'audioc MULTICAST_ADDR SSRC -yPAYLOAD --calibrate' runs this check (and measures the
+GETODELAY granularity and the output latency) for every fragment size and stores the
+results in a profile that audioc uses afterwards.
 */
 
 #include <stdlib.h>
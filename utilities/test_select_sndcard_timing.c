@@ -24,6 +24,10 @@ Alternative, execute as
 Then, read trace as
     cat traceName | ./diffTime | less
 And observe values for different tests...
+
+'audioc MULTICAST_ADDR SSRC -yPAYLOAD --calibrate' measures how late these select()
+calls wake up for every fragment size and stores the results in a profile that audioc
+uses afterwards.
 */
 
 /* According to POSIX.1-2001, POSIX.1-2008 */